@@ -12,13 +12,45 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <string.h>
 #include "diskio_impl.h"
 #include "ffconf.h"
 #include "ff.h"
 #include "sdmmc_cmd.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "soc/soc_memory_layout.h"
+
+#define CACHE_SECTORS   CONFIG_FATFS_SDMMC_CACHE_SECTORS
+/* FatFs switches between the FAT and the data of a file; each gets a line this way */
+#define CACHE_LINES     2
+
+/* Block cache between FatFs and the card.
+ * FatFs mostly reads and writes one sector at a time. Each cache line holds a
+ * run of up to CACHE_SECTORS consecutive sectors in a DMA-capable buffer: a read
+ * which misses fills the least recently used line with one multi-block read,
+ * starting from the requested sector, and small writes are collected into a
+ * contiguous dirty run of a line, which is written with one multi-block write
+ * on CTRL_SYNC or when the line is needed for other sectors.
+ * Requests of at least CACHE_SECTORS sectors bypass the cache.
+ */
+typedef struct {
+    uint8_t* buf;       /* CACHE_SECTORS sectors */
+    DWORD start;        /* first sector held in buf */
+    UINT count;         /* number of valid sectors in buf, 0 if the line is unused */
+    DWORD dirty_start;  /* first sector in buf not written to the card yet */
+    UINT dirty_count;   /* number of such sectors, 0 if the line is clean */
+    uint32_t last_use;  /* value of use_counter when the line was last used */
+} sdmmc_cache_line_t;
+
+typedef struct {
+    uint8_t* buf;       /* buffer of all lines, NULL if the cache is not used */
+    uint32_t use_counter;
+    sdmmc_cache_line_t lines[CACHE_LINES];
+} sdmmc_cache_t;
 
 static sdmmc_card_t* s_cards[FF_VOLUMES] = { NULL };
+static sdmmc_cache_t s_caches[FF_VOLUMES];
 
 static const char* TAG = "diskio_sdmmc";
 
@@ -32,11 +64,245 @@ DSTATUS ff_sdmmc_status (BYTE pdrv)
     return 0;
 }
 
+static inline bool is_dma_buffer(const void* buff)
+{
+    return esp_ptr_dma_capable(buff) && (intptr_t) buff % 4 == 0;
+}
+
+static inline bool ranges_overlap(DWORD start1, UINT count1, DWORD start2, UINT count2)
+{
+    return count1 > 0 && count2 > 0 && start1 < start2 + count2 && start2 < start1 + count1;
+}
+
+static esp_err_t line_flush(sdmmc_card_t* card, sdmmc_cache_line_t* line)
+{
+    if (line->dirty_count == 0) {
+        return ESP_OK;
+    }
+    size_t offset = (line->dirty_start - line->start) * card->csd.sector_size;
+    esp_err_t err = sdmmc_write_sectors(card, line->buf + offset, line->dirty_start, line->dirty_count);
+    if (err == ESP_OK) {
+        line->dirty_count = 0;
+    }
+    return err;
+}
+
+static esp_err_t cache_flush(sdmmc_card_t* card, sdmmc_cache_t* cache)
+{
+    if (cache->buf == NULL) {
+        return ESP_OK;
+    }
+    for (int i = 0; i < CACHE_LINES; ++i) {
+        esp_err_t err = line_flush(card, &cache->lines[i]);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+/* Write the dirty sectors in the given range to the card, optionally dropping the cached copies */
+static esp_err_t cache_flush_range(sdmmc_card_t* card, sdmmc_cache_t* cache, DWORD sector, UINT count,
+        const sdmmc_cache_line_t* except, bool invalidate)
+{
+    for (int i = 0; i < CACHE_LINES; ++i) {
+        sdmmc_cache_line_t* line = &cache->lines[i];
+        if (line == except || !ranges_overlap(line->start, line->count, sector, count)) {
+            continue;
+        }
+        if (ranges_overlap(line->dirty_start, line->dirty_count, sector, count) || invalidate) {
+            esp_err_t err = line_flush(card, line);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        if (invalidate) {
+            line->count = 0;
+        }
+    }
+    return ESP_OK;
+}
+
+/* Write back and return the least recently used line */
+static esp_err_t cache_evict(sdmmc_card_t* card, sdmmc_cache_t* cache, sdmmc_cache_line_t** out_line)
+{
+    sdmmc_cache_line_t* line = &cache->lines[0];
+    for (int i = 1; i < CACHE_LINES; ++i) {
+        if (cache->lines[i].last_use < line->last_use) {
+            line = &cache->lines[i];
+        }
+    }
+    esp_err_t err = line_flush(card, line);
+    if (err != ESP_OK) {
+        return err;
+    }
+    line->count = 0;
+    line->last_use = ++cache->use_counter;
+    *out_line = line;
+    return ESP_OK;
+}
+
+static esp_err_t cache_read(sdmmc_card_t* card, sdmmc_cache_t* cache, BYTE* buff, DWORD sector, UINT count)
+{
+    esp_err_t err;
+    sdmmc_cache_line_t* line = NULL;
+    for (int i = 0; i < CACHE_LINES; ++i) {
+        sdmmc_cache_line_t* l = &cache->lines[i];
+        if (l->count > 0 && sector >= l->start && sector + count <= l->start + l->count) {
+            line = l;
+            line->last_use = ++cache->use_counter;
+            break;
+        }
+    }
+    if (line == NULL) {
+        // read ahead as many sectors as fit into the line
+        UINT ahead = CACHE_SECTORS;
+        if (sector + ahead > card->csd.capacity) {
+            ahead = card->csd.capacity - sector;
+        }
+        err = cache_evict(card, cache, &line);
+        if (err == ESP_OK) {
+            // dirty sectors in the other line have to be read back
+            err = cache_flush_range(card, cache, sector, ahead, line, false);
+        }
+        if (err == ESP_OK) {
+            err = sdmmc_read_sectors(card, line->buf, sector, ahead);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        line->start = sector;
+        line->count = ahead;
+    }
+    memcpy(buff, line->buf + (sector - line->start) * card->csd.sector_size, count * card->csd.sector_size);
+    return ESP_OK;
+}
+
+static esp_err_t cache_write(sdmmc_card_t* card, sdmmc_cache_t* cache, const BYTE* buff, DWORD sector, UINT count)
+{
+    esp_err_t err;
+    DWORD end = sector + count;
+    sdmmc_cache_line_t* line = NULL;
+    for (int i = 0; i < CACHE_LINES; ++i) {
+        sdmmc_cache_line_t* l = &cache->lines[i];
+        if (l->count > 0 && sector >= l->start && sector <= l->start + l->count
+                && end <= l->start + CACHE_SECTORS) {
+            line = l;
+            line->last_use = ++cache->use_counter;
+            break;
+        }
+    }
+    if (line == NULL) {
+        // sectors are not next to the cached ones, start a new run
+        err = cache_evict(card, cache, &line);
+        if (err != ESP_OK) {
+            return err;
+        }
+        line->start = sector;
+    } else if (line->dirty_count > 0 &&
+            (sector > line->dirty_start + line->dirty_count || end < line->dirty_start)) {
+        // dirty sectors have to stay contiguous
+        err = line_flush(card, line);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    // copies of these sectors in the other line become stale
+    err = cache_flush_range(card, cache, sector, count, line, true);
+    if (err != ESP_OK) {
+        return err;
+    }
+    memcpy(line->buf + (sector - line->start) * card->csd.sector_size, buff, count * card->csd.sector_size);
+    if (end - line->start > line->count) {
+        line->count = end - line->start;
+    }
+    if (line->dirty_count == 0) {
+        line->dirty_start = sector;
+        line->dirty_count = count;
+    } else {
+        DWORD dirty_end = line->dirty_start + line->dirty_count;
+        if (sector < line->dirty_start) {
+            line->dirty_start = sector;
+        }
+        if (end > dirty_end) {
+            dirty_end = end;
+        }
+        line->dirty_count = dirty_end - line->dirty_start;
+    }
+    return ESP_OK;
+}
+
+/* Transfers which bypass the cache. Buffers which can not be used for DMA are copied
+ * through a cache line, CACHE_SECTORS at a time, instead of the sector by sector copy
+ * done by sdmmc_read_sectors and sdmmc_write_sectors. */
+static esp_err_t direct_read(sdmmc_card_t* card, sdmmc_cache_t* cache, BYTE* buff, DWORD sector, UINT count)
+{
+    // dirty sectors have to be read back
+    esp_err_t err = cache_flush_range(card, cache, sector, count, NULL, false);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (is_dma_buffer(buff)) {
+        return sdmmc_read_sectors(card, buff, sector, count);
+    }
+    size_t sector_size = card->csd.sector_size;
+    sdmmc_cache_line_t* line;
+    err = cache_evict(card, cache, &line);
+    while (err == ESP_OK && count > 0) {
+        UINT n = (count < CACHE_SECTORS) ? count : CACHE_SECTORS;
+        err = sdmmc_read_sectors(card, line->buf, sector, n);
+        if (err == ESP_OK) {
+            memcpy(buff, line->buf, n * sector_size);
+            line->start = sector;
+            line->count = n;
+            buff += n * sector_size;
+            sector += n;
+            count -= n;
+        }
+    }
+    return err;
+}
+
+static esp_err_t direct_write(sdmmc_card_t* card, sdmmc_cache_t* cache, const BYTE* buff, DWORD sector, UINT count)
+{
+    esp_err_t err = cache_flush_range(card, cache, sector, count, NULL, true);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (is_dma_buffer(buff)) {
+        return sdmmc_write_sectors(card, buff, sector, count);
+    }
+    size_t sector_size = card->csd.sector_size;
+    sdmmc_cache_line_t* line;
+    err = cache_evict(card, cache, &line);
+    while (err == ESP_OK && count > 0) {
+        UINT n = (count < CACHE_SECTORS) ? count : CACHE_SECTORS;
+        memcpy(line->buf, buff, n * sector_size);
+        err = sdmmc_write_sectors(card, line->buf, sector, n);
+        if (err == ESP_OK) {
+            line->start = sector;
+            line->count = n;
+            buff += n * sector_size;
+            sector += n;
+            count -= n;
+        }
+    }
+    return err;
+}
+
 DRESULT ff_sdmmc_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count)
 {
     sdmmc_card_t* card = s_cards[pdrv];
     assert(card);
-    esp_err_t err = sdmmc_read_sectors(card, buff, sector, count);
+    sdmmc_cache_t* cache = &s_caches[pdrv];
+    esp_err_t err;
+    if (cache->buf == NULL) {
+        err = sdmmc_read_sectors(card, buff, sector, count);
+    } else if (count < CACHE_SECTORS) {
+        err = cache_read(card, cache, buff, sector, count);
+    } else {
+        err = direct_read(card, cache, buff, sector, count);
+    }
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "sdmmc_read_blocks failed (%d)", err);
         return RES_ERROR;
@@ -48,7 +314,15 @@ DRESULT ff_sdmmc_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count)
 {
     sdmmc_card_t* card = s_cards[pdrv];
     assert(card);
-    esp_err_t err = sdmmc_write_sectors(card, buff, sector, count);
+    sdmmc_cache_t* cache = &s_caches[pdrv];
+    esp_err_t err;
+    if (cache->buf == NULL) {
+        err = sdmmc_write_sectors(card, buff, sector, count);
+    } else if (count < CACHE_SECTORS) {
+        err = cache_write(card, cache, buff, sector, count);
+    } else {
+        err = direct_write(card, cache, buff, sector, count);
+    }
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "sdmmc_write_blocks failed (%d)", err);
         return RES_ERROR;
@@ -62,6 +336,10 @@ DRESULT ff_sdmmc_ioctl (BYTE pdrv, BYTE cmd, void* buff)
     assert(card);
     switch(cmd) {
         case CTRL_SYNC:
+            if (cache_flush(card, &s_caches[pdrv]) != ESP_OK) {
+                ESP_LOGE(TAG, "sdmmc_write_blocks failed while flushing cache");
+                return RES_ERROR;
+            }
             return RES_OK;
         case GET_SECTOR_COUNT:
             *((DWORD*) buff) = card->csd.capacity;
@@ -84,7 +362,27 @@ void ff_diskio_register_sdmmc(BYTE pdrv, sdmmc_card_t* card)
         .write = &ff_sdmmc_write,
         .ioctl = &ff_sdmmc_ioctl
     };
+    sdmmc_cache_t* cache = &s_caches[pdrv];
+    if (s_cards[pdrv] != NULL && cache_flush(s_cards[pdrv], cache) != ESP_OK) {
+        ESP_LOGE(TAG, "sdmmc_write_blocks failed while flushing cache");
+    }
+    free(cache->buf);
+    memset(cache, 0, sizeof(*cache));
     s_cards[pdrv] = card;
+    if (card == NULL) {
+        ff_diskio_unregister(pdrv);
+        return;
+    }
+    if (CACHE_SECTORS > 0) {
+        size_t line_size = CACHE_SECTORS * card->csd.sector_size;
+        cache->buf = heap_caps_malloc(CACHE_LINES * line_size, MALLOC_CAP_DMA);
+        if (cache->buf == NULL) {
+            ESP_LOGW(TAG, "not enough memory for sector cache, using the card without it");
+        }
+        for (int i = 0; cache->buf != NULL && i < CACHE_LINES; ++i) {
+            cache->lines[i].buf = cache->buf + i * line_size;
+        }
+    }
     ff_diskio_register(pdrv, &sdmmc_impl);
 }
 
@@ -24,8 +24,13 @@ extern "C" {
 /**
  * Register SD/MMC diskio driver
  *
+ * Writes are cached (see CONFIG_FATFS_SDMMC_CACHE_SECTORS) until FatFs syncs
+ * the volume, or until the driver is unregistered by calling this function
+ * with card set to NULL.
+ *
  * @param pdrv  drive number
  * @param card  pointer to sdmmc_card_t structure describing a card; card should be initialized before calling f_mount.
+ *              NULL to write back cached sectors and unregister the drive.
  */
 void ff_diskio_register_sdmmc(unsigned char pdrv, sdmmc_card_t* card);
 
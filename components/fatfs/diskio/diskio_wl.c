@@ -13,6 +13,8 @@
 // limitations under the License.
 
 #include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
 #include "diskio_impl.h"
 #include "ffconf.h"
 #include "ff.h"
@@ -27,6 +29,49 @@ wl_handle_t ff_wl_handles[FF_VOLUMES] = {
         WL_INVALID_HANDLE,
 };
 
+/* State of the erase-skip layer of a drive. A sector is only erased before
+ * it is written if some bit has to change from 0 to 1. Sectors which are known
+ * to be blank are marked in blank_map, contents of other sectors are read into
+ * sector_buf and compared with the new data. */
+typedef struct {
+    uint8_t *sector_buf;
+    uint32_t *blank_map;
+} ff_wl_erase_skip_t;
+
+static ff_wl_erase_skip_t s_erase_skip[FF_VOLUMES];
+
+static bool ff_wl_is_blank(const BYTE *data, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] != 0xff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void ff_wl_set_blank(ff_wl_erase_skip_t *state, DWORD sector, bool blank)
+{
+    if (blank) {
+        state->blank_map[sector / 32] |= 1u << (sector % 32);
+    } else {
+        state->blank_map[sector / 32] &= ~(1u << (sector % 32));
+    }
+}
+
+static bool ff_wl_get_blank(const ff_wl_erase_skip_t *state, DWORD sector)
+{
+    return (state->blank_map[sector / 32] & (1u << (sector % 32))) != 0;
+}
+
+static void ff_wl_free_erase_skip(BYTE pdrv)
+{
+    free(s_erase_skip[pdrv].sector_buf);
+    free(s_erase_skip[pdrv].blank_map);
+    s_erase_skip[pdrv].sector_buf = NULL;
+    s_erase_skip[pdrv].blank_map = NULL;
+}
+
 DSTATUS ff_wl_initialize (BYTE pdrv)
 {
     return 0;
@@ -47,24 +92,112 @@ DRESULT ff_wl_read (BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
         ESP_LOGE(TAG, "wl_read failed (%d)", err);
         return RES_ERROR;
     }
+    ff_wl_erase_skip_t *state = &s_erase_skip[pdrv];
+    if (state->blank_map != NULL) {
+        size_t sector_size = wl_sector_size(wl_handle);
+        for (UINT i = 0; i < count; i++) {
+            ff_wl_set_blank(state, sector + i, ff_wl_is_blank(buff + i * sector_size, sector_size));
+        }
+    }
     return RES_OK;
 }
 
-DRESULT ff_wl_write (BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+/* Write 'count' sectors, erasing them first if 'erase' is set */
+static DRESULT ff_wl_write_range(wl_handle_t wl_handle, const BYTE *buff, DWORD sector, UINT count, bool erase)
 {
-    ESP_LOGV(TAG, "ff_wl_write - pdrv=%i, sector=%i, count=%i\n", (unsigned int)pdrv, (unsigned int)sector, (unsigned int)count);
-    wl_handle_t wl_handle = ff_wl_handles[pdrv];
-    assert(wl_handle + 1);
-    esp_err_t err = wl_erase_range(wl_handle, sector * wl_sector_size(wl_handle), count * wl_sector_size(wl_handle));
+    size_t sector_size = wl_sector_size(wl_handle);
+    esp_err_t err;
+    if (erase) {
+        err = wl_erase_range(wl_handle, sector * sector_size, count * sector_size);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "wl_erase_range failed (%d)", err);
+            return RES_ERROR;
+        }
+    }
+    err = wl_write(wl_handle, sector * sector_size, buff, count * sector_size);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "wl_erase_range failed (%d)", err);
+        ESP_LOGE(TAG, "wl_write failed (%d)", err);
         return RES_ERROR;
     }
-    err = wl_write(wl_handle, sector * wl_sector_size(wl_handle), buff, count * wl_sector_size(wl_handle));
+    return RES_OK;
+}
+
+typedef enum {
+    FF_WL_SKIP,         /* sector already holds the data */
+    FF_WL_WRITE,        /* data can be written without erasing the sector */
+    FF_WL_ERASE_WRITE,  /* sector has to be erased first */
+} ff_wl_write_action_t;
+
+static DRESULT ff_wl_get_write_action(BYTE pdrv, const BYTE *data, DWORD sector, ff_wl_write_action_t *action)
+{
+    ff_wl_erase_skip_t *state = &s_erase_skip[pdrv];
+    wl_handle_t wl_handle = ff_wl_handles[pdrv];
+    size_t sector_size = wl_sector_size(wl_handle);
+    if (ff_wl_get_blank(state, sector)) {
+        *action = FF_WL_WRITE;
+        return RES_OK;
+    }
+    esp_err_t err = wl_read(wl_handle, sector * sector_size, state->sector_buf, sector_size);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "wl_write failed (%d)", err);
+        ESP_LOGE(TAG, "wl_read failed (%d)", err);
         return RES_ERROR;
     }
+    if (memcmp(state->sector_buf, data, sector_size) == 0) {
+        *action = FF_WL_SKIP;
+        return RES_OK;
+    }
+    *action = FF_WL_WRITE;
+    for (size_t i = 0; i < sector_size; i++) {
+        if ((state->sector_buf[i] & data[i]) != data[i]) {
+            *action = FF_WL_ERASE_WRITE;
+            break;
+        }
+    }
+    return RES_OK;
+}
+
+DRESULT ff_wl_write (BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+    ESP_LOGV(TAG, "ff_wl_write - pdrv=%i, sector=%i, count=%i\n", (unsigned int)pdrv, (unsigned int)sector, (unsigned int)count);
+    wl_handle_t wl_handle = ff_wl_handles[pdrv];
+    assert(wl_handle + 1);
+    ff_wl_erase_skip_t *state = &s_erase_skip[pdrv];
+    if (state->blank_map == NULL) {
+        return ff_wl_write_range(wl_handle, buff, sector, count, true);
+    }
+
+    // Consecutive sectors which need the same action are written together
+    size_t sector_size = wl_sector_size(wl_handle);
+    UINT run_start = 0;
+    ff_wl_write_action_t run_action = FF_WL_SKIP;
+    for (UINT i = 0; i <= count; i++) {
+        ff_wl_write_action_t action = FF_WL_SKIP;
+        if (i < count) {
+            DRESULT res = ff_wl_get_write_action(pdrv, buff + i * sector_size, sector + i, &action);
+            if (res != RES_OK) {
+                return res;
+            }
+            // if a write fails, the sector may hold any data, so it is only marked blank again below
+            ff_wl_set_blank(state, sector + i, false);
+            if (i > run_start && action == run_action) {
+                continue;
+            }
+        }
+        if (i > run_start && run_action != FF_WL_SKIP) {
+            DRESULT res = ff_wl_write_range(wl_handle, buff + run_start * sector_size, sector + run_start,
+                                            i - run_start, run_action == FF_WL_ERASE_WRITE);
+            if (res != RES_OK) {
+                return res;
+            }
+        }
+        run_start = i;
+        run_action = action;
+    }
+    for (UINT i = 0; i < count; i++) {
+        if (ff_wl_is_blank(buff + i * sector_size, sector_size)) {
+            ff_wl_set_blank(state, sector + i, true);
+        }
+    }
     return RES_OK;
 }
 
@@ -74,8 +207,14 @@ DRESULT ff_wl_ioctl (BYTE pdrv, BYTE cmd, void *buff)
     ESP_LOGV(TAG, "ff_wl_ioctl: cmd=%i\n", cmd);
     assert(wl_handle + 1);
     switch (cmd) {
-    case CTRL_SYNC:
+    case CTRL_SYNC: {
+        esp_err_t err = wl_sync(wl_handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "wl_sync failed (%d)", err);
+            return RES_ERROR;
+        }
         return RES_OK;
+    }
     case GET_SECTOR_COUNT:
         *((DWORD *) buff) = wl_size(wl_handle) / wl_sector_size(wl_handle);
         return RES_OK;
@@ -101,11 +240,33 @@ esp_err_t ff_diskio_register_wl_partition(BYTE pdrv, wl_handle_t flash_handle)
         .write = &ff_wl_write,
         .ioctl = &ff_wl_ioctl
     };
+    ff_wl_free_erase_skip(pdrv);
     ff_wl_handles[pdrv] = flash_handle;
     ff_diskio_register(pdrv, &wl_impl);
     return ESP_OK;
 }
 
+esp_err_t ff_diskio_wl_set_erase_skip(BYTE pdrv, bool enable)
+{
+    if (pdrv >= FF_VOLUMES || ff_wl_handles[pdrv] == WL_INVALID_HANDLE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ff_wl_free_erase_skip(pdrv);
+    if (!enable) {
+        return ESP_OK;
+    }
+    wl_handle_t wl_handle = ff_wl_handles[pdrv];
+    size_t sector_count = wl_size(wl_handle) / wl_sector_size(wl_handle);
+    // nothing is known about the sectors yet
+    s_erase_skip[pdrv].blank_map = calloc((sector_count + 31) / 32, sizeof(uint32_t));
+    s_erase_skip[pdrv].sector_buf = malloc(wl_sector_size(wl_handle));
+    if (s_erase_skip[pdrv].blank_map == NULL || s_erase_skip[pdrv].sector_buf == NULL) {
+        ff_wl_free_erase_skip(pdrv);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
 BYTE ff_diskio_get_pdrv_wl(wl_handle_t flash_handle)
 {
     for (int i = 0; i < FF_VOLUMES; i++) {
@@ -121,6 +282,7 @@ void ff_diskio_clear_pdrv_wl(wl_handle_t flash_handle)
     for (int i = 0; i < FF_VOLUMES; i++) {
         if (flash_handle == ff_wl_handles[i]) {
             ff_wl_handles[i] = WL_INVALID_HANDLE;
+            ff_wl_free_erase_skip(i);
         }
     }
 }
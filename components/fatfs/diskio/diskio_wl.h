@@ -19,6 +19,7 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
 #include "wear_levelling.h"
 
 
@@ -29,6 +30,25 @@ extern "C" {
  * @param flash_handle  handle of the wear levelling partition.
  */
 esp_err_t ff_diskio_register_wl_partition(unsigned char pdrv, wl_handle_t flash_handle);
+
+/**
+ * Enable or disable erase skipping for a registered wear levelling drive
+ *
+ * When enabled, a sector is only erased before it is written if some of its
+ * bits have to change from 0 to 1. This needs an additional read of sectors
+ * which are not known to be blank, and one sector sized buffer.
+ * Must not be enabled for encrypted partitions, and the partition should not
+ * be written other than through FatFs while enabled.
+ *
+ * @param pdrv  drive number
+ * @param enable  true to enable erase skipping, false to disable it
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if no partition is registered for the drive
+ *      - ESP_ERR_NO_MEM if memory can not be allocated
+ */
+esp_err_t ff_diskio_wl_set_erase_skip(unsigned char pdrv, bool enable);
+
 unsigned char ff_diskio_get_pdrv_wl(wl_handle_t flash_handle);
 void ff_diskio_clear_pdrv_wl(wl_handle_t flash_handle);
 
@@ -3921,6 +3921,7 @@ FRESULT f_write (
 			if (fp->fptr >= fp->obj.objsize) {	/* Avoid silly cache filling on the growing edge */
 				if (sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);
 				fs->winsect = sect;
+				mem_set(fs->win, 0xFF, SS(fs));	/* Leave unused part of the sector blank, so that appending to it does not need an erase */
 			}
 #else
 			if (fp->sect != sect && 		/* Fill sector cache with file data */
@@ -3928,6 +3929,9 @@ FRESULT f_write (
 				disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK) {
 					ABORT(fs, FR_DISK_ERR);
 			}
+			if (fp->sect != sect && fp->fptr >= fp->obj.objsize) {
+				mem_set(fp->buf, 0xFF, SS(fs));	/* Leave unused part of the sector blank, so that appending to it does not need an erase */
+			}
 #endif
 			fp->sect = sect;
 		}
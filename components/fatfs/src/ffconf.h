@@ -44,7 +44,11 @@
 /* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
 
 
+#ifdef CONFIG_FATFS_USE_FASTSEEK
+#define FF_USE_FASTSEEK	1
+#else
 #define FF_USE_FASTSEEK	0
+#endif
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
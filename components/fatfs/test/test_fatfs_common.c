@@ -139,6 +139,85 @@ void test_fatfs_lseek(const char* filename)
     TEST_ASSERT_EQUAL(0, fclose(f));
 }
 
+static void check_fragmented_word(FILE* f, long pos)
+{
+    uint32_t word;
+    TEST_ASSERT_EQUAL(0, fseek(f, pos * sizeof(word), SEEK_SET));
+    TEST_ASSERT_EQUAL(1, fread(&word, sizeof(word), 1, f));
+    TEST_ASSERT_EQUAL_UINT32(pos, word);
+}
+
+void test_fatfs_lseek_fragmented(const char* filename_prefix)
+{
+    char name_a[64];
+    char name_b[64];
+    snprintf(name_a, sizeof(name_a), "%s_a.bin", filename_prefix);
+    snprintf(name_b, sizeof(name_b), "%s_b.bin", filename_prefix);
+
+    // write two files in turns, so that the clusters of each file are not contiguous
+    const size_t chunk_words = 1024;
+    const size_t chunk_count = 24;
+    uint32_t* chunk = malloc(chunk_words * sizeof(uint32_t));
+    TEST_ASSERT_NOT_NULL(chunk);
+    FILE* fa = fopen(name_a, "wb");
+    TEST_ASSERT_NOT_NULL(fa);
+    FILE* fb = fopen(name_b, "wb");
+    TEST_ASSERT_NOT_NULL(fb);
+    for (size_t i = 0; i < chunk_count; ++i) {
+        for (size_t j = 0; j < chunk_words; ++j) {
+            chunk[j] = i * chunk_words + j;
+        }
+        TEST_ASSERT_EQUAL(chunk_words, fwrite(chunk, sizeof(uint32_t), chunk_words, fa));
+        TEST_ASSERT_EQUAL(0, fflush(fa));
+        TEST_ASSERT_EQUAL(chunk_words, fwrite(chunk, sizeof(uint32_t), chunk_words, fb));
+        TEST_ASSERT_EQUAL(0, fflush(fb));
+    }
+    TEST_ASSERT_EQUAL(0, fclose(fb));
+    TEST_ASSERT_EQUAL(0, fclose(fa));
+    free(chunk);
+
+    const long file_words = chunk_count * chunk_words;
+    FILE* f = fopen(name_a, "rb+");
+    TEST_ASSERT_NOT_NULL(f);
+    srand(42);
+    for (int i = 0; i < 200; ++i) {
+        check_fragmented_word(f, rand() % file_words);
+    }
+    check_fragmented_word(f, file_words - 1);
+    check_fragmented_word(f, 0);
+
+    // overwrite inside of the file, then extend it after a seek
+    uint32_t word = 0xdeadbeef;
+    TEST_ASSERT_EQUAL(0, fseek(f, 100 * sizeof(word), SEEK_SET));
+    TEST_ASSERT_EQUAL(1, fwrite(&word, sizeof(word), 1, f));
+    TEST_ASSERT_EQUAL(0, fseek(f, (file_words - 1) * sizeof(word), SEEK_SET));
+    for (long pos = file_words - 1; pos < file_words + 2 * (long) chunk_words; ++pos) {
+        word = pos;
+        TEST_ASSERT_EQUAL(1, fwrite(&word, sizeof(word), 1, f));
+    }
+    // seek beyond the end of file extends it
+    const long end_words = file_words + 3 * chunk_words;
+    TEST_ASSERT_EQUAL(0, fseek(f, end_words * sizeof(word) - sizeof(word), SEEK_SET));
+    word = end_words - 1;
+    TEST_ASSERT_EQUAL(1, fwrite(&word, sizeof(word), 1, f));
+
+    for (int i = 0; i < 200; ++i) {
+        long pos = rand() % (file_words + 2 * chunk_words);
+        if (pos != 100) {
+            check_fragmented_word(f, pos);
+        }
+    }
+    TEST_ASSERT_EQUAL(0, fseek(f, 100 * sizeof(word), SEEK_SET));
+    TEST_ASSERT_EQUAL(1, fread(&word, sizeof(word), 1, f));
+    TEST_ASSERT_EQUAL_HEX32(0xdeadbeef, word);
+    check_fragmented_word(f, end_words - 1);
+    TEST_ASSERT_EQUAL(end_words * sizeof(word), ftell(f));
+    TEST_ASSERT_EQUAL(0, fclose(f));
+
+    TEST_ASSERT_EQUAL(0, unlink(name_a));
+    TEST_ASSERT_EQUAL(0, unlink(name_b));
+}
+
 void test_fatfs_truncate_file(const char* filename)
 {
     int read = 0;
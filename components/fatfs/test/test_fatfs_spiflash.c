@@ -96,6 +96,13 @@ TEST_CASE("(WL) can lseek", "[fatfs][wear_levelling]")
     test_teardown();
 }
 
+TEST_CASE("(WL) can lseek in fragmented file", "[fatfs][wear_levelling]")
+{
+    test_setup();
+    test_fatfs_lseek_fragmented("/spiflash/frag");
+    test_teardown();
+}
+
 TEST_CASE("(WL) can truncate", "[fatfs][wear_levelling]")
 {
     test_setup();
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ff.h"
+#include "esp_partition.h"
+#include "wear_levelling.h"
+#include "diskio_impl.h"
+#include "diskio_wl.h"
+#include "SpiFlash.h"
+#include "fs_benchmark.h"
+
+#include "catch.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+extern "C" void init_spi_flash(const char* chip_size, size_t block_size, size_t sector_size, size_t page_size, const char* partition_bin);
+extern SpiFlash spiflash;
+
+// FAT volume on a wear-levelled partition, driven through the FatFs API
+class FatfsBenchTarget : public FsBenchTarget
+{
+public:
+    const char* name() const override
+    {
+        return "fatfs_wl";
+    }
+
+    bool mount() override
+    {
+        init_spi_flash(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+        spiflash.set_timing(FLASH_TIMING_W25Q32);
+        mPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_FAT, "storage");
+        if (mPartition == NULL || wl_mount(mPartition, &mWlHandle) != ESP_OK) {
+            return false;
+        }
+        if (ff_diskio_get_drive(&mPdrv) != ESP_OK || ff_diskio_register_wl_partition(mPdrv, mWlHandle) != ESP_OK) {
+            wl_unmount(mWlHandle);
+            return false;
+        }
+        snprintf(mDrv, sizeof(mDrv), "%d:", mPdrv);
+
+        DWORD part_list[] = {100, 0, 0, 0};
+        BYTE work_area[FF_MAX_SS];
+        return f_fdisk(mPdrv, part_list, work_area) == FR_OK &&
+               f_mkfs(mDrv, FM_ANY, 0, work_area, sizeof(work_area)) == FR_OK &&
+               f_mount(&mFs, mDrv, 0) == FR_OK;
+    }
+
+    void unmount() override
+    {
+        f_mount(0, mDrv, 0);
+        ff_diskio_unregister(mPdrv);
+        ff_diskio_clear_pdrv_wl(mWlHandle);
+        wl_unmount(mWlHandle);
+    }
+
+    bool write(const char* path, const void* data, size_t size, bool append) override
+    {
+        FIL file;
+        if (f_open(&file, fullPath(path), FA_WRITE | (append ? FA_OPEN_APPEND : FA_CREATE_ALWAYS)) != FR_OK) {
+            return false;
+        }
+        UINT bw;
+        FRESULT res = f_write(&file, data, size, &bw);
+        return f_close(&file) == FR_OK && res == FR_OK && bw == size;
+    }
+
+    bool overwrite(const char* path, size_t offset, const void* data, size_t size) override
+    {
+        FIL file;
+        if (f_open(&file, fullPath(path), FA_WRITE | FA_OPEN_EXISTING) != FR_OK) {
+            return false;
+        }
+        UINT bw = 0;
+        FRESULT res = f_lseek(&file, offset);
+        if (res == FR_OK) {
+            res = f_write(&file, data, size, &bw);
+        }
+        return f_close(&file) == FR_OK && res == FR_OK && bw == size;
+    }
+
+    bool read(const char* path, void* data, size_t size) override
+    {
+        FIL file;
+        if (f_open(&file, fullPath(path), FA_READ) != FR_OK) {
+            return false;
+        }
+        UINT br;
+        FRESULT res = f_read(&file, data, size, &br);
+        return f_close(&file) == FR_OK && res == FR_OK && br == size;
+    }
+
+    bool remove(const char* path) override
+    {
+        return f_unlink(fullPath(path)) == FR_OK;
+    }
+
+    int list() override
+    {
+        FF_DIR dir;
+        FILINFO info;
+        if (f_opendir(&dir, fullPath("")) != FR_OK) {
+            return -1;
+        }
+        int count = 0;
+        while (f_readdir(&dir, &info) == FR_OK && info.fname[0] != 0) {
+            if (!(info.fattrib & AM_DIR)) {
+                ++count;
+            }
+        }
+        f_closedir(&dir);
+        return count;
+    }
+
+    void resetFlashStats() override
+    {
+        spiflash.reset_read_counters();
+        spiflash.reset_write_counters();
+        spiflash.reset_erase_cycles();
+        spiflash.reset_total_erase_cycles();
+        spiflash.reset_total_time();
+    }
+
+    FsBenchFlashStats getFlashStats() override
+    {
+        FsBenchFlashStats stats;
+        stats.readBytes = spiflash.get_read_bytes();
+        stats.writeBytes = spiflash.get_write_bytes();
+        stats.eraseOps = spiflash.get_total_erase_cycles();
+        stats.flashTimeUs = spiflash.get_total_time_us();
+        uint32_t sector_size = spiflash.get_sector_size();
+        for (uint32_t i = 0; i < mPartition->size / sector_size; i++) {
+            stats.sectorEraseCounts.push_back(spiflash.get_erase_cycles(mPartition->address / sector_size + i));
+        }
+        return stats;
+    }
+
+protected:
+    const char* fullPath(const char* path)
+    {
+        snprintf(mPath, sizeof(mPath), "%s/%s", mDrv, path);
+        return mPath;
+    }
+
+    const esp_partition_t* mPartition = NULL;
+    wl_handle_t mWlHandle = WL_INVALID_HANDLE;
+    BYTE mPdrv = 0xFF;
+    FATFS mFs;
+    char mDrv[4];
+    char mPath[32];
+};
+
+TEST_CASE("benchmark fatfs on wear levelling with shared file system workloads", "[bench][.]")
+{
+    const char* fileName = getenv("FS_BENCH_OUTPUT");
+    std::ofstream file((fileName != NULL) ? fileName : "fs_bench_fatfs.csv");
+    CHECK(file.is_open());
+    fsBenchPrintHeader(file);
+    fsBenchPrintHeader(std::cout);
+
+    FatfsBenchTarget target;
+    std::stringstream rows;
+    CHECK(fsBenchRun(target, rows));
+    file << rows.str();
+    std::cout << rows.str();
+}
@@ -6,3 +6,4 @@
 #define CONFIG_ESPTOOLPY_FLASHSIZE "8MB"
 //currently use the legacy implementation, since the stubs for new HAL are not done yet
 #define CONFIG_SPI_FLASH_USE_LEGACY_IMPL
+#define CONFIG_FATFS_SDMMC_CACHE_SECTORS 8
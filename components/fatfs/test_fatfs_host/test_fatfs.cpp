@@ -1,15 +1,19 @@
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 
 #include "ff.h"
 #include "esp_partition.h"
 #include "wear_levelling.h"
 #include "diskio_impl.h"
 #include "diskio_wl.h"
+#include "diskio_sdmmc.h"
+#include "SpiFlash.h"
 
 #include "catch.hpp"
 
 extern "C" void init_spi_flash(const char* chip_size, size_t block_size, size_t sector_size, size_t page_size, const char* partition_bin);
+extern SpiFlash spiflash;
 
 TEST_CASE("create volume, open file, write and read back data", "[fatfs]")
 {
@@ -91,3 +95,298 @@ TEST_CASE("create volume, open file, write and read back data", "[fatfs]")
     free(read);
     free(data);
 }
+
+static uint32_t append_log_records(bool erase_skip, size_t record_count)
+{
+    init_spi_flash(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_FAT, "storage");
+    wl_handle_t wl_handle;
+    REQUIRE(wl_mount(partition, &wl_handle) == ESP_OK);
+    BYTE pdrv;
+    REQUIRE(ff_diskio_get_drive(&pdrv) == ESP_OK);
+    REQUIRE(ff_diskio_register_wl_partition(pdrv, wl_handle) == ESP_OK);
+    REQUIRE(ff_diskio_wl_set_erase_skip(pdrv, erase_skip) == ESP_OK);
+
+    // the drive is not necessarily the default one, use its logical drive number in paths
+    char drv[3] = {(char) ('0' + pdrv), ':', 0};
+    char path[16];
+    snprintf(path, sizeof(path), "%s/log.txt", drv);
+
+    DWORD part_list[] = {100, 0, 0, 0};
+    BYTE work_area[FF_MAX_SS];
+    REQUIRE(f_fdisk(pdrv, part_list, work_area) == FR_OK);
+    REQUIRE(f_mkfs(drv, FM_ANY, 0, work_area, sizeof(work_area)) == FR_OK);
+
+    FATFS fs;
+    FIL file;
+    UINT bw;
+    REQUIRE(f_mount(&fs, drv, 0) == FR_OK);
+    REQUIRE(f_open(&file, path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+
+    spiflash.reset_total_erase_cycles();
+    char record[64];
+    for (size_t i = 0; i < record_count; i++) {
+        memset(record, 'a' + i % 26, sizeof(record));
+        REQUIRE(f_write(&file, record, sizeof(record), &bw) == FR_OK);
+        REQUIRE(bw == sizeof(record));
+        REQUIRE(f_sync(&file) == FR_OK);
+    }
+    uint32_t erase_cycles = spiflash.get_total_erase_cycles();
+    REQUIRE(f_close(&file) == FR_OK);
+
+    // check that the log reads back correctly
+    REQUIRE(f_open(&file, path, FA_READ) == FR_OK);
+    for (size_t i = 0; i < record_count; i++) {
+        REQUIRE(f_read(&file, record, sizeof(record), &bw) == FR_OK);
+        REQUIRE(bw == sizeof(record));
+        for (size_t j = 0; j < sizeof(record); j++) {
+            REQUIRE(record[j] == (char) ('a' + i % 26));
+        }
+    }
+    REQUIRE(f_close(&file) == FR_OK);
+
+    REQUIRE(f_mount(0, drv, 0) == FR_OK);
+    ff_diskio_unregister(pdrv);
+    ff_diskio_clear_pdrv_wl(wl_handle);
+    REQUIRE(wl_unmount(wl_handle) == ESP_OK);
+    return erase_cycles;
+}
+
+TEST_CASE("appending to a file skips erasing sectors which are already blank", "[fatfs]")
+{
+    const size_t record_count = 256;
+    uint32_t erases_always = append_log_records(false, record_count);
+    uint32_t erases_skip = append_log_records(true, record_count);
+    printf("Appending %u records: %u erases without erase skipping, %u erases with erase skipping\n",
+           (unsigned) record_count, (unsigned) erases_always, (unsigned) erases_skip);
+    // every record still updates the file size in the directory entry, which needs an erase,
+    // but the data sector is only appended to
+    CHECK(erases_skip * 3 < erases_always * 2);
+}
+
+TEST_CASE("sectors written by a failed write are not skipped when erasing", "[fatfs]")
+{
+    init_spi_flash(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_FAT, "storage");
+    wl_handle_t wl_handle;
+    REQUIRE(wl_mount(partition, &wl_handle) == ESP_OK);
+    BYTE pdrv;
+    REQUIRE(ff_diskio_get_drive(&pdrv) == ESP_OK);
+    REQUIRE(ff_diskio_register_wl_partition(pdrv, wl_handle) == ESP_OK);
+    REQUIRE(ff_diskio_wl_set_erase_skip(pdrv, true) == ESP_OK);
+
+    const size_t sector_size = CONFIG_WL_SECTOR_SIZE;
+    BYTE *data = (BYTE *) malloc(2 * sector_size);
+    REQUIRE(data != NULL);
+
+    // sector 0 is known to be blank, sector 1 holds data
+    REQUIRE(wl_erase_range(wl_handle, 0, 2 * sector_size) == ESP_OK);
+    REQUIRE(disk_read(pdrv, data, 0, 2) == RES_OK);
+    memset(data, 0x00, sector_size);
+    REQUIRE(disk_write(pdrv, data, 1, 1) == RES_OK);
+
+    // sector 0 is written without erasing, then erasing sector 1 fails
+    memset(data, 0x55, sector_size);
+    memset(data + sector_size, 0xaa, sector_size);
+    spiflash.set_fail_after(0, SPIFLASH_OP_ERASE);
+    CHECK(disk_write(pdrv, data, 0, 2) == RES_ERROR);
+    spiflash.clear_fail();
+
+    // sector 0 isn't blank any more, so it has to be erased before it is written again
+    memset(data, 0xaa, sector_size);
+    REQUIRE(disk_write(pdrv, data, 0, 1) == RES_OK);
+    memset(data, 0, sector_size);
+    REQUIRE(disk_read(pdrv, data, 0, 1) == RES_OK);
+    for (size_t i = 0; i < sector_size; i++) {
+        REQUIRE(data[i] == 0xaa);
+    }
+
+    free(data);
+    ff_diskio_unregister(pdrv);
+    ff_diskio_clear_pdrv_wl(wl_handle);
+    REQUIRE(wl_unmount(wl_handle) == ESP_OK);
+}
+
+static uint32_t read_two_files_in_turns(size_t cache_sectors)
+{
+    init_spi_flash(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    REQUIRE(esp_partition_read_cache_config(cache_sectors) == ESP_OK);
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_FAT, "storage");
+    wl_handle_t wl_handle;
+    REQUIRE(wl_mount(partition, &wl_handle) == ESP_OK);
+    BYTE pdrv;
+    REQUIRE(ff_diskio_get_drive(&pdrv) == ESP_OK);
+    REQUIRE(ff_diskio_register_wl_partition(pdrv, wl_handle) == ESP_OK);
+    char drv[3] = {(char) ('0' + pdrv), ':', 0};
+    char path[2][16];
+    snprintf(path[0], sizeof(path[0]), "%s/a.bin", drv);
+    snprintf(path[1], sizeof(path[1]), "%s/b.bin", drv);
+
+    DWORD part_list[] = {100, 0, 0, 0};
+    BYTE work_area[FF_MAX_SS];
+    REQUIRE(f_fdisk(pdrv, part_list, work_area) == FR_OK);
+    REQUIRE(f_mkfs(drv, FM_ANY, 0, work_area, sizeof(work_area)) == FR_OK);
+    FATFS fs;
+    FIL file[2];
+    UINT bw;
+    REQUIRE(f_mount(&fs, drv, 0) == FR_OK);
+
+    const size_t file_size = 32 * 1024;
+    const size_t record_size = 128;
+    uint8_t record[record_size];
+    for (int f = 0; f < 2; f++) {
+        REQUIRE(f_open(&file[f], path[f], FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+        for (size_t pos = 0; pos < file_size; pos += record_size) {
+            memset(record, (int) (f * 128 + pos / record_size), record_size);
+            REQUIRE(f_write(&file[f], record, record_size, &bw) == FR_OK);
+        }
+        REQUIRE(f_close(&file[f]) == FR_OK);
+    }
+
+    // with a single sector buffer in FatFs, every switch between the files reads a sector again
+    spiflash.reset_read_counters();
+    REQUIRE(f_open(&file[0], path[0], FA_READ) == FR_OK);
+    REQUIRE(f_open(&file[1], path[1], FA_READ) == FR_OK);
+    for (size_t pos = 0; pos < file_size; pos += record_size) {
+        for (int f = 0; f < 2; f++) {
+            REQUIRE(f_read(&file[f], record, record_size, &bw) == FR_OK);
+            REQUIRE(bw == record_size);
+            REQUIRE(record[0] == (uint8_t) (f * 128 + pos / record_size));
+        }
+    }
+    uint32_t read_ops = spiflash.get_read_ops();
+    REQUIRE(f_close(&file[0]) == FR_OK);
+    REQUIRE(f_close(&file[1]) == FR_OK);
+
+    REQUIRE(f_mount(0, drv, 0) == FR_OK);
+    ff_diskio_unregister(pdrv);
+    ff_diskio_clear_pdrv_wl(wl_handle);
+    REQUIRE(wl_unmount(wl_handle) == ESP_OK);
+    REQUIRE(esp_partition_read_cache_config(0) == ESP_OK);
+    return read_ops;
+}
+
+TEST_CASE("partition read cache saves flash reads when switching between files", "[fatfs]")
+{
+    uint32_t reads_uncached = read_two_files_in_turns(0);
+    uint32_t reads_cached = read_two_files_in_turns(4);
+    printf("Reading two files in turns: %u flash reads without partition read cache, %u with cache\n",
+           (unsigned) reads_uncached, (unsigned) reads_cached);
+    CHECK(reads_cached * 4 < reads_uncached);
+}
+
+// RAM-backed stand-in for an SD card, counting the commands sent to it
+static uint8_t* s_ram_card;
+static size_t s_ram_card_reads;
+static size_t s_ram_card_writes;
+
+extern "C" esp_err_t sdmmc_read_sectors(sdmmc_card_t* card, void* dst, size_t start_sector, size_t sector_count)
+{
+    REQUIRE(start_sector + sector_count <= (size_t) card->csd.capacity);
+    memcpy(dst, s_ram_card + start_sector * card->csd.sector_size, sector_count * card->csd.sector_size);
+    s_ram_card_reads++;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t sdmmc_write_sectors(sdmmc_card_t* card, const void* src, size_t start_sector, size_t sector_count)
+{
+    REQUIRE(start_sector + sector_count <= (size_t) card->csd.capacity);
+    memcpy(s_ram_card + start_sector * card->csd.sector_size, src, sector_count * card->csd.sector_size);
+    s_ram_card_writes++;
+    return ESP_OK;
+}
+
+TEST_CASE("SD card sector cache batches single sector requests", "[fatfs]")
+{
+    sdmmc_card_t card;
+    card.csd.sector_size = 512;
+    card.csd.capacity = 8192;
+    s_ram_card = (uint8_t*) calloc(card.csd.capacity, card.csd.sector_size);
+    REQUIRE(s_ram_card != NULL);
+
+    BYTE pdrv;
+    REQUIRE(ff_diskio_get_drive(&pdrv) == ESP_OK);
+    ff_diskio_register_sdmmc(pdrv, &card);
+    char drv[3] = {(char) ('0' + pdrv), ':', 0};
+    char path[16];
+    snprintf(path, sizeof(path), "%s/data.bin", drv);
+
+    BYTE work_area[FF_MAX_SS];
+    REQUIRE(f_mkfs(drv, FM_ANY, 0, work_area, sizeof(work_area)) == FR_OK);
+    FATFS fs;
+    FIL file;
+    UINT bw;
+    REQUIRE(f_mount(&fs, drv, 0) == FR_OK);
+
+    const size_t data_size = 256 * 1024;
+    const size_t record_size = 100;
+    uint8_t* data = (uint8_t*) malloc(data_size);
+    uint8_t* read = (uint8_t*) malloc(data_size);
+    for (size_t i = 0; i < data_size; ++i) {
+        data[i] = (uint8_t) (i * 7 + i / 256);
+    }
+    const size_t sectors = data_size / card.csd.sector_size;
+
+    // small sequential writes, each data sector is one single sector request from FatFs
+    s_ram_card_writes = 0;
+    REQUIRE(f_open(&file, path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+    for (size_t pos = 0; pos < data_size; pos += record_size) {
+        UINT len = (UINT) std::min(record_size, data_size - pos);
+        REQUIRE(f_write(&file, data + pos, len, &bw) == FR_OK);
+        REQUIRE(bw == len);
+    }
+    REQUIRE(f_close(&file) == FR_OK);
+    size_t writes = s_ram_card_writes;
+
+    // overwrite records at scattered offsets
+    REQUIRE(f_open(&file, path, FA_READ | FA_WRITE) == FR_OK);
+    srand(1);
+    for (int i = 0; i < 200; ++i) {
+        size_t pos = rand() % (data_size - record_size);
+        for (size_t j = 0; j < record_size; ++j) {
+            data[pos + j] = (uint8_t) rand();
+        }
+        REQUIRE(f_lseek(&file, pos) == FR_OK);
+        REQUIRE(f_write(&file, data + pos, record_size, &bw) == FR_OK);
+    }
+    REQUIRE(f_close(&file) == FR_OK);
+
+    // small sequential reads
+    s_ram_card_reads = 0;
+    REQUIRE(f_open(&file, path, FA_READ) == FR_OK);
+    for (size_t pos = 0; pos < data_size; pos += record_size) {
+        UINT len = (UINT) std::min(record_size, data_size - pos);
+        REQUIRE(f_read(&file, read + pos, len, &bw) == FR_OK);
+        REQUIRE(bw == len);
+    }
+    REQUIRE(f_close(&file) == FR_OK);
+    size_t reads = s_ram_card_reads;
+    REQUIRE(memcmp(data, read, data_size) == 0);
+
+    printf("%u data sectors: %u write commands, %u read commands\n",
+           (unsigned) sectors, (unsigned) writes, (unsigned) reads);
+    CHECK(writes * 4 < sectors);
+    CHECK(reads * 4 < sectors);
+
+    // unregistering writes back the cache, the data is read back from the card after mounting again
+    REQUIRE(f_mount(0, drv, 0) == FR_OK);
+    ff_diskio_register_sdmmc(pdrv, NULL);
+    ff_diskio_register_sdmmc(pdrv, &card);
+    REQUIRE(f_mount(&fs, drv, 0) == FR_OK);
+    memset(read, 0, data_size);
+    REQUIRE(f_open(&file, path, FA_READ) == FR_OK);
+    REQUIRE(f_read(&file, read + 1, data_size - 1, &bw) == FR_OK);
+    REQUIRE(f_read(&file, read, 1, &bw) == FR_OK);
+    REQUIRE(f_close(&file) == FR_OK);
+    REQUIRE(memcmp(data, read + 1, data_size - 1) == 0);
+    REQUIRE(read[0] == data[data_size - 1]);
+
+    REQUIRE(f_mount(0, drv, 0) == FR_OK);
+    ff_diskio_register_sdmmc(pdrv, NULL);
+    free(read);
+    free(data);
+    free(s_ram_card);
+}
@@ -33,6 +33,9 @@ typedef struct {
     char tmp_path_buf[FILENAME_MAX+3];  /* temporary buffer used to prepend drive name to the path */
     char tmp_path_buf2[FILENAME_MAX+3]; /* as above; used in functions which take two path arguments */
     bool *o_append;  /* O_APPEND is stored here for each max_files entries (because O_APPEND is not compatible with FA_OPEN_APPEND) */
+#if FF_USE_FASTSEEK
+    bool *no_fast_seek; /* set for each max_files entries whose cluster link map does not fit into CONFIG_FATFS_FAST_SEEK_BUFFER_SIZE */
+#endif
     FIL files[0];   /* array with max_files entries; must be the final member of the structure */
 } vfs_fat_ctx_t;
 
@@ -161,6 +164,15 @@ esp_err_t esp_vfs_fat_register(const char* base_path, const char* fat_drive, siz
         return ESP_ERR_NO_MEM;
     }
     memset(fat_ctx->o_append, 0, max_files * sizeof(bool));
+#if FF_USE_FASTSEEK
+    fat_ctx->no_fast_seek = ff_memalloc(max_files * sizeof(bool));
+    if (fat_ctx->no_fast_seek == NULL) {
+        free(fat_ctx->o_append);
+        free(fat_ctx);
+        return ESP_ERR_NO_MEM;
+    }
+    memset(fat_ctx->no_fast_seek, 0, max_files * sizeof(bool));
+#endif
     fat_ctx->max_files = max_files;
     strlcpy(fat_ctx->fat_drive, fat_drive, sizeof(fat_ctx->fat_drive) - 1);
     strlcpy(fat_ctx->base_path, base_path, sizeof(fat_ctx->base_path) - 1);
@@ -168,6 +180,9 @@ esp_err_t esp_vfs_fat_register(const char* base_path, const char* fat_drive, siz
     esp_err_t err = esp_vfs_register(base_path, &vfs, fat_ctx);
     if (err != ESP_OK) {
         free(fat_ctx->o_append);
+#if FF_USE_FASTSEEK
+        free(fat_ctx->no_fast_seek);
+#endif
         free(fat_ctx);
         return err;
     }
@@ -196,6 +211,9 @@ esp_err_t esp_vfs_fat_unregister_path(const char* base_path)
     }
     _lock_close(&fat_ctx->lock);
     free(fat_ctx->o_append);
+#if FF_USE_FASTSEEK
+    free(fat_ctx->no_fast_seek);
+#endif
     free(fat_ctx);
     s_fat_ctxs[ctx] = NULL;
     return ESP_OK;
@@ -277,8 +295,62 @@ static int fresult_to_errno(FRESULT fr)
     return ENOTSUP;
 }
 
+#if FF_USE_FASTSEEK
+/**
+ * @brief Build the cluster link map of an open file
+ * With the map, f_lseek finds the cluster of the new position without following
+ * the FAT chain from the start of the file. The map is allocated with room for
+ * CONFIG_FATFS_FAST_SEEK_BUFFER_SIZE items and shrunk to the size in use. If the
+ * file is too fragmented for the map to fit, seeking falls back to walking the
+ * chain until the file is extended again.
+ */
+static void fast_seek_enable(vfs_fat_ctx_t* ctx, int fd)
+{
+    FIL* file = &ctx->files[fd];
+    if (file->cltbl != NULL || ctx->no_fast_seek[fd] || f_size(file) == 0) {
+        return;
+    }
+    DWORD* tbl = ff_memalloc(CONFIG_FATFS_FAST_SEEK_BUFFER_SIZE * sizeof(DWORD));
+    if (tbl == NULL) {
+        return;
+    }
+    tbl[0] = CONFIG_FATFS_FAST_SEEK_BUFFER_SIZE;
+    file->cltbl = tbl;
+    FRESULT res = f_lseek(file, CREATE_LINKMAP);
+    if (res != FR_OK) {
+        ESP_LOGD(TAG, "%s: fresult=%d, %d items needed", __func__, res, (int) tbl[0]);
+        file->cltbl = NULL;
+        free(tbl);
+        ctx->no_fast_seek[fd] = (res == FR_NOT_ENOUGH_CORE);
+        return;
+    }
+    /* tbl[0] now holds the number of items in use */
+    DWORD* used = realloc(tbl, tbl[0] * sizeof(DWORD));
+    if (used != NULL) {
+        file->cltbl = used;
+    }
+}
+
+/**
+ * @brief Drop the cluster link map of an open file
+ * FatFs can not allocate new clusters to a file while the map is in use. The
+ * position in FIL stays valid, so the following operation continues from it
+ * using the FAT chain.
+ */
+static void fast_seek_disable(vfs_fat_ctx_t* ctx, int fd)
+{
+    FIL* file = &ctx->files[fd];
+    free(file->cltbl);
+    file->cltbl = NULL;
+    ctx->no_fast_seek[fd] = false;
+}
+#endif // FF_USE_FASTSEEK
+
 static void file_cleanup(vfs_fat_ctx_t* ctx, int fd)
 {
+#if FF_USE_FASTSEEK
+    fast_seek_disable(ctx, fd);
+#endif
     memset(&ctx->files[fd], 0, sizeof(FIL));
 }
 
@@ -345,6 +417,11 @@ static ssize_t vfs_fat_write(void* ctx, int fd, const void * data, size_t size)
             return -1;
         }
     }
+#if FF_USE_FASTSEEK
+    if (f_tell(file) + size > f_size(file)) {
+        fast_seek_disable(fat_ctx, fd);
+    }
+#endif
     unsigned written = 0;
     res = f_write(file, data, size, &written);
     if (res != FR_OK) {
@@ -423,6 +500,14 @@ static off_t vfs_fat_lseek(void* ctx, int fd, off_t offset, int mode)
         errno = EINVAL;
         return -1;
     }
+#if FF_USE_FASTSEEK
+    // in fast seek mode f_lseek does not extend the file, so only use it inside of the file
+    if ((FSIZE_t) new_pos <= f_size(file)) {
+        fast_seek_enable(fat_ctx, fd);
+    } else {
+        fast_seek_disable(fat_ctx, fd);
+    }
+#endif
     FRESULT res = f_lseek(file, new_pos);
     if (res != FR_OK) {
         ESP_LOGD(TAG, "%s: fresult=%d", __func__, res);
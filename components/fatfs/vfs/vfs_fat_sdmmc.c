@@ -150,13 +150,14 @@ esp_err_t esp_vfs_fat_sdmmc_mount(const char* base_path,
     return ESP_OK;
 
 fail:
+    // write back cached sectors while the host is still initialized
+    ff_diskio_register_sdmmc(pdrv, NULL);
     host_config->deinit();
     free(workbuf);
     if (fs) {
         f_mount(NULL, drv, 0);
     }
     esp_vfs_fat_unregister_path(base_path);
-    ff_diskio_unregister(pdrv);
     free(s_card);
     s_card = NULL;
     return err;
@@ -172,7 +173,7 @@ esp_err_t esp_vfs_fat_sdmmc_unmount()
     f_mount(0, drv, 0);
     // release SD driver
     esp_err_t (*host_deinit)() = s_card->host.deinit;
-    ff_diskio_unregister(s_pdrv);
+    ff_diskio_register_sdmmc(s_pdrv, NULL);
     free(s_card);
     s_card = NULL;
     (*host_deinit)();
@@ -63,6 +63,16 @@ esp_err_t esp_vfs_fat_spiflash_mount(const char* base_path,
         ESP_LOGE(TAG, "ff_diskio_register_wl_partition failed pdrv=%i, error - 0x(%x)", pdrv, result);
         goto fail;
     }
+#ifdef CONFIG_FATFS_WL_ERASE_SKIP
+    // in-place writes are not possible if the data is encrypted
+    if (!data_partition->encrypted) {
+        result = ff_diskio_wl_set_erase_skip(pdrv, true);
+        if (result != ESP_OK) {
+            ESP_LOGE(TAG, "ff_diskio_wl_set_erase_skip failed pdrv=%i, error - 0x(%x)", pdrv, result);
+            goto fail;
+        }
+    }
+#endif
     FATFS *fs;
     result = esp_vfs_fat_register(base_path, drv, mount_config->max_files, &fs);
     if (result == ESP_ERR_INVALID_STATE) {
@@ -111,6 +121,7 @@ fail:
     free(workbuf);
     esp_vfs_fat_unregister_path(base_path);
     ff_diskio_unregister(pdrv);
+    ff_diskio_clear_pdrv_wl(*wl_handle);
     return result;
 }
 
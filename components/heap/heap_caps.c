@@ -18,6 +18,7 @@
 #include <sys/param.h>
 #include "esp_attr.h"
 #include "esp_heap_caps.h"
+#include "esp_heap_cache.h"
 #include "multi_heap.h"
 #include "esp_log.h"
 #include "heap_private.h"
@@ -60,8 +61,163 @@ Routine to allocate a bit of memory with certain capabilities. caps is a bitfiel
 */
 IRAM_ATTR void *heap_caps_malloc( size_t size, uint32_t caps )
 {
-    void *ret = NULL;
+#ifdef CONFIG_HEAP_CACHE
+    void *ret = heap_caps_cache_malloc(size, caps);
+    if (ret != NULL) {
+        return ret;
+    }
+#endif
+    return heap_caps_malloc_base(size, caps);
+}
+
+/* Lookup table from requested caps to the heaps which can satisfy them, see heap_caps_lookup_add().
+
+   Entries are added lazily by heap_caps_malloc(), and reset by heap_caps_lookup_reset() when the set of
+   registered heaps changes. Readers don't take a lock: s_lookup_seq is odd while the table is being
+   written, and readers check that it didn't change before using each heap read from an entry.
+
+   Caps matching more heaps than fit in an entry, or in the rest of s_lookup_heaps, still get an entry,
+   marked scan_all, so that heap_caps_malloc() goes straight to scanning registered_heaps for them.
+*/
+typedef struct {
+    uint32_t caps;
+    uint8_t first;      ///< Index of the first heap of this entry in s_lookup_heaps
+    uint8_t num_heaps;
+    bool scan_all;      ///< Heaps not listed, scan registered_heaps instead
+} caps_lookup_entry_t;
+
+static caps_lookup_entry_t s_lookup[HEAP_CAPS_LOOKUP_ENTRIES];
+static heap_t *s_lookup_heaps[HEAP_CAPS_LOOKUP_POOL_SIZE];
+static size_t s_lookup_count;
+static size_t s_lookup_pool_used;
+static volatile uint32_t s_lookup_seq;
+static portMUX_TYPE s_lookup_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/* Return the heaps which can satisfy 'caps', in the order heap_caps_malloc() tries them: by priority,
+   then in the order of registered_heaps. Each heap is only listed at the first priority it matches.
+
+   Returns -1 if there are more than max_heaps such heaps.
+*/
+IRAM_ATTR static int find_heaps_for_caps(uint32_t caps, heap_t **heaps, int max_heaps)
+{
+    int num_heaps = 0;
+    for (int prio = 0; prio < SOC_MEMORY_TYPE_NO_PRIOS; prio++) {
+        heap_t *heap;
+        SLIST_FOREACH(heap, &registered_heaps, next) {
+            if (heap->heap == NULL) {
+                continue;
+            }
+            //Heap has at least one of the caps requested at this prio, and all of them across its prios
+            if ((heap->caps[prio] & caps) == 0 || (get_all_caps(heap) & caps) != caps) {
+                continue;
+            }
+            bool listed = false;
+            for (int i = 0; i < num_heaps; i++) {
+                if (heaps[i] == heap) {
+                    listed = true;
+                    break;
+                }
+            }
+            if (!listed) {
+                if (num_heaps == max_heaps) {
+                    return -1;
+                }
+                heaps[num_heaps++] = heap;
+            }
+        }
+    }
+    return num_heaps;
+}
 
+/* Find the lookup table entry for 'caps', or NULL. The entry is only valid while s_lookup_seq == seq. */
+IRAM_ATTR static const caps_lookup_entry_t *find_lookup_entry(uint32_t caps, uint32_t seq)
+{
+    if (seq & 1) {
+        return NULL; // being written
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    for (size_t i = 0; i < s_lookup_count; i++) {
+        if (s_lookup[i].caps == caps) {
+            return &s_lookup[i];
+        }
+    }
+    return NULL;
+}
+
+/* Add an entry for 'caps' to the lookup table, unless the table changed since 'seq' was read */
+IRAM_ATTR static void add_lookup_entry(uint32_t caps, uint32_t seq)
+{
+    // Once the table is full, don't look for the heaps or take the lock on every miss.
+    // Checked again below, with the lock held.
+    if (s_lookup_count >= HEAP_CAPS_LOOKUP_ENTRIES) {
+        return;
+    }
+    heap_t *heaps[HEAP_CAPS_LOOKUP_MAX_HEAPS];
+    int num_heaps = -1;
+    if (s_lookup_pool_used < HEAP_CAPS_LOOKUP_POOL_SIZE) {
+        num_heaps = find_heaps_for_caps(caps, heaps, HEAP_CAPS_LOOKUP_MAX_HEAPS);
+    }
+    bool scan_all = (num_heaps < 0 || s_lookup_pool_used + num_heaps > HEAP_CAPS_LOOKUP_POOL_SIZE);
+    if (scan_all) {
+        num_heaps = 0;
+    }
+    portENTER_CRITICAL(&s_lookup_mux);
+    if (s_lookup_seq == seq && s_lookup_count < HEAP_CAPS_LOOKUP_ENTRIES
+        && s_lookup_pool_used + num_heaps <= HEAP_CAPS_LOOKUP_POOL_SIZE) {
+        s_lookup_seq++;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        caps_lookup_entry_t *entry = &s_lookup[s_lookup_count++];
+        entry->caps = caps;
+        entry->first = s_lookup_pool_used;
+        entry->num_heaps = num_heaps;
+        entry->scan_all = scan_all;
+        memcpy(&s_lookup_heaps[s_lookup_pool_used], heaps, num_heaps * sizeof(heap_t *));
+        s_lookup_pool_used += num_heaps;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        s_lookup_seq++;
+    }
+    portEXIT_CRITICAL(&s_lookup_mux);
+}
+
+void heap_caps_lookup_reset(void)
+{
+    portENTER_CRITICAL(&s_lookup_mux);
+    s_lookup_seq++;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    s_lookup_count = 0;
+    s_lookup_pool_used = 0;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    s_lookup_seq++;
+    portEXIT_CRITICAL(&s_lookup_mux);
+}
+
+void heap_caps_lookup_add(uint32_t caps)
+{
+    uint32_t seq = s_lookup_seq;
+    if ((seq & 1) == 0 && find_lookup_entry(caps, seq) == NULL) {
+        add_lookup_entry(caps, seq);
+    }
+}
+
+/* Allocate from one heap which has all of 'caps' */
+IRAM_ATTR static void *heap_malloc(heap_t *heap, size_t size, uint32_t caps)
+{
+    if ((caps & MALLOC_CAP_EXEC) && esp_ptr_in_diram_dram((void *)heap->start)) {
+        //This is special, insofar that what we're going to get back is a DRAM address. If so,
+        //we need to 'invert' it (lowest address in DRAM == highest address in IRAM and vice-versa) and
+        //add a pointer to the DRAM equivalent before the address we're going to return.
+        void *ret = multi_heap_malloc(heap->heap, size + 4);  // int overflow checked above
+        if (ret != NULL) {
+            return dram_alloc_to_iram_addr(ret, size + 4);  // int overflow checked above
+        }
+        return NULL;
+    }
+    //Just try to alloc, nothing special.
+    return multi_heap_malloc(heap->heap, size);
+}
+
+IRAM_ATTR void *heap_caps_malloc_base( size_t size, uint32_t caps )
+{
     if (size > HEAP_SIZE_MAX) {
         // Avoids int overflow when adding small numbers to size, or
         // calculating 'end' from start+size, by limiting 'size' to the possible range
@@ -86,8 +242,35 @@ IRAM_ATTR void *heap_caps_malloc( size_t size, uint32_t caps )
         size = (size + 3) & (~3); // int overflow checked above
     }
 
+    uint32_t seq = s_lookup_seq;
+    const caps_lookup_entry_t *entry = find_lookup_entry(caps, seq);
+    if (entry != NULL && entry->scan_all) {
+        goto scan;
+    } else if (entry != NULL) {
+        size_t end = entry->first + entry->num_heaps;
+        for (size_t i = entry->first; i < end && i < HEAP_CAPS_LOOKUP_POOL_SIZE; i++) {
+            heap_t *heap = s_lookup_heaps[i];
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (s_lookup_seq != seq) {
+                // table changed under us, so 'heap' may not be a match
+                goto scan;
+            }
+            void *ret = heap_malloc(heap, size, caps);
+            if (ret != NULL) {
+                return ret;
+            }
+        }
+        if (s_lookup_seq == seq) {
+            return NULL;
+        }
+    } else if ((seq & 1) == 0) {
+        add_lookup_entry(caps, seq);
+    }
+
+ scan:
+    //No lookup table entry for these caps (too many heaps, or the table is full or changing),
+    //iterate over heaps and check capabilities at each priority
     for (int prio = 0; prio < SOC_MEMORY_TYPE_NO_PRIOS; prio++) {
-        //Iterate over heaps and check capabilities at this priority
         heap_t *heap;
         SLIST_FOREACH(heap, &registered_heaps, next) {
             if (heap->heap == NULL) {
@@ -98,20 +281,9 @@ IRAM_ATTR void *heap_caps_malloc( size_t size, uint32_t caps )
                 //doesn't cover, see if they're available in other prios.
                 if ((get_all_caps(heap) & caps) == caps) {
                     //This heap can satisfy all the requested capabilities. See if we can grab some memory using it.
-                    if ((caps & MALLOC_CAP_EXEC) && esp_ptr_in_diram_dram((void *)heap->start)) {
-                        //This is special, insofar that what we're going to get back is a DRAM address. If so,
-                        //we need to 'invert' it (lowest address in DRAM == highest address in IRAM and vice-versa) and
-                        //add a pointer to the DRAM equivalent before the address we're going to return.
-                        ret = multi_heap_malloc(heap->heap, size + 4);  // int overflow checked above
-                        if (ret != NULL) {
-                            return dram_alloc_to_iram_addr(ret, size + 4);  // int overflow checked above
-                        }
-                    } else {
-                        //Just try to alloc, nothing special.
-                        ret = multi_heap_malloc(heap->heap, size);
-                        if (ret != NULL) {
-                            return ret;
-                        }
+                    void *ret = heap_malloc(heap, size, caps);
+                    if (ret != NULL) {
+                        return ret;
                     }
                 }
             }
@@ -265,6 +437,18 @@ IRAM_ATTR void heap_caps_free( void *ptr)
 
     heap_t *heap = find_containing_heap(ptr);
     assert(heap != NULL && "free() target pointer is outside heap areas");
+#ifdef CONFIG_HEAP_CACHE
+    if (heap_caps_cache_free(heap, ptr)) {
+        return;
+    }
+#endif
+    multi_heap_free(heap->heap, ptr);
+}
+
+IRAM_ATTR void heap_caps_free_base( void *ptr )
+{
+    heap_t *heap = find_containing_heap(ptr);
+    assert(heap != NULL && "free() target pointer is outside heap areas");
     multi_heap_free(heap->heap, ptr);
 }
 
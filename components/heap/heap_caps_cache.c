@@ -0,0 +1,222 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <freertos/FreeRTOS.h>
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_heap_cache.h"
+#include "multi_heap.h"
+#include "heap_private.h"
+
+#ifdef CONFIG_HEAP_CACHE
+
+/*
+ Small object cache ("magazines").
+
+ Each CPU core keeps a short stack of free objects for each of a few fixed size classes. Small allocations
+ with default internal caps are served from the stack of the current core, and freed small blocks are pushed
+ back onto it, without taking any heap lock. An empty stack is refilled with a batch of objects allocated from
+ the heaps, a full stack returns half of its objects to the heaps.
+
+ Objects in the cache are ordinary allocated heap blocks, so they can be passed to heap_caps_realloc() like any
+ other block. Each stack has its own spinlock. A task only takes the lock of the core it runs on, so the two
+ cores do not contend unless a task migrates between reading the core ID and taking the lock, or
+ heap_caps_cache_flush() runs.
+*/
+
+#define CACHE_OBJECTS CONFIG_HEAP_CACHE_OBJECTS
+#define CACHE_BATCH (CACHE_OBJECTS / 2)
+
+typedef struct {
+    portMUX_TYPE mux;
+    size_t count;
+    void *objects[CACHE_OBJECTS];
+    uint32_t alloc_hits;
+    uint32_t alloc_misses;
+    uint32_t free_hits;
+    uint32_t free_misses;
+} cache_class_t;
+
+static cache_class_t s_cache[portNUM_PROCESSORS][HEAP_CACHE_CLASSES];
+
+static bool s_cache_initialised;
+
+void heap_caps_cache_init(void)
+{
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        for (int i = 0; i < HEAP_CACHE_CLASSES; i++) {
+            cache_class_t *c = &s_cache[core][i];
+            memset(c, 0, sizeof(cache_class_t));
+            vPortCPUInitializeMutex(&c->mux);
+        }
+    }
+    s_cache_initialised = true;
+}
+
+/* Size class for an allocation of 'size' bytes */
+static inline int size_to_class(size_t size)
+{
+    return (size - 1) / HEAP_CACHE_CLASS_GRANULARITY;
+}
+
+static inline size_t class_to_size(int class)
+{
+    return (class + 1) * HEAP_CACHE_CLASS_GRANULARITY;
+}
+
+IRAM_ATTR void *heap_caps_cache_malloc(size_t size, uint32_t caps)
+{
+    /* Only serve requests for ordinary data memory. Requests for other caps, or for 32-bit memory only,
+       would prefer other heaps. */
+    if (!s_cache_initialised || size == 0 || size > HEAP_CACHE_MAX_SIZE
+        || (caps & ~HEAP_CACHE_CAPS) != 0 || (caps & (MALLOC_CAP_DEFAULT | MALLOC_CAP_8BIT)) == 0) {
+        return NULL;
+    }
+    int class = size_to_class(size);
+    cache_class_t *c = &s_cache[xPortGetCoreID()][class];
+    void *ret = NULL;
+
+    portENTER_CRITICAL(&c->mux);
+    if (c->count > 0) {
+        ret = c->objects[--c->count];
+        c->alloc_hits++;
+    } else {
+        c->alloc_misses++;
+    }
+    portEXIT_CRITICAL(&c->mux);
+
+    if (ret != NULL) {
+        return ret;
+    }
+
+    /* Refill with a batch, outside the critical section as every allocation takes a heap lock */
+    void *batch[CACHE_BATCH];
+    size_t n;
+    for (n = 0; n < CACHE_BATCH; n++) {
+        batch[n] = heap_caps_malloc_base(class_to_size(class), HEAP_CACHE_CAPS);
+        if (batch[n] == NULL) {
+            break;
+        }
+    }
+    if (n == 0) {
+        return NULL;
+    }
+    ret = batch[--n];
+
+    portENTER_CRITICAL(&c->mux);
+    while (n > 0 && c->count < CACHE_OBJECTS) {
+        c->objects[c->count++] = batch[--n];
+    }
+    portEXIT_CRITICAL(&c->mux);
+
+    /* The cache may have been filled by other frees in the meantime */
+    while (n > 0) {
+        heap_caps_free_base(batch[--n]);
+    }
+    return ret;
+}
+
+IRAM_ATTR bool heap_caps_cache_free(heap_t *heap, void *ptr)
+{
+    if (!s_cache_initialised || !heap_caps_match(heap, HEAP_CACHE_CAPS)) {
+        return false;
+    }
+    /* Only blocks whose size is close to a class size are kept, larger ones would waste memory */
+    size_t size = multi_heap_get_allocated_size(heap->heap, ptr);
+    if (size < HEAP_CACHE_CLASS_GRANULARITY || size >= HEAP_CACHE_MAX_SIZE + HEAP_CACHE_CLASS_GRANULARITY) {
+        return false;
+    }
+    int class = size / HEAP_CACHE_CLASS_GRANULARITY - 1;
+    cache_class_t *c = &s_cache[xPortGetCoreID()][class];
+    void *batch[CACHE_BATCH];
+    size_t n = 0;
+
+    portENTER_CRITICAL(&c->mux);
+    if (c->count == CACHE_OBJECTS) {
+        c->free_misses++;
+        while (n < CACHE_BATCH) {
+            batch[n++] = c->objects[--c->count];
+        }
+    } else {
+        c->free_hits++;
+    }
+    c->objects[c->count++] = ptr;
+    portEXIT_CRITICAL(&c->mux);
+
+    while (n > 0) {
+        heap_caps_free_base(batch[--n]);
+    }
+    return true;
+}
+
+void heap_caps_cache_flush(void)
+{
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        for (int i = 0; i < HEAP_CACHE_CLASSES; i++) {
+            cache_class_t *c = &s_cache[core][i];
+            while (true) {
+                void *ptr = NULL;
+                portENTER_CRITICAL(&c->mux);
+                if (c->count > 0) {
+                    ptr = c->objects[--c->count];
+                }
+                portEXIT_CRITICAL(&c->mux);
+                if (ptr == NULL) {
+                    break;
+                }
+                heap_caps_free_base(ptr);
+            }
+        }
+    }
+}
+
+size_t heap_caps_cache_get_stats(heap_caps_cache_stats_t *stats, size_t num_classes)
+{
+    size_t n = (num_classes < HEAP_CACHE_CLASSES) ? num_classes : HEAP_CACHE_CLASSES;
+    for (size_t i = 0; i < n; i++) {
+        heap_caps_cache_stats_t *s = &stats[i];
+        memset(s, 0, sizeof(heap_caps_cache_stats_t));
+        s->size = class_to_size(i);
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            cache_class_t *c = &s_cache[core][i];
+            portENTER_CRITICAL(&c->mux);
+            s->alloc_hits += c->alloc_hits;
+            s->alloc_misses += c->alloc_misses;
+            s->free_hits += c->free_hits;
+            s->free_misses += c->free_misses;
+            s->cached += c->count;
+            portEXIT_CRITICAL(&c->mux);
+        }
+    }
+    return n;
+}
+
+void heap_caps_cache_reset_stats(void)
+{
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        for (int i = 0; i < HEAP_CACHE_CLASSES; i++) {
+            cache_class_t *c = &s_cache[core][i];
+            portENTER_CRITICAL(&c->mux);
+            c->alloc_hits = 0;
+            c->alloc_misses = 0;
+            c->free_hits = 0;
+            c->free_misses = 0;
+            portEXIT_CRITICAL(&c->mux);
+        }
+    }
+}
+
+#endif // CONFIG_HEAP_CACHE
@@ -29,6 +29,27 @@ static const char *TAG = "heap_init";
 /* Linked-list of registered heaps */
 struct registered_heap_ll registered_heaps;
 
+/* Caps requested by malloc() and by most drivers, these always have an entry in the heap lookup table.
+   Entries for other caps are added the first time they are requested. */
+static const uint32_t lookup_caps[] = {
+    MALLOC_CAP_DEFAULT | MALLOC_CAP_INTERNAL,
+    MALLOC_CAP_DEFAULT | MALLOC_CAP_SPIRAM,
+    MALLOC_CAP_DEFAULT,
+    MALLOC_CAP_8BIT,
+    MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT,
+    MALLOC_CAP_DMA,
+    MALLOC_CAP_32BIT,
+};
+
+/* Build the table of heaps for each set of caps, after the registered heaps changed */
+static void build_heap_lookup(void)
+{
+    heap_caps_lookup_reset();
+    for (size_t i = 0; i < sizeof(lookup_caps) / sizeof(lookup_caps[0]); i++) {
+        heap_caps_lookup_add(lookup_caps[i]);
+    }
+}
+
 static void register_heap(heap_t *region)
 {
     size_t heap_size = region->end - region->start;
@@ -52,6 +73,7 @@ void heap_caps_enable_nonos_stack_heaps()
             }
         }
     }
+    build_heap_lookup();
 }
 
 /* Initialize the heap allocator to use all of the memory not
@@ -152,6 +174,12 @@ void heap_caps_init()
             SLIST_INSERT_AFTER(&heaps_array[i-1], &heaps_array[i], next);
         }
     }
+
+    build_heap_lookup();
+
+#ifdef CONFIG_HEAP_CACHE
+    heap_caps_cache_init();
+#endif
 }
 
 esp_err_t heap_caps_add_region(intptr_t start, intptr_t end)
@@ -231,6 +259,7 @@ esp_err_t heap_caps_add_region_with_caps(const uint32_t caps[], intptr_t start,
     static _lock_t registered_heaps_write_lock;
     _lock_acquire(&registered_heaps_write_lock);
     SLIST_INSERT_HEAD(&registered_heaps, p_new, next);
+    build_heap_lookup();
     _lock_release(&registered_heaps_write_lock);
 
     err = ESP_OK;
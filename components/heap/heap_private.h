@@ -50,6 +50,20 @@ extern SLIST_HEAD(registered_heap_ll, heap_t_) registered_heaps;
 
 bool heap_caps_match(const heap_t *heap, uint32_t caps);
 
+/* Table of the heaps to try, in order, for a given set of requested caps (see heap_caps.c).
+   HEAP_CAPS_LOOKUP_MAX_HEAPS is also the largest number of heaps heap_caps_malloc() keeps on
+   the stack, requests matching more heaps fall back to scanning registered_heaps. Requests without
+   an entry once all HEAP_CAPS_LOOKUP_ENTRIES are used also scan registered_heaps. */
+#define HEAP_CAPS_LOOKUP_ENTRIES 12
+#define HEAP_CAPS_LOOKUP_MAX_HEAPS 12
+#define HEAP_CAPS_LOOKUP_POOL_SIZE 64
+
+/* Empty the lookup table, must be called whenever heaps are registered */
+void heap_caps_lookup_reset(void);
+
+/* Add a lookup table entry for 'caps', if there is room */
+void heap_caps_lookup_add(uint32_t caps);
+
 /* return all possible capabilities (across all priorities) for a given heap */
 inline static IRAM_ATTR uint32_t get_all_caps(const heap_t *heap)
 {
@@ -71,6 +85,27 @@ inline static IRAM_ATTR uint32_t get_all_caps(const heap_t *heap)
 void *heap_caps_realloc_default(void *p, size_t size);
 void *heap_caps_malloc_default(size_t size);
 
+/* Allocate or free without going through the small object cache. Also not wrapped
+   by heap tracing, as the objects held by the cache are not in use by the application.
+*/
+void *heap_caps_malloc_base(size_t size, uint32_t caps);
+void heap_caps_free_base(void *ptr);
+
+#ifdef CONFIG_HEAP_CACHE
+/* Capabilities of the heaps the small object cache allocates from. Requests for a
+   subset of these caps, including MALLOC_CAP_DEFAULT or MALLOC_CAP_8BIT, can be
+   served by the cache. */
+#define HEAP_CACHE_CAPS (MALLOC_CAP_DEFAULT | MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT | MALLOC_CAP_32BIT)
+
+void heap_caps_cache_init(void);
+
+/* Allocate from the small object cache, returns NULL if the request can't be served by it */
+void *heap_caps_cache_malloc(size_t size, uint32_t caps);
+
+/* Keep a freed block in the small object cache, returns false if it should be freed to 'heap' */
+bool heap_caps_cache_free(heap_t *heap, void *ptr);
+#endif
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,376 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_heap_profile.h"
+
+#ifdef ESP_PLATFORM
+
+#include <freertos/FreeRTOS.h>
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+static portMUX_TYPE profile_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#define PROFILE_LOCK() portENTER_CRITICAL(&profile_mux)
+#define PROFILE_UNLOCK() portEXIT_CRITICAL(&profile_mux)
+#define PROFILE_TIME_US() esp_timer_get_time()
+
+#else // ESP_PLATFORM
+
+#include <time.h>
+
+#define IRAM_ATTR
+#define PROFILE_LOCK()
+#define PROFILE_UNLOCK()
+
+static int64_t profile_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+#define PROFILE_TIME_US() profile_time_us()
+
+#endif // ESP_PLATFORM
+
+/*
+ Allocation profiler.
+
+ Both tables are hash tables with linear probing, in arrays provided by the application, and are kept at most
+ 3/4 full so that probe sequences stay short. Allocations and frees take a spinlock and a few probes, whatever
+ the size of the tables.
+
+ 'sites' holds the counts of each (caller, caps) pair. Entries are never removed while profiling, an entry with
+ alloc_count 0 is empty. Allocations made by call sites which don't fit are counted in 'other_site'.
+
+ 'blocks' maps the address of each live allocation to its size and call site, so that a free can be counted
+ against the call site which made the allocation. Entries are removed when the allocation is freed.
+*/
+
+#define OTHER_SITE UINT32_MAX
+
+static heap_profile_site_t *sites;
+static size_t num_sites;
+static size_t used_sites;
+
+static heap_profile_block_t *blocks;
+static size_t num_blocks;
+static size_t used_blocks;
+
+static heap_profile_site_t other_site;
+static uint32_t untracked_count;
+static bool profiling;
+
+esp_err_t heap_profile_init(heap_profile_site_t *sites_param, size_t num_sites_param,
+                            heap_profile_block_t *blocks_param, size_t num_blocks_param)
+{
+    if (profiling) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (sites_param == NULL && blocks_param == NULL && num_sites_param == 0 && num_blocks_param == 0) {
+        sites = NULL;
+        blocks = NULL;
+        num_sites = 0;
+        num_blocks = 0;
+        return ESP_OK;
+    }
+    if (sites_param == NULL || blocks_param == NULL || num_sites_param < 2 || num_blocks_param < 2) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sites = sites_param;
+    num_sites = num_sites_param;
+    blocks = blocks_param;
+    num_blocks = num_blocks_param;
+    memset(sites, 0, num_sites * sizeof(heap_profile_site_t));
+    memset(blocks, 0, num_blocks * sizeof(heap_profile_block_t));
+    used_sites = 0;
+    used_blocks = 0;
+    return ESP_OK;
+}
+
+esp_err_t heap_profile_start(void)
+{
+    if (sites == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    PROFILE_LOCK();
+    memset(sites, 0, num_sites * sizeof(heap_profile_site_t));
+    memset(blocks, 0, num_blocks * sizeof(heap_profile_block_t));
+    used_sites = 0;
+    used_blocks = 0;
+    memset(&other_site, 0, sizeof(other_site));
+    untracked_count = 0;
+    profiling = true;
+    PROFILE_UNLOCK();
+    return ESP_OK;
+}
+
+esp_err_t heap_profile_stop(void)
+{
+    if (!profiling) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    profiling = false;
+    return ESP_OK;
+}
+
+/* Index in [0, n) from a 32-bit hash, works for any table size */
+static inline IRAM_ATTR size_t hash_index(uint32_t key, size_t n)
+{
+    uint32_t hash = key * 2654435761U;
+    return ((uint64_t)hash * n) >> 32;
+}
+
+static inline IRAM_ATTR size_t site_home(void *caller, uint32_t caps)
+{
+    return hash_index(((uint32_t)(intptr_t)caller >> 1) ^ (caps * 0x9E3779B1U), num_sites);
+}
+
+static inline IRAM_ATTR size_t block_home(void *p)
+{
+    return hash_index((uint32_t)(intptr_t)p >> 2, num_blocks);
+}
+
+static inline IRAM_ATTR heap_profile_site_t *get_site(uint32_t idx)
+{
+    return (idx == OTHER_SITE) ? &other_site : &sites[idx];
+}
+
+/* Find the entry of (caller, caps), adding it if there is room. Called with the lock held. */
+static IRAM_ATTR uint32_t find_site(void *caller, uint32_t caps)
+{
+    size_t i = site_home(caller, caps);
+    while (sites[i].alloc_count != 0) {
+        if (sites[i].caller == caller && sites[i].caps == caps) {
+            return i;
+        }
+        i = (i + 1 < num_sites) ? i + 1 : 0;
+    }
+    if (used_sites >= num_sites * 3 / 4) {
+        return OTHER_SITE;
+    }
+    /* the caller sets alloc_count, which marks the entry as used */
+    used_sites++;
+    sites[i].caller = caller;
+    sites[i].caps = caps;
+    return i;
+}
+
+/* Find the entry of the live allocation at 'p'. Called with the lock held. */
+static IRAM_ATTR heap_profile_block_t *find_block(void *p)
+{
+    size_t i = block_home(p);
+    while (blocks[i].address != NULL) {
+        if (blocks[i].address == p) {
+            return &blocks[i];
+        }
+        i = (i + 1 < num_blocks) ? i + 1 : 0;
+    }
+    return NULL;
+}
+
+/* Remove the entry of a live allocation, moving back the entries after it so that they can still be found */
+static IRAM_ATTR void remove_block(heap_profile_block_t *block)
+{
+    size_t hole = block - blocks;
+    size_t i = hole;
+    while (true) {
+        i = (i + 1 < num_blocks) ? i + 1 : 0;
+        if (blocks[i].address == NULL) {
+            break;
+        }
+        size_t home = block_home(blocks[i].address);
+        /* the entry can move to the hole if its home isn't between the hole and it (cyclically) */
+        bool stays = (hole <= i) ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (!stays) {
+            blocks[hole] = blocks[i];
+            hole = i;
+        }
+    }
+    blocks[hole].address = NULL;
+    used_blocks--;
+}
+
+/* Count the allocation of 'block' as freed, and remove it. Called with the lock held. */
+static IRAM_ATTR void free_block(heap_profile_block_t *block)
+{
+    heap_profile_site_t *site = get_site(block->site);
+    site->live_bytes -= block->size;
+    site->live_count--;
+    site->free_count++;
+    remove_block(block);
+}
+
+IRAM_ATTR void heap_profile_record_alloc(void *p, size_t size, uint32_t caps, void *caller)
+{
+    if (!profiling || p == NULL) {
+        return;
+    }
+
+    PROFILE_LOCK();
+    if (profiling) {
+        uint32_t idx = find_site(caller, caps);
+        heap_profile_site_t *site = get_site(idx);
+        site->alloc_count++;
+        site->alloc_bytes += size;
+
+        /* A free which wasn't traced leaves a stale entry at this address */
+        heap_profile_block_t *block = find_block(p);
+        if (block != NULL) {
+            free_block(block);
+        }
+
+        if (used_blocks < num_blocks * 3 / 4) {
+            size_t i = block_home(p);
+            while (blocks[i].address != NULL) {
+                i = (i + 1 < num_blocks) ? i + 1 : 0;
+            }
+            blocks[i].address = p;
+            blocks[i].size = size;
+            blocks[i].site = idx;
+            used_blocks++;
+            site->live_bytes += size;
+            site->live_count++;
+        } else {
+            untracked_count++;
+        }
+    }
+    PROFILE_UNLOCK();
+}
+
+IRAM_ATTR void heap_profile_record_free(void *p)
+{
+    if (!profiling || p == NULL) {
+        return;
+    }
+
+    PROFILE_LOCK();
+    if (profiling) {
+        heap_profile_block_t *block = find_block(p);
+        if (block != NULL) {
+            free_block(block);
+        }
+    }
+    PROFILE_UNLOCK();
+}
+
+static int compare_sites(const void *a, const void *b)
+{
+    const heap_profile_site_t *sa = a, *sb = b;
+    if (sa->caller != sb->caller) {
+        return ((uintptr_t)sa->caller < (uintptr_t)sb->caller) ? -1 : 1;
+    }
+    if (sa->caps != sb->caps) {
+        return (sa->caps < sb->caps) ? -1 : 1;
+    }
+    return 0;
+}
+
+esp_err_t heap_profile_snapshot(heap_profile_snapshot_t *snapshot)
+{
+    if (snapshot == NULL || snapshot->sites == NULL || snapshot->max_sites == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t result = ESP_OK;
+    size_t n = 0;
+
+    PROFILE_LOCK();
+    snapshot->time_us = PROFILE_TIME_US();
+    snapshot->untracked_count = untracked_count;
+    if (other_site.alloc_count != 0) {
+        snapshot->sites[n++] = other_site;
+    }
+    for (size_t i = 0; i < num_sites; i++) {
+        if (sites[i].alloc_count == 0) {
+            continue;
+        }
+        if (n == snapshot->max_sites) {
+            result = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+        snapshot->sites[n++] = sites[i];
+    }
+    PROFILE_UNLOCK();
+
+    /* Sorted, so that heap_profile_diff() can match the sites of two snapshots in one pass */
+    qsort(snapshot->sites, n, sizeof(heap_profile_site_t), compare_sites);
+    snapshot->num_sites = n;
+    return result;
+}
+
+/* Insert 'diff' in the array sorted by decreasing alloc_count, dropping the last entry if the array is full */
+static size_t insert_diff(heap_profile_diff_t *diffs, size_t num_diffs, size_t max_diffs, const heap_profile_diff_t *diff)
+{
+    size_t i = num_diffs;
+    if (num_diffs == max_diffs) {
+        if (max_diffs == 0 || diffs[max_diffs - 1].alloc_count >= diff->alloc_count) {
+            return num_diffs;
+        }
+        i = max_diffs - 1;
+    } else {
+        num_diffs++;
+    }
+    while (i > 0 && diffs[i - 1].alloc_count < diff->alloc_count) {
+        diffs[i] = diffs[i - 1];
+        i--;
+    }
+    diffs[i] = *diff;
+    return num_diffs;
+}
+
+size_t heap_profile_diff(const heap_profile_snapshot_t *before, const heap_profile_snapshot_t *after,
+                         heap_profile_diff_t *diffs, size_t max_diffs)
+{
+    static const heap_profile_site_t empty_site;
+    size_t num_diffs = 0;
+    size_t b = 0, a = 0;
+
+    /* Both arrays are sorted, walk them together */
+    while (b < before->num_sites || a < after->num_sites) {
+        const heap_profile_site_t *sb = &empty_site;
+        const heap_profile_site_t *sa = &empty_site;
+        int order;
+        if (b == before->num_sites) {
+            order = 1;
+        } else if (a == after->num_sites) {
+            order = -1;
+        } else {
+            order = compare_sites(&before->sites[b], &after->sites[a]);
+        }
+        if (order <= 0) {
+            sb = &before->sites[b++];
+        }
+        if (order >= 0) {
+            sa = &after->sites[a++];
+        }
+
+        heap_profile_diff_t diff = {
+            .caller = (order <= 0) ? sb->caller : sa->caller,
+            .caps = (order <= 0) ? sb->caps : sa->caps,
+            .alloc_count = sa->alloc_count - sb->alloc_count,
+            .free_count = sa->free_count - sb->free_count,
+            .alloc_bytes = sa->alloc_bytes - sb->alloc_bytes,
+            .live_bytes = (int32_t)(sa->live_bytes - sb->live_bytes),
+            .live_count = (int32_t)(sa->live_count - sb->live_count),
+        };
+        if (diff.alloc_count != 0 || diff.free_count != 0) {
+            num_diffs = insert_diff(diffs, num_diffs, max_diffs, &diff);
+        }
+    }
+    return num_diffs;
+}
@@ -19,6 +19,7 @@
 #undef HEAP_TRACE_SRCFILE
 
 #include "esp_attr.h"
+#include "esp_heap_caps.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
@@ -31,11 +32,39 @@ static portMUX_TYPE trace_mux = portMUX_INITIALIZER_UNLOCKED;
 static bool tracing;
 static heap_trace_mode_t mode;
 
-/* Buffer used for records, starting at offset 0
+/* Buffer used for records, provided by the application.
+
+   Records are not moved once written. Each record in use is on a list in allocation order, records freed in
+   HEAP_TRACE_LEAKS mode go on a list of unused records to be reused, and the oldest record is only dropped
+   when no record is unused. An index of records by address makes finding the record of a free fast.
+
+   The lists and index are kept in 'links' and 'hash_buckets', allocated by heap_trace_init_standalone(),
+   so that adding and removing a record takes constant time.
 */
 static heap_trace_record_t *buffer;
 static size_t total_records;
 
+typedef uint16_t record_idx_t;
+#define NO_RECORD ((record_idx_t)0xFFFF)
+
+typedef struct {
+    record_idx_t prev;       // previous record in allocation order
+    record_idx_t next;       // next record in allocation order, or next unused record
+    record_idx_t hash_next;  // next record in the same hash bucket
+} record_link_t;
+
+static record_link_t *links;
+static record_idx_t *hash_buckets;
+static uint32_t hash_bits;
+
+/* Oldest and newest records in use, and first unused record */
+static record_idx_t oldest, newest, unused;
+
+/* Last record returned by heap_trace_get(), so reading all records in order doesn't walk the list each time.
+   Cleared whenever a record is removed. */
+static size_t cursor_index;
+static record_idx_t cursor;
+
 /* Count of entries logged in the buffer.
 
    Maximum total_records
@@ -56,12 +85,58 @@ esp_err_t heap_trace_init_standalone(heap_trace_record_t *record_buffer, size_t
     if (tracing) {
         return ESP_ERR_INVALID_STATE;
     }
+    if (num_records >= NO_RECORD) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Tracing is stopped, so these allocations aren't traced */
+    heap_caps_free(links);
+    heap_caps_free(hash_buckets);
+    links = NULL;
+    hash_buckets = NULL;
+    buffer = NULL;
+    total_records = 0;
+
+    if (record_buffer == NULL || num_records == 0) {
+        return ESP_OK;
+    }
+
+    hash_bits = 1;
+    while ((1U << hash_bits) < num_records) {
+        hash_bits++;
+    }
+    /* Must be accessible with the cache disabled, like the records */
+    links = heap_caps_malloc(num_records * sizeof(record_link_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    hash_buckets = heap_caps_malloc((1U << hash_bits) * sizeof(record_idx_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (links == NULL || hash_buckets == NULL) {
+        heap_caps_free(links);
+        heap_caps_free(hash_buckets);
+        links = NULL;
+        hash_buckets = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
     buffer = record_buffer;
     total_records = num_records;
     memset(buffer, 0, num_records * sizeof(heap_trace_record_t));
     return ESP_OK;
 }
 
+/* Empty the buffer and the address index. Called with trace_mux held. */
+static void clear_records(void)
+{
+    memset(buffer, 0, total_records * sizeof(heap_trace_record_t));
+    for (size_t i = 0; i < total_records; i++) {
+        links[i].next = (i + 1 < total_records) ? i + 1 : NO_RECORD;
+    }
+    memset(hash_buckets, 0xFF, (1U << hash_bits) * sizeof(record_idx_t));
+    unused = 0;
+    oldest = NO_RECORD;
+    newest = NO_RECORD;
+    cursor = NO_RECORD;
+    count = 0;
+}
+
 esp_err_t heap_trace_start(heap_trace_mode_t mode_param)
 {
     if (buffer == NULL || total_records == 0) {
@@ -72,7 +147,7 @@ esp_err_t heap_trace_start(heap_trace_mode_t mode_param)
 
     tracing = false;
     mode = mode_param;
-    count = 0;
+    clear_records();
     total_allocations = 0;
     total_frees = 0;
     has_overflowed = false;
@@ -117,7 +192,16 @@ esp_err_t heap_trace_get(size_t index, heap_trace_record_t *record)
     if (index >= count) {
         result = ESP_ERR_INVALID_ARG; /* out of range for 'count' */
     } else {
-        memcpy(record, &buffer[index], sizeof(heap_trace_record_t));
+        /* Walk from the cursor if it's before 'index', otherwise from the oldest record */
+        if (cursor == NO_RECORD || cursor_index > index) {
+            cursor = oldest;
+            cursor_index = 0;
+        }
+        while (cursor_index < index) {
+            cursor = links[cursor].next;
+            cursor_index++;
+        }
+        memcpy(record, &buffer[cursor], sizeof(heap_trace_record_t));
     }
     portEXIT_CRITICAL(&trace_mux);
     return result;
@@ -132,7 +216,11 @@ void heap_trace_dump(void)
            count, total_records);
     size_t start_count = count;
     for (int i = 0; i < count; i++) {
-        heap_trace_record_t *rec = &buffer[i];
+        heap_trace_record_t rec_copy;
+        heap_trace_record_t *rec = &rec_copy;
+        if (heap_trace_get(i, rec) != ESP_OK) {
+            break;
+        }
 
         if (rec->address != NULL) {
             printf("%d bytes (@ %p) allocated CPU %d ccount 0x%08x caller ",
@@ -170,6 +258,56 @@ void heap_trace_dump(void)
     }
 }
 
+static inline IRAM_ATTR uint32_t hash_address(void *p)
+{
+    /* Fibonacci hashing, allocations are at least 4 byte aligned */
+    return ((uint32_t)(intptr_t)p >> 2) * 2654435761U >> (32 - hash_bits);
+}
+
+static IRAM_ATTR void hash_insert(record_idx_t idx)
+{
+    record_idx_t *bucket = &hash_buckets[hash_address(buffer[idx].address)];
+    links[idx].hash_next = *bucket;
+    *bucket = idx;
+}
+
+/* Remove the record at 'idx' from the address index, or the newest record of 'p' if 'idx' is NO_RECORD.
+   Returns the record removed, or NO_RECORD if it wasn't in the index. */
+static IRAM_ATTR record_idx_t hash_remove(void *p, record_idx_t idx)
+{
+    record_idx_t *prev = &hash_buckets[hash_address(p)];
+    for (record_idx_t i = *prev; i != NO_RECORD; i = *prev) {
+        if (i == idx || (idx == NO_RECORD && buffer[i].address == p)) {
+            *prev = links[i].hash_next;
+            return i;
+        }
+        prev = &links[i].hash_next;
+    }
+    return NO_RECORD;
+}
+
+/* Remove the record at 'idx' from the list of records in use, and put it on the list of unused records */
+static IRAM_ATTR void remove_record(record_idx_t idx)
+{
+    record_link_t *link = &links[idx];
+    if (link->prev != NO_RECORD) {
+        links[link->prev].next = link->next;
+    } else {
+        oldest = link->next;
+    }
+    if (link->next != NO_RECORD) {
+        links[link->next].prev = link->prev;
+    } else {
+        newest = link->prev;
+    }
+    // zero the record out to avoid ambiguity
+    memset(&buffer[idx], 0, sizeof(heap_trace_record_t));
+    link->next = unused;
+    unused = idx;
+    cursor = NO_RECORD;
+    count--;
+}
+
 /* Add a new allocation to the heap trace records */
 static IRAM_ATTR void record_allocation(const heap_trace_record_t *record)
 {
@@ -179,29 +317,33 @@ static IRAM_ATTR void record_allocation(const heap_trace_record_t *record)
 
     portENTER_CRITICAL(&trace_mux);
     if (tracing) {
-        if (count == total_records) {
+        if (unused == NO_RECORD) {
+            /* Drop the oldest record. In HEAP_TRACE_ALL mode it may be a freed allocation, which is
+               already out of the address index. */
             has_overflowed = true;
-            /* Move the whole buffer back one slot.
-
-               This is a bit slow, compared to treating this buffer as a ringbuffer and rotating a head pointer.
-
-               However, ringbuffer code gets tricky when we remove elements in mid-buffer (for leak trace mode) while
-               trying to keep track of an item count that may overflow.
-            */
-            memmove(&buffer[0], &buffer[1], sizeof(heap_trace_record_t) * (total_records -1));
-            count--;
+            hash_remove(buffer[oldest].address, oldest);
+            remove_record(oldest);
+        }
+        record_idx_t idx = unused;
+        unused = links[idx].next;
+
+        // Copy new record into place, as the newest record
+        memcpy(&buffer[idx], record, sizeof(heap_trace_record_t));
+        links[idx].prev = newest;
+        links[idx].next = NO_RECORD;
+        if (newest != NO_RECORD) {
+            links[newest].next = idx;
+        } else {
+            oldest = idx;
         }
-        // Copy new record into place
-        memcpy(&buffer[count], record, sizeof(heap_trace_record_t));
+        newest = idx;
+        hash_insert(idx);
         count++;
         total_allocations++;
     }
     portEXIT_CRITICAL(&trace_mux);
 }
 
-// remove a record, used when freeing
-static void remove_record(int index);
-
 /* record a free event in the heap trace log
 
    For HEAP_TRACE_ALL, this means filling in the freed_by pointer.
@@ -216,40 +358,21 @@ static IRAM_ATTR void record_free(void *p, void **callers)
     portENTER_CRITICAL(&trace_mux);
     if (tracing && count > 0) {
         total_frees++;
-        /* search backwards for the allocation record matching this free */
-        int i;
-        for (i = count - 1; i >= 0; i--) {
-            if (buffer[i].address == p) {
-                break;
-            }
-        }
+        /* find the newest allocation record matching this free */
+        record_idx_t idx = hash_remove(p, NO_RECORD);
 
-        if (i >= 0) {
+        if (idx != NO_RECORD) {
             if (mode == HEAP_TRACE_ALL) {
-                memcpy(buffer[i].freed_by, callers, sizeof(void *) * STACK_DEPTH);
+                memcpy(buffer[idx].freed_by, callers, sizeof(void *) * STACK_DEPTH);
             } else { // HEAP_TRACE_LEAKS
                 // Leak trace mode, once an allocation is freed we remove it from the list
-                remove_record(i);
+                remove_record(idx);
             }
         }
     }
     portEXIT_CRITICAL(&trace_mux);
 }
 
-/* remove the entry at 'index' from the ringbuffer of saved records */
-static IRAM_ATTR void remove_record(int index)
-{
-    if (index < count - 1) {
-        // Remove the buffer entry from the list
-        memmove(&buffer[index], &buffer[index+1],
-                sizeof(heap_trace_record_t) * (total_records - index - 1));
-    } else {
-        // For last element, just zero it out to avoid ambiguity
-        memset(&buffer[index], 0, sizeof(heap_trace_record_t));
-    }
-    count--;
-}
-
 #include "heap_trace.inc"
 
 #endif /*CONFIG_HEAP_TRACING_STANDALONE*/
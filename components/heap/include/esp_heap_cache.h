@@ -0,0 +1,74 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "sdkconfig.h"
+
+#ifdef CONFIG_HEAP_CACHE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Size classes of the small object cache. Class i serves allocations of
+ * up to (i + 1) * HEAP_CACHE_CLASS_GRANULARITY bytes.
+ */
+#define HEAP_CACHE_CLASS_GRANULARITY 16
+#define HEAP_CACHE_CLASSES 4
+#define HEAP_CACHE_MAX_SIZE (HEAP_CACHE_CLASSES * HEAP_CACHE_CLASS_GRANULARITY)
+
+/** @brief Statistics of one size class of the small object cache, summed over all CPU cores */
+typedef struct {
+    size_t size;                ///< Largest allocation served by this class, in bytes
+    uint32_t alloc_hits;        ///< Allocations served from objects already in the cache
+    uint32_t alloc_misses;      ///< Allocations which refilled the cache from the heap
+    uint32_t free_hits;         ///< Frees which kept the object in the cache
+    uint32_t free_misses;       ///< Frees which returned part of a full cache to the heap
+    size_t cached;              ///< Number of free objects currently held by the cache
+} heap_caps_cache_stats_t;
+
+/**
+ * @brief Get the statistics of the small object cache
+ *
+ * The allocation hit rate of a class is alloc_hits / (alloc_hits + alloc_misses).
+ *
+ * @param stats Array to fill, one entry per size class
+ * @param num_classes Number of entries in the array
+ *
+ * @return Number of entries filled, at most HEAP_CACHE_CLASSES
+ */
+size_t heap_caps_cache_get_stats(heap_caps_cache_stats_t *stats, size_t num_classes);
+
+/**
+ * @brief Reset the hit and miss counters of the small object cache
+ */
+void heap_caps_cache_reset_stats(void);
+
+/**
+ * @brief Return all objects held by the small object cache to their heaps
+ *
+ * Objects held by the cache are counted as allocated by heap_caps_get_free_size()
+ * and heap_caps_get_info(). Flush the cache first to get figures which only count
+ * memory in use by the application.
+ */
+void heap_caps_cache_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONFIG_HEAP_CACHE
@@ -0,0 +1,166 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Allocation counts of one call site, for one set of capabilities
+ *
+ * The call site is the first return address recorded by heap tracing, ie the code which called malloc(),
+ * heap_caps_malloc(), etc.
+ */
+typedef struct {
+    void *caller;           ///< Address of the caller, NULL for the entry counting the allocations of all call sites which didn't fit in the table
+    uint32_t caps;          ///< Capabilities requested, MALLOC_CAP_DEFAULT for malloc(). 0 for the entry counting the call sites which didn't fit.
+    uint32_t alloc_count;   ///< Number of allocations made since profiling started
+    uint32_t free_count;    ///< Number of these allocations which were freed
+    uint64_t alloc_bytes;   ///< Total bytes allocated since profiling started
+    size_t live_bytes;      ///< Bytes allocated and not freed yet
+    size_t live_count;      ///< Number of allocations not freed yet
+} heap_profile_site_t;
+
+/**
+ * @brief An allocation followed by the profiler, so that it can be counted as freed. Contents are private.
+ */
+typedef struct {
+    void *address;
+    size_t size;
+    uint32_t site;
+} heap_profile_block_t;
+
+/**
+ * @brief Copy of the allocation counts at one point in time
+ */
+typedef struct {
+    int64_t time_us;                ///< Time the snapshot was taken, in microseconds
+    uint32_t untracked_count;       ///< Allocations not counted in live_bytes and live_count, as the table of live allocations was full
+    size_t num_sites;               ///< Number of entries filled in 'sites'
+    size_t max_sites;               ///< Capacity of the 'sites' array, set by the caller
+    heap_profile_site_t *sites;     ///< Array to fill with the call sites, set by the caller. Sorted by caller and caps.
+} heap_profile_snapshot_t;
+
+/**
+ * @brief Change of the allocation counts of one call site between two snapshots
+ */
+typedef struct {
+    void *caller;           ///< Address of the caller, as in heap_profile_site_t
+    uint32_t caps;          ///< Capabilities requested, as in heap_profile_site_t
+    uint32_t alloc_count;   ///< Number of allocations made between the snapshots
+    uint32_t free_count;    ///< Number of allocations freed between the snapshots
+    uint64_t alloc_bytes;   ///< Bytes allocated between the snapshots
+    int32_t live_bytes;     ///< Change of the bytes allocated and not freed
+    int32_t live_count;     ///< Change of the number of allocations not freed
+} heap_profile_diff_t;
+
+/**
+ * @brief Initialise the allocation profiler
+ *
+ * The profiler counts allocations made through the heap tracing wrappers of malloc(), heap_caps_malloc(), etc,
+ * for each call site and set of capabilities. It only uses the memory provided here, which must be in internal
+ * memory and remain valid while profiling.
+ *
+ * Up to 3/4 of num_sites call sites (rounded down) are counted separately. Allocations made by further call
+ * sites are counted together, in an entry with a NULL caller. Up to 3/4 of num_blocks allocations are followed
+ * until they are freed, further allocations are counted in the untracked count of snapshots instead of in live
+ * bytes.
+ *
+ * To release the memory, stop profiling and then call heap_profile_init(NULL, 0, NULL, 0).
+ *
+ * @param sites Array used to count allocations per call site
+ * @param num_sites Number of entries in 'sites'
+ * @param blocks Array used to follow allocations until they are freed
+ * @param num_blocks Number of entries in 'blocks'
+ * @return
+ *  - ESP_ERR_INVALID_STATE Profiling is in progress.
+ *  - ESP_ERR_INVALID_ARG One of the arrays is missing or too small.
+ *  - ESP_OK Profiler initialised successfully.
+ */
+esp_err_t heap_profile_init(heap_profile_site_t *sites, size_t num_sites, heap_profile_block_t *blocks, size_t num_blocks);
+
+/**
+ * @brief Start profiling. Clears all counts.
+ *
+ * Allocations made before profiling started are not counted when they are freed.
+ *
+ * @return
+ *  - ESP_ERR_INVALID_STATE heap_profile_init() wasn't called with valid arrays.
+ *  - ESP_OK Profiling started.
+ */
+esp_err_t heap_profile_start(void);
+
+/**
+ * @brief Stop profiling. The counts are kept until profiling starts again.
+ *
+ * @return
+ *  - ESP_ERR_INVALID_STATE Profiling wasn't running.
+ *  - ESP_OK Profiling stopped.
+ */
+esp_err_t heap_profile_stop(void);
+
+/**
+ * @brief Take a snapshot of the allocation counts
+ *
+ * Can be called while profiling is running.
+ *
+ * @param snapshot Snapshot to fill. 'sites' and 'max_sites' must be set by the caller.
+ * @return
+ *  - ESP_ERR_INVALID_ARG The snapshot has no array of sites.
+ *  - ESP_ERR_INVALID_SIZE There were more call sites than max_sites, the snapshot only has max_sites of them.
+ *  - ESP_OK Snapshot taken.
+ */
+esp_err_t heap_profile_snapshot(heap_profile_snapshot_t *snapshot);
+
+/**
+ * @brief Find the call sites whose counts changed between two snapshots
+ *
+ * The call sites which made the most allocations come first. The allocation rate of a call site, in allocations
+ * per second, is alloc_count * 1000000 / (after->time_us - before->time_us).
+ *
+ * @param before Snapshot taken first
+ * @param after Snapshot taken later, during the same profiling run
+ * @param diffs Array to fill with the changes
+ * @param max_diffs Number of entries in 'diffs'. If more call sites changed, the ones which made the fewest
+ *                  allocations are left out.
+ * @return Number of entries filled in 'diffs'
+ */
+size_t heap_profile_diff(const heap_profile_snapshot_t *before, const heap_profile_snapshot_t *after,
+                         heap_profile_diff_t *diffs, size_t max_diffs);
+
+/**
+ * @brief Count an allocation. Called by the heap tracing wrappers.
+ *
+ * @param p Address allocated, or NULL if the allocation failed
+ * @param size Size requested
+ * @param caps Capabilities requested
+ * @param caller Address of the caller
+ */
+void heap_profile_record_alloc(void *p, size_t size, uint32_t caps, void *caller);
+
+/**
+ * @brief Count a free. Called by the heap tracing wrappers.
+ *
+ * @param p Address freed
+ */
+void heap_profile_record_free(void *p);
+
+#ifdef __cplusplus
+}
+#endif
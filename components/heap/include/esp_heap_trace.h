@@ -54,10 +54,13 @@ typedef struct {
  *
  * @param record_buffer Provide a buffer to use for heap trace data. Must remain valid any time heap tracing is enabled, meaning
  * it must be allocated from internal memory not in PSRAM.
- * @param num_records Size of the heap trace buffer, as number of record structures.
+ * @param num_records Size of the heap trace buffer, as number of record structures. At most 65534.
+ * An index of the records, about 8 bytes per record, is also allocated from internal memory.
  * @return
  *  - ESP_ERR_NOT_SUPPORTED Project was compiled without heap tracing enabled in menuconfig.
  *  - ESP_ERR_INVALID_STATE Heap tracing is currently in progress.
+ *  - ESP_ERR_INVALID_ARG num_records is too large.
+ *  - ESP_ERR_NO_MEM Not enough free internal memory for the index of the records.
  *  - ESP_OK Heap tracing initialised successfully.
  */
 esp_err_t heap_trace_init_standalone(heap_trace_record_t *record_buffer, size_t num_records);
@@ -0,0 +1,819 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <multi_heap.h>
+#include "multi_heap_internal.h"
+
+/* Note: Keep platform-specific parts in this header, this source
+   file should depend on libc only */
+#include "multi_heap_platform.h"
+
+/* Defines compile-time configuration macros */
+#include "multi_heap_config.h"
+
+#ifdef MULTI_HEAP_TLSF
+
+/* Two-Level Segregated Fit implementation of the multi_heap "_impl" functions.
+
+   Free blocks are kept in segregated lists, one per size class. The first level splits sizes by powers of two, the
+   second level splits each power of two range linearly into 2^sl_log2 classes. A bitmap of non-empty lists at each
+   level lets malloc find the smallest suitable class with two "find first set" operations, and boundary tags let free
+   merge a block with both of its neighbours, so malloc and free do not depend on the number of blocks in the heap.
+
+   This is a good fit rather than a best fit: malloc takes the first block of the first non-empty class that only
+   contains large enough blocks, so a block can be split even if a better sized one is free in another list.
+*/
+
+#ifndef MULTI_HEAP_POISONING
+/* if no heap poisoning, public API aliases directly to these implementations */
+void *multi_heap_malloc(multi_heap_handle_t heap, size_t size)
+    __attribute__((alias("multi_heap_malloc_impl")));
+
+void multi_heap_free(multi_heap_handle_t heap, void *p)
+    __attribute__((alias("multi_heap_free_impl")));
+
+void *multi_heap_realloc(multi_heap_handle_t heap, void *p, size_t size)
+    __attribute__((alias("multi_heap_realloc_impl")));
+
+size_t multi_heap_get_allocated_size(multi_heap_handle_t heap, void *p)
+    __attribute__((alias("multi_heap_get_allocated_size_impl")));
+
+multi_heap_handle_t multi_heap_register(void *start, size_t size)
+    __attribute__((alias("multi_heap_register_impl")));
+
+void multi_heap_get_info(multi_heap_handle_t heap, multi_heap_info_t *info)
+    __attribute__((alias("multi_heap_get_info_impl")));
+
+size_t multi_heap_free_size(multi_heap_handle_t heap)
+    __attribute__((alias("multi_heap_free_size_impl")));
+
+size_t multi_heap_minimum_free_size(multi_heap_handle_t heap)
+    __attribute__((alias("multi_heap_minimum_free_size_impl")));
+
+void *multi_heap_get_block_address(multi_heap_block_handle_t block)
+    __attribute__((alias("multi_heap_get_block_address_impl")));
+
+void *multi_heap_get_block_owner(multi_heap_block_handle_t block)
+{
+    return NULL;
+}
+
+#endif
+
+#define ALIGN(X) ((X) & ~(sizeof(void *)-1))
+#define ALIGN_UP(X) ALIGN((X)+sizeof(void *)-1)
+
+/* Block in the heap
+
+   'header' holds the data size of the block ORed with two flags: whether this block is free, and whether the
+   previous block in the heap is free.
+
+   'prev_phys' is a pointer to the previous block in the heap. It is stored in the last word of the previous block's
+   data, so it is only valid if the previous block is free (BLOCK_PREV_FREE_FLAG is set.)
+
+   'next_free' and 'prev_free' link the block into the free list of its size class, valid if the block is free.
+*/
+typedef struct heap_block {
+    struct heap_block *prev_phys;         /* Previous block in heap, valid if previous block is free */
+    size_t header;                        /* Data size of this block, ORed with flags */
+    union {
+        uint8_t data[1];                  /* First byte of data, valid if block is used. Actual size of data is 'block_data_size(block)' */
+        struct {
+            struct heap_block *next_free; /* Next block in the same free list, valid if block is free */
+            struct heap_block *prev_free; /* Previous block in the same free list, valid if block is free */
+        };
+    };
+} heap_block_t;
+
+/* These masks apply to the 'header' field of heap_block_t */
+#define BLOCK_FREE_FLAG 0x1      /* If set, this block is free & next_free, prev_free pointers are valid */
+#define BLOCK_PREV_FREE_FLAG 0x2 /* If set, the previous block is free & prev_phys pointer is valid */
+#define BLOCK_SIZE_MASK (~(size_t)3)
+
+/* Bytes added to each block data size: the 'header' field. (prev_phys is part of the previous block's data.) */
+#define BLOCK_OVERHEAD (sizeof(size_t))
+
+/* A free block needs room for the free list pointers, and for 'prev_phys' of the following block */
+#define MIN_BLOCK_SIZE (sizeof(heap_block_t) - BLOCK_OVERHEAD)
+
+/* Smallest space for blocks in a heap: one free block of minimum size and the last block */
+#define MIN_HEAP_BLOCKS_SIZE (BLOCK_OVERHEAD + MIN_BLOCK_SIZE + BLOCK_OVERHEAD)
+
+/* Size classes. Second level index is log2 of the number of classes per power of two. It is chosen for each heap at
+   registration, so that the free list table stays small compared to the heap size.
+*/
+#define SL_LOG2_MAX 4
+#define ALIGN_LOG2 ((sizeof(void *) == 8) ? 3 : 2)
+
+/* Number of blocks checked in the free list of the requested size class itself, when no larger class has a free
+   block. Keeps malloc bounded in time on a nearly full heap. */
+#define FALLBACK_SEARCH_BLOCKS 4
+
+/* Metadata header for the heap, stored at the beginning of heap space.
+
+   The free list heads and second level bitmaps follow this structure, their sizes depend on the heap size.
+
+   'last_block' is a block of length 0 at the end of the heap. It is always marked used, so it is never merged into
+   the block before it.
+ */
+typedef struct multi_heap_info {
+    void *lock;
+    size_t free_bytes;
+    size_t minimum_free_bytes;
+    heap_block_t *first_block;
+    heap_block_t *last_block;
+    uint32_t fl_bitmap;        /* Bit N set if any list of first level class N is not empty */
+    uint8_t fl_count;          /* Number of first level classes */
+    uint8_t sl_log2;           /* log2 of the number of second level classes */
+    heap_block_t *free_lists[]; /* fl_count << sl_log2 list heads, followed by fl_count second level bitmaps */
+} heap_t;
+
+static inline int fls_size(size_t x)
+{
+    return (int)(sizeof(unsigned long) * 8 - 1) - __builtin_clzl((unsigned long)x);
+}
+
+/* Given a pointer to the 'data' field of a block (ie the previous malloc/realloc result), return a pointer to the
+   containing block.
+*/
+static inline heap_block_t *get_block(const void *data_ptr)
+{
+    return (heap_block_t *)((char *)data_ptr - offsetof(heap_block_t, data));
+}
+
+/* Data size of the block (excludes this block's header) */
+static inline size_t block_data_size(const heap_block_t *block)
+{
+    return block->header & BLOCK_SIZE_MASK;
+}
+
+static inline void set_block_data_size(heap_block_t *block, size_t size)
+{
+    block->header = size | (block->header & ~BLOCK_SIZE_MASK);
+}
+
+/* Return true if this block is free. */
+static inline bool is_free(const heap_block_t *block)
+{
+    return block->header & BLOCK_FREE_FLAG;
+}
+
+static inline bool is_prev_free(const heap_block_t *block)
+{
+    return block->header & BLOCK_PREV_FREE_FLAG;
+}
+
+/* Return true if this block is the last_block in the heap */
+static inline bool is_last_block(const heap_t *heap, const heap_block_t *block)
+{
+    return block == heap->last_block;
+}
+
+/* Return the next sequential block in the heap. Must not be called for last_block. */
+static inline heap_block_t *get_next_block(const heap_block_t *block)
+{
+    return (heap_block_t *)(block->data + block_data_size(block) - sizeof(heap_block_t *));
+}
+
+/* Mark a block as free, and tell the following block about it */
+static inline void mark_free(heap_block_t *block)
+{
+    heap_block_t *next = get_next_block(block);
+    next->prev_phys = block;
+    next->header |= BLOCK_PREV_FREE_FLAG;
+    block->header |= BLOCK_FREE_FLAG;
+}
+
+static inline void mark_used(heap_block_t *block)
+{
+    heap_block_t *next = get_next_block(block);
+    next->header &= ~BLOCK_PREV_FREE_FLAG;
+    block->header &= ~BLOCK_FREE_FLAG;
+#ifdef MULTI_HEAP_POISONING_SLOW
+    /* next->prev_phys is now part of this block's data */
+    multi_heap_internal_poison_fill_region(&next->prev_phys, sizeof(next->prev_phys), true);
+#endif
+}
+
+/* Size classes below 2^(sl_log2 + ALIGN_LOG2) are linear, so that the second level index stays in range */
+static inline size_t small_block_size(const heap_t *heap)
+{
+    return (size_t)1 << (heap->sl_log2 + ALIGN_LOG2);
+}
+
+/* Size class holding blocks of 'size' bytes */
+static inline void mapping_insert(const heap_t *heap, size_t size, int *fl, int *sl)
+{
+    if (size < small_block_size(heap)) {
+        *fl = 0;
+        *sl = size >> ALIGN_LOG2;
+    } else {
+        int f = fls_size(size);
+        *sl = (size >> (f - heap->sl_log2)) ^ (1 << heap->sl_log2);
+        *fl = f - (heap->sl_log2 + ALIGN_LOG2) + 1;
+    }
+}
+
+/* Smallest size class in which all blocks hold at least 'size' bytes */
+static inline void mapping_search(const heap_t *heap, size_t size, int *fl, int *sl)
+{
+    if (size >= small_block_size(heap)) {
+        size += ((size_t)1 << (fls_size(size) - heap->sl_log2)) - 1;
+    }
+    mapping_insert(heap, size, fl, sl);
+}
+
+static inline heap_block_t **free_list(heap_t *heap, int fl, int sl)
+{
+    return &heap->free_lists[(fl << heap->sl_log2) + sl];
+}
+
+/* Bitmap of non-empty lists of first level class 'fl' */
+static inline uint16_t *sl_bitmap(heap_t *heap, int fl)
+{
+    return (uint16_t *)&heap->free_lists[heap->fl_count << heap->sl_log2] + fl;
+}
+
+static void insert_free_block(heap_t *heap, heap_block_t *block)
+{
+    int fl, sl;
+    mapping_insert(heap, block_data_size(block), &fl, &sl);
+    heap_block_t **head = free_list(heap, fl, sl);
+    block->next_free = *head;
+    block->prev_free = NULL;
+    if (*head != NULL) {
+        (*head)->prev_free = block;
+    }
+    *head = block;
+    heap->fl_bitmap |= 1U << fl;
+    *sl_bitmap(heap, fl) |= 1U << sl;
+}
+
+static void remove_free_block(heap_t *heap, heap_block_t *block)
+{
+    int fl, sl;
+    mapping_insert(heap, block_data_size(block), &fl, &sl);
+    heap_block_t **head = free_list(heap, fl, sl);
+    if (block->next_free != NULL) {
+        block->next_free->prev_free = block->prev_free;
+    }
+    if (block->prev_free != NULL) {
+        block->prev_free->next_free = block->next_free;
+    } else {
+        MULTI_HEAP_ASSERT(*head == block, head); // free block should be head of its list
+        *head = block->next_free;
+        if (*head == NULL) {
+            *sl_bitmap(heap, fl) &= ~(1U << sl);
+            if (*sl_bitmap(heap, fl) == 0) {
+                heap->fl_bitmap &= ~(1U << fl);
+            }
+        }
+    }
+}
+
+/* Find a free block of at least 'size' bytes, or NULL */
+static heap_block_t *find_free_block(heap_t *heap, size_t size)
+{
+    int fl, sl;
+    mapping_search(heap, size, &fl, &sl);
+    if (fl < heap->fl_count) {
+        uint32_t sl_map = *sl_bitmap(heap, fl) & (~0U << sl);
+        if (sl_map == 0) {
+            uint32_t fl_map = (fl + 1 < 32) ? heap->fl_bitmap & (~0U << (fl + 1)) : 0;
+            if (fl_map != 0) {
+                fl = __builtin_ctz(fl_map);
+                sl_map = *sl_bitmap(heap, fl);
+            }
+        }
+        if (sl_map != 0) {
+            sl = __builtin_ctz(sl_map);
+            return *free_list(heap, fl, sl);
+        }
+    }
+
+    /* Rounding the size up to the next class skips blocks in the class of 'size' itself,
+       some of which may still be large enough. Only check the first few blocks of that list,
+       and only when the heap is nearly exhausted, so malloc stays bounded in time. */
+    mapping_insert(heap, size, &fl, &sl);
+    if (fl >= heap->fl_count) {
+        return NULL;
+    }
+    heap_block_t *b = *free_list(heap, fl, sl);
+    for (int i = 0; i < FALLBACK_SEARCH_BLOCKS && b != NULL; i++, b = b->next_free) {
+        if (block_data_size(b) >= size) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/* Check a block is valid for this heap. Used to verify parameters. */
+static void assert_valid_block(const heap_t *heap, const heap_block_t *block)
+{
+    MULTI_HEAP_ASSERT(block >= heap->first_block && block < heap->last_block,
+                      block); // block not in heap
+    const heap_block_t *next = get_next_block(block);
+    MULTI_HEAP_ASSERT(next > block && next <= heap->last_block, block); // Next block not in heap
+}
+
+/* Merge free block 'b' into the preceding block 'a'. Neither block may be on a free list.
+
+   Resulting block has the free flag of 'a'.
+*/
+static heap_block_t *merge_adjacent(heap_t *heap, heap_block_t *a, heap_block_t *b)
+{
+    MULTI_HEAP_ASSERT(get_next_block(a) == b, a); // Blocks should be in order
+    MULTI_HEAP_ASSERT(!is_last_block(heap, b), b); // last block is never merged
+
+    set_block_data_size(a, block_data_size(a) + block_data_size(b) + BLOCK_OVERHEAD);
+    if (is_free(a)) {
+        /* b's header can be put into the pool of free bytes */
+        heap->free_bytes += BLOCK_OVERHEAD;
+    }
+
+#ifdef MULTI_HEAP_POISONING_SLOW
+    /* b's former block header (and the free list pointers) needs to be replaced with a fill pattern */
+    multi_heap_internal_poison_fill_region(b, sizeof(heap_block_t), is_free(a));
+#endif
+
+    return a;
+}
+
+/* Shrink used block 'block' to 'size' bytes of data, making any spare space into a new free block
+   (or adding it to the following free block.)
+*/
+static void split_if_necessary(heap_t *heap, heap_block_t *block, size_t size)
+{
+    const size_t block_size = block_data_size(block);
+    MULTI_HEAP_ASSERT(!is_free(block), block); // split block shouldn't be free
+    MULTI_HEAP_ASSERT(size <= block_size, block); // size should be valid
+
+    heap_block_t *next_block = get_next_block(block);
+    bool next_free = is_free(next_block);
+    size_t spare = block_size - size;
+
+    /* Can't split 'block' if we're not going to get a usable free block afterwards */
+    if (spare < sizeof(heap_block_t) && !(next_free && spare > 0)) {
+        return;
+    }
+
+    set_block_data_size(block, size);
+    heap_block_t *new_block = get_next_block(block);
+    new_block->header = (spare - BLOCK_OVERHEAD) | BLOCK_FREE_FLAG;
+    heap->free_bytes += spare - BLOCK_OVERHEAD;
+
+    if (next_free) {
+        /* The next block is free, extend it downwards */
+        remove_free_block(heap, next_block);
+        new_block = merge_adjacent(heap, new_block, next_block);
+    }
+    mark_free(new_block);
+    insert_free_block(heap, new_block);
+}
+
+void *multi_heap_get_block_address_impl(multi_heap_block_handle_t block)
+{
+    return ((char *)block + offsetof(heap_block_t, data));
+}
+
+size_t multi_heap_get_allocated_size_impl(multi_heap_handle_t heap, void *p)
+{
+    heap_block_t *pb = get_block(p);
+
+    assert_valid_block(heap, pb);
+    MULTI_HEAP_ASSERT(!is_free(pb), pb); // block shouldn't be free
+    return block_data_size(pb);
+}
+
+/* Size of the heap metadata, including free list table */
+static size_t heap_header_size(int fl_count, int sl_log2)
+{
+    return ALIGN_UP(sizeof(heap_t) + (fl_count << sl_log2) * sizeof(heap_block_t *) + fl_count * sizeof(uint16_t));
+}
+
+multi_heap_handle_t multi_heap_register_impl(void *start_ptr, size_t size)
+{
+    uintptr_t start = ALIGN_UP((uintptr_t)start_ptr);
+    uintptr_t end = ALIGN((uintptr_t)start_ptr + size);
+    heap_t *heap = (heap_t *)start;
+    size = end - start;
+
+    if (end < start || size < sizeof(heap_t) + MIN_HEAP_BLOCKS_SIZE) {
+        return NULL; /* 'size' is too small to fit a heap here */
+    }
+
+    /* Use as many second level classes as possible while the free list table takes at most 1/16 of the heap */
+    heap->sl_log2 = SL_LOG2_MAX + 1;
+    int fl, sl;
+    do {
+        heap->sl_log2--;
+        mapping_insert(heap, size, &fl, &sl);
+        heap->fl_count = fl + 1;
+    } while (heap->sl_log2 > 0 && heap_header_size(heap->fl_count, heap->sl_log2) > size / 16);
+
+    size_t header_size = heap_header_size(heap->fl_count, heap->sl_log2);
+    if (size < header_size + MIN_HEAP_BLOCKS_SIZE) {
+        return NULL;
+    }
+    heap->lock = NULL;
+    heap->fl_bitmap = 0;
+    memset(heap->free_lists, 0, header_size - sizeof(heap_t));
+
+    /* first block header goes after the heap structure, its prev_phys field overlaps the end of the structure
+       and is never used */
+    heap->first_block = (heap_block_t *)(start + header_size - offsetof(heap_block_t, header));
+    /* last block header is the last word of the heap, its prev_phys field is the end of the first block data */
+    heap->last_block = (heap_block_t *)(end - offsetof(heap_block_t, data));
+
+    heap_block_t *first_free_block = heap->first_block;
+    first_free_block->header = (uintptr_t)heap->last_block - (uintptr_t)first_free_block - BLOCK_OVERHEAD;
+    heap->last_block->header = 0;
+    mark_free(first_free_block);
+    insert_free_block(heap, first_free_block);
+
+    heap->free_bytes = block_data_size(first_free_block);
+    heap->minimum_free_bytes = heap->free_bytes;
+
+    return heap;
+}
+
+void multi_heap_set_lock(multi_heap_handle_t heap, void *lock)
+{
+    heap->lock = lock;
+}
+
+void inline multi_heap_internal_lock(multi_heap_handle_t heap)
+{
+    MULTI_HEAP_LOCK(heap->lock);
+}
+
+void inline multi_heap_internal_unlock(multi_heap_handle_t heap)
+{
+    MULTI_HEAP_UNLOCK(heap->lock);
+}
+
+multi_heap_block_handle_t multi_heap_get_first_block(multi_heap_handle_t heap)
+{
+    return heap->first_block;
+}
+
+multi_heap_block_handle_t multi_heap_get_next_block(multi_heap_handle_t heap, multi_heap_block_handle_t block)
+{
+    heap_block_t *next = get_next_block(block);
+    if (is_last_block(heap, next)) {
+        return NULL;
+    }
+    assert_valid_block(heap, next);
+    return next;
+}
+
+bool multi_heap_is_free(multi_heap_block_handle_t block)
+{
+    return is_free(block);
+}
+
+/* Data size to allocate for a request of 'size' bytes */
+static inline size_t adjust_size(size_t size)
+{
+    size = ALIGN_UP(size);
+    return (size < MIN_BLOCK_SIZE) ? MIN_BLOCK_SIZE : size;
+}
+
+void *multi_heap_malloc_impl(multi_heap_handle_t heap, size_t size)
+{
+    if (size == 0 || heap == NULL || size > SIZE_MAX - sizeof(heap_block_t)) {
+        return NULL;
+    }
+    size = adjust_size(size);
+
+    multi_heap_internal_lock(heap);
+
+    if (heap->free_bytes < size) {
+        multi_heap_internal_unlock(heap);
+        return NULL;
+    }
+
+    heap_block_t *block = find_free_block(heap, size);
+    if (block == NULL) {
+        multi_heap_internal_unlock(heap);
+        return NULL; /* No room in heap */
+    }
+    MULTI_HEAP_ASSERT(is_free(block), block); // block should be free
+    MULTI_HEAP_ASSERT(block_data_size(block) >= size, block); // block should be large enough
+
+    remove_free_block(heap, block);
+    mark_used(block);
+    heap->free_bytes -= block_data_size(block);
+
+    split_if_necessary(heap, block, size);
+
+    if (heap->free_bytes < heap->minimum_free_bytes) {
+        heap->minimum_free_bytes = heap->free_bytes;
+    }
+
+    multi_heap_internal_unlock(heap);
+
+    return block->data;
+}
+
+void multi_heap_free_impl(multi_heap_handle_t heap, void *p)
+{
+    heap_block_t *pb = get_block(p);
+
+    if (heap == NULL || p == NULL) {
+        return;
+    }
+
+    multi_heap_internal_lock(heap);
+
+    assert_valid_block(heap, pb);
+    MULTI_HEAP_ASSERT(!is_free(pb), pb); // block should not be free
+
+    heap->free_bytes += block_data_size(pb);
+    pb->header |= BLOCK_FREE_FLAG;
+
+    /* Try and merge previous free block into this one */
+    if (is_prev_free(pb)) {
+        heap_block_t *prev = pb->prev_phys;
+        MULTI_HEAP_ASSERT(prev >= heap->first_block && prev < pb, &pb->prev_phys); // prev block should be in heap
+        MULTI_HEAP_ASSERT(is_free(prev) && get_next_block(prev) == pb, prev); // prev block should be free & adjacent
+        remove_free_block(heap, prev);
+        pb = merge_adjacent(heap, prev, pb);
+    }
+
+    /* If next block is free, try to merge the two */
+    heap_block_t *next = get_next_block(pb);
+    if (is_free(next)) {
+        remove_free_block(heap, next);
+        pb = merge_adjacent(heap, pb, next);
+    }
+
+    mark_free(pb);
+    insert_free_block(heap, pb);
+
+    multi_heap_internal_unlock(heap);
+}
+
+void *multi_heap_realloc_impl(multi_heap_handle_t heap, void *p, size_t size)
+{
+    heap_block_t *pb = get_block(p);
+    void *result;
+
+    assert(heap != NULL);
+
+    if (p == NULL) {
+        return multi_heap_malloc_impl(heap, size);
+    }
+
+    assert_valid_block(heap, pb);
+    // non-null realloc arg should be allocated
+    MULTI_HEAP_ASSERT(!is_free(pb), pb);
+
+    if (size == 0) {
+        /* note: calling multi_free_impl() here as we've already been
+           through any poison-unwrapping */
+        multi_heap_free_impl(heap, p);
+        return NULL;
+    }
+
+    if (heap == NULL || size > SIZE_MAX - sizeof(heap_block_t)) {
+        return NULL;
+    }
+    size = adjust_size(size);
+
+    multi_heap_internal_lock(heap);
+    result = NULL;
+
+    size_t orig_size = block_data_size(pb);
+    heap_block_t *next = get_next_block(pb);
+
+    if (size <= orig_size) {
+        // Shrinking....
+        split_if_necessary(heap, pb, size);
+        result = pb->data;
+    } else if (is_free(next) && orig_size + block_data_size(next) + BLOCK_OVERHEAD >= size) {
+        // Growing into the next block
+        remove_free_block(heap, next);
+        heap->free_bytes -= block_data_size(next);
+        pb = merge_adjacent(heap, pb, next);
+        get_next_block(pb)->header &= ~BLOCK_PREV_FREE_FLAG;
+        split_if_necessary(heap, pb, size);
+        result = pb->data;
+    } else {
+        // Need to allocate elsewhere and copy data over
+        //
+        // (Calling _impl versions here as we've already been through any
+        // unwrapping for heap poisoning features.)
+        result = multi_heap_malloc_impl(heap, size);
+        if (result != NULL) {
+            memcpy(result, pb->data, orig_size);
+            multi_heap_free_impl(heap, pb->data);
+        }
+    }
+
+    if (heap->free_bytes < heap->minimum_free_bytes) {
+        heap->minimum_free_bytes = heap->free_bytes;
+    }
+
+    multi_heap_internal_unlock(heap);
+    return result;
+}
+
+#define FAIL_PRINT(MSG, ...) do {                                       \
+        if (print_errors) {                                             \
+            MULTI_HEAP_STDERR_PRINTF(MSG, __VA_ARGS__);                 \
+        }                                                               \
+        valid = false;                                                  \
+    }                                                                   \
+    while(0)
+
+bool multi_heap_check(multi_heap_handle_t heap, bool print_errors)
+{
+    bool valid = true;
+    size_t total_free_bytes = 0;
+    size_t free_blocks = 0;
+    assert(heap != NULL);
+
+    multi_heap_internal_lock(heap);
+
+    heap_block_t *prev = NULL;
+
+    /* note: not using get_next_block() assertions in loop, so that corruption is reported rather than asserted */
+    for(heap_block_t *b = heap->first_block; b != heap->last_block; b = get_next_block(b)) {
+        if (b <= prev) {
+            FAIL_PRINT("CORRUPT HEAP: Block %p is before prev block %p\n", b, prev);
+            goto done;
+        }
+        if (b > heap->last_block || b < heap->first_block) {
+            FAIL_PRINT("CORRUPT HEAP: Block %p is outside heap (last valid block %p)\n", b, prev);
+            goto done;
+        }
+        bool prev_free = (prev != NULL && is_free(prev));
+        if (is_prev_free(b) != prev_free) {
+            FAIL_PRINT("CORRUPT HEAP: Block %p previous free flag doesn't match previous block %p\n", b, prev);
+        }
+        if (prev_free && b->prev_phys != prev) {
+            FAIL_PRINT("CORRUPT HEAP: Block %p points to previous block %p but previous block is %p\n", b, b->prev_phys, prev);
+        }
+        if (is_free(b)) {
+            if (prev_free) {
+                FAIL_PRINT("CORRUPT HEAP: Two adjacent free blocks found, %p and %p\n", prev, b);
+            }
+            if (block_data_size(b) < MIN_BLOCK_SIZE) {
+                FAIL_PRINT("CORRUPT HEAP: Free block %p is too small (0x%08x bytes)\n", b, (unsigned)block_data_size(b));
+            }
+            total_free_bytes += block_data_size(b);
+            free_blocks++;
+        }
+        prev = b;
+
+#ifdef MULTI_HEAP_POISONING
+        /* For slow heap poisoning, any block should contain correct poisoning patterns and/or fills */
+        bool poison_ok;
+        if (is_free(b)) {
+            /* skip free list pointers, and the next block's prev_phys at the end */
+            uint32_t block_len = block_data_size(b) - MIN_BLOCK_SIZE;
+            poison_ok = multi_heap_internal_check_block_poisoning(&b->prev_free + 1, block_len, true, print_errors);
+        }
+        else {
+            poison_ok = multi_heap_internal_check_block_poisoning(b->data, block_data_size(b), false, print_errors);
+        }
+        valid = poison_ok && valid;
+#endif
+
+    } /* for(heap_block_t b = ... */
+
+    if (is_prev_free(heap->last_block) != (prev != NULL && is_free(prev))) {
+        FAIL_PRINT("CORRUPT HEAP: Last block %p previous free flag doesn't match previous block %p\n", heap->last_block, prev);
+    }
+    if (is_free(heap->last_block) || block_data_size(heap->last_block) != 0) {
+        FAIL_PRINT("CORRUPT HEAP: Expected last block %p to be used and empty\n", heap->last_block);
+    }
+
+    if (heap->free_bytes != total_free_bytes) {
+        FAIL_PRINT("CORRUPT HEAP: Expected %u free bytes counted %u\n", (unsigned)heap->free_bytes, (unsigned)total_free_bytes);
+    }
+
+    /* every free block should be in the list of its size class, and the bitmaps should match the lists */
+    size_t listed_blocks = 0;
+    for (int fl = 0; fl < heap->fl_count; fl++) {
+        if (((heap->fl_bitmap >> fl) & 1) != (*sl_bitmap(heap, fl) != 0)) {
+            FAIL_PRINT("CORRUPT HEAP: First level bitmap 0x%08x doesn't match second level bitmap %d\n", heap->fl_bitmap, fl);
+        }
+        for (int sl = 0; sl < (1 << heap->sl_log2); sl++) {
+            heap_block_t *list = *free_list(heap, fl, sl);
+            if (((*sl_bitmap(heap, fl) >> sl) & 1) != (list != NULL)) {
+                FAIL_PRINT("CORRUPT HEAP: Second level bitmap 0x%04x doesn't match free list %d\n", *sl_bitmap(heap, fl), sl);
+            }
+            heap_block_t *prev_free = NULL;
+            for (heap_block_t *b = list; b != NULL; b = b->next_free) {
+                int bfl, bsl;
+                if (b < heap->first_block || b >= heap->last_block || !is_free(b) || b->prev_free != prev_free) {
+                    FAIL_PRINT("CORRUPT HEAP: Invalid block %p in free list %d/%d\n", b, fl, sl);
+                    goto done;
+                }
+                mapping_insert(heap, block_data_size(b), &bfl, &bsl);
+                if (bfl != fl || bsl != sl) {
+                    FAIL_PRINT("CORRUPT HEAP: Block %p is in wrong free list %d\n", b, (fl << heap->sl_log2) + sl);
+                }
+                if (++listed_blocks > free_blocks) {
+                    FAIL_PRINT("CORRUPT HEAP: More blocks in free lists than free blocks (%u)\n", (unsigned)free_blocks);
+                    goto done;
+                }
+                prev_free = b;
+            }
+        }
+    }
+    if (listed_blocks != free_blocks) {
+        FAIL_PRINT("CORRUPT HEAP: Expected %u free blocks in free lists, found %u\n", (unsigned)free_blocks, (unsigned)listed_blocks);
+    }
+
+ done:
+    multi_heap_internal_unlock(heap);
+
+    return valid;
+}
+
+void multi_heap_dump(multi_heap_handle_t heap)
+{
+    assert(heap != NULL);
+
+    multi_heap_internal_lock(heap);
+    MULTI_HEAP_STDERR_PRINTF("Heap start %p end %p\nFree list bitmap 0x%08x\n", heap->first_block, heap->last_block, heap->fl_bitmap);
+    for(heap_block_t *b = heap->first_block; b != heap->last_block; b = get_next_block(b)) {
+        MULTI_HEAP_STDERR_PRINTF("Block %p data size 0x%08x bytes next block %p", b, block_data_size(b), get_next_block(b));
+        if (is_free(b)) {
+            MULTI_HEAP_STDERR_PRINTF(" FREE. Next free %p\n", b->next_free);
+        } else {
+            MULTI_HEAP_STDERR_PRINTF("%s", "\n"); /* C macros & optional __VA_ARGS__ */
+        }
+    }
+    multi_heap_internal_unlock(heap);
+}
+
+size_t multi_heap_free_size_impl(multi_heap_handle_t heap)
+{
+    if (heap == NULL) {
+        return 0;
+    }
+    return heap->free_bytes;
+}
+
+size_t multi_heap_minimum_free_size_impl(multi_heap_handle_t heap)
+{
+    if (heap == NULL) {
+        return 0;
+    }
+    return heap->minimum_free_bytes;
+}
+
+void multi_heap_get_info_impl(multi_heap_handle_t heap, multi_heap_info_t *info)
+{
+    memset(info, 0, sizeof(multi_heap_info_t));
+
+    if (heap == NULL) {
+        return;
+    }
+
+    multi_heap_internal_lock(heap);
+    for(heap_block_t *b = heap->first_block; !is_last_block(heap, b); b = get_next_block(b)) {
+        info->total_blocks++;
+        if (is_free(b)) {
+            size_t s = block_data_size(b);
+            info->total_free_bytes += s;
+            if (s > info->largest_free_block) {
+                info->largest_free_block = s;
+            }
+            info->free_blocks++;
+        } else {
+            info->total_allocated_bytes += block_data_size(b);
+            info->allocated_blocks++;
+        }
+    }
+
+    info->minimum_free_bytes = heap->minimum_free_bytes;
+    // heap has wrong total size (address printed here is not indicative of the real error)
+    MULTI_HEAP_ASSERT(info->total_free_bytes == heap->free_bytes, heap);
+
+    multi_heap_internal_unlock(heap);
+
+}
+
+#endif // MULTI_HEAP_TLSF
@@ -0,0 +1,78 @@
+/*
+ Tests for the per-core small object cache in front of heap_caps_malloc()
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_heap_caps.h"
+#include "esp_heap_cache.h"
+#include "sdkconfig.h"
+
+#ifdef CONFIG_HEAP_CACHE
+
+TEST_CASE("small object cache reuses freed objects", "[heap]")
+{
+    heap_caps_cache_stats_t stats[HEAP_CACHE_CLASSES];
+
+    heap_caps_cache_flush();
+    heap_caps_cache_reset_stats();
+
+    /* First allocation misses and refills the 32 byte class with a batch */
+    void *a = heap_caps_malloc(24, MALLOC_CAP_DEFAULT | MALLOC_CAP_INTERNAL);
+    TEST_ASSERT_NOT_NULL(a);
+    heap_caps_free(a);
+
+    /* Same class, so the object freed last is handed out again */
+    void *b = heap_caps_malloc(30, MALLOC_CAP_8BIT);
+    TEST_ASSERT_EQUAL_PTR(a, b);
+    /* The object was allocated with the size of its class */
+    memset(b, 0xEE, 32);
+    TEST_ASSERT(heap_caps_check_integrity_all(true));
+    heap_caps_free(b);
+
+    TEST_ASSERT_EQUAL(HEAP_CACHE_CLASSES, heap_caps_cache_get_stats(stats, HEAP_CACHE_CLASSES));
+    TEST_ASSERT_EQUAL(32, stats[1].size);
+    TEST_ASSERT_EQUAL(1, stats[1].alloc_misses);
+    TEST_ASSERT_EQUAL(1, stats[1].alloc_hits);
+    TEST_ASSERT_EQUAL(2, stats[1].free_hits);
+    TEST_ASSERT_EQUAL(CONFIG_HEAP_CACHE_OBJECTS / 2, stats[1].cached);
+
+    heap_caps_cache_flush();
+    heap_caps_cache_get_stats(stats, HEAP_CACHE_CLASSES);
+    for (int i = 0; i < HEAP_CACHE_CLASSES; i++) {
+        TEST_ASSERT_EQUAL(0, stats[i].cached);
+    }
+}
+
+TEST_CASE("small object cache returns objects to the heap when full", "[heap]")
+{
+    const int count = CONFIG_HEAP_CACHE_OBJECTS * 2;
+    void *p[count];
+    heap_caps_cache_stats_t stats[HEAP_CACHE_CLASSES];
+
+    heap_caps_cache_flush();
+    heap_caps_cache_reset_stats();
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+
+    /* DMA capable allocations bypass the cache, but the freed blocks can be cached */
+    for (int i = 0; i < count; i++) {
+        p[i] = heap_caps_malloc(16, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA);
+        TEST_ASSERT_NOT_NULL(p[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        heap_caps_free(p[i]);
+    }
+
+    heap_caps_cache_get_stats(stats, HEAP_CACHE_CLASSES);
+    printf("class %d: %d free hits, %d free misses, %d cached\n",
+           stats[0].size, stats[0].free_hits, stats[0].free_misses, stats[0].cached);
+    TEST_ASSERT_EQUAL(0, stats[0].alloc_hits + stats[0].alloc_misses);
+    TEST_ASSERT(stats[0].free_misses > 0);
+    TEST_ASSERT(stats[0].cached <= CONFIG_HEAP_CACHE_OBJECTS);
+
+    heap_caps_cache_flush();
+    TEST_ASSERT_EQUAL(free_before, heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+}
+
+#endif // CONFIG_HEAP_CACHE
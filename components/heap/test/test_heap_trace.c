@@ -59,9 +59,10 @@ TEST_CASE("heap trace leak check", "[heap]")
     heap_trace_get(0, &trace_b);
     TEST_ASSERT_EQUAL_PTR(b, trace_b.address);
 
-    /* buffer deletes trace_a when freed,
-       so trace_b at head of buffer */
-    TEST_ASSERT_EQUAL_PTR(recs[0].address, trace_b.address);
+    /* buffer clears trace_a when freed, to be reused,
+       and trace_b stays where it was */
+    TEST_ASSERT_EQUAL_PTR(NULL, recs[0].address);
+    TEST_ASSERT_EQUAL_PTR(recs[1].address, trace_b.address);
 
     heap_trace_stop();
 }
@@ -123,6 +124,37 @@ TEST_CASE("heap trace wrapped buffer check", "[heap]")
     heap_trace_stop();
 }
 
+TEST_CASE("heap trace keeps old leaks while other allocations are freed", "[heap]")
+{
+    const size_t N = 8;
+    heap_trace_record_t recs[N];
+    heap_trace_init_standalone(recs, N);
+
+    heap_trace_start(HEAP_TRACE_LEAKS);
+
+    void *leak = malloc(20);
+
+    /* Many more allocations than records, but each one is freed so its record is reused */
+    for (int i = 0; i < N * 10; i++) {
+        void *p = malloc(i + 1);
+        free(p);
+    }
+
+    heap_trace_stop();
+
+    bool saw_leak = false;
+    for (int i = 0; i < heap_trace_get_count(); i++) {
+        heap_trace_record_t rec;
+        TEST_ASSERT_EQUAL(ESP_OK, heap_trace_get(i, &rec));
+        if (rec.address == leak) {
+            saw_leak = true;
+        }
+    }
+    TEST_ASSERT(saw_leak);
+
+    free(leak);
+}
+
 static void print_floats_task(void *ignore)
 {
     heap_trace_start(HEAP_TRACE_ALL);
@@ -0,0 +1,57 @@
+/*
+ Fake memory regions for the heap_caps host tests, loosely modelled on the ESP32 with external RAM:
+ several DRAM regions, D/IRAM, IRAM and one large SPI RAM region. Regions are separated by gaps
+ so that heap_caps_init() doesn't merge them.
+*/
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "soc/soc_memory_layout.h"
+
+#define KB 1024
+#define GAP 64
+
+enum {
+    TYPE_DRAM,
+    TYPE_DIRAM,
+    TYPE_IRAM,
+    TYPE_SPIRAM,
+};
+
+const soc_memory_type_desc_t soc_memory_types[] = {
+    { "DRAM", { MALLOC_CAP_8BIT | MALLOC_CAP_DEFAULT, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA | MALLOC_CAP_32BIT, 0 }, false, false },
+    { "D/IRAM", { 0, MALLOC_CAP_DMA | MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL | MALLOC_CAP_DEFAULT, MALLOC_CAP_32BIT | MALLOC_CAP_EXEC }, true, false },
+    { "IRAM", { MALLOC_CAP_EXEC | MALLOC_CAP_32BIT | MALLOC_CAP_INTERNAL, 0, 0 }, false, false },
+    { "SPIRAM", { MALLOC_CAP_SPIRAM | MALLOC_CAP_DEFAULT, 0, MALLOC_CAP_8BIT | MALLOC_CAP_32BIT }, false, false },
+};
+
+const size_t soc_memory_type_count = sizeof(soc_memory_types) / sizeof(soc_memory_types[0]);
+
+/* All regions are carved out of this buffer, in address order */
+static uint8_t s_memory[6 * (32 * KB + GAP) + 2 * (16 * KB + GAP) + 256 * KB] __attribute__((aligned(16)));
+
+#define REGION(OFFSET, SIZE, TYPE) { (intptr_t) &s_memory[OFFSET], SIZE, TYPE, 0 }
+
+const soc_memory_region_t soc_memory_regions[] = {
+    REGION(0 * (32 * KB + GAP), 32 * KB, TYPE_DRAM),
+    REGION(1 * (32 * KB + GAP), 32 * KB, TYPE_DRAM),
+    REGION(2 * (32 * KB + GAP), 32 * KB, TYPE_DRAM),
+    REGION(3 * (32 * KB + GAP), 32 * KB, TYPE_DRAM),
+    REGION(4 * (32 * KB + GAP), 32 * KB, TYPE_DIRAM),
+    REGION(5 * (32 * KB + GAP), 32 * KB, TYPE_DIRAM),
+    REGION(6 * (32 * KB + GAP), 16 * KB, TYPE_IRAM),
+    REGION(6 * (32 * KB + GAP) + 16 * KB + GAP, 16 * KB, TYPE_IRAM),
+    REGION(6 * (32 * KB + GAP) + 2 * (16 * KB + GAP), 256 * KB, TYPE_SPIRAM),
+};
+
+const size_t soc_memory_region_count = sizeof(soc_memory_regions) / sizeof(soc_memory_regions[0]);
+
+size_t soc_get_available_memory_region_max_count(void)
+{
+    return soc_memory_region_count;
+}
+
+size_t soc_get_available_memory_regions(soc_memory_region_t *regions)
+{
+    memcpy(regions, soc_memory_regions, sizeof(soc_memory_regions));
+    return soc_memory_region_count;
+}
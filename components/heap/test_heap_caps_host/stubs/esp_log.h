@@ -0,0 +1,7 @@
+#pragma once
+
+#define ESP_EARLY_LOGE(tag, ...) ((void) (tag))
+#define ESP_EARLY_LOGW(tag, ...) ((void) (tag))
+#define ESP_EARLY_LOGI(tag, ...) ((void) (tag))
+#define ESP_EARLY_LOGD(tag, ...) ((void) (tag))
+#define ESP_EARLY_LOGV(tag, ...) ((void) (tag))
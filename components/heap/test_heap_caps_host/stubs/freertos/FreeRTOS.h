@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include "esp_attr.h"
+
+/* Single threaded host build, spinlocks do nothing */
+typedef struct {
+    uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0, 0 }
+#define portNUM_PROCESSORS 1
+
+#define portENTER_CRITICAL(mux) ((void) (mux))
+#define portEXIT_CRITICAL(mux) ((void) (mux))
+
+static inline void vPortCPUInitializeMutex(portMUX_TYPE *mux)
+{
+    mux->owner = 0;
+    mux->count = 0;
+}
+
+static inline int xPortGetCoreID(void)
+{
+    return 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+/* Memory layout for host tests of heap_caps. The memory regions are defined by the test. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SOC_MEMORY_TYPE_NO_PRIOS 3
+#define SOC_MAX_CONTIGUOUS_RAM_SIZE 0x400000
+
+/* No D/IRAM aliasing on the host */
+#define SOC_DIRAM_IRAM_LOW 0
+#define SOC_DIRAM_DRAM_HIGH 0
+
+typedef struct {
+    const char *name;
+    uint32_t caps[SOC_MEMORY_TYPE_NO_PRIOS];
+    bool aliased_iram;
+    bool startup_stack;
+} soc_memory_type_desc_t;
+
+extern const soc_memory_type_desc_t soc_memory_types[];
+extern const size_t soc_memory_type_count;
+
+typedef struct {
+    intptr_t start;
+    size_t size;
+    size_t type;
+    intptr_t iram_address;
+} soc_memory_region_t;
+
+extern const soc_memory_region_t soc_memory_regions[];
+extern const size_t soc_memory_region_count;
+
+size_t soc_get_available_memory_region_max_count(void);
+size_t soc_get_available_memory_regions(soc_memory_region_t *regions);
+
+static inline bool esp_ptr_in_diram_dram(const void *p)
+{
+    (void) p;
+    return false;
+}
+
+static inline bool esp_ptr_in_diram_iram(const void *p)
+{
+    (void) p;
+    return false;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,219 @@
+#include "catch.hpp"
+#include "esp_heap_caps.h"
+#include "esp_heap_caps_init.h"
+#include "../heap_private.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+static void init_heaps()
+{
+    static bool initialised;
+    if (!initialised) {
+        heap_caps_init();
+        initialised = true;
+    }
+}
+
+static heap_t *containing_heap(void *p)
+{
+    heap_t *heap;
+    SLIST_FOREACH(heap, &registered_heaps, next) {
+        if (heap->heap != NULL && (intptr_t)p >= heap->start && (intptr_t)p < heap->end) {
+            return heap;
+        }
+    }
+    return NULL;
+}
+
+/* heap_caps_malloc() as it was before the caps lookup table: check every heap at every priority */
+static void *scan_malloc(size_t size, uint32_t caps)
+{
+    if (caps & MALLOC_CAP_EXEC) {
+        if ((caps & MALLOC_CAP_8BIT) || (caps & MALLOC_CAP_DMA)) {
+            return NULL;
+        }
+        caps |= MALLOC_CAP_32BIT;
+    }
+    if (caps & MALLOC_CAP_32BIT) {
+        size = (size + 3) & (~3);
+    }
+    for (int prio = 0; prio < SOC_MEMORY_TYPE_NO_PRIOS; prio++) {
+        heap_t *heap;
+        SLIST_FOREACH(heap, &registered_heaps, next) {
+            if (heap->heap == NULL) {
+                continue;
+            }
+            if ((heap->caps[prio] & caps) != 0 && (get_all_caps(heap) & caps) == caps) {
+                void *ret = multi_heap_malloc(heap->heap, size);
+                if (ret != NULL) {
+                    return ret;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+static const uint32_t test_caps[] = {
+    MALLOC_CAP_DEFAULT | MALLOC_CAP_INTERNAL,
+    MALLOC_CAP_DEFAULT | MALLOC_CAP_SPIRAM,
+    MALLOC_CAP_DEFAULT,
+    MALLOC_CAP_8BIT,
+    MALLOC_CAP_32BIT,
+    MALLOC_CAP_DMA,
+    MALLOC_CAP_EXEC,
+    MALLOC_CAP_INTERNAL,
+    MALLOC_CAP_SPIRAM,
+    MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT,
+    MALLOC_CAP_DMA | MALLOC_CAP_32BIT,
+    MALLOC_CAP_EXEC | MALLOC_CAP_8BIT,
+    MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA,
+    MALLOC_CAP_PID3,
+};
+
+/* Allocate with both heap_caps_malloc() and scan_malloc(), and check they use the same heap */
+static void check_same_heap(size_t size, uint32_t caps)
+{
+    void *p = heap_caps_malloc(size, caps);
+    void *q = scan_malloc(size, caps);
+    INFO("caps 0x" << std::hex << caps << std::dec << " size " << size);
+    REQUIRE( (p == NULL) == (q == NULL) );
+    if (p != NULL) {
+        REQUIRE( containing_heap(p) == containing_heap(q) );
+    }
+    heap_caps_free(p);
+    heap_caps_free(q);
+}
+
+TEST_CASE("heap_caps_malloc uses the heaps in the same order as a scan of all heaps", "[heap_caps]")
+{
+    init_heaps();
+    for (uint32_t caps : test_caps) {
+        check_same_heap(100, caps);
+    }
+
+    /* Fill the first choice heaps, so that allocations move on to the next heaps */
+    std::vector<void *> blocks;
+    void *p;
+    while ((p = heap_caps_malloc(2000, MALLOC_CAP_DEFAULT | MALLOC_CAP_INTERNAL)) != NULL) {
+        blocks.push_back(p);
+        for (uint32_t caps : test_caps) {
+            check_same_heap(1000, caps);
+        }
+    }
+    REQUIRE( blocks.size() > 60 );
+    for (void *b : blocks) {
+        heap_caps_free(b);
+    }
+    REQUIRE( heap_caps_check_integrity_all(true) );
+}
+
+TEST_CASE("heap_caps_malloc handles more combinations of caps than lookup table entries", "[heap_caps]")
+{
+    init_heaps();
+    const uint32_t bits[] = { MALLOC_CAP_EXEC, MALLOC_CAP_32BIT, MALLOC_CAP_8BIT, MALLOC_CAP_DMA,
+                              MALLOC_CAP_SPIRAM, MALLOC_CAP_INTERNAL, MALLOC_CAP_DEFAULT };
+    const int num_bits = sizeof(bits) / sizeof(bits[0]);
+    for (int pass = 0; pass < 2; pass++) {
+        for (int combination = 1; combination < (1 << num_bits); combination++) {
+            uint32_t caps = 0;
+            for (int i = 0; i < num_bits; i++) {
+                if (combination & (1 << i)) {
+                    caps |= bits[i];
+                }
+            }
+            check_same_heap(64, caps);
+        }
+    }
+}
+
+TEST_CASE("heap_caps_add_region makes new heaps available to lookups", "[heap_caps]")
+{
+    init_heaps();
+    static uint8_t region[4096] __attribute__((aligned(4)));
+    const uint32_t caps[SOC_MEMORY_TYPE_NO_PRIOS] = { MALLOC_CAP_PID2 | MALLOC_CAP_8BIT, 0, 0 };
+
+    /* No heap has these caps yet, the lookup table now holds an empty list for them */
+    REQUIRE( heap_caps_malloc(32, MALLOC_CAP_PID2) == NULL );
+
+    REQUIRE( heap_caps_add_region_with_caps(caps, (intptr_t)region, (intptr_t)region + sizeof(region)) == ESP_OK );
+
+    void *p = heap_caps_malloc(32, MALLOC_CAP_PID2);
+    REQUIRE( p != NULL );
+    REQUIRE( (uint8_t *)p >= region );
+    REQUIRE( (uint8_t *)p < region + sizeof(region) );
+    heap_caps_free(p);
+
+    /* The new heap goes first in the list of heaps, ahead of the other 8-bit heaps at priority 0 */
+    check_same_heap(32, MALLOC_CAP_8BIT);
+}
+
+typedef void *(*malloc_fn_t)(size_t size, uint32_t caps);
+
+static double time_malloc_free_ns(malloc_fn_t fn, uint32_t caps, int iterations)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        void *p = fn(32, caps);
+        heap_caps_free(p);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (double) iterations;
+}
+
+TEST_CASE("heap_caps benchmark heap selection with and without the lookup table", "[heap_caps][bench][.]")
+{
+    init_heaps();
+    const int ITERATIONS = 200000;
+    const struct {
+        const char *name;
+        uint32_t caps;
+    } workloads[] = {
+        { "malloc", MALLOC_CAP_DEFAULT | MALLOC_CAP_INTERNAL },
+        { "spiram", MALLOC_CAP_SPIRAM },
+        { "dma", MALLOC_CAP_DMA },
+        { "exec", MALLOC_CAP_EXEC },
+        { "impossible", MALLOC_CAP_EXEC | MALLOC_CAP_SPIRAM },
+    };
+
+    std::cout << "workload,caps,lookup_ns_per_malloc_free,scan_ns_per_malloc_free" << std::endl;
+    for (auto &w : workloads) {
+        /* warm up, then take the best of a few runs of each */
+        time_malloc_free_ns(heap_caps_malloc, w.caps, ITERATIONS / 10);
+        double lookup_ns = 1e9, scan_ns = 1e9;
+        for (int run = 0; run < 5; run++) {
+            lookup_ns = std::min(lookup_ns, time_malloc_free_ns(heap_caps_malloc, w.caps, ITERATIONS));
+            scan_ns = std::min(scan_ns, time_malloc_free_ns(scan_malloc, w.caps, ITERATIONS));
+        }
+        std::cout << w.name << ",0x" << std::hex << w.caps << std::dec << ","
+                  << lookup_ns << "," << scan_ns << std::endl;
+    }
+
+    /* Fill the lookup table with caps no heap has, then allocate with caps which have no entry */
+    const uint32_t pid_bits[] = { MALLOC_CAP_PID2, MALLOC_CAP_PID3, MALLOC_CAP_PID4,
+                                  MALLOC_CAP_PID5, MALLOC_CAP_PID6, MALLOC_CAP_PID7 };
+    heap_caps_lookup_reset();
+    for (int combination = 1; combination <= HEAP_CAPS_LOOKUP_ENTRIES; combination++) {
+        uint32_t caps = 0;
+        for (int i = 0; i < 6; i++) {
+            if (combination & (1 << i)) {
+                caps |= pid_bits[i];
+            }
+        }
+        heap_caps_lookup_add(caps);
+    }
+    const uint32_t caps = MALLOC_CAP_DEFAULT | MALLOC_CAP_INTERNAL;
+    double lookup_ns = 1e9, scan_ns = 1e9;
+    for (int run = 0; run < 5; run++) {
+        lookup_ns = std::min(lookup_ns, time_malloc_free_ns(heap_caps_malloc, caps, ITERATIONS));
+        scan_ns = std::min(scan_ns, time_malloc_free_ns(scan_malloc, caps, ITERATIONS));
+    }
+    std::cout << "malloc (table full),0x" << std::hex << caps << std::dec << ","
+              << lookup_ns << "," << scan_ns << std::endl;
+    heap_caps_lookup_reset();
+}
@@ -0,0 +1,125 @@
+#include "catch.hpp"
+#include "multi_heap.h"
+
+#include "../multi_heap_config.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#ifdef MULTI_HEAP_TLSF
+#define ALLOCATOR_NAME "tlsf"
+#else
+#define ALLOCATOR_NAME "best_fit"
+#endif
+
+typedef std::chrono::steady_clock bench_clock;
+
+static void print_latencies(const char *workload, const char *op, std::vector<uint32_t> &ns)
+{
+    std::sort(ns.begin(), ns.end());
+    size_t n = ns.size();
+    std::cout << ALLOCATOR_NAME << "," << workload << "," << op << "," << n << ","
+              << ns[0] << "," << ns[n / 2] << "," << ns[n * 9 / 10] << ","
+              << ns[n * 99 / 100] << "," << ns[n * 999 / 1000] << "," << ns[n - 1] << std::endl;
+}
+
+static uint32_t elapsed_ns(bench_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count();
+}
+
+/* Fill the heap with blocks of random size, then free a random subset of them so
+   that the free list is long. 'keep_pct' is the percentage of blocks kept allocated. */
+static void fragment_heap(multi_heap_handle_t heap, std::mt19937 &rng, std::vector<void *> &blocks,
+                          size_t min_size, size_t max_size, int keep_pct)
+{
+    std::uniform_int_distribution<size_t> size_dist(min_size, max_size);
+    while (true) {
+        void *p = multi_heap_malloc(heap, size_dist(rng));
+        if (p == NULL) {
+            break;
+        }
+        blocks.push_back(p);
+    }
+    std::uniform_int_distribution<int> pct(0, 99);
+    for (auto &p : blocks) {
+        if (pct(rng) >= keep_pct) {
+            multi_heap_free(heap, p);
+            p = NULL;
+        }
+    }
+    blocks.erase(std::remove(blocks.begin(), blocks.end(), (void *)NULL), blocks.end());
+}
+
+/* Time single malloc and free calls on a fragmented heap, with a working set of
+   allocations that is replaced in random order */
+static void run_latency(const char *workload, size_t min_size, size_t max_size, int keep_pct)
+{
+    const size_t HEAP_SIZE = 150 * 1024;
+    const size_t ITERATIONS = 200000;
+    const size_t WORKING_SET = 64;
+    static uint8_t heap_mem[HEAP_SIZE];
+
+    multi_heap_handle_t heap = multi_heap_register(heap_mem, sizeof(heap_mem));
+    REQUIRE( heap != NULL );
+
+    std::mt19937 rng(42);
+    std::vector<void *> pinned;
+    fragment_heap(heap, rng, pinned, min_size, max_size, keep_pct);
+
+    std::uniform_int_distribution<size_t> size_dist(min_size, max_size);
+    std::uniform_int_distribution<size_t> slot_dist(0, WORKING_SET - 1);
+    std::vector<void *> working(WORKING_SET, (void *)NULL);
+    std::vector<uint32_t> malloc_ns, free_ns;
+    malloc_ns.reserve(ITERATIONS);
+    free_ns.reserve(ITERATIONS);
+    size_t failed = 0;
+
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        size_t slot = slot_dist(rng);
+        if (working[slot] != NULL) {
+            auto start = bench_clock::now();
+            multi_heap_free(heap, working[slot]);
+            free_ns.push_back(elapsed_ns(start));
+            working[slot] = NULL;
+        } else {
+            size_t size = size_dist(rng);
+            auto start = bench_clock::now();
+            working[slot] = multi_heap_malloc(heap, size);
+            malloc_ns.push_back(elapsed_ns(start));
+            if (working[slot] == NULL) {
+                failed++;
+            }
+        }
+    }
+
+    REQUIRE( multi_heap_check(heap, true) );
+    print_latencies(workload, "malloc", malloc_ns);
+    print_latencies(workload, "free", free_ns);
+    if (failed) {
+        std::cout << "# " << ALLOCATOR_NAME << "," << workload << ": " << failed << " allocations failed" << std::endl;
+    }
+
+    for (auto p : working) {
+        multi_heap_free(heap, p);
+    }
+    for (auto p : pinned) {
+        multi_heap_free(heap, p);
+    }
+}
+
+/* Prints the latency distribution of malloc and free for the allocator this test
+   program was built with. Build and run with both allocators ('make benchmark')
+   to compare them. */
+TEST_CASE("multi_heap benchmark malloc and free latency on a fragmented heap", "[multi_heap][bench][.]")
+{
+    std::cout << "allocator,workload,op,count,min_ns,p50_ns,p90_ns,p99_ns,p99.9_ns,max_ns" << std::endl;
+    run_latency("small", 8, 128, 50);
+    run_latency("mixed", 8, 2048, 50);
+    run_latency("sparse", 8, 512, 10);
+}
@@ -0,0 +1,282 @@
+#include "catch.hpp"
+#include "multi_heap.h"
+#include "esp_heap_profile.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+/* Callers and caps are opaque to the profiler, use made up ones */
+static void *const CALLER_A = (void *)0x400d1000;
+static void *const CALLER_B = (void *)0x400d2004;
+static const uint32_t CAPS_DEFAULT = 1 << 12;
+static const uint32_t CAPS_DMA = 1 << 3;
+
+static const heap_profile_site_t *find_site(const heap_profile_snapshot_t *snapshot, void *caller, uint32_t caps)
+{
+    for (size_t i = 0; i < snapshot->num_sites; i++) {
+        if (snapshot->sites[i].caller == caller && snapshot->sites[i].caps == caps) {
+            return &snapshot->sites[i];
+        }
+    }
+    return NULL;
+}
+
+/* Allocate from a multi_heap and tell the profiler, as the heap tracing wrappers do */
+static void *profiled_malloc(multi_heap_handle_t heap, size_t size, uint32_t caps, void *caller)
+{
+    void *p = multi_heap_malloc(heap, size);
+    heap_profile_record_alloc(p, size, caps, caller);
+    return p;
+}
+
+static void profiled_free(multi_heap_handle_t heap, void *p)
+{
+    heap_profile_record_free(p);
+    multi_heap_free(heap, p);
+}
+
+TEST_CASE("heap profile counts allocations per call site and caps", "[heap_profile]")
+{
+    static uint8_t heap_mem[4096];
+    multi_heap_handle_t heap = multi_heap_register(heap_mem, sizeof(heap_mem));
+    heap_profile_site_t sites[16];
+    heap_profile_block_t blocks[32];
+    heap_profile_site_t snap_sites[16];
+    heap_profile_snapshot_t snapshot = { };
+    snapshot.sites = snap_sites;
+    snapshot.max_sites = 16;
+
+    REQUIRE( heap_profile_start() == ESP_ERR_INVALID_STATE );
+    REQUIRE( heap_profile_init(sites, 16, NULL, 0) == ESP_ERR_INVALID_ARG );
+    REQUIRE( heap_profile_init(sites, 16, blocks, 32) == ESP_OK );
+
+    /* not counted, profiling isn't running */
+    void *before = profiled_malloc(heap, 10, CAPS_DEFAULT, CALLER_A);
+
+    REQUIRE( heap_profile_start() == ESP_OK );
+    REQUIRE( heap_profile_init(sites, 16, blocks, 32) == ESP_ERR_INVALID_STATE );
+
+    void *a1 = profiled_malloc(heap, 100, CAPS_DEFAULT, CALLER_A);
+    void *a2 = profiled_malloc(heap, 50, CAPS_DEFAULT, CALLER_A);
+    void *a3 = profiled_malloc(heap, 20, CAPS_DMA, CALLER_A);
+    void *b1 = profiled_malloc(heap, 8, CAPS_DEFAULT, CALLER_B);
+    profiled_free(heap, a1);
+    profiled_free(heap, before);
+
+    /* failed allocations aren't counted */
+    REQUIRE( profiled_malloc(heap, 100000, CAPS_DEFAULT, CALLER_B) == NULL );
+
+    REQUIRE( heap_profile_snapshot(&snapshot) == ESP_OK );
+    REQUIRE( snapshot.num_sites == 3 );
+    REQUIRE( snapshot.untracked_count == 0 );
+
+    const heap_profile_site_t *s = find_site(&snapshot, CALLER_A, CAPS_DEFAULT);
+    REQUIRE( s != NULL );
+    REQUIRE( s->alloc_count == 2 );
+    REQUIRE( s->free_count == 1 );
+    REQUIRE( s->alloc_bytes == 150 );
+    REQUIRE( s->live_bytes == 50 );
+    REQUIRE( s->live_count == 1 );
+
+    s = find_site(&snapshot, CALLER_A, CAPS_DMA);
+    REQUIRE( s != NULL );
+    REQUIRE( s->alloc_count == 1 );
+    REQUIRE( s->live_bytes == 20 );
+
+    s = find_site(&snapshot, CALLER_B, CAPS_DEFAULT);
+    REQUIRE( s != NULL );
+    REQUIRE( s->alloc_count == 1 );
+    REQUIRE( s->live_bytes == 8 );
+
+    /* sorted by caller, then caps */
+    REQUIRE( snapshot.sites[0].caller == CALLER_A );
+    REQUIRE( snapshot.sites[0].caps == CAPS_DMA );
+    REQUIRE( snapshot.sites[1].caps == CAPS_DEFAULT );
+    REQUIRE( snapshot.sites[2].caller == CALLER_B );
+
+    /* counts are kept after stopping */
+    REQUIRE( heap_profile_stop() == ESP_OK );
+    REQUIRE( heap_profile_stop() == ESP_ERR_INVALID_STATE );
+    profiled_free(heap, a2);
+    REQUIRE( heap_profile_snapshot(&snapshot) == ESP_OK );
+    REQUIRE( find_site(&snapshot, CALLER_A, CAPS_DEFAULT)->live_bytes == 50 );
+
+    /* snapshot too small */
+    snapshot.max_sites = 2;
+    REQUIRE( heap_profile_snapshot(&snapshot) == ESP_ERR_INVALID_SIZE );
+    REQUIRE( snapshot.num_sites == 2 );
+
+    profiled_free(heap, a3);
+    profiled_free(heap, b1);
+    REQUIRE( heap_profile_init(NULL, 0, NULL, 0) == ESP_OK );
+}
+
+TEST_CASE("heap profile diff finds the call sites churning the heap", "[heap_profile]")
+{
+    static uint8_t heap_mem[8192];
+    multi_heap_handle_t heap = multi_heap_register(heap_mem, sizeof(heap_mem));
+    heap_profile_site_t sites[16];
+    heap_profile_block_t blocks[64];
+    heap_profile_site_t before_sites[16], after_sites[16];
+    heap_profile_snapshot_t before = { }, after = { };
+    before.sites = before_sites;
+    before.max_sites = 16;
+    after.sites = after_sites;
+    after.max_sites = 16;
+    void *const caller_quiet = (void *)0x400d3000;
+    void *const caller_leak = (void *)0x400d4000;
+    void *const caller_churn = (void *)0x400d5000;
+
+    REQUIRE( heap_profile_init(sites, 16, blocks, 64) == ESP_OK );
+    REQUIRE( heap_profile_start() == ESP_OK );
+
+    void *quiet = profiled_malloc(heap, 64, CAPS_DEFAULT, caller_quiet);
+    void *leak = profiled_malloc(heap, 16, CAPS_DEFAULT, caller_leak);
+    REQUIRE( heap_profile_snapshot(&before) == ESP_OK );
+
+    /* the "throughput test" */
+    std::vector<void *> leaks;
+    uint64_t churn_bytes = 0;
+    for (int i = 0; i < 100; i++) {
+        churn_bytes += 32 + i % 8;
+        void *p = profiled_malloc(heap, 32 + i % 8, CAPS_DMA, caller_churn);
+        REQUIRE( p != NULL );
+        profiled_free(heap, p);
+        if (i % 25 == 0) {
+            leaks.push_back(profiled_malloc(heap, 16, CAPS_DEFAULT, caller_leak));
+        }
+    }
+    REQUIRE( heap_profile_snapshot(&after) == ESP_OK );
+    REQUIRE( after.time_us >= before.time_us );
+
+    heap_profile_diff_t diffs[4];
+    size_t n = heap_profile_diff(&before, &after, diffs, 4);
+
+    /* the quiet site didn't change, the churning one comes first */
+    REQUIRE( n == 2 );
+    REQUIRE( diffs[0].caller == caller_churn );
+    REQUIRE( diffs[0].caps == CAPS_DMA );
+    REQUIRE( diffs[0].alloc_count == 100 );
+    REQUIRE( diffs[0].free_count == 100 );
+    REQUIRE( diffs[0].alloc_bytes == churn_bytes );
+    REQUIRE( diffs[0].live_bytes == 0 );
+    REQUIRE( diffs[0].live_count == 0 );
+
+    REQUIRE( diffs[1].caller == caller_leak );
+    REQUIRE( diffs[1].alloc_count == 4 );
+    REQUIRE( diffs[1].free_count == 0 );
+    REQUIRE( diffs[1].live_bytes == 4 * 16 );
+    REQUIRE( diffs[1].live_count == 4 );
+
+    /* freeing the leaks shows as a negative change */
+    for (void *p : leaks) {
+        profiled_free(heap, p);
+    }
+    profiled_free(heap, leak);
+    REQUIRE( heap_profile_snapshot(&before) == ESP_OK );
+    n = heap_profile_diff(&after, &before, diffs, 1);
+    REQUIRE( n == 1 );
+    REQUIRE( diffs[0].caller == caller_leak );
+    REQUIRE( diffs[0].alloc_count == 0 );
+    REQUIRE( diffs[0].free_count == 5 );
+    REQUIRE( diffs[0].live_bytes == -5 * 16 );
+    REQUIRE( diffs[0].live_count == -5 );
+
+    profiled_free(heap, quiet);
+    heap_profile_stop();
+}
+
+TEST_CASE("heap profile stays within its tables", "[heap_profile]")
+{
+    static uint8_t heap_mem[32768];
+    multi_heap_handle_t heap = multi_heap_register(heap_mem, sizeof(heap_mem));
+    const size_t NUM_SITES = 13, NUM_BLOCKS = 40;
+    heap_profile_site_t sites[NUM_SITES];
+    heap_profile_block_t blocks[NUM_BLOCKS];
+    heap_profile_site_t snap_sites[NUM_SITES + 1];
+    heap_profile_snapshot_t snapshot = { };
+    snapshot.sites = snap_sites;
+    snapshot.max_sites = NUM_SITES + 1;
+
+    /* expected counts, by the call site index used below */
+    const int NUM_CALLERS = 20;
+    std::map<void *, std::pair<int, size_t>> live; // address -> (caller, size)
+    std::vector<uint32_t> allocs(NUM_CALLERS), frees(NUM_CALLERS);
+
+    REQUIRE( heap_profile_init(sites, NUM_SITES, blocks, NUM_BLOCKS) == ESP_OK );
+    REQUIRE( heap_profile_start() == ESP_OK );
+
+    srand(7);
+    for (int i = 0; i < 20000; i++) {
+        if (live.size() < 60 && (live.empty() || rand() % 2)) {
+            int caller = rand() % NUM_CALLERS;
+            size_t size = 4 + rand() % 100;
+            void *p = profiled_malloc(heap, size, CAPS_DEFAULT, (void *)(intptr_t)(0x400d0000 + caller * 4));
+            REQUIRE( p != NULL );
+            live[p] = std::make_pair(caller, size);
+            allocs[caller]++;
+        } else {
+            auto it = live.begin();
+            std::advance(it, rand() % live.size());
+            profiled_free(heap, it->first);
+            frees[it->second.first]++;
+            live.erase(it);
+        }
+    }
+
+    REQUIRE( heap_profile_snapshot(&snapshot) == ESP_OK );
+
+    /* 9 of the 20 call sites fit, the others are counted together */
+    REQUIRE( snapshot.num_sites == NUM_SITES * 3 / 4 + 1 );
+    REQUIRE( snapshot.sites[0].caller == NULL );
+    REQUIRE( snapshot.sites[0].caps == 0 );
+
+    /* 30 allocations are followed, so more were live than followed */
+    REQUIRE( snapshot.untracked_count > 0 );
+
+    uint32_t total_allocs = 0;
+    size_t total_live_count = 0;
+    for (size_t i = 0; i < snapshot.num_sites; i++) {
+        const heap_profile_site_t *s = &snapshot.sites[i];
+        total_allocs += s->alloc_count;
+        total_live_count += s->live_count;
+        REQUIRE( s->free_count + s->live_count <= s->alloc_count );
+        if (s->caller != NULL) {
+            int caller = ((intptr_t)s->caller - 0x400d0000) / 4;
+            /* allocation counts are exact, frees of untracked allocations are missed */
+            REQUIRE( s->alloc_count == allocs[caller] );
+            REQUIRE( s->free_count <= frees[caller] );
+        }
+    }
+    uint32_t expected_allocs = 0;
+    for (uint32_t a : allocs) {
+        expected_allocs += a;
+    }
+    REQUIRE( total_allocs == expected_allocs );
+    REQUIRE( total_live_count <= live.size() );
+
+    /* after freeing everything, nothing followed is live and the table of live allocations is empty again */
+    for (auto &l : live) {
+        profiled_free(heap, l.first);
+    }
+    uint32_t untracked = snapshot.untracked_count;
+    std::vector<void *> again;
+    for (size_t i = 0; i < NUM_BLOCKS * 3 / 4; i++) {
+        again.push_back(profiled_malloc(heap, 8, CAPS_DMA, CALLER_A));
+    }
+    for (void *p : again) {
+        profiled_free(heap, p);
+    }
+    REQUIRE( heap_profile_snapshot(&snapshot) == ESP_OK );
+    REQUIRE( snapshot.untracked_count == untracked );
+    for (size_t i = 0; i < snapshot.num_sites; i++) {
+        REQUIRE( snapshot.sites[i].live_count == 0 );
+        REQUIRE( snapshot.sites[i].live_bytes == 0 );
+    }
+
+    heap_profile_stop();
+}
@@ -16,11 +16,36 @@
 #undef realloc
 #define realloc #error
 
+/* Register a small test heap of 'size' bytes at the start of 'buf'.
+
+   TLSF heaps start with a larger header, which includes the free list table, so a TLSF heap of the same size has
+   less free space (none at all for the smallest test heaps.) For TLSF, register the smallest heap in 'buf' which
+   has at least 'min_free' bytes free instead, the space the test needs.
+*/
+static multi_heap_handle_t register_small_heap(uint8_t *buf, size_t buf_size, size_t size, size_t min_free)
+{
+#ifndef MULTI_HEAP_TLSF
+    (void) buf_size;
+    (void) min_free;
+    return multi_heap_register(buf, size);
+#else
+    (void) size;
+    for (size_t heap_size = min_free; heap_size <= buf_size; heap_size += sizeof(void *)) {
+        multi_heap_handle_t heap = multi_heap_register(buf, heap_size);
+        if (heap != NULL && multi_heap_free_size(heap) >= min_free) {
+            return heap;
+        }
+    }
+    return NULL;
+#endif
+}
+
 TEST_CASE("multi_heap simple allocations", "[multi_heap]")
 {
-    uint8_t small_heap[128];
+    uint8_t small_heap[384];
 
-    multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
+    multi_heap_handle_t heap = register_small_heap(small_heap, sizeof(small_heap), 128, 80);
+    REQUIRE( heap != NULL );
 
     size_t test_alloc_size = (multi_heap_free_size(heap) + 4) / 2;
 
@@ -91,7 +116,10 @@ TEST_CASE("multi_heap fragmentation", "[multi_heap]")
     printf("****************\n");
 
     void *big = multi_heap_malloc(heap, alloc_size * 3);
+#ifndef MULTI_HEAP_TLSF
+    /* TLSF doesn't place blocks by best fit */
     REQUIRE( p[3] == big ); /* big should go where p[3] was freed from */
+#endif
     multi_heap_free(heap, big);
 
     multi_heap_free(heap, p[2]);
@@ -391,8 +419,9 @@ TEST_CASE("multi_heap minimum-size allocations", "[multi_heap]")
 TEST_CASE("multi_heap_realloc()", "[multi_heap]")
 {
     const uint32_t PATTERN = 0xABABDADA;
-    uint8_t small_heap[300];
-    multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
+    uint8_t small_heap[512];
+    multi_heap_handle_t heap = register_small_heap(small_heap, sizeof(small_heap), 300, 248);
+    REQUIRE( heap != NULL );
 
     uint32_t *a = (uint32_t *)multi_heap_malloc(heap, 64);
     uint32_t *b = (uint32_t *)multi_heap_malloc(heap, 32);
@@ -417,6 +446,10 @@ TEST_CASE("multi_heap_realloc()", "[multi_heap]")
     REQUIRE( c == d ); /* 'c' block should be shrunk in-place */
     REQUIRE( *d == PATTERN);
 
+#ifndef MULTI_HEAP_TLSF
+    // TLSF takes the first block of a large enough size class, not the best
+    // fitting block, so the placement checks below only hold for best fit
+
     uint32_t *e = (uint32_t *)multi_heap_malloc(heap, 64);
     REQUIRE( multi_heap_check(heap, true));
     REQUIRE( a == e ); /* 'e' takes the block formerly occupied by 'a' */
@@ -440,6 +473,7 @@ TEST_CASE("multi_heap_realloc()", "[multi_heap]")
     g = (uint32_t *)multi_heap_realloc(heap, e, 128);
     REQUIRE( multi_heap_check(heap, true) );
     REQUIRE( e == g ); /* 'g' extends 'e' in place, into the space formerly held by 'f' */
+#endif // MULTI_HEAP_TLSF
 #endif
 }
 
@@ -459,6 +493,11 @@ TEST_CASE("unaligned heaps", "[multi_heap]")
     const size_t CHUNK_LEN = 256;
     const size_t CANARY_LEN = 16;
     const uint8_t CANARY_BYTE = 0x3E;
+#ifdef MULTI_HEAP_TLSF
+    const size_t MAX_OVERHEAD = 96; /* heap header includes the free list table */
+#else
+    const size_t MAX_OVERHEAD = 64;
+#endif
     uint8_t heap_chunk[CHUNK_LEN + CANARY_LEN * 2];
 
     /* Put some canary bytes before and after the bytes we intend to use for
@@ -475,8 +514,8 @@ TEST_CASE("unaligned heaps", "[multi_heap]")
 
         multi_heap_get_info(heap, &info);
 
-        REQUIRE( info.total_free_bytes > CHUNK_LEN - 64 - i );
-        REQUIRE( info.largest_free_block > CHUNK_LEN - 64 - i );
+        REQUIRE( info.total_free_bytes > CHUNK_LEN - MAX_OVERHEAD - i );
+        REQUIRE( info.largest_free_block > CHUNK_LEN - MAX_OVERHEAD - i );
 
         void *a = multi_heap_malloc(heap, info.largest_free_block);
         REQUIRE( a != NULL );
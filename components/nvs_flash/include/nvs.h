@@ -110,6 +110,11 @@ typedef struct {
  */
 typedef struct nvs_opaque_iterator_t *nvs_iterator_t;
 
+/**
+ * Opaque pointer type representing a blob opened for streaming read or write
+ */
+typedef struct nvs_opaque_blob_t *nvs_blob_t;
+
 /**
  * @brief      Open non-volatile storage with a given namespace from the default NVS partition
  *
@@ -345,6 +350,119 @@ esp_err_t nvs_get_str (nvs_handle_t handle, const char* key, char* out_value, si
 esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length);
 /**@}*/
 
+/**
+ * @brief      Open a blob for reading it in parts
+ *
+ * Unlike nvs_get_blob, this function doesn't need a buffer for the whole value.
+ * Only chunk headers are looked up here; the data of each chunk is read
+ * and checked when it is first accessed with nvs_blob_read.
+ *
+ * The blob should not be modified while it is open for reading, otherwise
+ * nvs_blob_read returns ESP_ERR_NVS_NOT_FOUND.
+ *
+ * @param[in]  handle      Handle obtained from nvs_open function.
+ * @param[in]  key         Key name. Maximal length is 15 characters. Shouldn't be empty.
+ * @param[out] out_blob    Blob object, to be passed to nvs_blob_read and nvs_blob_close.
+ * @param[out] out_length  Length of the blob. May be NULL.
+ *
+ * @return
+ *             - ESP_OK if the blob was opened successfully
+ *             - ESP_ERR_NVS_NOT_FOUND if the requested key doesn't exist
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_INVALID_ARG if out_blob is NULL
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_blob_open_read(nvs_handle_t handle, const char* key, nvs_blob_t* out_blob, size_t* out_length);
+
+/**
+ * @brief      Read part of a blob opened with nvs_blob_open_read
+ *
+ * Parts may be read in any order. Only the chunks overlapping the requested
+ * range are read from flash.
+ *
+ * @param[in]  blob      Blob obtained from nvs_blob_open_read.
+ * @param[in]  offset    Offset of the first byte to read.
+ * @param[out] out_data  Buffer of at least length bytes.
+ * @param[in]  length    Number of bytes to read.
+ *
+ * @return
+ *             - ESP_OK if the data was read successfully
+ *             - ESP_ERR_NVS_INVALID_LENGTH if the range goes past the end of the blob
+ *             - ESP_ERR_NVS_NOT_FOUND if the blob has been modified or its data is corrupt
+ *             - ESP_ERR_INVALID_ARG if blob is NULL or has been opened for writing
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_blob_read(nvs_blob_t blob, size_t offset, void* out_data, size_t length);
+
+/**
+ * @brief      Open a blob for writing it in parts
+ *
+ * The total length has to be known up front. Data is passed in sequential
+ * parts with nvs_blob_write and is buffered one chunk (up to 4000 bytes) at a time.
+ * The new value replaces the old one only in nvs_blob_close, once all
+ * length bytes have been written; until then the old value can still be read.
+ *
+ * While the blob is open, setting or erasing the same key, and erasing
+ * its namespace, fail with ESP_ERR_INVALID_STATE.
+ *
+ * @param[in]  handle    Handle obtained from nvs_open function.
+ *                       Handles that were opened read only cannot be used.
+ * @param[in]  key       Key name. Maximal length is 15 characters. Shouldn't be empty.
+ * @param[in]  length    Total length of the blob.
+ * @param[out] out_blob  Blob object, to be passed to nvs_blob_write and nvs_blob_close.
+ *
+ * @return
+ *             - ESP_OK if the blob was opened successfully
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_READ_ONLY if storage handle was opened as read only
+ *             - ESP_ERR_NVS_KEY_TOO_LONG if the key name is too long
+ *             - ESP_ERR_NVS_VALUE_TOO_LONG if the value is too long
+ *             - ESP_ERR_INVALID_STATE if the key is already open for writing
+ *             - ESP_ERR_INVALID_ARG if out_blob is NULL
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_blob_open_write(nvs_handle_t handle, const char* key, size_t length, nvs_blob_t* out_blob);
+
+/**
+ * @brief      Append data to a blob opened with nvs_blob_open_write
+ *
+ * If this function fails, the blob is discarded when it is closed.
+ *
+ * @param[in]  blob    Blob obtained from nvs_blob_open_write.
+ * @param[in]  data    Data to append.
+ * @param[in]  length  Number of bytes to append.
+ *
+ * @return
+ *             - ESP_OK if the data was accepted
+ *             - ESP_ERR_NVS_INVALID_LENGTH if more data than announced is written
+ *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if there is not enough space in the
+ *               underlying storage to save the value
+ *             - ESP_ERR_INVALID_ARG if blob is NULL or has been opened for reading
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_blob_write(nvs_blob_t blob, const void* data, size_t length);
+
+/**
+ * @brief      Close a blob and free its resources
+ *
+ * For a blob opened for writing, this is where the new value becomes visible
+ * and the previous one is erased. If fewer bytes than announced have been
+ * written, or writing has failed, the new value is discarded and the old one is kept.
+ *
+ * All blobs have to be closed before NVS is deinitialized.
+ *
+ * @param[in]  blob    Blob obtained from nvs_blob_open_read or nvs_blob_open_write.
+ *
+ * @return
+ *             - ESP_OK if the blob was closed (and for a writer, stored) successfully
+ *             - ESP_ERR_NVS_INVALID_LENGTH if the writer got fewer bytes than announced
+ *             - ESP_ERR_NVS_REMOVE_FAILED if the new value was stored but the old one
+ *               couldn't be erased. It will be erased after re-initialization of nvs.
+ *             - ESP_ERR_INVALID_ARG if blob is NULL
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_blob_close(nvs_blob_t blob);
+
 /**
  * @brief      Erase key-value pair with given key name.
  *
@@ -399,6 +517,97 @@ esp_err_t nvs_erase_all(nvs_handle_t handle);
  */
 esp_err_t nvs_commit(nvs_handle_t handle);
 
+/**
+ * @brief      Enable or disable write-back mode for the storage handle
+ *
+ * In write-back mode, integer values set through the handle are kept in RAM
+ * until nvs_commit is called. Repeated writes to the same key only keep the latest
+ * value, and nvs_commit writes consecutive entries in a single flash operation.
+ * Each key is updated atomically: after a power loss, it holds either the
+ * previous or the committed value. Strings and blobs are still written immediately.
+ *
+ * Values which have not been committed are discarded by nvs_close.
+ * Disabling write-back mode commits pending values first.
+ *
+ * @param[in]  handle  Storage handle obtained with nvs_open.
+ *                     Handles that were opened read only cannot be used.
+ * @param[in]  enable  true to buffer values until nvs_commit, false to write them immediately
+ *
+ * @return
+ *             - ESP_OK if the mode has been changed successfully
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_READ_ONLY if storage handle was opened as read only
+ *             - ESP_ERR_INVALID_STATE if a transaction is open on the handle
+ *             - other error codes from nvs_commit
+ */
+esp_err_t nvs_set_write_back(nvs_handle_t handle, bool enable);
+
+/**
+ * @brief      Start a transaction on the storage handle
+ *
+ * Integer values set through the handle until nvs_transaction_commit is called
+ * are kept in RAM and are then written all together: after a power loss,
+ * either all of them or none of them have been updated. Reading a value through
+ * the handle returns the value set in the transaction, other handles keep
+ * reading the previous values until the transaction is committed.
+ *
+ * While the transaction is open, nvs_set_str, nvs_set_blob, nvs_blob_open_write,
+ * nvs_erase_key and nvs_erase_all fail with ESP_ERR_INVALID_STATE for this handle,
+ * and nvs_commit doesn't write the values of the transaction.
+ * In write-back mode, values set before the transaction are committed first.
+ *
+ * @param[in]  handle  Storage handle obtained with nvs_open.
+ *                     Handles that were opened read only cannot be used.
+ *
+ * @return
+ *             - ESP_OK if the transaction has been started
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_READ_ONLY if storage handle was opened as read only
+ *             - ESP_ERR_INVALID_STATE if a transaction is already open on the handle
+ *             - other error codes from nvs_commit
+ */
+esp_err_t nvs_transaction_begin(nvs_handle_t handle);
+
+/**
+ * @brief      Write all values set in the transaction and end it
+ *
+ * The values, together with a marker item, are written into consecutive entries
+ * of one page, so a transaction can hold up to 125 values. Previous versions
+ * of the values are erased afterwards; if power goes off before that is done,
+ * it is finished during initialization.
+ *
+ * If the values couldn't be written, the transaction stays open and can be
+ * committed again or aborted.
+ *
+ * @param[in]  handle  Storage handle obtained with nvs_open.
+ *
+ * @return
+ *             - ESP_OK if the values have been written successfully
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_INVALID_STATE if no transaction is open on the handle
+ *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if the values don't fit in one page
+ *               or there is not enough space in the underlying storage
+ *             - ESP_ERR_NVS_REMOVE_FAILED if the values were written but previous
+ *               versions couldn't be erased. This will be finished after
+ *               re-initialization of nvs, provided that flash operation doesn't fail again.
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_transaction_commit(nvs_handle_t handle);
+
+/**
+ * @brief      Discard all values set in the transaction and end it
+ *
+ * Closing the handle with an open transaction has the same effect.
+ *
+ * @param[in]  handle  Storage handle obtained with nvs_open.
+ *
+ * @return
+ *             - ESP_OK if the transaction has been discarded
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_INVALID_STATE if no transaction is open on the handle
+ */
+esp_err_t nvs_transaction_abort(nvs_handle_t handle);
+
 /**
  * @brief      Close the storage handle and free any allocated resources
  *
@@ -495,6 +704,66 @@ esp_err_t nvs_get_stats(const char *part_name, nvs_stats_t *nvs_stats);
  */
 esp_err_t nvs_get_used_entry_count(nvs_handle_t handle, size_t* used_entries);
 
+/**
+ * Size of the header preceding each value in the buffer filled by nvs_export_namespace.
+ * The header holds the type of the value (one byte of nvs_type_t), the key padded with
+ * zeros to 16 bytes, and the length of the value as a 32-bit little endian number.
+ */
+#define NVS_EXPORT_HEADER_SIZE      21
+
+/**
+ * @brief      Copy all key-value pairs of a namespace to a buffer
+ *
+ * Values are written one after another, each preceded by a header of
+ * NVS_EXPORT_HEADER_SIZE bytes. The buffer can be passed to
+ * nvs_import_namespace to restore the values, for example as a backup of
+ * the configuration of a module.
+ *
+ * Only values which have been written to flash are exported. Values set
+ * with a handle in write-back mode have to be committed first.
+ *
+ * \code{c}
+ * // Example of exporting a namespace to a buffer of the right size:
+ * size_t length = 0;
+ * nvs_export_namespace(handle, NULL, &length);
+ * void* buf = malloc(length);
+ * nvs_export_namespace(handle, buf, &length);
+ * \endcode
+ *
+ * @param[in]     handle    Handle obtained from nvs_open function.
+ * @param[out]    out_buf   Buffer to fill. If NULL, only the required length is returned.
+ * @param[inout]  length    Size of out_buf. Set to the number of bytes required
+ *                          to export the namespace.
+ *
+ * @return
+ *             - ESP_OK if the namespace was exported, or if out_buf is NULL
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_INVALID_LENGTH if length is NULL, or if out_buf is too small
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_export_namespace(nvs_handle_t handle, void* out_buf, size_t* length);
+
+/**
+ * @brief      Write key-value pairs exported with nvs_export_namespace
+ *
+ * Values are written to the namespace of the handle, which doesn't have to be
+ * the namespace they were exported from. Keys which are present in the namespace
+ * but not in the buffer are left unchanged.
+ *
+ * @param[in]  handle    Handle obtained from nvs_open function.
+ * @param[in]  buf       Buffer filled by nvs_export_namespace.
+ * @param[in]  length    Number of bytes in buf.
+ *
+ * @return
+ *             - ESP_OK if all values were written
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_READ_ONLY if handle was opened as read only
+ *             - ESP_ERR_INVALID_STATE if a transaction is in progress on the handle
+ *             - ESP_ERR_INVALID_ARG if buf is NULL, or if its content is malformed
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_import_namespace(nvs_handle_t handle, const void* buf, size_t length);
+
 /**
  * @brief       Create an iterator to enumerate NVS entries based on one or more parameters
  *
@@ -85,6 +85,35 @@ esp_err_t nvs_flash_deinit(void);
  */
 esp_err_t nvs_flash_deinit_partition(const char* partition_label);
 
+/**
+ * @brief Perform a bounded amount of garbage collection on the given NVS partition
+ *
+ * When the last but one free page of a partition is taken into use, the next
+ * write which needs a new page has to free one first, by copying all the items
+ * of a full page and erasing it. This function does the same work in small steps,
+ * so that it can be called periodically from a low priority task, keeping two
+ * pages free ahead of demand.
+ *
+ * Each call moves items from the full page holding the fewest items to the
+ * current page, until either the given number of entries has been moved,
+ * or the full page is empty and has been erased. At least one item is moved,
+ * even if it takes up more entries than the budget. Every item is moved the
+ * same way as a value is updated, so it is preserved if power goes off.
+ *
+ * @param[in]  partition_label   Label of the partition
+ * @param[in]  budget            Maximum number of 32-byte entries to move
+ * @param[out] out_done          Set to true if no more work is needed or possible
+ *                               at the moment, i.e. two pages are free or no page
+ *                               can be freed without erasing a page first. Can be NULL.
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_NVS_NOT_INITIALIZED if the storage for given partition was not
+ *        initialized prior to this call
+ *      - one of the error codes from the underlying flash storage driver
+ */
+esp_err_t nvs_flash_gc_step(const char* partition_label, size_t budget, bool* out_done);
+
 /**
  * @brief Erase the default NVS partition
  *
@@ -55,10 +55,22 @@ public:
     {
     }
 
+    void freePendingItems()
+    {
+        if (mPendingItems != nullptr) {
+            mPendingItems->clearAndFreeNodes();
+            delete mPendingItems;
+            mPendingItems = nullptr;
+        }
+    }
+
     nvs_handle_t mHandle;
     uint8_t mReadOnly;
     uint8_t mNsIndex;
     nvs::Storage* mStoragePtr;
+    nvs::Storage::TPendingItemList* mPendingItems = nullptr; // non-null in write-back mode or in a transaction
+    bool mWriteBack = false;
+    bool mInTransaction = false;
 };
 
 #ifdef ESP_PLATFORM
@@ -236,6 +248,7 @@ extern "C" esp_err_t nvs_flash_deinit_partition(const char* partition_name)
             ESP_LOGD(TAG, "Deleting handle %d (ns=%d) related to partition \"%s\" (missing call to nvs_close?)",
                      it->mHandle, it->mNsIndex, partition_name);
             s_nvs_handles.erase(it);
+            it->freePendingItems();
             delete static_cast<HandleEntry*>(it);
         }
         it = next;
@@ -253,6 +266,23 @@ extern "C" esp_err_t nvs_flash_deinit(void)
     return nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME);
 }
 
+extern "C" esp_err_t nvs_flash_gc_step(const char* partition_name, size_t budget, bool* out_done)
+{
+    Lock lock;
+
+    nvs::Storage* storage = lookup_storage_from_name(partition_name);
+    if (!storage) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    bool done;
+    auto err = storage->collectGarbage(budget, done);
+    if (err == ESP_OK && out_done != NULL) {
+        *out_done = done;
+    }
+    return err;
+}
+
 static esp_err_t nvs_find_ns_handle(nvs_handle_t handle, HandleEntry& entry)
 {
     auto it = find_if(begin(s_nvs_handles), end(s_nvs_handles), [=](HandleEntry& e) -> bool {
@@ -310,9 +340,154 @@ extern "C" void nvs_close(nvs_handle_t handle)
         return;
     }
     s_nvs_handles.erase(it);
+    it->freePendingItems();
     delete static_cast<HandleEntry*>(it);
 }
 
+static HandleEntry* nvs_find_handle_entry(nvs_handle_t handle)
+{
+    auto it = find_if(begin(s_nvs_handles), end(s_nvs_handles), [=](HandleEntry& e) -> bool {
+        return e.mHandle == handle;
+    });
+    if (it == end(s_nvs_handles)) {
+        return nullptr;
+    }
+    return it;
+}
+
+extern "C" esp_err_t nvs_set_write_back(nvs_handle_t handle, bool enable)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %d %d", __func__, handle, enable);
+    HandleEntry* it = nvs_find_handle_entry(handle);
+    if (it == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (it->mReadOnly) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    if (it->mInTransaction) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (enable) {
+        if (it->mPendingItems == nullptr) {
+            it->mPendingItems = new nvs::Storage::TPendingItemList;
+        }
+        it->mWriteBack = true;
+        return ESP_OK;
+    }
+    if (it->mPendingItems != nullptr) {
+        auto err = it->mStoragePtr->writePendingItems(it->mNsIndex, *it->mPendingItems);
+        if (err != ESP_OK) {
+            return err;
+        }
+        it->freePendingItems();
+    }
+    it->mWriteBack = false;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_transaction_begin(nvs_handle_t handle)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %d", __func__, handle);
+    HandleEntry* it = nvs_find_handle_entry(handle);
+    if (it == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (it->mReadOnly) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    if (it->mInTransaction) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (it->mPendingItems == nullptr) {
+        it->mPendingItems = new nvs::Storage::TPendingItemList;
+    } else {
+        // values set before the transaction are not part of it
+        auto err = it->mStoragePtr->writePendingItems(it->mNsIndex, *it->mPendingItems);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    it->mInTransaction = true;
+    return ESP_OK;
+}
+
+static void nvs_end_transaction(HandleEntry* entry)
+{
+    entry->mInTransaction = false;
+    if (!entry->mWriteBack) {
+        entry->freePendingItems();
+    } else {
+        entry->mPendingItems->clearAndFreeNodes();
+    }
+}
+
+extern "C" esp_err_t nvs_transaction_commit(nvs_handle_t handle)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %d", __func__, handle);
+    HandleEntry* it = nvs_find_handle_entry(handle);
+    if (it == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (!it->mInTransaction) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    auto err = it->mStoragePtr->writeTransaction(it->mNsIndex, *it->mPendingItems);
+    // once the values are written, the transaction is over even if erasing old versions failed
+    if (err == ESP_OK || err == ESP_ERR_NVS_REMOVE_FAILED) {
+        nvs_end_transaction(it);
+    }
+    return err;
+}
+
+extern "C" esp_err_t nvs_transaction_abort(nvs_handle_t handle)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %d", __func__, handle);
+    HandleEntry* it = nvs_find_handle_entry(handle);
+    if (it == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (!it->mInTransaction) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    nvs_end_transaction(it);
+    return ESP_OK;
+}
+
+static nvs::Storage::PendingItem* nvs_find_pending_item(HandleEntry& entry, nvs::ItemType datatype, const char* key)
+{
+    auto it = find_if(begin(*entry.mPendingItems), end(*entry.mPendingItems), [=](nvs::Storage::PendingItem& e) -> bool {
+        return e.mDatatype == datatype && strncmp(e.mKey, key, nvs::Item::MAX_KEY_LENGTH) == 0;
+    });
+    if (it == end(*entry.mPendingItems)) {
+        return nullptr;
+    }
+    return it;
+}
+
+static esp_err_t nvs_set_pending_item(HandleEntry& entry, nvs::ItemType datatype, const char* key, const void* data, size_t dataSize)
+{
+    if (strlen(key) > nvs::Item::MAX_KEY_LENGTH) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    // repeated writes to the same key only keep the latest value
+    auto item = nvs_find_pending_item(entry, datatype, key);
+    if (item == nullptr) {
+        item = new nvs::Storage::PendingItem;
+        strncpy(item->mKey, key, sizeof(item->mKey) - 1);
+        item->mKey[sizeof(item->mKey) - 1] = 0;
+        item->mDatatype = datatype;
+        item->mDataSize = dataSize;
+        entry.mPendingItems->push_back(item);
+    }
+    memcpy(item->mData, data, dataSize);
+    return ESP_OK;
+}
+
 extern "C" esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key)
 {
     Lock lock;
@@ -325,6 +500,25 @@ extern "C" esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key)
     if (entry.mReadOnly) {
         return ESP_ERR_NVS_READ_ONLY;
     }
+    if (entry.mInTransaction) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (entry.mPendingItems != nullptr) {
+        bool erasedPending = false;
+        for (auto it = begin(*entry.mPendingItems); it != end(*entry.mPendingItems);) {
+            nvs::Storage::PendingItem* item = it++;
+            if (strncmp(item->mKey, key, nvs::Item::MAX_KEY_LENGTH) == 0) {
+                entry.mPendingItems->erase(item);
+                delete item;
+                erasedPending = true;
+            }
+        }
+        err = entry.mStoragePtr->eraseItem(entry.mNsIndex, key);
+        if (err == ESP_ERR_NVS_NOT_FOUND && erasedPending) {
+            return ESP_OK;
+        }
+        return err;
+    }
     return entry.mStoragePtr->eraseItem(entry.mNsIndex, key);
 }
 
@@ -340,6 +534,12 @@ extern "C" esp_err_t nvs_erase_all(nvs_handle_t handle)
     if (entry.mReadOnly) {
         return ESP_ERR_NVS_READ_ONLY;
     }
+    if (entry.mInTransaction) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (entry.mPendingItems != nullptr) {
+        entry.mPendingItems->clearAndFreeNodes();
+    }
     return entry.mStoragePtr->eraseNamespace(entry.mNsIndex);
 }
 
@@ -356,6 +556,9 @@ static esp_err_t nvs_set(nvs_handle_t handle, const char* key, T value)
     if (entry.mReadOnly) {
         return ESP_ERR_NVS_READ_ONLY;
     }
+    if (entry.mPendingItems != nullptr) {
+        return nvs_set_pending_item(entry, itemTypeOf(value), key, &value, sizeof(value));
+    }
     return entry.mStoragePtr->writeItem(entry.mNsIndex, key, value);
 }
 
@@ -402,9 +605,12 @@ extern "C" esp_err_t nvs_set_u64 (nvs_handle_t handle, const char* key, uint64_t
 extern "C" esp_err_t nvs_commit(nvs_handle_t handle)
 {
     Lock lock;
-    // no-op for now, to be used when intermediate cache is added
     HandleEntry entry;
-    return nvs_find_ns_handle(handle, entry);
+    auto err = nvs_find_ns_handle(handle, entry);
+    if (err != ESP_OK || entry.mPendingItems == nullptr || entry.mInTransaction) {
+        return err;
+    }
+    return entry.mStoragePtr->writePendingItems(entry.mNsIndex, *entry.mPendingItems);
 }
 
 extern "C" esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value)
@@ -416,6 +622,9 @@ extern "C" esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const cha
     if (err != ESP_OK) {
         return err;
     }
+    if (entry.mInTransaction) {
+        return ESP_ERR_INVALID_STATE;
+    }
     return entry.mStoragePtr->writeItem(entry.mNsIndex, nvs::ItemType::SZ, key, value, strlen(value) + 1);
 }
 
@@ -428,6 +637,9 @@ extern "C" esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const vo
     if (err != ESP_OK) {
         return err;
     }
+    if (entry.mInTransaction) {
+        return ESP_ERR_INVALID_STATE;
+    }
     return entry.mStoragePtr->writeItem(entry.mNsIndex, nvs::ItemType::BLOB, key, value, length);
 }
 
@@ -442,6 +654,13 @@ static esp_err_t nvs_get(nvs_handle_t handle, const char* key, T* out_value)
     if (err != ESP_OK) {
         return err;
     }
+    if (entry.mPendingItems != nullptr) {
+        auto item = nvs_find_pending_item(entry, itemTypeOf(*out_value), key);
+        if (item != nullptr) {
+            memcpy(out_value, item->mData, sizeof(T));
+            return ESP_OK;
+        }
+    }
     return entry.mStoragePtr->readItem(entry.mNsIndex, key, *out_value);
 }
 
@@ -525,6 +744,88 @@ extern "C" esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* ou
     return nvs_get_str_or_blob(handle, nvs::ItemType::BLOB, key, out_value, length);
 }
 
+extern "C" esp_err_t nvs_blob_open_read(nvs_handle_t handle, const char* key, nvs_blob_t* out_blob, size_t* out_length)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %s", __func__, key);
+    if (out_blob == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    HandleEntry entry;
+    auto err = nvs_find_ns_handle(handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    nvs_blob_t blob = new nvs_opaque_blob_t;
+    err = entry.mStoragePtr->openBlobForReading(blob, entry.mNsIndex, key);
+    if (err != ESP_OK) {
+        delete blob;
+        return err;
+    }
+    if (out_length != nullptr) {
+        *out_length = blob->dataSize;
+    }
+    *out_blob = blob;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_blob_read(nvs_blob_t blob, size_t offset, void* out_data, size_t length)
+{
+    Lock lock;
+    if (blob == nullptr || blob->writing) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return blob->storage->readBlobPart(blob, offset, out_data, length);
+}
+
+extern "C" esp_err_t nvs_blob_open_write(nvs_handle_t handle, const char* key, size_t length, nvs_blob_t* out_blob)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %s %d", __func__, key, length);
+    if (out_blob == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    HandleEntry entry;
+    auto err = nvs_find_ns_handle(handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (entry.mReadOnly) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    if (entry.mInTransaction) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    nvs_blob_t blob = new nvs_opaque_blob_t;
+    err = entry.mStoragePtr->openBlobForWriting(blob, entry.mNsIndex, key, length);
+    if (err != ESP_OK) {
+        delete blob;
+        return err;
+    }
+    *out_blob = blob;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_blob_write(nvs_blob_t blob, const void* data, size_t length)
+{
+    Lock lock;
+    if (blob == nullptr || !blob->writing) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return blob->storage->writeBlobPart(blob, data, length);
+}
+
+extern "C" esp_err_t nvs_blob_close(nvs_blob_t blob)
+{
+    Lock lock;
+    if (blob == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    auto err = blob->storage->closeBlob(blob);
+    delete blob;
+    return err;
+}
+
 extern "C" esp_err_t nvs_get_stats(const char* part_name, nvs_stats_t* nvs_stats)
 {
     Lock lock;
@@ -572,6 +873,164 @@ extern "C" esp_err_t nvs_get_used_entry_count(nvs_handle_t handle, size_t* used_
     return err;
 }
 
+/* Layout of a value in the buffer filled by nvs_export_namespace:
+ * type, key padded with zeros, length (little endian), data */
+static const size_t NVS_EXPORT_KEY_SIZE = sizeof(nvs_entry_info_t::key);
+static const size_t NVS_EXPORT_LENGTH_OFFSET = 1 + NVS_EXPORT_KEY_SIZE;
+static_assert(NVS_EXPORT_HEADER_SIZE == NVS_EXPORT_LENGTH_OFFSET + 4, "export header size is incorrect");
+
+struct ExportRecord {
+    nvs::ItemType datatype;
+    char key[NVS_EXPORT_KEY_SIZE];
+    size_t dataSize;
+    const uint8_t* data;
+};
+
+static bool nvs_is_integer_type(nvs_type_t type)
+{
+    switch (type) {
+    case NVS_TYPE_U8: case NVS_TYPE_I8:
+    case NVS_TYPE_U16: case NVS_TYPE_I16:
+    case NVS_TYPE_U32: case NVS_TYPE_I32:
+    case NVS_TYPE_U64: case NVS_TYPE_I64:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static nvs::ItemType nvs_export_item_type(nvs_type_t type)
+{
+    // the iterator reports blobs by their data chunks, the value is read through the blob index
+    return (type == NVS_TYPE_BLOB) ? nvs::ItemType::BLOB : static_cast<nvs::ItemType>(type);
+}
+
+/* Parse the record at 'offset', checking that it lies within the buffer and is well formed */
+static bool nvs_parse_export_record(const uint8_t* buf, size_t length, size_t offset, ExportRecord& record)
+{
+    if (length - offset < NVS_EXPORT_HEADER_SIZE) {
+        return false;
+    }
+    const uint8_t* header = buf + offset;
+    nvs_type_t type = static_cast<nvs_type_t>(header[0]);
+    memcpy(record.key, header + 1, NVS_EXPORT_KEY_SIZE);
+    if (record.key[0] == 0 || record.key[NVS_EXPORT_KEY_SIZE - 1] != 0) {
+        return false;
+    }
+    record.dataSize = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        record.dataSize |= static_cast<size_t>(header[NVS_EXPORT_LENGTH_OFFSET + i]) << (8 * i);
+    }
+    if (record.dataSize > length - offset - NVS_EXPORT_HEADER_SIZE) {
+        return false;
+    }
+    record.data = header + NVS_EXPORT_HEADER_SIZE;
+    record.datatype = nvs_export_item_type(type);
+    if (nvs_is_integer_type(type)) {
+        return record.dataSize == (type & 0x0f); // lower nibble of integer types is the size
+    }
+    if (type == NVS_TYPE_STR) {
+        return record.dataSize > 0 && record.data[record.dataSize - 1] == 0;
+    }
+    return type == NVS_TYPE_BLOB;
+}
+
+extern "C" esp_err_t nvs_export_namespace(nvs_handle_t handle, void* out_buf, size_t* length)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s", __func__);
+    if (length == nullptr) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    HandleEntry entry;
+    auto err = nvs_find_ns_handle(handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    uint8_t* out = static_cast<uint8_t*>(out_buf);
+    size_t offset = 0;
+    nvs_opaque_iterator_t it;
+    it.storage = entry.mStoragePtr;
+    it.type = NVS_TYPE_ANY;
+    for (bool found = entry.mStoragePtr->findEntry(&it, entry.mNsIndex); found; found = entry.mStoragePtr->nextEntry(&it)) {
+        nvs_type_t type = it.entry_info.type;
+        nvs::ItemType datatype = nvs_export_item_type(type);
+        size_t dataSize = type & 0x0f;
+        if (!nvs_is_integer_type(type)) {
+            err = entry.mStoragePtr->getItemDataSize(entry.mNsIndex, datatype, it.entry_info.key, dataSize);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        // keep counting the required length once the buffer is full
+        if (out != nullptr && offset + NVS_EXPORT_HEADER_SIZE + dataSize <= *length) {
+            uint8_t* header = out + offset;
+            header[0] = type;
+            memset(header + 1, 0, NVS_EXPORT_KEY_SIZE);
+            strncpy(reinterpret_cast<char*>(header + 1), it.entry_info.key, NVS_EXPORT_KEY_SIZE - 1);
+            for (size_t i = 0; i < 4; ++i) {
+                header[NVS_EXPORT_LENGTH_OFFSET + i] = static_cast<uint8_t>(dataSize >> (8 * i));
+            }
+            err = entry.mStoragePtr->readItem(entry.mNsIndex, datatype, it.entry_info.key,
+                                              header + NVS_EXPORT_HEADER_SIZE, dataSize);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        offset += NVS_EXPORT_HEADER_SIZE + dataSize;
+    }
+
+    size_t capacity = *length;
+    *length = offset;
+    if (out != nullptr && offset > capacity) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_import_namespace(nvs_handle_t handle, const void* buf, size_t length)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %d", __func__, length);
+    if (buf == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    HandleEntry entry;
+    auto err = nvs_find_ns_handle(handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (entry.mReadOnly) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    if (entry.mInTransaction) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // check the whole buffer first, so that a malformed one doesn't leave the namespace half-written
+    const uint8_t* in = static_cast<const uint8_t*>(buf);
+    ExportRecord record;
+    for (size_t offset = 0; offset < length; offset += NVS_EXPORT_HEADER_SIZE + record.dataSize) {
+        if (!nvs_parse_export_record(in, length, offset, record)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    for (size_t offset = 0; offset < length; offset += NVS_EXPORT_HEADER_SIZE + record.dataSize) {
+        nvs_parse_export_record(in, length, offset, record);
+        if (entry.mPendingItems != nullptr && nvs_is_integer_type(static_cast<nvs_type_t>(record.datatype))) {
+            err = nvs_set_pending_item(entry, record.datatype, record.key, record.data, record.dataSize);
+        } else {
+            err = entry.mStoragePtr->writeItem(entry.mNsIndex, record.datatype, record.key, record.data, record.dataSize);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
 #if (defined CONFIG_NVS_ENCRYPTION) && (defined ESP_PLATFORM)
 
 extern "C" esp_err_t nvs_flash_generate_keys(const esp_partition_t* partition, nvs_sec_cfg_t* cfg)
@@ -48,6 +48,11 @@ namespace nvs
 
     XtsCtxt* EncrMgr::findXtsCtxtFromAddr(uint32_t addr) {
 
+        if (lastXtsCtxt && lastXtsCtxt->baseSector * SPI_FLASH_SEC_SIZE <= addr
+                && addr < (lastXtsCtxt->baseSector + lastXtsCtxt->sectorCount) * SPI_FLASH_SEC_SIZE) {
+            return lastXtsCtxt;
+        }
+
         auto it = find_if(std::begin(xtsCtxtList), std::end(xtsCtxtList), [=](XtsCtxt& ctx) -> bool
                 { return (ctx.baseSector * SPI_FLASH_SEC_SIZE  <= addr)
                 && (addr < (ctx.baseSector + ctx.sectorCount) * SPI_FLASH_SEC_SIZE); });
@@ -55,6 +60,7 @@ namespace nvs
         if (it == std::end(xtsCtxtList)) {
             return nullptr;
         }
+        lastXtsCtxt = it;
         return it;
     }
 
@@ -88,7 +94,12 @@ namespace nvs
         if(!xtsCtxt) {
             return ESP_ERR_NVS_XTS_CFG_NOT_FOUND;
         }
+        if (lastXtsCtxt == xtsCtxt) {
+            lastXtsCtxt = nullptr;
+        }
         xtsCtxtList.erase(xtsCtxt);
+        mbedtls_aes_xts_free(xtsCtxt->ectxt);
+        mbedtls_aes_xts_free(xtsCtxt->dctxt);
         delete xtsCtxt;
 
         if(!xtsCtxtList.size()) {
@@ -113,7 +124,7 @@ namespace nvs
 
         memset(data_unit, 0, sizeof(data_unit));
 
-        for(uint8_t entry = 0; entry < (ptxtLen/entrySize); entry++)
+        for(uint32_t entry = 0; entry < (ptxtLen/entrySize); entry++)
         {
             uint32_t offset = entry * entrySize;
             uint32_t *addr_loc = (uint32_t*) &data_unit[0];
@@ -128,22 +139,26 @@ namespace nvs
 
     esp_err_t EncrMgr::decryptNvsData(uint8_t* ctxt, uint32_t addr, uint32_t ctxtLen, XtsCtxt* xtsCtxt) {
 
+        uint8_t entrySize = sizeof(Item);
+
         //sector num required as an arr by mbedtls. Should have been just uint64/32.
         uint8_t data_unit[16];
 
-
-        /** Currently upper layer of NVS reads entries one by one even for variable size
-        * multi-entry data types. So length should always be equal to size of an entry.*/
-        assert(ctxtLen == sizeof(Item));
+        /* Each entry is a separate XTS data unit, so multi-entry spans
+         * (e.g. string and blob data) can be read and decrypted in one go. */
+        assert(ctxtLen % entrySize == 0);
 
         uint32_t relAddr = addr - (xtsCtxt->baseSector * SPI_FLASH_SEC_SIZE);
 
         memset(data_unit, 0, sizeof(data_unit));
 
-        memcpy(data_unit, &relAddr, sizeof(relAddr));
-
-        if(mbedtls_aes_crypt_xts(xtsCtxt->dctxt, MBEDTLS_AES_DECRYPT, ctxtLen, data_unit, ctxt, ctxt))  {
-            return ESP_ERR_NVS_XTS_DECR_FAILED;
+        for(uint32_t offset = 0; offset < ctxtLen; offset += entrySize)
+        {
+            uint32_t unitAddr = relAddr + offset;
+            memcpy(data_unit, &unitAddr, sizeof(unitAddr));
+            if(mbedtls_aes_crypt_xts(xtsCtxt->dctxt, MBEDTLS_AES_DECRYPT, entrySize, data_unit, ctxt + offset, ctxt + offset))  {
+                return ESP_ERR_NVS_XTS_DECR_FAILED;
+            }
         }
         return ESP_OK;
     }
@@ -49,6 +49,9 @@ class EncrMgr
         static bool isActive;
         static EncrMgr* instance;
         intrusive_list<XtsCtxt> xtsCtxtList;
+        /* Context found by the last lookup. Consecutive reads and writes almost
+         * always target the same partition, so this avoids walking the list. */
+        XtsCtxt* lastXtsCtxt = nullptr;
         EncrMgr() {}
 
 }; // class EncrMgr
@@ -13,85 +13,42 @@
 // limitations under the License.
 
 #include "nvs_item_hash_list.hpp"
+#include <algorithm>
 
 namespace nvs
 {
 
 HashList::HashList()
 {
+    clear();
 }
-    
+
 void HashList::clear()
 {
-    for (auto it = mBlockList.begin(); it != mBlockList.end();) {
-        auto tmp = it;
-        ++it;
-        mBlockList.erase(tmp);
-        delete static_cast<HashListBlock*>(tmp);
-    }
-}
-    
-HashList::~HashList()
-{
-    clear();
+    std::fill_n(mHashes, MAX_ENTRY_COUNT, static_cast<uint16_t>(EMPTY_HASH));
+    std::fill_n(mNsIndices, MAX_ENTRY_COUNT, static_cast<uint8_t>(EMPTY_NS));
 }
 
-HashList::HashListBlock::HashListBlock()
+uint16_t HashList::calcHash(const Item& item)
 {
-    static_assert(sizeof(HashListBlock) == HashListBlock::BYTE_SIZE,
-                  "cache block size calculation incorrect");
+    uint16_t hash = item.calculateCrc32WithoutValue() & 0xffff;
+    // EMPTY_HASH marks unused slots
+    return (hash == EMPTY_HASH) ? EMPTY_HASH - 1 : hash;
 }
 
 void HashList::insert(const Item& item, size_t index)
 {
-    const uint32_t hash_24 = item.calculateCrc32WithoutValue() & 0xffffff;
-    // add entry to the end of last block if possible
-    if (mBlockList.size()) {
-        auto& block = mBlockList.back();
-        if (block.mCount < HashListBlock::ENTRY_COUNT) {
-            block.mNodes[block.mCount++] = HashListNode(hash_24, index);
-            return;
-        }
-    }
-    // if the above failed, create a new block and add entry to it
-    HashListBlock* newBlock = new HashListBlock;
-    mBlockList.push_back(newBlock);
-    newBlock->mNodes[0] = HashListNode(hash_24, index);
-    newBlock->mCount++;
+    assert(index < MAX_ENTRY_COUNT);
+    mHashes[index] = calcHash(item);
+    mNsIndices[index] = item.nsIndex;
 }
 
 void HashList::erase(size_t index, bool itemShouldExist)
 {
-    for (auto it = mBlockList.begin(); it != mBlockList.end();) {
-        bool haveEntries = false;
-        bool foundIndex = false;
-        for (size_t i = 0; i < it->mCount; ++i) {
-            if (it->mNodes[i].mIndex == index) {
-                it->mNodes[i].mIndex = 0xff;
-                foundIndex = true;
-                /* found the item and removed it */
-            }
-            if (it->mNodes[i].mIndex != 0xff) {
-                haveEntries = true;
-            }
-            if (haveEntries && foundIndex) {
-                /* item was found, and HashListBlock still has some items */
-                return;
-            }
-        }
-        /* no items left in HashListBlock, can remove */
-        if (!haveEntries) {
-            auto tmp = it;
-            ++it;
-            mBlockList.erase(tmp);
-            delete static_cast<HashListBlock*>(tmp);
-        } else {
-            ++it;
-        }
-        if (foundIndex) {
-            /* item was found and empty HashListBlock was removed */
-            return;
-        }
+    if (index < MAX_ENTRY_COUNT && mHashes[index] != EMPTY_HASH) {
+        mHashes[index] = EMPTY_HASH;
+        mNsIndices[index] = EMPTY_NS;
+        return;
     }
     if (itemShouldExist) {
         assert(false && "item should have been present in cache");
@@ -100,19 +57,23 @@ void HashList::erase(size_t index, bool itemShouldExist)
 
 size_t HashList::find(size_t start, const Item& item)
 {
-    const uint32_t hash_24 = item.calculateCrc32WithoutValue() & 0xffffff;
-    for (auto it = mBlockList.begin(); it != mBlockList.end(); ++it) {
-        for (size_t index = 0; index < it->mCount; ++index) {
-            HashListNode& e = it->mNodes[index];
-            if (e.mIndex >= start &&
-                    e.mHash == hash_24 &&
-                    e.mIndex != 0xff) {
-                return e.mIndex;
-            }
+    const uint16_t hash = calcHash(item);
+    for (size_t index = start; index < MAX_ENTRY_COUNT; ++index) {
+        if (mHashes[index] == hash) {
+            return index;
         }
     }
     return SIZE_MAX;
 }
 
+size_t HashList::findNamespace(size_t start, uint8_t nsIndex) const
+{
+    for (size_t index = start; index < MAX_ENTRY_COUNT; ++index) {
+        if (mNsIndices[index] == nsIndex) {
+            return index;
+        }
+    }
+    return SIZE_MAX;
+}
 
 } // namespace nvs
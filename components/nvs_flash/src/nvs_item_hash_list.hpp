@@ -17,55 +17,45 @@
 
 #include "nvs.h"
 #include "nvs_types.hpp"
-#include "intrusive_list.h"
 
 namespace nvs
 {
 
+/**
+ * Per-page index of item hashes.
+ *
+ * The hash of the item starting at entry i is kept in slot i of a flat array,
+ * so the memory footprint is fixed and allocated together with the page.
+ * find() returns the lowest index at or after 'start' whose hash matches.
+ * Different items may share a hash, callers have to check the item itself.
+ * The namespace index of each item is kept as well, so that the items of one
+ * namespace can be enumerated without reading other items from flash.
+ */
 class HashList
 {
 public:
+    static const size_t MAX_ENTRY_COUNT = 126;
+
     HashList();
-    ~HashList();
-    
+
     void insert(const Item& item, size_t index);
     void erase(const size_t index, bool itemShouldExist=true);
     size_t find(size_t start, const Item& item);
+    size_t findNamespace(size_t start, uint8_t nsIndex) const;
     void clear();
-    
+
 private:
     HashList(const HashList& other);
     const HashList& operator= (const HashList& rhs);
-    
-protected:
-
-    struct HashListNode {
-        HashListNode() :
-            mIndex(0xff), mHash(0)
-        {
-        }
 
-        HashListNode(uint32_t hash, size_t index) :
-            mIndex((uint32_t) index), mHash(hash)
-        {
-        }
-
-        uint32_t mIndex : 8;
-        uint32_t mHash  : 24;
-    };
-
-    struct HashListBlock : public intrusive_list_node<HashList::HashListBlock> {
-        HashListBlock();
-
-        static const size_t BYTE_SIZE = 128;
-        static const size_t ENTRY_COUNT = (BYTE_SIZE - sizeof(intrusive_list_node<HashListBlock>) - sizeof(size_t)) / 4;
+protected:
+    static const uint16_t EMPTY_HASH = 0xffff;
+    static const uint8_t EMPTY_NS = 0xff;
 
-        size_t mCount = 0;
-        HashListNode mNodes[ENTRY_COUNT];
-    };
+    static uint16_t calcHash(const Item& item);
 
-    typedef intrusive_list<HashListBlock> TBlockList;
-    TBlockList mBlockList;
+    uint16_t mHashes[MAX_ENTRY_COUNT];
+    uint8_t mNsIndices[MAX_ENTRY_COUNT];
 }; // class HashList
 
 } // namespace nvs
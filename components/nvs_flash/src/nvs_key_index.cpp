@@ -0,0 +1,182 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nvs_key_index.hpp"
+
+namespace nvs
+{
+
+void KeyIndex::init(size_t byteSize)
+{
+    size_t capacity = byteSize / sizeof(Slot);
+    if (capacity != mCapacity) {
+        mSlots.reset((capacity > 0) ? new Slot[capacity] : nullptr);
+        mCapacity = capacity;
+    }
+    clear();
+}
+
+void KeyIndex::clear()
+{
+    for (size_t i = 0; i < mCapacity; ++i) {
+        mSlots[i].mPage = nullptr;
+    }
+    mUsedCount = 0;
+    mValid = (mCapacity > 0);
+}
+
+uint32_t KeyIndex::calcHash(uint8_t nsIndex, const char* key)
+{
+    // datatype and chunk index are left out, so that all the items
+    // sharing <namespace, key> (e.g. blob index and data chunks) end up together
+    return Item(nsIndex, ItemType::ANY, 0, key).calculateCrc32WithoutValue();
+}
+
+size_t KeyIndex::findSlot(uint32_t hash, uint8_t nsIndex, const Page* page) const
+{
+    if (mCapacity == 0) {
+        return SIZE_MAX;
+    }
+    for (size_t i = homeSlot(hash); mSlots[i].mPage != nullptr; i = (i + 1) % mCapacity) {
+        const Slot& slot = mSlots[i];
+        if (slot.mHash == hash && slot.mNsIndex == nsIndex && slot.mPage == page) {
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+void KeyIndex::eraseSlot(size_t index)
+{
+    // backward shift deletion, keeps probe sequences intact without tombstones
+    size_t hole = index;
+    for (size_t i = (hole + 1) % mCapacity; mSlots[i].mPage != nullptr; i = (i + 1) % mCapacity) {
+        size_t home = homeSlot(mSlots[i].mHash);
+        bool canStay = (hole <= i) ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (!canStay) {
+            mSlots[hole] = mSlots[i];
+            hole = i;
+        }
+    }
+    mSlots[hole].mPage = nullptr;
+    --mUsedCount;
+}
+
+void KeyIndex::insert(uint8_t nsIndex, const char* key, Page* page)
+{
+    if (!mValid) {
+        return;
+    }
+    uint32_t hash = calcHash(nsIndex, key);
+    size_t i = homeSlot(hash);
+    for (; mSlots[i].mPage != nullptr; i = (i + 1) % mCapacity) {
+        Slot& slot = mSlots[i];
+        if (slot.mHash == hash && slot.mNsIndex == nsIndex && slot.mPage == page) {
+            if (slot.mCount < UINT8_MAX) {
+                ++slot.mCount;
+            }
+            return;
+        }
+    }
+
+    // keep load factor below 3/4, otherwise probe sequences get too long
+    if ((mUsedCount + 1) * 4 > mCapacity * 3) {
+        mValid = false;
+        return;
+    }
+    mSlots[i].mHash = hash;
+    mSlots[i].mPage = page;
+    mSlots[i].mNsIndex = nsIndex;
+    mSlots[i].mCount = 1;
+    ++mUsedCount;
+}
+
+void KeyIndex::erase(uint8_t nsIndex, const char* key, Page* page)
+{
+    if (!mValid) {
+        return;
+    }
+    size_t i = findSlot(calcHash(nsIndex, key), nsIndex, page);
+    if (i == SIZE_MAX) {
+        return;
+    }
+    if (mSlots[i].mCount > 1) {
+        --mSlots[i].mCount;
+    } else {
+        eraseSlot(i);
+    }
+}
+
+void KeyIndex::eraseNamespace(uint8_t nsIndex)
+{
+    if (!mValid) {
+        return;
+    }
+    for (size_t i = 0; i < mCapacity;) {
+        if (mSlots[i].mPage != nullptr && mSlots[i].mNsIndex == nsIndex) {
+            eraseSlot(i); // another slot may have been moved into i, check it again
+        } else {
+            ++i;
+        }
+    }
+}
+
+void KeyIndex::relocate(Page* from, Page* to)
+{
+    if (!mValid || from == to) {
+        return;
+    }
+    for (size_t i = 0; i < mCapacity;) {
+        Slot& slot = mSlots[i];
+        if (slot.mPage != from) {
+            ++i;
+            continue;
+        }
+        size_t existing = findSlot(slot.mHash, slot.mNsIndex, to);
+        if (existing == SIZE_MAX) {
+            slot.mPage = to;
+            ++i;
+        } else {
+            size_t count = mSlots[existing].mCount + slot.mCount;
+            mSlots[existing].mCount = (count < UINT8_MAX) ? count : UINT8_MAX;
+            eraseSlot(i);
+        }
+    }
+}
+
+size_t KeyIndex::find(uint8_t nsIndex, const char* key, Page** pages, size_t maxPages) const
+{
+    if (mCapacity == 0) {
+        return 0;
+    }
+    uint32_t hash = calcHash(nsIndex, key);
+    size_t count = 0;
+    for (size_t i = homeSlot(hash); mSlots[i].mPage != nullptr; i = (i + 1) % mCapacity) {
+        const Slot& slot = mSlots[i];
+        if (slot.mHash == hash && slot.mNsIndex == nsIndex) {
+            if (count < maxPages) {
+                pages[count] = slot.mPage;
+            }
+            ++count;
+        }
+    }
+    return count;
+}
+
+bool KeyIndex::contains(uint8_t nsIndex, const char* key, const Page* page) const
+{
+    return findSlot(calcHash(nsIndex, key), nsIndex, page) != SIZE_MAX;
+}
+
+} // namespace nvs
@@ -0,0 +1,117 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef nvs_key_index_hpp
+#define nvs_key_index_hpp
+
+#include <memory>
+#include "nvs.h"
+#include "nvs_types.hpp"
+
+namespace nvs
+{
+
+class Page;
+
+/**
+ * Storage-wide index which maps <namespace, key> to the pages holding
+ * items with that namespace and key.
+ *
+ * The index is conservative: it may report a page which no longer holds
+ * a matching item, but it never omits a page which does. Every page is
+ * tracked together with the number of items for the key it holds, so that
+ * the entry can be dropped once the last of them is erased.
+ *
+ * Memory is allocated once, in init(). If the index runs out of room it
+ * marks itself invalid and the owner must fall back to scanning all pages.
+ */
+class KeyIndex
+{
+public:
+    KeyIndex() {}
+
+    void init(size_t byteSize);
+
+    void clear();
+
+    bool isValid() const
+    {
+        return mValid;
+    }
+
+    void invalidate()
+    {
+        mValid = false;
+    }
+
+    void insert(uint8_t nsIndex, const char* key, Page* page);
+
+    void erase(uint8_t nsIndex, const char* key, Page* page);
+
+    void eraseNamespace(uint8_t nsIndex);
+
+    void relocate(Page* from, Page* to);
+
+    /**
+     * Fill 'pages' with up to 'maxPages' pages which may contain items with the given key.
+     * Returns the total number of such pages, which may be larger than maxPages.
+     */
+    size_t find(uint8_t nsIndex, const char* key, Page** pages, size_t maxPages) const;
+
+    bool contains(uint8_t nsIndex, const char* key, const Page* page) const;
+
+    size_t getCapacity() const
+    {
+        return mCapacity;
+    }
+
+    size_t getUsedCount() const
+    {
+        return mUsedCount;
+    }
+
+    static size_t getSlotSize()
+    {
+        return sizeof(Slot);
+    }
+
+protected:
+    /* Slots form an open addressing table with linear probing.
+     * A slot with mPage == nullptr is empty. */
+    struct Slot {
+        uint32_t mHash;
+        Page* mPage;
+        uint8_t mNsIndex;
+        uint8_t mCount;
+    };
+
+    static uint32_t calcHash(uint8_t nsIndex, const char* key);
+
+    size_t homeSlot(uint32_t hash) const
+    {
+        return hash % mCapacity;
+    }
+
+    size_t findSlot(uint32_t hash, uint8_t nsIndex, const Page* page) const;
+
+    void eraseSlot(size_t index);
+
+    std::unique_ptr<Slot[]> mSlots;
+    size_t mCapacity = 0;
+    size_t mUsedCount = 0;
+    bool mValid = false;
+}; // class KeyIndex
+
+} // namespace nvs
+
+#endif /* nvs_key_index_hpp */
@@ -17,11 +17,14 @@
 #ifdef CONFIG_NVS_ENCRYPTION
 #include "nvs_encr.hpp"
 #include <string.h>
+#include <stdlib.h>
 #endif
 
 namespace nvs
 {
 #ifdef CONFIG_NVS_ENCRYPTION
+static const size_t NVS_OPS_STACK_BUF_SIZE = 64;
+
 esp_err_t nvs_flash_write(size_t destAddr, const void *srcAddr, size_t size) {
 
     if(EncrMgr::isEncrActive()) {
@@ -29,14 +32,23 @@ esp_err_t nvs_flash_write(size_t destAddr, const void *srcAddr, size_t size) {
         auto xtsCtxt = encrMgr->findXtsCtxtFromAddr(destAddr);
 
         if(xtsCtxt) {
-            uint8_t* buf = static_cast<uint8_t*>(malloc(size));
+            /* Most writes are a single entry, keep those off the heap */
+            uint32_t stackBuf[NVS_OPS_STACK_BUF_SIZE / sizeof(uint32_t)];
+            uint8_t* buf = reinterpret_cast<uint8_t*>(stackBuf);
+            if (size > sizeof(stackBuf)) {
+                buf = static_cast<uint8_t*>(malloc(size));
+                if (!buf) {
+                    return ESP_ERR_NO_MEM;
+                }
+            }
             memcpy(buf, srcAddr, size);
             auto err = encrMgr->encryptNvsData(buf, destAddr, size, xtsCtxt);
-            if( err != ESP_OK) {
-                return err;
+            if (err == ESP_OK) {
+                err = spi_flash_write(destAddr, buf, size);
+            }
+            if (buf != reinterpret_cast<uint8_t*>(stackBuf)) {
+                free(buf);
             }
-            err = spi_flash_write(destAddr, buf, size);
-            delete buf;
             return err;
         }
     }
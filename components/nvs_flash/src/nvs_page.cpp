@@ -257,6 +257,95 @@ esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, c
     return ESP_OK;
 }
 
+esp_err_t Page::writeItems(Item* items, size_t count)
+{
+    esp_err_t err;
+
+    if (mState == PageState::INVALID) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+
+    if (mState == PageState::UNINITIALIZED) {
+        err = initialize();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    if (mState == PageState::FULL) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    if (mNextFreeEntry == INVALID_ENTRY || mNextFreeEntry + count > ENTRY_COUNT) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        assert(!isVariableLengthType(items[i].datatype) && items[i].span == 1);
+        items[i].crc32 = items[i].calculateCrc32();
+    }
+
+    // Entries are marked as written starting from the last one. If power goes off before
+    // the first one is marked, mLoadEntryTable finds the whole range half-written and erases it.
+    err = nvs_flash_write(getEntryAddress(mNextFreeEntry), items, count * sizeof(Item));
+    if (err != ESP_OK) {
+        mState = PageState::INVALID;
+        return err;
+    }
+
+    err = alterEntryRangeState(mNextFreeEntry, mNextFreeEntry + count, EntryState::WRITTEN);
+    if (err != ESP_OK) {
+        // the entry table is partly marked as written, so the free entries are no longer known
+        mState = PageState::INVALID;
+        return err;
+    }
+
+    const size_t first = mNextFreeEntry;
+    for (size_t i = 0; i < count; ++i) {
+        mHashList.insert(items[i], first + i);
+    }
+
+    if (mFirstUsedEntry == INVALID_ENTRY) {
+        mFirstUsedEntry = first;
+    }
+
+    mUsedEntryCount += count;
+    mNextFreeEntry += count;
+
+    // Erase previous versions of the items found on this page. Each word of the entry
+    // state table is written once, no matter how many of its entries have changed.
+    uint32_t changedWords = 0;
+    for (size_t i = 0; i < count; ++i) {
+        size_t index = 0;
+        Item item;
+        if (findItem(items[i].nsIndex, items[i].datatype, items[i].key, index, item) != ESP_OK || index >= first) {
+            continue;
+        }
+        mHashList.erase(index);
+        mEntryTable.set(index, EntryState::ERASED);
+        changedWords |= 1 << mEntryTable.getWordIndex(index);
+        --mUsedEntryCount;
+        ++mErasedEntryCount;
+        if (index == mFirstUsedEntry) {
+            updateFirstUsedEntry(index, 1);
+        }
+    }
+
+    for (size_t wordIndex = 0; changedWords != 0; ++wordIndex, changedWords >>= 1) {
+        if ((changedWords & 1) == 0) {
+            continue;
+        }
+        uint32_t word = mEntryTable.data()[wordIndex];
+        err = spi_flash_write(mBaseAddress + ENTRY_TABLE_OFFSET + static_cast<uint32_t>(wordIndex) * 4,
+                &word, sizeof(word));
+        if (err != ESP_OK) {
+            mState = PageState::INVALID;
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
 esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize, uint8_t chunkIdx, VerOffset chunkStart)
 {
     size_t index = 0;
@@ -286,15 +375,15 @@ esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, vo
 
     uint8_t* dst = reinterpret_cast<uint8_t*>(data);
     size_t left = item.varLength.dataSize;
-    for (size_t i = index + 1; i < index + item.span; ++i) {
-        Item ditem;
-        rc = readEntry(i, ditem);
+    Item ditems[READ_BATCH_ENTRIES];
+    for (size_t i = index + 1; i < index + item.span; i += READ_BATCH_ENTRIES) {
+        size_t count = std::min(index + item.span - i, static_cast<size_t>(READ_BATCH_ENTRIES));
+        rc = readEntries(i, ditems, count);
         if (rc != ESP_OK) {
             return rc;
         }
-        size_t willCopy = ENTRY_SIZE;
-        willCopy = (left < willCopy)?left:willCopy;
-        memcpy(dst, ditem.rawData, willCopy);
+        size_t willCopy = std::min(left, count * ENTRY_SIZE);
+        memcpy(dst, ditems, willCopy);
         left -= willCopy;
         dst += willCopy;
     }
@@ -308,6 +397,70 @@ esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, vo
     return ESP_OK;
 }
 
+esp_err_t Page::readItemData(uint8_t nsIndex, ItemType datatype, const char* key, size_t offset, void* data, size_t dataSize, uint8_t chunkIdx, bool checkCrc)
+{
+    size_t index = 0;
+    Item item;
+
+    if (mState == PageState::INVALID) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+
+    if (!isVariableLengthType(datatype)) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+
+    esp_err_t rc = findItem(nsIndex, datatype, key, index, item, chunkIdx);
+    if (rc != ESP_OK) {
+        return rc;
+    }
+
+    size_t itemSize = item.varLength.dataSize;
+    if (offset > itemSize || dataSize > itemSize - offset) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    if (dataSize == 0 && !checkCrc) {
+        return ESP_OK;
+    }
+
+    size_t first = 0;
+    size_t last = (itemSize + ENTRY_SIZE - 1) / ENTRY_SIZE;
+    if (!checkCrc) {
+        first = offset / ENTRY_SIZE;
+        last = (offset + dataSize + ENTRY_SIZE - 1) / ENTRY_SIZE;
+    }
+
+    uint8_t* dst = reinterpret_cast<uint8_t*>(data);
+    uint32_t crc32 = 0xffffffff;
+    Item ditems[READ_BATCH_ENTRIES];
+    for (size_t i = first; i < last; i += READ_BATCH_ENTRIES) {
+        size_t count = std::min(last - i, static_cast<size_t>(READ_BATCH_ENTRIES));
+        rc = readEntries(index + 1 + i, ditems, count);
+        if (rc != ESP_OK) {
+            return rc;
+        }
+        const uint8_t* src = reinterpret_cast<const uint8_t*>(ditems);
+        size_t batchStart = i * ENTRY_SIZE;
+        size_t batchSize = std::min(itemSize - batchStart, count * ENTRY_SIZE);
+        if (checkCrc) {
+            crc32 = Item::calculateCrc32(src, batchSize, crc32);
+        }
+        size_t copyStart = std::max(batchStart, offset);
+        size_t copyEnd = std::min(batchStart + batchSize, offset + dataSize);
+        if (copyStart < copyEnd) {
+            memcpy(dst + copyStart - offset, src + copyStart - batchStart, copyEnd - copyStart);
+        }
+    }
+    if (checkCrc && crc32 != item.varLength.dataCrc32) {
+        rc = eraseEntryAndSpan(index);
+        if (rc != ESP_OK) {
+            return rc;
+        }
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
 esp_err_t Page::cmpItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint8_t chunkIdx, VerOffset chunkStart)
 {
     size_t index = 0;
@@ -501,6 +654,53 @@ esp_err_t Page::copyItems(Page& other)
     return ESP_OK;
 }
 
+esp_err_t Page::moveItem(size_t index, Page& other)
+{
+    if (other.mState == PageState::UNINITIALIZED) {
+        auto err = other.initialize();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    if (other.mState != PageState::ACTIVE) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    Item entry;
+    auto err = readEntry(index, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    size_t end = index + entry.span;
+    assert(end <= ENTRY_COUNT);
+    if (other.mNextFreeEntry == INVALID_ENTRY || other.mNextFreeEntry + entry.span > ENTRY_COUNT) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    other.mHashList.insert(entry, other.mNextFreeEntry);
+    err = other.writeEntry(entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    for (size_t i = index + 1; i < end; ++i) {
+        err = readEntry(i, entry);
+        if (err != ESP_OK) {
+            return err;
+        }
+        err = other.writeEntry(entry);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    // If power goes off before the original is erased, the copy is the last item
+    // of the newest page, and PageManager::load erases the original.
+    return eraseEntryAndSpan(index);
+}
+
 esp_err_t Page::mLoadEntryTable()
 {
     // for states where we actually care about data in the page, read entry state table
@@ -603,9 +803,6 @@ esp_err_t Page::mLoadEntryTable()
 
             mHashList.insert(item, i);
 
-            // search for potential duplicate item
-            size_t duplicateIndex = mHashList.find(0, item);
-
             if (isVariableLengthType(item.datatype)) {
                 span = item.span;
                 bool needErase = false;
@@ -622,12 +819,24 @@ esp_err_t Page::mLoadEntryTable()
                 }
             }
 
-            /* Note that logic for duplicate detections works fine even 
+            /* Search for potential duplicate item. Hashes of different items may match,
+             * so each candidate is compared with the item itself.
+             * Note that logic for duplicate detections works fine even 
              * when old-format blob is present along with new-format blob-index 
-             * for same key on active page. Since datatype is not used in hash calculation, 
+             * for same key on active page. Since datatype is not compared,
              * old-format blob will be removed.*/
-            if (duplicateIndex < i) {
-                eraseEntryAndSpan(duplicateIndex);
+            for (size_t j = mHashList.find(0, item); j < i; j = mHashList.find(j + 1, item)) {
+                Item dupItem;
+                err = readEntry(j, dupItem);
+                if (err != ESP_OK) {
+                    mState = PageState::INVALID;
+                    return err;
+                }
+                if (dupItem.nsIndex == item.nsIndex && dupItem.chunkIndex == item.chunkIndex
+                        && strncmp(dupItem.key, item.key, Item::MAX_KEY_LENGTH) == 0) {
+                    eraseEntryAndSpan(j);
+                    break;
+                }
             }
         }
 
@@ -648,21 +857,35 @@ esp_err_t Page::mLoadEntryTable()
     } else if (mState == PageState::FULL || mState == PageState::FREEING) {
         // We have already filled mHashList for page in active state.
         // Do the same for the case when page is in full or freeing state.
-        Item item;
+        // Nothing can be appended to such a page, so entries are read in batches
+        // rather than one by one.
+        Item* batch = new Item[LOAD_BATCH_ENTRIES];
+        size_t batchStart = 0;
+        size_t batchEnd = 0;
         for (size_t i = mFirstUsedEntry; i < ENTRY_COUNT; ++i) {
             if (mEntryTable.get(i) != EntryState::WRITTEN) {
                 continue;
             }
 
-            auto err = readEntry(i, item);
-            if (err != ESP_OK) {
-                mState = PageState::INVALID;
-                return err;
+            if (i >= batchEnd) {
+                batchStart = i;
+                batchEnd = std::min(i + LOAD_BATCH_ENTRIES, static_cast<size_t>(ENTRY_COUNT));
+                while (mEntryTable.get(batchEnd - 1) != EntryState::WRITTEN) {
+                    --batchEnd;
+                }
+                auto err = readEntries(batchStart, batch, batchEnd - batchStart);
+                if (err != ESP_OK) {
+                    delete[] batch;
+                    mState = PageState::INVALID;
+                    return err;
+                }
             }
+            Item& item = batch[i - batchStart];
 
             if (item.crc32 != item.calculateCrc32()) {
-                err = eraseEntryAndSpan(i);
+                auto err = eraseEntryAndSpan(i);
                 if (err != ESP_OK) {
+                    delete[] batch;
                     mState = PageState::INVALID;
                     return err;
                 }
@@ -686,7 +909,7 @@ esp_err_t Page::mLoadEntryTable()
 
             i += span - 1;
         }
-
+        delete[] batch;
     }
 
     return ESP_OK;
@@ -776,6 +999,12 @@ esp_err_t Page::readEntry(size_t index, Item& dst) const
     return ESP_OK;
 }
 
+esp_err_t Page::readEntries(size_t index, Item* dst, size_t count) const
+{
+    assert(index + count <= ENTRY_COUNT);
+    return nvs_flash_read(getEntryAddress(index), dst, count * sizeof(Item));
+}
+
 esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, size_t &itemIndex, Item& item, uint8_t chunkIdx, VerOffset chunkStart)
 {
     if (mState == PageState::CORRUPT || mState == PageState::INVALID || mState == PageState::UNINITIALIZED) {
@@ -797,8 +1026,21 @@ esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, si
         end = ENTRY_COUNT;
     }
 
-    if (nsIndex != NS_ANY && datatype != ItemType::ANY && key != NULL) {
-        size_t cachedIndex = mHashList.find(start, Item(nsIndex, datatype, 0, key, chunkIdx));
+    // with a key to look for, only the entries with a matching hash have to be read,
+    // without a key, only the entries of the namespace
+    const bool useHashList = (nsIndex != NS_ANY && datatype != ItemType::ANY && key != NULL);
+    const bool useNsList = (nsIndex != NS_ANY && key == NULL);
+    Item hashItem;
+    if (useHashList) {
+        hashItem = Item(nsIndex, datatype, 0, key, chunkIdx);
+        size_t cachedIndex = mHashList.find(start, hashItem);
+        if (cachedIndex < ENTRY_COUNT) {
+            start = cachedIndex;
+        } else {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+    } else if (useNsList) {
+        size_t cachedIndex = mHashList.findNamespace(start, nsIndex);
         if (cachedIndex < ENTRY_COUNT) {
             start = cachedIndex;
         } else {
@@ -809,6 +1051,11 @@ esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, si
     size_t next;
     for (size_t i = start; i < end; i = next) {
         next = i + 1;
+        if (useHashList) {
+            next = std::min(mHashList.find(i + 1, hashItem), end);
+        } else if (useNsList) {
+            next = std::min(mHashList.findNamespace(i + 1, nsIndex), end);
+        }
         if (mEntryTable.get(i) != EntryState::WRITTEN) {
             continue;
         }
@@ -829,7 +1076,7 @@ esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, si
             continue;
         }
 
-        if (isVariableLengthType(item.datatype)) {
+        if (isVariableLengthType(item.datatype) && !useHashList && !useNsList) {
             next = i + item.span;
         }
 
@@ -947,6 +1194,16 @@ size_t Page::getVarDataTailroom() const
     return ((mNextFreeEntry < (ENTRY_COUNT-1)) ? ((ENTRY_COUNT - mNextFreeEntry - 1) * ENTRY_SIZE): 0);
 }
 
+size_t Page::getFreeEntryCount() const
+{
+    if (mState == PageState::UNINITIALIZED) {
+        return ENTRY_COUNT;
+    } else if (mState != PageState::ACTIVE) {
+        return 0;
+    }
+    return (mNextFreeEntry < ENTRY_COUNT) ? (ENTRY_COUNT - mNextFreeEntry) : 0;
+}
+
 const char* Page::pageStateToName(PageState ps)
 {
     switch (ps) {
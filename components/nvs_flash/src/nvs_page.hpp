@@ -46,6 +46,12 @@ public:
     static const size_t ENTRY_COUNT = 126;
     static const uint32_t INVALID_ENTRY = 0xffffffff;
 
+    /* Number of data entries read from flash (and decrypted) at once */
+    static const size_t READ_BATCH_ENTRIES = 4;
+
+    /* Number of entries read at once while loading a full page */
+    static const size_t LOAD_BATCH_ENTRIES = 32;
+
     static const size_t CHUNK_MAX_SIZE = ENTRY_SIZE * (ENTRY_COUNT - 1);
 
     static const uint8_t NS_INDEX = 0;
@@ -92,8 +98,16 @@ public:
 
     esp_err_t writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint8_t chunkIdx = CHUNK_ANY);
 
+    // Write primitive items into consecutive entries, then erase their previous versions from this page.
+    // Either all or none of the new items survive a power loss.
+    esp_err_t writeItems(Item* items, size_t count);
+
     esp_err_t readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize, uint8_t chunkIdx = CHUNK_ANY, VerOffset chunkStart = VerOffset::VER_ANY);
 
+    // Read dataSize bytes of a variable length item, starting at offset within its data.
+    // Unless checkCrc is set, only the entries overlapping the requested range are read.
+    esp_err_t readItemData(uint8_t nsIndex, ItemType datatype, const char* key, size_t offset, void* data, size_t dataSize, uint8_t chunkIdx = CHUNK_ANY, bool checkCrc = true);
+
     esp_err_t cmpItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint8_t chunkIdx = CHUNK_ANY, VerOffset chunkStart = VerOffset::VER_ANY);
 
     esp_err_t eraseItem(uint8_t nsIndex, ItemType datatype, const char* key, uint8_t chunkIdx = CHUNK_ANY, VerOffset chunkStart = VerOffset::VER_ANY);
@@ -137,12 +151,16 @@ public:
     }
     size_t getVarDataTailroom() const ;
 
+    size_t getFreeEntryCount() const;
+
     esp_err_t markFull();
 
     esp_err_t markFreeing();
 
     esp_err_t copyItems(Page& other);
 
+    esp_err_t moveItem(size_t index, Page& other);
+
     esp_err_t erase();
 
     void debugDump() const;
@@ -187,6 +205,8 @@ protected:
 
     esp_err_t readEntry(size_t index, Item& dst) const;
 
+    esp_err_t readEntries(size_t index, Item* dst, size_t count) const;
+
     esp_err_t writeEntry(const Item& item);
     
     esp_err_t writeEntryData(const uint8_t* data, size_t size);
@@ -228,6 +248,7 @@ protected:
     static const uint32_t ENTRY_DATA_OFFSET = ENTRY_TABLE_OFFSET + 32;
 
     static_assert(sizeof(Header) == 32, "header size must be 32 bytes");
+    static_assert(ENTRY_COUNT <= HashList::MAX_ENTRY_COUNT, "hash list must have a slot for every entry");
     static_assert(ENTRY_TABLE_OFFSET % 32 == 0, "entry table offset should be aligned");
     static_assert(ENTRY_DATA_OFFSET % 32 == 0, "entry data offset should be aligned");
 
@@ -131,7 +131,7 @@ esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
     return ESP_OK;
 }
 
-esp_err_t PageManager::requestNewPage()
+esp_err_t PageManager::requestNewPage(Page** freedPage)
 {
     if (mFreePageList.empty()) {
         return ESP_ERR_NVS_INVALID_STATE;
@@ -167,6 +167,11 @@ esp_err_t PageManager::requestNewPage()
 
     Page* erasedPage = maxUnusedItemsPageIt;
 
+    // let the caller know that items are being moved from erasedPage to newPage
+    if (freedPage) {
+        *freedPage = erasedPage;
+    }
+
 #ifndef NDEBUG
     size_t usedEntries = erasedPage->getUsedEntryCount();
 #endif
@@ -194,6 +199,21 @@ esp_err_t PageManager::requestNewPage()
     return ESP_OK;
 }
 
+esp_err_t PageManager::reclaimPage(Page* page)
+{
+    // only pages which no longer hold any items can be erased without going through FREEING state
+    assert(page != &mPageList.back());
+    assert(page->getUsedEntryCount() == 0);
+
+    auto err = page->erase();
+    if (err != ESP_OK) {
+        return err;
+    }
+    mPageList.erase(page);
+    mFreePageList.push_back(page);
+    return ESP_OK;
+}
+
 esp_err_t PageManager::activatePage()
 {
     if (mFreePageList.empty()) {
@@ -52,7 +52,14 @@ public:
         return mPageCount;
     }
 
-    esp_err_t requestNewPage();
+    esp_err_t requestNewPage(Page** freedPage = nullptr);
+
+    esp_err_t reclaimPage(Page* page);
+
+    size_t getFreePageCount() const
+    {
+        return mFreePageList.size();
+    }
 
     esp_err_t fillStats(nvs_stats_t& nvsStats);
 
@@ -31,55 +31,66 @@ void Storage::clearNamespaces()
     mNamespaces.clearAndFreeNodes();
 }
 
-void Storage::populateBlobIndices(TBlobIndexList& blobIdxList)
+void Storage::eraseOrphanDataBlobs(TBlobIndexList& blobIdxList, TBlobDataList& blobDataList)
 {
-    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
-        Page& p = *it;
-        size_t itemIndex = 0;
-        Item item;
-
-        /* If the power went off just after writing a blob index, the duplicate detection
-         * logic in pagemanager will remove the earlier index. So we should never find a
-         * duplicate index at this point */
-
-        while (p.findItem(Page::NS_ANY, ItemType::BLOB_IDX, nullptr, itemIndex, item) == ESP_OK) {
-            BlobIndexNode* entry = new BlobIndexNode;
-
-            item.getKey(entry->key, sizeof(entry->key) - 1);
-            entry->nsIndex = item.nsIndex;
-            entry->chunkStart = item.blobIndex.chunkStart;
-            entry->chunkCount = item.blobIndex.chunkCount;
-
-            blobIdxList.push_back(entry);
-            itemIndex += item.span;
+    /* Chunks with same <ns,key> and with chunkIndex in the following ranges
+     * belong to same family.
+     * 1) VER_0_OFFSET <= chunkIndex < VER_1_OFFSET-1 => Version0 chunks
+     * 2) VER_1_OFFSET <= chunkIndex < VER_ANY => Version1 chunks
+     */
+    for (auto chunk = blobDataList.begin(); chunk != blobDataList.end(); ++chunk) {
+        auto iter = std::find_if(blobIdxList.begin(),
+                blobIdxList.end(),
+                [=] (const BlobIndexNode& e) -> bool
+                {return (strncmp(chunk->key, e.key, sizeof(e.key) - 1) == 0)
+                        && (chunk->nsIndex == e.nsIndex)
+                        && (chunk->chunkIndex >=  static_cast<uint8_t> (e.chunkStart))
+                        && (chunk->chunkIndex < static_cast<uint8_t> (e.chunkStart) + e.chunkCount);});
+        if (iter == std::end(blobIdxList)) {
+            if (chunk->mPage->eraseItem(chunk->nsIndex, ItemType::BLOB_DATA, chunk->key, chunk->chunkIndex) == ESP_OK) {
+                mKeyIndex.erase(chunk->nsIndex, chunk->key, chunk->mPage);
+            }
         }
     }
 }
 
-void Storage::eraseOrphanDataBlobs(TBlobIndexList& blobIdxList)
+bool Storage::isTransactionMarker(const Item& item)
 {
-    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
-        Page& p = *it;
-        size_t itemIndex = 0;
-        Item item;
-        /* Chunks with same <ns,key> and with chunkIndex in the following ranges
-         * belong to same family.
-         * 1) VER_0_OFFSET <= chunkIndex < VER_1_OFFSET-1 => Version0 chunks
-         * 2) VER_1_OFFSET <= chunkIndex < VER_ANY => Version1 chunks
-         */
-        while (p.findItem(Page::NS_ANY, ItemType::BLOB_DATA, nullptr, itemIndex, item) == ESP_OK) {
-
-            auto iter = std::find_if(blobIdxList.begin(),
-                    blobIdxList.end(),
-                    [=] (const BlobIndexNode& e) -> bool
-                    {return (strncmp(item.key, e.key, sizeof(e.key) - 1) == 0)
-                            && (item.nsIndex == e.nsIndex)
-                            && (item.chunkIndex >=  static_cast<uint8_t> (e.chunkStart))
-                            && (item.chunkIndex < static_cast<uint8_t> (e.chunkStart) + e.chunkCount);});
-            if (iter == std::end(blobIdxList)) {
-                p.eraseItem(item.nsIndex, item.datatype, item.key, item.chunkIndex);
+    return item.nsIndex == Page::NS_INDEX && item.datatype == ItemType::U32
+            && item.chunkIndex == TRANSACTION_MARKER_CHUNK
+            && strncmp(item.key, TRANSACTION_MARKER_KEY, Item::MAX_KEY_LENGTH) == 0;
+}
+
+void Storage::finishTransactions(TTransactionMarkerList& markerList)
+{
+    /* If the marker is present, power went off after the transaction had been written,
+     * but before all previous versions of its values had been erased */
+    for (auto marker = markerList.begin(); marker != markerList.end(); ++marker) {
+        Page& p = *marker->mPage;
+        for (size_t i = marker->mIndex + 1; i <= marker->mIndex + marker->mItemCount && i < Page::ENTRY_COUNT; ++i) {
+            size_t itemIndex = i;
+            Item item;
+            if (p.findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) != ESP_OK || itemIndex != i) {
+                continue;
+            }
+            for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+                size_t oldIndex = 0;
+                Item oldItem;
+                while (it->findItem(item.nsIndex, item.datatype, item.key, oldIndex, oldItem) == ESP_OK
+                        && (static_cast<Page*>(it) != &p || oldIndex < marker->mIndex)) {
+                    if (it->eraseItem(item.nsIndex, item.datatype, item.key) != ESP_OK) {
+                        break;
+                    }
+                    mKeyIndex.erase(item.nsIndex, item.key, static_cast<Page*>(it));
+                    oldIndex = 0;
+                }
+                if (static_cast<Page*>(it) == &p) {
+                    break;
+                }
             }
-            itemIndex += item.span;
+        }
+        if (p.eraseItem(Page::NS_INDEX, ItemType::U32, TRANSACTION_MARKER_KEY, TRANSACTION_MARKER_CHUNK) == ESP_OK) {
+            mKeyIndex.erase(Page::NS_INDEX, TRANSACTION_MARKER_KEY, &p);
         }
     }
 }
@@ -92,19 +103,50 @@ esp_err_t Storage::init(uint32_t baseSector, uint32_t sectorCount)
         return err;
     }
 
-    // load namespaces list
+    /* Load namespaces list, build the key index and collect blob indices and data chunks
+     * in a single pass over all items, so that each item header is read only once */
     clearNamespaces();
     std::fill_n(mNamespaceUsage.data(), mNamespaceUsage.byteSize() / 4, 0);
+    mKeyIndex.init(mKeyIndexSize);
+    TTransactionMarkerList markerList;
+    TBlobIndexList blobIdxList;
+    TBlobDataList blobDataList;
     for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
         Page& p = *it;
         size_t itemIndex = 0;
         Item item;
-        while (p.findItem(Page::NS_INDEX, ItemType::U8, nullptr, itemIndex, item) == ESP_OK) {
-            NamespaceEntry* entry = new NamespaceEntry;
-            item.getKey(entry->mName, sizeof(entry->mName) - 1);
-            item.getValue(entry->mIndex);
-            mNamespaces.push_back(entry);
-            mNamespaceUsage.set(entry->mIndex, true);
+        while (p.findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
+            if (item.nsIndex == Page::NS_INDEX && item.datatype == ItemType::U8) {
+                NamespaceEntry* entry = new NamespaceEntry;
+                item.getKey(entry->mName, sizeof(entry->mName) - 1);
+                item.getValue(entry->mIndex);
+                mNamespaces.push_back(entry);
+                mNamespaceUsage.set(entry->mIndex, true);
+            } else if (isTransactionMarker(item)) {
+                TransactionMarkerNode* marker = new TransactionMarkerNode;
+                marker->mPage = &p;
+                marker->mIndex = itemIndex;
+                item.getValue(marker->mItemCount);
+                markerList.push_back(marker);
+            } else if (item.datatype == ItemType::BLOB_IDX) {
+                /* If the power went off just after writing a blob index, the duplicate detection
+                 * logic in pagemanager will remove the earlier index. So we should never find a
+                 * duplicate index at this point */
+                BlobIndexNode* entry = new BlobIndexNode;
+                item.getKey(entry->key, sizeof(entry->key) - 1);
+                entry->nsIndex = item.nsIndex;
+                entry->chunkStart = item.blobIndex.chunkStart;
+                entry->chunkCount = item.blobIndex.chunkCount;
+                blobIdxList.push_back(entry);
+            } else if (item.datatype == ItemType::BLOB_DATA) {
+                BlobDataNode* entry = new BlobDataNode;
+                entry->mPage = &p;
+                item.getKey(entry->key, sizeof(entry->key) - 1);
+                entry->nsIndex = item.nsIndex;
+                entry->chunkIndex = item.chunkIndex;
+                blobDataList.push_back(entry);
+            }
+            mKeyIndex.insert(item.nsIndex, item.key, &p);
             itemIndex += item.span;
         }
     }
@@ -112,15 +154,16 @@ esp_err_t Storage::init(uint32_t baseSector, uint32_t sectorCount)
     mNamespaceUsage.set(255, true);
     mState = StorageState::ACTIVE;
 
-    // Populate list of multi-page index entries.
-    TBlobIndexList blobIdxList;
-    populateBlobIndices(blobIdxList);
+    // Erase values superseded by a transaction which was interrupted by power loss.
+    finishTransactions(markerList);
+    markerList.clearAndFreeNodes();
 
     // Remove the entries for which there is no parent multi-page index.
-    eraseOrphanDataBlobs(blobIdxList);
+    eraseOrphanDataBlobs(blobIdxList, blobDataList);
 
-    // Purge the blob index list
+    // Purge the blob index and data lists
     blobIdxList.clearAndFreeNodes();
+    blobDataList.clearAndFreeNodes();
 
 #ifndef ESP_PLATFORM
     debugCheck();
@@ -135,6 +178,33 @@ bool Storage::isValid() const
 
 esp_err_t Storage::findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item, uint8_t chunkIdx, VerOffset chunkStart)
 {
+    if (mKeyIndex.isValid() && key != nullptr && nsIndex != Page::NS_ANY) {
+        Page* pages[KEY_INDEX_MAX_PAGES];
+        size_t count = mKeyIndex.find(nsIndex, key, pages, KEY_INDEX_MAX_PAGES);
+        if (count <= KEY_INDEX_MAX_PAGES) {
+            // probe candidate pages in the same order as the page list, i.e. by sequence number
+            uint32_t seqNumbers[KEY_INDEX_MAX_PAGES];
+            for (size_t i = 0; i < count; ++i) {
+                if (pages[i]->getSeqNumber(seqNumbers[i]) != ESP_OK) {
+                    seqNumbers[i] = UINT32_MAX;
+                }
+                for (size_t j = i; j > 0 && seqNumbers[j - 1] > seqNumbers[j]; --j) {
+                    std::swap(seqNumbers[j - 1], seqNumbers[j]);
+                    std::swap(pages[j - 1], pages[j]);
+                }
+            }
+            for (size_t i = 0; i < count; ++i) {
+                size_t itemIndex = 0;
+                auto err = pages[i]->findItem(nsIndex, datatype, key, itemIndex, item, chunkIdx, chunkStart);
+                if (err == ESP_OK) {
+                    page = pages[i];
+                    return ESP_OK;
+                }
+            }
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+    }
+
     for (auto it = std::begin(mPageManager); it != std::end(mPageManager); ++it) {
         size_t itemIndex = 0;
         auto err = it->findItem(nsIndex, datatype, key, itemIndex, item, chunkIdx, chunkStart);
@@ -146,6 +216,91 @@ esp_err_t Storage::findItem(uint8_t nsIndex, ItemType datatype, const char* key,
     return ESP_ERR_NVS_NOT_FOUND;
 }
 
+esp_err_t Storage::requestNewPage()
+{
+    Page* freedPage = nullptr;
+    auto err = mPageManager.requestNewPage(&freedPage);
+    if (freedPage != nullptr) {
+        if (err == ESP_OK) {
+            // all items of the freed page now live on the new current page
+            mKeyIndex.relocate(freedPage, &getCurrentPage());
+        } else {
+            // items may be left on either of the pages
+            mKeyIndex.invalidate();
+        }
+    }
+    return err;
+}
+
+esp_err_t Storage::collectGarbage(size_t maxEntries, bool& done)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    /* Instead of copying a whole page while it is in FREEING state, items are moved to
+     * the current page one at a time, the same way as values are updated. Once the page
+     * holds no items, it is erased. */
+    size_t movedEntries = 0;
+    done = false;
+    while (mPageManager.getFreePageCount() < GC_FREE_PAGE_RESERVE) {
+        Page& current = getCurrentPage();
+        const size_t freeEntries = current.getFreeEntryCount();
+
+        // pick the page with the fewest items which all fit into the current page
+        Page* victim = nullptr;
+        for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+            if (&*it == &current || it->state() != Page::PageState::FULL) {
+                continue;
+            }
+            size_t used = it->getUsedEntryCount();
+            if (used <= freeEntries && (victim == nullptr || used < victim->getUsedEntryCount())) {
+                victim = it;
+            }
+        }
+        if (victim == nullptr) {
+            // nothing can be done until requestNewPage frees a page
+            break;
+        }
+
+        if (victim->getUsedEntryCount() == 0) {
+            auto err = mPageManager.reclaimPage(victim);
+            if (err != ESP_OK) {
+                return err;
+            }
+            continue;
+        }
+
+        if (movedEntries >= maxEntries) {
+            return ESP_OK;
+        }
+
+        size_t itemIndex = 0;
+        Item item;
+        auto err = victim->findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            // entries which don't belong to any item, leave them to requestNewPage
+            break;
+        } else if (err != ESP_OK) {
+            return err;
+        }
+
+        err = victim->moveItem(itemIndex, current);
+        if (err != ESP_OK) {
+            mKeyIndex.invalidate();
+            return err;
+        }
+        mKeyIndex.insert(item.nsIndex, item.key, &current);
+        mKeyIndex.erase(item.nsIndex, item.key, victim);
+        movedEntries += item.span;
+    }
+    done = true;
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
 esp_err_t Storage::writeMultiPageBlob(uint8_t nsIndex, const char* key, const void* data, size_t dataSize, VerOffset chunkStart)
 {
     uint8_t chunkCount = 0;
@@ -177,7 +332,7 @@ esp_err_t Storage::writeMultiPageBlob(uint8_t nsIndex, const char* key, const vo
                     return err;
                 }
             }
-            err = mPageManager.requestNewPage();
+            err = requestNewPage();
             if (err != ESP_OK) {
                 return err;
             } else if(getCurrentPage().getVarDataTailroom() == tailroom) {
@@ -203,6 +358,7 @@ esp_err_t Storage::writeMultiPageBlob(uint8_t nsIndex, const char* key, const vo
         if (err != ESP_OK) {
             break;
         } else {
+            mKeyIndex.insert(nsIndex, key, &page);
             UsedPageNode* node = new UsedPageNode();
             node->mPage = &page;
             usedPages.push_back(node);
@@ -213,7 +369,7 @@ esp_err_t Storage::writeMultiPageBlob(uint8_t nsIndex, const char* key, const vo
                         break;
                     }
                 }
-                err = mPageManager.requestNewPage();
+                err = requestNewPage();
                 if (err != ESP_OK) {
                     break;
                 }
@@ -230,6 +386,9 @@ esp_err_t Storage::writeMultiPageBlob(uint8_t nsIndex, const char* key, const vo
 
             err = getCurrentPage().writeItem(nsIndex, ItemType::BLOB_IDX, key, item.data, sizeof(item.data));
             assert(err != ESP_ERR_NVS_PAGE_FULL);
+            if (err == ESP_OK) {
+                mKeyIndex.insert(nsIndex, key, &getCurrentPage());
+            }
             break;
         }
     } while (1);
@@ -238,7 +397,9 @@ esp_err_t Storage::writeMultiPageBlob(uint8_t nsIndex, const char* key, const vo
         /* Anything failed, then we should erase all the written chunks*/
         int ii=0;
         for (auto it = std::begin(usedPages); it != std::end(usedPages); it++) {
-            it->mPage->eraseItem(nsIndex, ItemType::BLOB_DATA, key, ii++);
+            if (it->mPage->eraseItem(nsIndex, ItemType::BLOB_DATA, key, ii++) == ESP_OK) {
+                mKeyIndex.erase(nsIndex, key, it->mPage);
+            }
         }
     }
     usedPages.clearAndFreeNodes();
@@ -256,6 +417,9 @@ esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key
 
     esp_err_t err;
     if (datatype == ItemType::BLOB) {
+        if (isBlobWriterOpen(nsIndex, key)) {
+            return ESP_ERR_INVALID_STATE;
+        }
         err = findItem(nsIndex, ItemType::BLOB_IDX, key, findPage, item);
     } else {
         err = findItem(nsIndex, datatype, key, findPage, item);
@@ -335,7 +499,7 @@ esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key
                     return err;
                 }
             }
-            err = mPageManager.requestNewPage();
+            err = requestNewPage();
             if (err != ESP_OK) {
                 return err;
             }
@@ -350,6 +514,7 @@ esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key
         } else if (err != ESP_OK) {
             return err;
         }
+        mKeyIndex.insert(nsIndex, key, &getCurrentPage());
     }
 
     if (findPage) {
@@ -364,6 +529,7 @@ esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key
         if (err != ESP_OK) {
             return err;
         }
+        mKeyIndex.erase(nsIndex, key, findPage);
     }
 #ifndef ESP_PLATFORM
     debugCheck();
@@ -371,6 +537,221 @@ esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key
     return ESP_OK;
 }
 
+esp_err_t Storage::writePendingItems(uint8_t nsIndex, TPendingItemList& items)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    const size_t batchSize = std::min(items.size(), static_cast<size_t>(Page::ENTRY_COUNT));
+    if (batchSize == 0) {
+        return ESP_OK;
+    }
+    std::unique_ptr<Item[]> batch(new Item[batchSize]);
+    std::unique_ptr<PendingItem*[]> sources(new PendingItem*[batchSize]);
+    std::unique_ptr<bool[]> replaces(new bool[batchSize]);
+    esp_err_t err;
+
+    /* Items which are new or whose previous version is on the current page are written
+     * together. If power goes off after the batch has been written, but before the previous
+     * versions have been erased, duplicates on the active page are removed on load. */
+    bool pageFull;
+    do {
+        Page& page = getCurrentPage();
+        const size_t freeCount = page.getFreeEntryCount();
+        size_t count = 0;
+        pageFull = false;
+
+        for (auto it = items.begin(); it != items.end();) {
+            PendingItem* pending = it++;
+            Page* findPage = nullptr;
+            Item item;
+            err = findItem(nsIndex, pending->mDatatype, pending->mKey, findPage, item);
+            if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+                return err;
+            }
+            if (findPage != nullptr &&
+                    findPage->cmpItem(nsIndex, pending->mDatatype, pending->mKey, pending->mData, pending->mDataSize) == ESP_OK) {
+                items.erase(pending);
+                delete pending;
+                continue;
+            }
+            if (findPage != nullptr && findPage != &page) {
+                continue;
+            }
+            if (count == freeCount) {
+                pageFull = true;
+                break;
+            }
+            batch[count] = Item(nsIndex, pending->mDatatype, 1, pending->mKey);
+            memcpy(batch[count].data, pending->mData, pending->mDataSize);
+            sources[count] = pending;
+            replaces[count] = (findPage != nullptr);
+            ++count;
+        }
+
+        if (count > 0) {
+            err = page.writeItems(batch.get(), count);
+            if (err != ESP_OK) {
+                // the batch may have been written without erasing the previous versions
+                mKeyIndex.invalidate();
+                return err;
+            }
+
+            // previous versions on this page have been erased by writeItems
+            for (size_t i = 0; i < count; ++i) {
+                if (!replaces[i]) {
+                    mKeyIndex.insert(nsIndex, sources[i]->mKey, &page);
+                }
+                items.erase(sources[i]);
+                delete sources[i];
+            }
+        }
+
+        if (pageFull) {
+            if (page.state() != Page::PageState::FULL) {
+                err = page.markFull();
+                if (err != ESP_OK) {
+                    return err;
+                }
+            }
+            err = requestNewPage();
+            if (err != ESP_OK) {
+                return err;
+            }
+            if (getCurrentPage().getFreeEntryCount() == 0) {
+                return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+            }
+        }
+    } while (pageFull);
+
+    // previous versions of the remaining items are on older pages, write them one by one
+    for (auto it = items.begin(); it != items.end();) {
+        PendingItem* pending = it++;
+        err = writeItem(nsIndex, pending->mDatatype, pending->mKey, pending->mData, pending->mDataSize);
+        if (err != ESP_OK) {
+            return err;
+        }
+        items.erase(pending);
+        delete pending;
+    }
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
+esp_err_t Storage::writeTransaction(uint8_t nsIndex, TPendingItemList& items)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    /* The marker and the values are written as a single batch, which doesn't span pages */
+    if (items.size() + 1 > Page::ENTRY_COUNT) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    if (items.empty()) {
+        return ESP_OK;
+    }
+    std::unique_ptr<Item[]> batch(new Item[items.size() + 1]);
+    std::unique_ptr<Page*[]> oldPages(new Page*[items.size() + 1]);
+    size_t count;
+    esp_err_t err;
+
+    for (size_t attempt = 0; ; ++attempt) {
+        Page& page = getCurrentPage();
+        count = 1;
+        for (auto it = items.begin(); it != items.end(); ++it) {
+            Page* findPage = nullptr;
+            Item item;
+            err = findItem(nsIndex, it->mDatatype, it->mKey, findPage, item);
+            if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+                return err;
+            }
+            if (findPage != nullptr &&
+                    findPage->cmpItem(nsIndex, it->mDatatype, it->mKey, it->mData, it->mDataSize) == ESP_OK) {
+                continue;
+            }
+            batch[count] = Item(nsIndex, it->mDatatype, 1, it->mKey);
+            memcpy(batch[count].data, it->mData, it->mDataSize);
+            oldPages[count] = findPage;
+            ++count;
+        }
+        if (count == 1) {
+            items.clearAndFreeNodes();
+            return ESP_OK;
+        }
+        if (count <= page.getFreeEntryCount()) {
+            break;
+        }
+        if (attempt == mPageManager.getPageCount()) {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+
+        /* Freeing a page may move previous versions, so they are looked up again */
+        if (page.state() != Page::PageState::FULL) {
+            err = page.markFull();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        err = requestNewPage();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    batch[0] = Item(Page::NS_INDEX, ItemType::U32, 1, TRANSACTION_MARKER_KEY, TRANSACTION_MARKER_CHUNK);
+    uint32_t itemCount = count - 1;
+    memcpy(batch[0].data, &itemCount, sizeof(itemCount));
+
+    /* Either the whole batch or nothing of it survives a power loss. If it survives,
+     * previous versions left on other pages are erased on init, as long as the marker is there. */
+    Page& page = getCurrentPage();
+    err = page.writeItems(batch.get(), count);
+    if (err != ESP_OK) {
+        mKeyIndex.invalidate();
+        return err;
+    }
+    items.clearAndFreeNodes();
+
+    // previous versions on this page have been erased by writeItems
+    mKeyIndex.insert(Page::NS_INDEX, TRANSACTION_MARKER_KEY, &page);
+    for (size_t i = 1; i < count; ++i) {
+        if (oldPages[i] != &page) {
+            mKeyIndex.insert(nsIndex, batch[i].key, &page);
+        }
+    }
+
+    for (size_t i = 1; i < count; ++i) {
+        if (oldPages[i] == nullptr || oldPages[i] == &page) {
+            continue;
+        }
+        err = oldPages[i]->eraseItem(nsIndex, batch[i].datatype, batch[i].key);
+        if (err == ESP_ERR_FLASH_OP_FAIL) {
+            return ESP_ERR_NVS_REMOVE_FAILED;
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        mKeyIndex.erase(nsIndex, batch[i].key, oldPages[i]);
+    }
+
+    err = page.eraseItem(Page::NS_INDEX, ItemType::U32, TRANSACTION_MARKER_KEY, TRANSACTION_MARKER_CHUNK);
+    if (err == ESP_ERR_FLASH_OP_FAIL) {
+        return ESP_ERR_NVS_REMOVE_FAILED;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    mKeyIndex.erase(Page::NS_INDEX, TRANSACTION_MARKER_KEY, &page);
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
 esp_err_t Storage::createOrOpenNamespace(const char* nsName, bool canCreate, uint8_t& nsIndex)
 {
     if (mState != StorageState::ACTIVE) {
@@ -539,6 +920,7 @@ esp_err_t Storage::eraseMultiPageBlob(uint8_t nsIndex, const char* key, VerOffse
     if (err != ESP_OK) {
         return err;
     }
+    mKeyIndex.erase(nsIndex, key, findPage);
 
     uint8_t chunkCount = item.blobIndex.chunkCount;
 
@@ -561,6 +943,7 @@ esp_err_t Storage::eraseMultiPageBlob(uint8_t nsIndex, const char* key, VerOffse
         if (err != ESP_OK) {
             return err;
         }
+        mKeyIndex.erase(nsIndex, key, findPage);
 
     }
 
@@ -573,6 +956,10 @@ esp_err_t Storage::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key
         return ESP_ERR_NVS_NOT_INITIALIZED;
     }
 
+    if ((datatype == ItemType::BLOB || datatype == ItemType::ANY) && isBlobWriterOpen(nsIndex, key)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
     if (datatype == ItemType::BLOB) {
         return eraseMultiPageBlob(nsIndex, key);
     }
@@ -588,7 +975,12 @@ esp_err_t Storage::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key
         return eraseMultiPageBlob(nsIndex, key);
     }
 
-    return findPage->eraseItem(nsIndex, datatype, key);
+    err = findPage->eraseItem(nsIndex, datatype, key);
+    if (err != ESP_OK) {
+        return err;
+    }
+    mKeyIndex.erase(nsIndex, key, findPage);
+    return ESP_OK;
 }
 
 esp_err_t Storage::eraseNamespace(uint8_t nsIndex)
@@ -597,6 +989,10 @@ esp_err_t Storage::eraseNamespace(uint8_t nsIndex)
         return ESP_ERR_NVS_NOT_INITIALIZED;
     }
 
+    if (isBlobWriterOpen(nsIndex, nullptr)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
     for (auto it = std::begin(mPageManager); it != std::end(mPageManager); ++it) {
         while (true) {
             auto err = it->eraseItem(nsIndex, ItemType::ANY, nullptr);
@@ -608,6 +1004,7 @@ esp_err_t Storage::eraseNamespace(uint8_t nsIndex)
             }
         }
     }
+    mKeyIndex.eraseNamespace(nsIndex);
     return ESP_OK;
 
 }
@@ -663,6 +1060,7 @@ void Storage::debugCheck()
                 assert(0);
             }
             keys.insert(std::make_pair(keystr, static_cast<Page*>(p)));
+            assert(!mKeyIndex.isValid() || mKeyIndex.contains(item.nsIndex, item.key, static_cast<Page*>(p)));
             itemIndex += item.span;
             usedCount += item.span;
         }
@@ -719,16 +1117,23 @@ void Storage::fillEntryInfo(Item &item, nvs_entry_info_t &info)
 
 bool Storage::findEntry(nvs_opaque_iterator_t* it, const char* namespace_name)
 {
-    it->entryIndex = 0;
-    it->nsIndex = Page::NS_ANY;
-    it->page = mPageManager.begin();
+    uint8_t nsIndex = Page::NS_ANY;
 
     if (namespace_name != nullptr) {
-        if(createOrOpenNamespace(namespace_name, false, it->nsIndex) != ESP_OK) {
+        if(createOrOpenNamespace(namespace_name, false, nsIndex) != ESP_OK) {
             return false;
         }
     }
 
+    return findEntry(it, nsIndex);
+}
+
+bool Storage::findEntry(nvs_opaque_iterator_t* it, uint8_t nsIndex)
+{
+    it->entryIndex = 0;
+    it->nsIndex = nsIndex;
+    it->page = mPageManager.begin();
+
     return nextEntry(it);
 }
 
@@ -741,7 +1146,10 @@ inline bool isIterableItem(Item& item)
 
 inline bool isMultipageBlob(Item& item)
 {
-    return (item.datatype == ItemType::BLOB_DATA && item.chunkIndex != 0);
+    // only the first chunk of either blob version represents the blob
+    return (item.datatype == ItemType::BLOB_DATA &&
+            item.chunkIndex != static_cast<uint8_t>(VerOffset::VER_0_OFFSET) &&
+            item.chunkIndex != static_cast<uint8_t>(VerOffset::VER_1_OFFSET));
 }
 
 bool Storage::nextEntry(nvs_opaque_iterator_t* it)
@@ -766,5 +1174,364 @@ bool Storage::nextEntry(nvs_opaque_iterator_t* it)
     return false;
 }
 
+bool Storage::isBlobWriterOpen(uint8_t nsIndex, const char* key)
+{
+    for (auto it = std::begin(mBlobWriters); it != std::end(mBlobWriters); ++it) {
+        if (it->nsIndex == nsIndex && (key == nullptr || strncmp(it->key, key, Item::MAX_KEY_LENGTH) == 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t Storage::openBlobForReading(nvs_opaque_blob_t* blob, uint8_t nsIndex, const char* key)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    Item item;
+    Page* findPage = nullptr;
+    auto err = findItem(nsIndex, ItemType::BLOB_IDX, key, findPage, item);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        /* Blobs written by earlier versions are stored as a single item without index */
+        err = findItem(nsIndex, ItemType::BLOB, key, findPage, item);
+        if (err != ESP_OK) {
+            return err;
+        }
+        blob->chunkType = ItemType::BLOB;
+        blob->chunkCount = 1;
+        blob->dataSize = item.varLength.dataSize;
+    } else if (err != ESP_OK) {
+        return err;
+    } else {
+        blob->chunkType = ItemType::BLOB_DATA;
+        blob->chunkStart = item.blobIndex.chunkStart;
+        blob->chunkCount = item.blobIndex.chunkCount;
+        blob->dataSize = item.blobIndex.dataSize;
+    }
+
+    blob->storage = this;
+    blob->nsIndex = nsIndex;
+    strncpy(blob->key, key, sizeof(blob->key) - 1);
+    blob->key[sizeof(blob->key) - 1] = 0;
+    blob->writing = false;
+    blob->chunks.reset(new nvs_opaque_blob_t::ChunkInfo[blob->chunkCount]);
+
+    /* Only chunk headers are read here, chunk data is read and checked on demand */
+    size_t totalSize = 0;
+    for (uint8_t chunkNum = 0; chunkNum < blob->chunkCount; chunkNum++) {
+        err = findItem(nsIndex, blob->chunkType, key, findPage, item, blob->chunkIndex(chunkNum));
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            eraseMultiPageBlob(nsIndex, key); // cleanup if a chunk is not found
+            return err;
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        blob->chunks[chunkNum].crc32 = item.varLength.dataCrc32;
+        blob->chunks[chunkNum].size = item.varLength.dataSize;
+        blob->chunks[chunkNum].verified = false;
+        totalSize += item.varLength.dataSize;
+    }
+    assert(totalSize == blob->dataSize);
+    return ESP_OK;
+}
+
+esp_err_t Storage::readBlobPart(nvs_opaque_blob_t* blob, size_t offset, void* data, size_t dataSize)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    if (offset > blob->dataSize || dataSize > blob->dataSize - offset) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    uint8_t* dst = static_cast<uint8_t*>(data);
+    size_t chunkOffset = 0;
+    for (uint8_t chunkNum = 0; chunkNum < blob->chunkCount && dataSize > 0; chunkNum++) {
+        nvs_opaque_blob_t::ChunkInfo& chunk = blob->chunks[chunkNum];
+        chunkOffset += chunk.size;
+        if (offset >= chunkOffset) {
+            continue;
+        }
+
+        Item item;
+        Page* findPage = nullptr;
+        auto err = findItem(blob->nsIndex, blob->chunkType, blob->key, findPage, item, blob->chunkIndex(chunkNum));
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (item.varLength.dataCrc32 != chunk.crc32 || item.varLength.dataSize != chunk.size) {
+            /* The blob has been rewritten since it was opened */
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+
+        size_t readOffset = offset - (chunkOffset - chunk.size);
+        size_t readSize = std::min(dataSize, chunkOffset - offset);
+        err = findPage->readItemData(blob->nsIndex, blob->chunkType, blob->key, readOffset, dst, readSize,
+                blob->chunkIndex(chunkNum), !chunk.verified);
+        if (err != ESP_OK) {
+            return err;
+        }
+        chunk.verified = true;
+        dst += readSize;
+        offset += readSize;
+        dataSize -= readSize;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::openBlobForWriting(nvs_opaque_blob_t* blob, uint8_t nsIndex, const char* key, size_t dataSize)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    if (strlen(key) > Item::MAX_KEY_LENGTH) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+
+    /* Same limit as in writeMultiPageBlob */
+    uint32_t max_pages = mPageManager.getPageCount() - 1;
+    if (max_pages > (Page::CHUNK_ANY-1)/2) {
+        max_pages = (Page::CHUNK_ANY-1)/2;
+    }
+    if (dataSize > max_pages * Page::CHUNK_MAX_SIZE) {
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+
+    if (isBlobWriterOpen(nsIndex, key)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    Item item;
+    Page* findPage = nullptr;
+    auto err = findItem(nsIndex, ItemType::BLOB_IDX, key, findPage, item);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        return err;
+    }
+
+    blob->storage = this;
+    blob->nsIndex = nsIndex;
+    strncpy(blob->key, key, sizeof(blob->key) - 1);
+    blob->key[sizeof(blob->key) - 1] = 0;
+    blob->writing = true;
+    blob->chunkType = ItemType::BLOB_DATA;
+    blob->chunkStart = VerOffset::VER_0_OFFSET;
+    blob->prevChunkStart = VerOffset::VER_ANY;
+    if (err == ESP_OK) {
+        /* Toggle the version, the previous one is kept until the new index is written */
+        blob->prevChunkStart = item.blobIndex.chunkStart;
+        assert(blob->prevChunkStart == VerOffset::VER_0_OFFSET || blob->prevChunkStart == VerOffset::VER_1_OFFSET);
+        blob->chunkStart = (blob->prevChunkStart == VerOffset::VER_1_OFFSET) ? VerOffset::VER_0_OFFSET : VerOffset::VER_1_OFFSET;
+    }
+    blob->chunkCount = 0;
+    blob->dataSize = dataSize;
+    blob->offset = 0;
+    blob->error = ESP_OK;
+    blob->bufferSize = std::min(dataSize, static_cast<size_t>(Page::CHUNK_MAX_SIZE));
+    blob->bufferUsed = 0;
+    if (blob->bufferSize > 0) {
+        blob->buffer.reset(new uint8_t[blob->bufferSize]);
+    }
+
+    mBlobWriters.push_back(blob);
+    return ESP_OK;
+}
+
+esp_err_t Storage::writeBlobChunk(nvs_opaque_blob_t* blob)
+{
+    /* Bytes of the blob which are not on flash yet, including the buffered ones */
+    size_t remainingSize = blob->dataSize - blob->offset + blob->bufferUsed;
+    esp_err_t err;
+
+    while (true) {
+        Page& page = getCurrentPage();
+        size_t tailroom = page.getVarDataTailroom();
+        if (!tailroom || (!blob->chunkCount && tailroom < remainingSize && tailroom < Page::CHUNK_MAX_SIZE/10)) {
+            /* Same placement rules as in writeMultiPageBlob */
+            if (page.state() != Page::PageState::FULL) {
+                err = page.markFull();
+                if (err != ESP_OK) {
+                    return err;
+                }
+            }
+            err = requestNewPage();
+            if (err != ESP_OK) {
+                return err;
+            } else if (getCurrentPage().getVarDataTailroom() == tailroom) {
+                /* We got the same page or we are not improving.*/
+                return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+            }
+            continue;
+        }
+
+        if (blob->chunkCount == (Page::CHUNK_ANY-1)/2) {
+            return ESP_ERR_NVS_VALUE_TOO_LONG;
+        }
+
+        size_t chunkSize = std::min(blob->bufferUsed, tailroom);
+        err = page.writeItem(blob->nsIndex, ItemType::BLOB_DATA, blob->key, blob->buffer.get(), chunkSize,
+                blob->chunkIndex(blob->chunkCount));
+        assert(err != ESP_ERR_NVS_PAGE_FULL);
+        if (err != ESP_OK) {
+            return err;
+        }
+        mKeyIndex.insert(blob->nsIndex, blob->key, &page);
+        blob->chunkCount++;
+
+        memmove(blob->buffer.get(), blob->buffer.get() + chunkSize, blob->bufferUsed - chunkSize);
+        blob->bufferUsed -= chunkSize;
+        remainingSize -= chunkSize;
+
+        if (remainingSize || (tailroom - chunkSize) < Page::ENTRY_SIZE) {
+            if (page.state() != Page::PageState::FULL) {
+                err = page.markFull();
+                if (err != ESP_OK) {
+                    return err;
+                }
+            }
+            err = requestNewPage();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        return ESP_OK;
+    }
+}
+
+esp_err_t Storage::writeBlobPart(nvs_opaque_blob_t* blob, const void* data, size_t dataSize)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    if (blob->error != ESP_OK) {
+        return blob->error;
+    }
+
+    if (dataSize > blob->dataSize - blob->offset) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    while (dataSize > 0) {
+        size_t copySize = std::min(dataSize, blob->bufferSize - blob->bufferUsed);
+        memcpy(blob->buffer.get() + blob->bufferUsed, src, copySize);
+        blob->bufferUsed += copySize;
+        blob->offset += copySize;
+        src += copySize;
+        dataSize -= copySize;
+
+        if (blob->bufferUsed == blob->bufferSize) {
+            auto err = writeBlobChunk(blob);
+            if (err != ESP_OK) {
+                blob->error = err;
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::writeBlobIndex(nvs_opaque_blob_t* blob)
+{
+    Item item;
+    std::fill_n(item.data, sizeof(item.data), 0xff);
+    item.blobIndex.dataSize = blob->dataSize;
+    item.blobIndex.chunkCount = blob->chunkCount;
+    item.blobIndex.chunkStart = blob->chunkStart;
+
+    /* Other items may have been written since the last chunk, so the current page can be full */
+    Page& page = getCurrentPage();
+    auto err = page.writeItem(blob->nsIndex, ItemType::BLOB_IDX, blob->key, item.data, sizeof(item.data));
+    if (err == ESP_ERR_NVS_PAGE_FULL) {
+        if (page.state() != Page::PageState::FULL) {
+            err = page.markFull();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        err = requestNewPage();
+        if (err != ESP_OK) {
+            return err;
+        }
+        err = getCurrentPage().writeItem(blob->nsIndex, ItemType::BLOB_IDX, blob->key, item.data, sizeof(item.data));
+        if (err == ESP_ERR_NVS_PAGE_FULL) {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    mKeyIndex.insert(blob->nsIndex, blob->key, &getCurrentPage());
+    return ESP_OK;
+}
+
+esp_err_t Storage::closeBlob(nvs_opaque_blob_t* blob)
+{
+    if (!blob->writing) {
+        return ESP_OK;
+    }
+    mBlobWriters.erase(blob);
+
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    esp_err_t err = blob->error;
+    if (err == ESP_OK && blob->offset != blob->dataSize) {
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    /* An empty blob is still stored with one empty chunk, as in writeMultiPageBlob */
+    while (err == ESP_OK && (blob->bufferUsed > 0 || blob->chunkCount == 0)) {
+        err = writeBlobChunk(blob);
+    }
+    if (err == ESP_OK) {
+        err = writeBlobIndex(blob);
+    }
+
+    if (err != ESP_OK) {
+        /* Without index the chunks are orphans, erase them now rather than on next init */
+        for (uint8_t chunkNum = 0; chunkNum < blob->chunkCount; chunkNum++) {
+            Item item;
+            Page* findPage = nullptr;
+            if (findItem(blob->nsIndex, ItemType::BLOB_DATA, blob->key, findPage, item, blob->chunkIndex(chunkNum)) == ESP_OK &&
+                    findPage->eraseItem(blob->nsIndex, ItemType::BLOB_DATA, blob->key, blob->chunkIndex(chunkNum)) == ESP_OK) {
+                mKeyIndex.erase(blob->nsIndex, blob->key, findPage);
+            }
+        }
+        return err;
+    }
+
+    if (blob->prevChunkStart != VerOffset::VER_ANY) {
+        /* Erase the blob with earlier version*/
+        err = eraseMultiPageBlob(blob->nsIndex, blob->key, blob->prevChunkStart);
+    } else {
+        /* Support for earlier versions where BLOBS were stored without index */
+        Item item;
+        Page* findPage = nullptr;
+        err = findItem(blob->nsIndex, ItemType::BLOB, blob->key, findPage, item);
+        if (err == ESP_OK) {
+            err = findPage->eraseItem(blob->nsIndex, ItemType::BLOB, blob->key);
+            if (err == ESP_OK) {
+                mKeyIndex.erase(blob->nsIndex, blob->key, findPage);
+            }
+        } else if (err == ESP_ERR_NVS_NOT_FOUND) {
+            err = ESP_OK;
+        }
+    }
+    if (err == ESP_ERR_FLASH_OP_FAIL) {
+        return ESP_ERR_NVS_REMOVE_FAILED;
+    }
+#ifndef ESP_PLATFORM
+    if (err == ESP_OK) {
+        debugCheck();
+    }
+#endif
+    return err;
+}
 
 }
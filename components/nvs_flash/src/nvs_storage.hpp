@@ -21,9 +21,47 @@
 #include "nvs_types.hpp"
 #include "nvs_page.hpp"
 #include "nvs_pagemanager.hpp"
+#include "nvs_key_index.hpp"
+#include "sdkconfig.h"
 
 //extern void dumpBytes(const uint8_t* data, size_t count);
 
+namespace nvs
+{
+class Storage;
+} // namespace nvs
+
+struct nvs_opaque_blob_t : public intrusive_list_node<nvs_opaque_blob_t>
+{
+    /* Size and data crc of a chunk, as seen when the blob was opened for reading */
+    struct ChunkInfo {
+        uint32_t crc32;
+        uint16_t size;
+        bool verified;
+    };
+
+    nvs::Storage *storage = nullptr;
+    uint8_t nsIndex = 0;
+    char key[nvs::Item::MAX_KEY_LENGTH + 1];
+    bool writing = false;
+    nvs::ItemType chunkType = nvs::ItemType::BLOB_DATA; // BLOB for blobs stored in the format without index
+    nvs::VerOffset chunkStart = nvs::VerOffset::VER_0_OFFSET;
+    nvs::VerOffset prevChunkStart = nvs::VerOffset::VER_ANY; // version replaced by the writer
+    uint8_t chunkCount = 0;
+    size_t dataSize = 0;
+    size_t offset = 0; // number of bytes passed to the writer so far
+    esp_err_t error = ESP_OK; // first error hit by the writer, the blob is discarded on close
+    std::unique_ptr<ChunkInfo[]> chunks;
+    std::unique_ptr<uint8_t[]> buffer; // data of the writer which is not on flash yet, at most one chunk
+    size_t bufferSize = 0;
+    size_t bufferUsed = 0;
+
+    uint8_t chunkIndex(uint8_t chunkNum) const
+    {
+        return (chunkType == nvs::ItemType::BLOB) ? nvs::Page::CHUNK_ANY : static_cast<uint8_t>(chunkStart) + chunkNum;
+    }
+};
+
 namespace nvs
 {
 
@@ -58,10 +96,42 @@ class Storage : public intrusive_list_node<Storage>
 
     typedef intrusive_list<BlobIndexNode> TBlobIndexList;
 
+    struct BlobDataNode: public intrusive_list_node<BlobDataNode> {
+        public:
+            Page* mPage;
+            char key[Item::MAX_KEY_LENGTH + 1];
+            uint8_t nsIndex;
+            uint8_t chunkIndex;
+    };
+
+    typedef intrusive_list<BlobDataNode> TBlobDataList;
+
+    struct TransactionMarkerNode: public intrusive_list_node<TransactionMarkerNode> {
+        public:
+            Page* mPage;
+            size_t mIndex;
+            uint32_t mItemCount;
+    };
+
+    typedef intrusive_list<TransactionMarkerNode> TTransactionMarkerList;
+
 public:
+    /* Value of a primitive item which has been set through a write-back handle
+     * but has not been committed to flash yet */
+    struct PendingItem : public intrusive_list_node<PendingItem> {
+    public:
+        char mKey[Item::MAX_KEY_LENGTH + 1];
+        ItemType mDatatype;
+        uint8_t mDataSize;
+        uint8_t mData[sizeof(Item::data)];
+    };
+
+    typedef intrusive_list<PendingItem> TPendingItemList;
+
     ~Storage();
 
-    Storage(const char *pName = NVS_DEFAULT_PART_NAME) : mPartitionName(pName) { };
+    Storage(const char *pName = NVS_DEFAULT_PART_NAME, size_t keyIndexSize = CONFIG_NVS_KEY_INDEX_SIZE) :
+        mPartitionName(pName), mKeyIndexSize(keyIndexSize) { };
 
     esp_err_t init(uint32_t baseSector, uint32_t sectorCount);
 
@@ -77,6 +147,10 @@ public:
 
     esp_err_t eraseItem(uint8_t nsIndex, ItemType datatype, const char* key);
 
+    esp_err_t writePendingItems(uint8_t nsIndex, TPendingItemList& items);
+
+    esp_err_t writeTransaction(uint8_t nsIndex, TPendingItemList& items);
+
     template<typename T>
     esp_err_t writeItem(uint8_t nsIndex, const char* key, const T& value)
     {
@@ -119,12 +193,26 @@ public:
 
     esp_err_t fillStats(nvs_stats_t& nvsStats);
 
+    esp_err_t collectGarbage(size_t maxEntries, bool& done);
+
     esp_err_t calcEntriesInNamespace(uint8_t nsIndex, size_t& usedEntries);
 
     bool findEntry(nvs_opaque_iterator_t*, const char* name);
 
+    bool findEntry(nvs_opaque_iterator_t*, uint8_t nsIndex);
+
     bool nextEntry(nvs_opaque_iterator_t* it);
 
+    esp_err_t openBlobForReading(nvs_opaque_blob_t* blob, uint8_t nsIndex, const char* key);
+
+    esp_err_t openBlobForWriting(nvs_opaque_blob_t* blob, uint8_t nsIndex, const char* key, size_t dataSize);
+
+    esp_err_t readBlobPart(nvs_opaque_blob_t* blob, size_t offset, void* data, size_t dataSize);
+
+    esp_err_t writeBlobPart(nvs_opaque_blob_t* blob, const void* data, size_t dataSize);
+
+    esp_err_t closeBlob(nvs_opaque_blob_t* blob);
+
 protected:
 
     Page& getCurrentPage()
@@ -134,14 +222,38 @@ protected:
 
     void clearNamespaces();
 
-    void populateBlobIndices(TBlobIndexList&);
+    void eraseOrphanDataBlobs(TBlobIndexList&, TBlobDataList&);
+
+    bool isTransactionMarker(const Item& item);
 
-    void eraseOrphanDataBlobs(TBlobIndexList&);
+    void finishTransactions(TTransactionMarkerList&);
 
     void fillEntryInfo(Item &item, nvs_entry_info_t &info);
 
     esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item, uint8_t chunkIdx = Page::CHUNK_ANY, VerOffset chunkStart = VerOffset::VER_ANY);
 
+    esp_err_t requestNewPage();
+
+    bool isBlobWriterOpen(uint8_t nsIndex, const char* key);
+
+    esp_err_t writeBlobChunk(nvs_opaque_blob_t* blob);
+
+    esp_err_t writeBlobIndex(nvs_opaque_blob_t* blob);
+
+    /* Number of candidate pages for which key index lookups are used,
+     * keys spread over more pages are searched for by scanning all pages */
+    static const size_t KEY_INDEX_MAX_PAGES = 16;
+
+    /* With this many free pages, PageManager::requestNewPage doesn't need to free a page */
+    static const size_t GC_FREE_PAGE_RESERVE = 2;
+
+    /* Written in the same batch as the values of a transaction, ahead of them. While it
+     * exists, previous versions of those values may still be present on other pages. */
+    static constexpr const char* TRANSACTION_MARKER_KEY = "nvs_txn";
+
+    /* Makes the marker differ from a namespace entry which happens to have the same name */
+    static const uint8_t TRANSACTION_MARKER_CHUNK = 0;
+
 protected:
     const char *mPartitionName;
     size_t mPageCount;
@@ -149,6 +261,9 @@ protected:
     TNamespaces mNamespaces;
     CompressedEnumTable<bool, 1, 256> mNamespaceUsage;
     StorageState mState = StorageState::INVALID;
+    size_t mKeyIndexSize;
+    KeyIndex mKeyIndex;
+    intrusive_list<nvs_opaque_blob_t> mBlobWriters;
 };
 
 } // namespace nvs
@@ -0,0 +1,413 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/* Flash-op accounting benchmark for the NVS API.
+ *
+ * Every workload (key count, value size, fill ratio) is run on a fresh emulated
+ * partition. For each operation the benchmark reports wall-clock throughput and
+ * the flash traffic counted by SpiFlashEmulator, normalized per operation.
+ * Results are written as CSV, one row per workload and operation, to the file
+ * named by NVS_BENCH_OUTPUT (nvs_bench.csv by default).
+ *
+ * A second benchmark runs the file system workloads shared with the SPIFFS and
+ * FAT host tests (see spi_flash/sim/fs_benchmark.h) on raw NVS, storing each
+ * file as a blob. Its results go to FS_BENCH_OUTPUT (fs_bench_nvs.csv by default).
+ *
+ * Run with "make benchmark", or "./test_nvs [bench]".
+ */
+
+#include "catch.hpp"
+#include "nvs.hpp"
+#include "nvs_test_api.h"
+#include "spi_flash_emulation.h"
+#include "fs_benchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define TEST_ESP_OK(rc) CHECK((rc) == ESP_OK)
+
+namespace
+{
+
+const uint32_t BENCH_SECTOR_COUNT = 32;
+const char* BENCH_NAMESPACE = "bench";
+const char* FILLER_NAMESPACE = "filler";
+const uint32_t FS_BENCH_SECTOR_COUNT = 64;
+const char* FS_BENCH_NAMESPACE = "fsbench";
+
+struct BenchWorkload {
+    int keyCount;
+    size_t valueSize;
+    int fillPercent;
+};
+
+class BenchReport
+{
+public:
+    BenchReport(ostream& out, SpiFlashEmulator& emu, const BenchWorkload& workload)
+        : mOut(out), mEmu(emu), mWorkload(workload), mTotalEraseCnt(BENCH_SECTOR_COUNT, 0)
+    {
+    }
+
+    static void printHeader(ostream& out)
+    {
+        out << "keys,value_size,fill_percent,op,count,ops_per_sec,"
+            << "reads_per_op,read_bytes_per_op,writes_per_op,write_bytes_per_op,"
+            << "erases_per_op,sim_us_per_op,erase_min,erase_max" << endl;
+    }
+
+    void start()
+    {
+        mEmu.clearStats();
+        mStart = chrono::steady_clock::now();
+    }
+
+    void stop(const char* op, size_t count)
+    {
+        auto end = chrono::steady_clock::now();
+        double wallUs = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(end - mStart).count()) / 1000;
+        vector<size_t> eraseCnt(BENCH_SECTOR_COUNT);
+        for (uint32_t i = 0; i < BENCH_SECTOR_COUNT; ++i) {
+            eraseCnt[i] = mEmu.getSectorEraseCount(i);
+            mTotalEraseCnt[i] += eraseCnt[i];
+        }
+        mTotalCount += count;
+        mTotalWallUs += wallUs;
+        mTotalReadOps += mEmu.getReadOps();
+        mTotalReadBytes += mEmu.getReadBytes();
+        mTotalWriteOps += mEmu.getWriteOps();
+        mTotalWriteBytes += mEmu.getWriteBytes();
+        mTotalEraseOps += mEmu.getEraseOps();
+        mTotalTime += mEmu.getTotalTime();
+        printRow(op, count, wallUs, mEmu.getReadOps(), mEmu.getReadBytes(), mEmu.getWriteOps(),
+                 mEmu.getWriteBytes(), mEmu.getEraseOps(), mEmu.getTotalTime(), eraseCnt);
+    }
+
+    /* Totals over all operations of the workload, the erase distribution of
+     * this row shows how evenly the whole workload wore the partition. */
+    void printTotal()
+    {
+        printRow("total", mTotalCount, mTotalWallUs, mTotalReadOps, mTotalReadBytes, mTotalWriteOps,
+                 mTotalWriteBytes, mTotalEraseOps, mTotalTime, mTotalEraseCnt);
+    }
+
+protected:
+    void printRow(const char* op, size_t count, double wallUs, size_t readOps, size_t readBytes,
+                  size_t writeOps, size_t writeBytes, size_t eraseOps, size_t simUs,
+                  const vector<size_t>& eraseCnt)
+    {
+        double n = static_cast<double>(max<size_t>(count, 1));
+        double opsPerSec = (wallUs > 0) ? count * 1e6 / wallUs : 0;
+        auto minmax = minmax_element(eraseCnt.begin(), eraseCnt.end());
+        mOut << mWorkload.keyCount << "," << mWorkload.valueSize << "," << mWorkload.fillPercent << ","
+             << op << "," << count << "," << static_cast<size_t>(opsPerSec) << ","
+             << readOps / n << "," << readBytes / n << ","
+             << writeOps / n << "," << writeBytes / n << ","
+             << eraseOps / n << "," << simUs / n << ","
+             << *minmax.first << "," << *minmax.second << endl;
+    }
+
+    ostream& mOut;
+    SpiFlashEmulator& mEmu;
+    BenchWorkload mWorkload;
+    chrono::steady_clock::time_point mStart;
+    vector<size_t> mTotalEraseCnt;
+    size_t mTotalCount = 0;
+    double mTotalWallUs = 0;
+    size_t mTotalReadOps = 0;
+    size_t mTotalReadBytes = 0;
+    size_t mTotalWriteOps = 0;
+    size_t mTotalWriteBytes = 0;
+    size_t mTotalEraseOps = 0;
+    size_t mTotalTime = 0;
+};
+
+size_t valueEntryCount(size_t valueSize)
+{
+    if (valueSize <= sizeof(uint32_t)) {
+        return 1;
+    }
+    // blob index, data chunk header and the data itself
+    return 2 + (valueSize + nvs::Page::ENTRY_SIZE - 1) / nvs::Page::ENTRY_SIZE;
+}
+
+esp_err_t setValue(nvs_handle_t handle, const char* key, const BenchWorkload& workload, uint32_t seed)
+{
+    if (workload.valueSize <= sizeof(uint32_t)) {
+        return nvs_set_u32(handle, key, seed);
+    }
+    vector<uint8_t> value(workload.valueSize, static_cast<uint8_t>(seed));
+    return nvs_set_blob(handle, key, value.data(), value.size());
+}
+
+esp_err_t getValue(nvs_handle_t handle, const char* key, const BenchWorkload& workload)
+{
+    if (workload.valueSize <= sizeof(uint32_t)) {
+        uint32_t value;
+        return nvs_get_u32(handle, key, &value);
+    }
+    vector<uint8_t> value(workload.valueSize);
+    size_t size = value.size();
+    return nvs_get_blob(handle, key, value.data(), &size);
+}
+
+/* Fill the partition with unrelated blobs until the requested share of entries is used */
+void fillPartition(int fillPercent)
+{
+    nvs_handle_t handle;
+    TEST_ESP_OK(nvs_open(FILLER_NAMESPACE, NVS_READWRITE, &handle));
+    vector<uint8_t> filler(2000, 0xaa);
+    nvs_stats_t stats;
+    TEST_ESP_OK(nvs_get_stats(NULL, &stats));
+    for (int i = 0; stats.used_entries * 100 < stats.total_entries * fillPercent; ++i) {
+        string key = "filler_" + to_string(i);
+        TEST_ESP_OK(nvs_set_blob(handle, key.c_str(), filler.data(), filler.size()));
+        TEST_ESP_OK(nvs_get_stats(NULL, &stats));
+    }
+    nvs_close(handle);
+}
+
+void runWorkload(ostream& out, const BenchWorkload& workload)
+{
+    SpiFlashEmulator emu(BENCH_SECTOR_COUNT);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, BENCH_SECTOR_COUNT));
+    fillPartition(workload.fillPercent);
+
+    BenchReport report(out, emu, workload);
+    nvs_handle_t handle;
+    TEST_ESP_OK(nvs_open(BENCH_NAMESPACE, NVS_READWRITE, &handle));
+    vector<string> keys;
+    for (int i = 0; i < workload.keyCount; ++i) {
+        keys.push_back("key_" + to_string(i));
+    }
+
+    report.start();
+    for (auto& key : keys) {
+        TEST_ESP_OK(setValue(handle, key.c_str(), workload, 1));
+    }
+    report.stop("set_new", keys.size());
+
+    report.start();
+    for (auto& key : keys) {
+        TEST_ESP_OK(setValue(handle, key.c_str(), workload, 2));
+    }
+    report.stop("set", keys.size());
+
+    report.start();
+    for (auto& key : keys) {
+        TEST_ESP_OK(getValue(handle, key.c_str(), workload));
+    }
+    report.stop("get", keys.size());
+
+    report.start();
+    size_t found = 0;
+    for (auto it = nvs_entry_find(NVS_DEFAULT_PART_NAME, BENCH_NAMESPACE, NVS_TYPE_ANY);
+            it != nullptr; it = nvs_entry_next(it)) {
+        ++found;
+    }
+    report.stop("iterate", found);
+    CHECK(found == keys.size());
+
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+    report.start();
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, BENCH_SECTOR_COUNT));
+    report.stop("init", 1);
+
+    TEST_ESP_OK(nvs_open(BENCH_NAMESPACE, NVS_READWRITE, &handle));
+    report.start();
+    for (auto& key : keys) {
+        TEST_ESP_OK(nvs_erase_key(handle, key.c_str()));
+    }
+    report.stop("erase", keys.size());
+
+    report.printTotal();
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
+/* Files of the shared file system workloads are stored as blobs, keyed by file name.
+ * NVS can not update a blob in place, so appends and overwrites rewrite the whole blob. */
+class NvsBenchTarget : public FsBenchTarget
+{
+public:
+    const char* name() const override
+    {
+        return "nvs";
+    }
+
+    bool mount() override
+    {
+        mEmu.reset(new SpiFlashEmulator(FS_BENCH_SECTOR_COUNT));
+        // same chip as the file system benchmarks, to keep the flash times comparable
+        mEmu->setTiming(FLASH_TIMING_W25Q32);
+        if (nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, FS_BENCH_SECTOR_COUNT) != ESP_OK) {
+            return false;
+        }
+        return nvs_open(FS_BENCH_NAMESPACE, NVS_READWRITE, &mHandle) == ESP_OK;
+    }
+
+    void unmount() override
+    {
+        nvs_close(mHandle);
+        nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME);
+        mEmu.reset();
+    }
+
+    bool write(const char* path, const void* data, size_t size, bool append) override
+    {
+        vector<uint8_t> blob;
+        if (append && !getBlob(path, blob, true)) {
+            return false;
+        }
+        blob.insert(blob.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+        return setBlob(path, blob);
+    }
+
+    bool overwrite(const char* path, size_t offset, const void* data, size_t size) override
+    {
+        vector<uint8_t> blob;
+        if (!getBlob(path, blob, false) || offset + size > blob.size()) {
+            return false;
+        }
+        memcpy(&blob[offset], data, size);
+        return setBlob(path, blob);
+    }
+
+    bool read(const char* path, void* data, size_t size) override
+    {
+        vector<uint8_t> blob;
+        if (!getBlob(path, blob, false) || blob.size() < size) {
+            return false;
+        }
+        memcpy(data, blob.data(), size);
+        return true;
+    }
+
+    bool remove(const char* path) override
+    {
+        return nvs_erase_key(mHandle, path) == ESP_OK && nvs_commit(mHandle) == ESP_OK;
+    }
+
+    int list() override
+    {
+        int count = 0;
+        for (auto it = nvs_entry_find(NVS_DEFAULT_PART_NAME, FS_BENCH_NAMESPACE, NVS_TYPE_ANY);
+                it != nullptr; it = nvs_entry_next(it)) {
+            ++count;
+        }
+        return count;
+    }
+
+    void resetFlashStats() override
+    {
+        mEmu->clearStats();
+    }
+
+    FsBenchFlashStats getFlashStats() override
+    {
+        FsBenchFlashStats stats;
+        stats.readBytes = mEmu->getReadBytes();
+        stats.writeBytes = mEmu->getWriteBytes();
+        stats.eraseOps = mEmu->getEraseOps();
+        stats.flashTimeUs = mEmu->getTotalTime();
+        for (uint32_t i = 0; i < FS_BENCH_SECTOR_COUNT; ++i) {
+            stats.sectorEraseCounts.push_back(mEmu->getSectorEraseCount(i));
+        }
+        return stats;
+    }
+
+protected:
+    bool getBlob(const char* key, vector<uint8_t>& blob, bool allowMissing)
+    {
+        size_t size = 0;
+        esp_err_t err = nvs_get_blob(mHandle, key, nullptr, &size);
+        if (err == ESP_ERR_NVS_NOT_FOUND && allowMissing) {
+            blob.clear();
+            return true;
+        }
+        if (err != ESP_OK) {
+            return false;
+        }
+        blob.resize(size);
+        return nvs_get_blob(mHandle, key, blob.data(), &size) == ESP_OK;
+    }
+
+    bool setBlob(const char* key, const vector<uint8_t>& blob)
+    {
+        return nvs_set_blob(mHandle, key, blob.data(), blob.size()) == ESP_OK && nvs_commit(mHandle) == ESP_OK;
+    }
+
+    unique_ptr<SpiFlashEmulator> mEmu;
+    nvs_handle_t mHandle = 0;
+};
+
+} // namespace
+
+TEST_CASE("benchmark nvs operations with flash-op accounting", "[bench][.]")
+{
+    const int keyCounts[] = {16, 128, 512};
+    const size_t valueSizes[] = {4, 32, 256};
+    const int fillPercents[] = {0, 50, 75};
+    // one page is kept free for garbage collection, another one is left as slack for updates
+    const size_t capacity = (BENCH_SECTOR_COUNT - 2) * nvs::Page::ENTRY_COUNT;
+
+    const char* fileName = getenv("NVS_BENCH_OUTPUT");
+    ofstream file((fileName != nullptr) ? fileName : "nvs_bench.csv");
+    CHECK(file.is_open());
+    BenchReport::printHeader(file);
+    BenchReport::printHeader(cout);
+
+    for (auto keyCount : keyCounts) {
+        for (auto valueSize : valueSizes) {
+            for (auto fillPercent : fillPercents) {
+                BenchWorkload workload = {keyCount, valueSize, fillPercent};
+                // skip workloads which do not fit next to the filler data
+                if (keyCount * valueEntryCount(valueSize) > capacity * (100 - fillPercent) / 100) {
+                    continue;
+                }
+                INFO("keys=" << keyCount << " value_size=" << valueSize << " fill=" << fillPercent);
+                stringstream rows;
+                runWorkload(rows, workload);
+                file << rows.str();
+                cout << rows.str();
+            }
+        }
+    }
+}
+
+TEST_CASE("benchmark nvs with shared file system workloads", "[bench][.]")
+{
+    const char* fileName = getenv("FS_BENCH_OUTPUT");
+    ofstream file((fileName != nullptr) ? fileName : "fs_bench_nvs.csv");
+    CHECK(file.is_open());
+    fsBenchPrintHeader(file);
+    fsBenchPrintHeader(cout);
+
+    NvsBenchTarget target;
+    stringstream rows;
+    CHECK(fsBenchRun(target, rows));
+    file << rows.str();
+    cout << rows.str();
+}
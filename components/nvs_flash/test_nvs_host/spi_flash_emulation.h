@@ -19,6 +19,7 @@
 #include <algorithm>
 #include <random>
 #include "esp_spi_flash.h"
+#include "flash_timing.h"
 #include "catch.hpp"
 
 using std::copy;
@@ -65,7 +66,7 @@ public:
 
         ++mReadOps;
         mReadBytes += size;
-        mTotalTime += getReadOpTime(static_cast<uint32_t>(size));
+        mTotalTimeNs += flash_timing_read_ns(&mTiming, size);
         return true;
     }
 
@@ -101,7 +102,7 @@ public:
         }
         ++mWriteOps;
         mWriteBytes += size;
-        mTotalTime += getWriteOpTime(static_cast<uint32_t>(size));
+        mTotalTimeNs += flash_timing_program_ns(&mTiming, dstAddr, size);
         return true;
     }
 
@@ -123,8 +124,12 @@ public:
 
         std::fill_n(begin(mData) + offset, SPI_FLASH_SEC_SIZE / 4, 0xffffffff);
 
+        if (sectorNumber >= mEraseCnt.size()) {
+            mEraseCnt.resize(sectorNumber + 1, 0);
+        }
+        ++mEraseCnt[sectorNumber];
         ++mEraseOps;
-        mTotalTime += getEraseOpTime();
+        mTotalTimeNs += flash_timing_sector_erase_ns(&mTiming);
         return true;
     }
     
@@ -180,7 +185,8 @@ public:
         mEraseOps = 0;
         mReadOps = 0;
         mWriteOps = 0;
-        mTotalTime = 0;
+        mTotalTimeNs = 0;
+        std::fill(begin(mEraseCnt), end(mEraseCnt), 0);
     }
 
     size_t getReadOps() const
@@ -205,7 +211,11 @@ public:
     }
     size_t getTotalTime() const
     {
-        return mTotalTime;
+        return static_cast<size_t>(mTotalTimeNs / 1000);
+    }
+    size_t getSectorEraseCount(uint32_t sector) const
+    {
+        return (sector < mEraseCnt.size()) ? mEraseCnt[sector] : 0;
     }
     
     void setBounds(uint32_t lowerSector, uint32_t upperSector) {
@@ -213,16 +223,16 @@ public:
         mUpperSectorBound = upperSector;
     }
     
+    /* Latency model used for getTotalTime(), see spi_flash/sim/flash_timing.h */
+    void setTiming(const flash_timing_t& timing) {
+        mTiming = timing;
+    }
+
     void failAfter(uint32_t count) {
         mFailCountdown = count;
     }
 
 protected:
-    static size_t getReadOpTime(uint32_t bytes);
-    static size_t getWriteOpTime(uint32_t bytes);
-    static size_t getEraseOpTime();
-
-
     std::vector<uint32_t> mData;
 
     mutable size_t mReadOps = 0;
@@ -230,7 +240,9 @@ protected:
     mutable size_t mReadBytes = 0;
     mutable size_t mWriteBytes = 0;
     mutable size_t mEraseOps = 0;
-    mutable size_t mTotalTime = 0;
+    mutable uint64_t mTotalTimeNs = 0;
+    flash_timing_t mTiming = FLASH_TIMING_ESP8266;
+    std::vector<size_t> mEraseCnt;
     size_t mLowerSectorBound = 0;
     size_t mUpperSectorBound = 0;
     
@@ -26,6 +26,10 @@
 #include <sys/wait.h>
 #include <string.h>
 #include <string>
+#include <chrono>
+#include <map>
+#include <vector>
+#include <algorithm>
 
 #define TEST_ESP_ERR(rc, res) CHECK((rc) == (res))
 #define TEST_ESP_OK(rc) CHECK((rc) == ESP_OK)
@@ -268,6 +272,32 @@ TEST_CASE("Page validates blob size", "[nvs]")
     TEST_ESP_OK(page.writeItem(1, ItemType::BLOB, "2", buf, Page::CHUNK_MAX_SIZE));
 }
 
+TEST_CASE("Page becomes invalid if marking a batch of items as written fails", "[nvs]")
+{
+    SpiFlashEmulator emu(4);
+    Page page;
+    TEST_ESP_OK(page.load(0));
+    TEST_ESP_OK(page.writeItem(1, "first", 1));
+
+    const size_t count = 20;
+    Item items[count];
+    for (size_t i = 0; i < count; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "key_%d", (int) i);
+        items[i] = Item(1, ItemType::U32, 1, key);
+        uint32_t value = i;
+        memcpy(items[i].data, &value, sizeof(value));
+    }
+    // the items are written, then the first write to the entry state table fails
+    emu.failAfter(count * sizeof(Item) / 4);
+    CHECK(page.writeItems(items, count) != ESP_OK);
+    emu.failAfter(UINT32_MAX);
+
+    // the entries of the batch must not be used again
+    CHECK(page.state() == Page::PageState::INVALID);
+    TEST_ESP_ERR(page.writeItem(1, "second", 2), ESP_ERR_NVS_INVALID_STATE);
+}
+
 TEST_CASE("Page handles invalid CRC of variable length items", "[nvs][cur]")
 {
     SpiFlashEmulator emu(4);
@@ -290,9 +320,15 @@ TEST_CASE("Page handles invalid CRC of variable length items", "[nvs][cur]")
 class HashListTestHelper : public HashList
 {
     public:
-        size_t getBlockCount()
+        size_t getUsedCount()
+        {
+            return std::count_if(mHashes, mHashes + MAX_ENTRY_COUNT,
+                    [](uint16_t hash) { return hash != EMPTY_HASH; });
+        }
+
+        static uint16_t getHash(const Item& item)
         {
-            return mBlockList.size();
+            return calcHash(item);
         }
 };
 
@@ -300,19 +336,19 @@ TEST_CASE("HashList is cleaned up as soon as items are erased", "[nvs]")
 {
     HashListTestHelper hashlist;
     // Add items
-    const size_t count = 128;
+    const size_t count = HashList::MAX_ENTRY_COUNT;
     for (size_t i = 0; i < count; ++i) {
         char key[16];
         snprintf(key, sizeof(key), "i%ld", (long int)i);
         Item item(1, ItemType::U32, 1, key);
         hashlist.insert(item, i);
     }
-    INFO("Added " << count << " items, " << hashlist.getBlockCount() << " blocks");
+    CHECK(hashlist.getUsedCount() == count);
     // Remove them in reverse order
     for (size_t i = count; i > 0; --i) {
         hashlist.erase(i - 1, true);
     }
-    CHECK(hashlist.getBlockCount() == 0);
+    CHECK(hashlist.getUsedCount() == 0);
     // Add again
     for (size_t i = 0; i < count; ++i) {
         char key[16];
@@ -320,12 +356,92 @@ TEST_CASE("HashList is cleaned up as soon as items are erased", "[nvs]")
         Item item(1, ItemType::U32, 1, key);
         hashlist.insert(item, i);
     }
-    INFO("Added " << count << " items, " << hashlist.getBlockCount() << " blocks");
     // Remove them in the same order
     for (size_t i = 0; i < count; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "i%ld", (long int)i);
         hashlist.erase(i, true);
+        CHECK(hashlist.find(0, Item(1, ItemType::U32, 1, key)) == SIZE_MAX);
+    }
+    CHECK(hashlist.getUsedCount() == 0);
+}
+
+TEST_CASE("HashList finds every index with a matching hash", "[nvs]")
+{
+    HashList hashlist;
+    Item item(1, ItemType::U32, 1, "key");
+    hashlist.insert(item, 3);
+    hashlist.insert(item, 10);
+    hashlist.insert(Item(1, ItemType::U32, 1, "other"), 5);
+    CHECK(hashlist.find(0, item) == 3);
+    CHECK(hashlist.find(4, item) == 10);
+    CHECK(hashlist.find(11, item) == SIZE_MAX);
+    hashlist.clear();
+    CHECK(hashlist.find(0, item) == SIZE_MAX);
+}
+
+TEST_CASE("items with colliding hashes are kept when page is loaded", "[nvs]")
+{
+    // find two keys which end up with the same hash
+    char key1[16];
+    char key2[16];
+    std::map<uint16_t, int> hashes;
+    for (int i = 0; ; ++i) {
+        snprintf(key2, sizeof(key2), "key_%d", i);
+        uint16_t hash = HashListTestHelper::getHash(Item(1, ItemType::U32, 0, key2));
+        auto it = hashes.find(hash);
+        if (it != hashes.end()) {
+            snprintf(key1, sizeof(key1), "key_%d", it->second);
+            break;
+        }
+        hashes[hash] = i;
+    }
+
+    SpiFlashEmulator emu(1);
+    {
+        Page page;
+        TEST_ESP_OK(page.load(0));
+        TEST_ESP_OK(page.writeItem(1, key1, static_cast<uint32_t>(1)));
+        TEST_ESP_OK(page.writeItem(1, key2, static_cast<uint32_t>(2)));
+        uint32_t value;
+        TEST_ESP_OK(page.readItem(1, key2, value));
+        CHECK(value == 2);
+    }
+    Page page;
+    TEST_ESP_OK(page.load(0));
+    CHECK(page.getUsedEntryCount() == 2);
+    uint32_t value;
+    TEST_ESP_OK(page.readItem(1, key1, value));
+    CHECK(value == 1);
+    TEST_ESP_OK(page.readItem(1, key2, value));
+    CHECK(value == 2);
+}
+
+TEST_CASE("measure HashList lookup time and memory footprint", "[nvs][bench][.]")
+{
+    const size_t count = HashList::MAX_ENTRY_COUNT;
+    const int rounds = 1000;
+    HashList hashlist;
+    std::vector<Item> items;
+    for (size_t i = 0; i < count; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "key_%d", (int)i);
+        items.push_back(Item(1, ItemType::U32, 0, key));
+        hashlist.insert(items.back(), i);
+    }
+    auto start = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (int r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < count; ++i) {
+            found += (hashlist.find(0, items[i]) <= i) ? 1 : 0;
+        }
     }
-    CHECK(hashlist.getBlockCount() == 0);
+    auto end = std::chrono::steady_clock::now();
+    CHECK(found == count * rounds);
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    std::cout << "HashList lookup in a full page: " << ns / (count * rounds) << " ns, "
+           << sizeof(HashList) << " bytes per page" << std::endl;
 }
 
 TEST_CASE("can init PageManager in empty flash", "[nvs]")
@@ -370,6 +486,30 @@ TEST_CASE("can init storage in empty flash", "[nvs]")
     s_perf << "Time to init empty storage (4 sectors): " << emu.getTotalTime() << " us" << std::endl;
 }
 
+TEST_CASE("storage init reads each item header once", "[nvs]")
+{
+    const size_t sectorCount = 8;
+    const int keyCount = 400;
+    SpiFlashEmulator emu(sectorCount);
+    {
+        Storage storage;
+        CHECK(storage.init(0, sectorCount) == ESP_OK);
+        for (int i = 0; i < keyCount; ++i) {
+            char key[16];
+            snprintf(key, sizeof(key), "key_%d", i);
+            TEST_ESP_OK(storage.writeItem(1, key, i));
+        }
+    }
+    emu.clearStats();
+    Storage storage;
+    CHECK(storage.init(0, sectorCount) == ESP_OK);
+    // entries of full pages are loaded in batches, then the single pass over
+    // all items reads each of them once (debugCheck in host builds reads them once more)
+    CHECK(emu.getReadOps() < keyCount * 2 + keyCount / 2);
+    s_perf << "Time to init storage with " << keyCount << " items (" << sectorCount << " sectors): "
+           << emu.getTotalTime() << " us (" << emu.getReadOps() << "R " << emu.getReadBytes() << "Rb)" << std::endl;
+}
+
 TEST_CASE("storage doesn't add duplicates within one page", "[nvs]")
 {
     SpiFlashEmulator emu(8);
@@ -767,10 +907,121 @@ TEST_CASE("nvs iterators tests", "[nvs]")
         nvs_close(handle_3);
     }
 
+    SECTION("Blob is found after it has been updated")
+    {
+        const uint32_t new_blob = 0x55667788;
+        TEST_ESP_OK(nvs_set_blob(handle_1, "value11", &new_blob, sizeof(new_blob)));
+        CHECK(entry_count(NVS_DEFAULT_PART_NAME, name_1, NVS_TYPE_BLOB) == 1);
+        CHECK(entry_count(NVS_DEFAULT_PART_NAME, name_1, NVS_TYPE_ANY) == 11);
+    }
+
     nvs_close(handle_1);
     nvs_close(handle_2);
 }
 
+TEST_CASE("iterating over a namespace only reads items of that namespace", "[nvs]")
+{
+    const uint32_t sectorCount = 16;
+    SpiFlashEmulator emu(sectorCount);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, sectorCount));
+
+    nvs_handle_t big_handle;
+    nvs_handle_t small_handle;
+    TEST_ESP_OK(nvs_open("big", NVS_READWRITE, &big_handle));
+    TEST_ESP_OK(nvs_open("small", NVS_READWRITE, &small_handle));
+    const int bigCount = 1000;
+    const int smallCount = 5;
+    for (int i = 0; i < bigCount; ++i) {
+        TEST_ESP_OK(nvs_set_u32(big_handle, to_string(i).c_str(), i));
+        if (i % (bigCount / smallCount) == 0) {
+            TEST_ESP_OK(nvs_set_u32(small_handle, to_string(i).c_str(), i));
+        }
+    }
+
+    emu.clearStats();
+    int found = 0;
+    for (auto it = nvs_entry_find(NVS_DEFAULT_PART_NAME, "small", NVS_TYPE_ANY); it != nullptr; it = nvs_entry_next(it)) {
+        ++found;
+    }
+    CHECK(found == smallCount);
+    CHECK(emu.getReadOps() < 4 * smallCount);
+
+    size_t used_entries;
+    emu.clearStats();
+    TEST_ESP_OK(nvs_get_used_entry_count(small_handle, &used_entries));
+    CHECK(used_entries == smallCount);
+    CHECK(emu.getReadOps() < 4 * smallCount);
+
+    nvs_close(big_handle);
+    nvs_close(small_handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
+TEST_CASE("namespace can be exported to a buffer and imported again", "[nvs]")
+{
+    const uint32_t sectorCount = 8;
+    SpiFlashEmulator emu(sectorCount);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, sectorCount));
+
+    nvs_handle_t handle;
+    nvs_handle_t other_handle;
+    TEST_ESP_OK(nvs_open("config", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_open("other", NVS_READWRITE, &other_handle));
+    vector<uint8_t> blob(5000);
+    for (size_t i = 0; i < blob.size(); ++i) {
+        blob[i] = static_cast<uint8_t>(i);
+    }
+    TEST_ESP_OK(nvs_set_i8(handle, "i8", -8));
+    TEST_ESP_OK(nvs_set_u16(handle, "u16", 1616));
+    TEST_ESP_OK(nvs_set_u64(handle, "u64", 0x0123456789abcdefULL));
+    TEST_ESP_OK(nvs_set_str(handle, "str", "value"));
+    TEST_ESP_OK(nvs_set_blob(handle, "blob", blob.data(), blob.size()));
+    TEST_ESP_OK(nvs_set_u32(other_handle, "u32", 32));
+
+    size_t length = 0;
+    TEST_ESP_OK(nvs_export_namespace(handle, NULL, &length));
+    CHECK(length == 5 * NVS_EXPORT_HEADER_SIZE + 1 + 2 + 8 + strlen("value") + 1 + blob.size());
+
+    vector<uint8_t> buf(length);
+    size_t small_length = length - 1;
+    CHECK(nvs_export_namespace(handle, buf.data(), &small_length) == ESP_ERR_NVS_INVALID_LENGTH);
+    CHECK(small_length == length);
+    TEST_ESP_OK(nvs_export_namespace(handle, buf.data(), &length));
+    CHECK(length == buf.size());
+
+    // malformed buffers are rejected without writing anything
+    CHECK(nvs_import_namespace(other_handle, buf.data(), buf.size() - 1) == ESP_ERR_INVALID_ARG);
+    size_t used_entries;
+    TEST_ESP_OK(nvs_get_used_entry_count(other_handle, &used_entries));
+    CHECK(used_entries == 1);
+
+    TEST_ESP_OK(nvs_import_namespace(other_handle, buf.data(), buf.size()));
+    int8_t i8;
+    uint16_t u16;
+    uint64_t u64;
+    uint32_t u32;
+    TEST_ESP_OK(nvs_get_i8(other_handle, "i8", &i8));
+    CHECK(i8 == -8);
+    TEST_ESP_OK(nvs_get_u16(other_handle, "u16", &u16));
+    CHECK(u16 == 1616);
+    TEST_ESP_OK(nvs_get_u64(other_handle, "u64", &u64));
+    CHECK(u64 == 0x0123456789abcdefULL);
+    TEST_ESP_OK(nvs_get_u32(other_handle, "u32", &u32));
+    CHECK(u32 == 32);
+    char str[16];
+    size_t str_length = sizeof(str);
+    TEST_ESP_OK(nvs_get_str(other_handle, "str", str, &str_length));
+    CHECK(string(str) == "value");
+    vector<uint8_t> blob_read(blob.size());
+    size_t blob_length = blob_read.size();
+    TEST_ESP_OK(nvs_get_blob(other_handle, "blob", blob_read.data(), &blob_length));
+    CHECK(blob_read == blob);
+
+    nvs_close(handle);
+    nvs_close(other_handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
 
 TEST_CASE("wifi test", "[nvs]")
 {
@@ -3261,6 +3512,803 @@ TEST_CASE("check and read data from partition generated via manufacturing utilit
 }
 #endif
 
+TEST_CASE("storage falls back to scanning pages when key index is out of space", "[nvs]")
+{
+    SpiFlashEmulator emu(8);
+    emu.setBounds(4, 8);
+    Storage storage(NVS_DEFAULT_PART_NAME, 4 * KeyIndex::getSlotSize());
+    CHECK(storage.init(4, 4) == ESP_OK);
+    for (int i = 0; i < 20; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "key_%d", i);
+        TEST_ESP_OK(storage.writeItem(1, key, i));
+    }
+    for (int i = 0; i < 20; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "key_%d", i);
+        int val;
+        TEST_ESP_OK(storage.readItem(1, key, val));
+        CHECK(val == i);
+    }
+}
+
+TEST_CASE("key index reduces the cost of lookups in a large partition", "[nvs][bench][.]")
+{
+    const size_t sectorCount = 64;
+    const int keyCount = 1000;
+    SpiFlashEmulator emu(sectorCount);
+
+    {
+        Storage storage(NVS_DEFAULT_PART_NAME, 64 * 1024);
+        CHECK(storage.init(0, sectorCount) == ESP_OK);
+        char filler[100];
+        for (int i = 0; i < keyCount; ++i) {
+            char key[16];
+            snprintf(key, sizeof(key), "key_%d", i);
+            TEST_ESP_OK(storage.writeItem(1, key, i));
+            // overwrite a bigger item to spread keys over the pages of the partition
+            snprintf(filler, sizeof(filler), "filler %d", i);
+            TEST_ESP_OK(storage.writeItem(1, ItemType::SZ, "filler", filler, sizeof(filler)));
+        }
+    }
+
+    auto readAll = [&](size_t keyIndexSize, size_t& readOps) -> long long {
+        Storage storage(NVS_DEFAULT_PART_NAME, keyIndexSize);
+        CHECK(storage.init(0, sectorCount) == ESP_OK);
+        emu.clearStats();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < keyCount; ++i) {
+            char key[16];
+            snprintf(key, sizeof(key), "key_%d", i);
+            int val;
+            TEST_ESP_OK(storage.readItem(1, key, val));
+            CHECK(val == i);
+        }
+        auto end = std::chrono::steady_clock::now();
+        readOps = emu.getReadOps();
+        return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    };
+
+    size_t scanReadOps, indexReadOps;
+    auto scanTime = readAll(0, scanReadOps);
+    auto indexTime = readAll(64 * 1024, indexReadOps);
+    CHECK(indexReadOps <= scanReadOps);
+
+    std::cout << "Time to look up " << keyCount << " keys in " << sectorCount << " sectors: "
+           << scanTime << " us (" << scanReadOps << "R) without key index, "
+           << indexTime << " us (" << indexReadOps << "R) with key index" << std::endl;
+}
+
+TEST_CASE("compare nvs_get throughput with and without encryption", "[nvs][bench][.]")
+{
+    const uint32_t sectorCount = 8;
+    const int keyCount = 50;
+    const int rounds = 20;
+    char str[200];
+    std::fill_n(str, sizeof(str) - 1, 'a');
+    str[sizeof(str) - 1] = 0;
+
+    nvs_sec_cfg_t xts_cfg;
+    for (int count = 0; count < NVS_KEY_SIZE; count++) {
+        xts_cfg.eky[count] = 0x11;
+        xts_cfg.tky[count] = 0x22;
+    }
+
+    auto readAll = [&](nvs_sec_cfg_t* cfg, size_t& readOps) -> long long {
+        SpiFlashEmulator emu(sectorCount);
+        if (cfg) {
+            TEST_ESP_OK(nvs_flash_secure_init_custom(NVS_DEFAULT_PART_NAME, 0, sectorCount, cfg));
+        } else {
+            TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, sectorCount));
+        }
+        nvs_handle_t handle;
+        TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+        char key[16];
+        for (int i = 0; i < keyCount; ++i) {
+            snprintf(key, sizeof(key), "u32_%d", i);
+            TEST_ESP_OK(nvs_set_u32(handle, key, i));
+            snprintf(key, sizeof(key), "str_%d", i);
+            TEST_ESP_OK(nvs_set_str(handle, key, str));
+        }
+
+        emu.clearStats();
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) {
+            for (int i = 0; i < keyCount; ++i) {
+                uint32_t val;
+                snprintf(key, sizeof(key), "u32_%d", i);
+                TEST_ESP_OK(nvs_get_u32(handle, key, &val));
+                CHECK(val == static_cast<uint32_t>(i));
+                char buf[sizeof(str)];
+                size_t len = sizeof(buf);
+                snprintf(key, sizeof(key), "str_%d", i);
+                TEST_ESP_OK(nvs_get_str(handle, key, buf, &len));
+                CHECK(strcmp(buf, str) == 0);
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        readOps = emu.getReadOps();
+
+        nvs_close(handle);
+        TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+        return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    };
+
+    size_t plainReadOps, encrReadOps;
+    auto plainTime = readAll(nullptr, plainReadOps);
+    auto encrTime = readAll(&xts_cfg, encrReadOps);
+    // string data is read in batches of entries, encrypted or not
+    CHECK(encrReadOps == plainReadOps);
+
+    std::cout << "Time to read " << keyCount << " integers and " << keyCount << " strings " << rounds << " times: "
+           << plainTime << " us (" << plainReadOps << "R) plain, "
+           << encrTime << " us (" << encrReadOps << "R) encrypted" << std::endl;
+}
+
+TEST_CASE("values set through a write-back handle are kept in RAM until nvs_commit", "[nvs]")
+{
+    SpiFlashEmulator emu(5);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+
+    nvs_handle_t handle, otherHandle;
+    TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_open("test", NVS_READONLY, &otherHandle));
+    TEST_ESP_ERR(nvs_set_write_back(otherHandle, true), ESP_ERR_NVS_READ_ONLY);
+    TEST_ESP_OK(nvs_set_i32(handle, "counter", 1));
+    TEST_ESP_OK(nvs_set_write_back(handle, true));
+
+    emu.clearStats();
+    for (int i = 0; i < 10; ++i) {
+        TEST_ESP_OK(nvs_set_i32(handle, "counter", i));
+        TEST_ESP_OK(nvs_set_u8(handle, "new", i));
+    }
+    TEST_ESP_ERR(nvs_set_u8(handle, "key name is too long", 1), ESP_ERR_NVS_KEY_TOO_LONG);
+    CHECK(emu.getWriteOps() == 0);
+
+    int32_t i32;
+    uint8_t u8;
+    TEST_ESP_OK(nvs_get_i32(handle, "counter", &i32));
+    CHECK(i32 == 9);
+    TEST_ESP_OK(nvs_get_u8(handle, "new", &u8));
+    CHECK(u8 == 9);
+    TEST_ESP_OK(nvs_get_i32(otherHandle, "counter", &i32));
+    CHECK(i32 == 1);
+    TEST_ESP_ERR(nvs_get_u8(otherHandle, "new", &u8), ESP_ERR_NVS_NOT_FOUND);
+
+    TEST_ESP_OK(nvs_commit(handle));
+    TEST_ESP_OK(nvs_get_i32(otherHandle, "counter", &i32));
+    CHECK(i32 == 9);
+    TEST_ESP_OK(nvs_get_u8(otherHandle, "new", &u8));
+    CHECK(u8 == 9);
+    size_t usedEntries;
+    TEST_ESP_OK(nvs_get_used_entry_count(handle, &usedEntries));
+    CHECK(usedEntries == 2);
+
+    // committing unchanged values doesn't touch flash
+    emu.clearStats();
+    TEST_ESP_OK(nvs_set_i32(handle, "counter", 9));
+    TEST_ESP_OK(nvs_commit(handle));
+    CHECK(emu.getWriteOps() == 0);
+
+    TEST_ESP_OK(nvs_set_u16(handle, "pending", 1));
+    TEST_ESP_OK(nvs_erase_key(handle, "pending"));
+    TEST_ESP_ERR(nvs_erase_key(handle, "pending"), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(nvs_set_u8(handle, "new", 10));
+    TEST_ESP_OK(nvs_erase_key(handle, "new"));
+    TEST_ESP_ERR(nvs_get_u8(handle, "new", &u8), ESP_ERR_NVS_NOT_FOUND);
+
+    // disabling write-back mode commits pending values, closing the handle discards them
+    TEST_ESP_OK(nvs_set_i32(handle, "counter", 10));
+    TEST_ESP_OK(nvs_set_write_back(handle, false));
+    TEST_ESP_OK(nvs_set_write_back(handle, true));
+    TEST_ESP_OK(nvs_set_i32(handle, "counter", 11));
+    nvs_close(handle);
+    nvs_close(otherHandle);
+
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+    TEST_ESP_OK(nvs_open("test", NVS_READONLY, &handle));
+    TEST_ESP_OK(nvs_get_i32(handle, "counter", &i32));
+    CHECK(i32 == 10);
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
+TEST_CASE("nvs_commit writes values set through a write-back handle in batches", "[nvs]")
+{
+    const int keyCount = 20;
+    const int rounds = 20;
+    SpiFlashEmulator emu(10);
+
+    auto updateAll = [&](bool writeBack) -> size_t {
+        TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 10));
+        nvs_handle_t handle;
+        TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+        TEST_ESP_OK(nvs_set_write_back(handle, writeBack));
+        emu.clearStats();
+        for (int round = 0; round < rounds; ++round) {
+            for (int i = 0; i < keyCount; ++i) {
+                char key[16];
+                snprintf(key, sizeof(key), "key_%d", i);
+                TEST_ESP_OK(nvs_set_u32(handle, key, round * keyCount + i));
+            }
+            TEST_ESP_OK(nvs_commit(handle));
+        }
+        size_t writeOps = emu.getWriteOps();
+        for (int i = 0; i < keyCount; ++i) {
+            char key[16];
+            snprintf(key, sizeof(key), "key_%d", i);
+            uint32_t val;
+            TEST_ESP_OK(nvs_get_u32(handle, key, &val));
+            CHECK(val == static_cast<uint32_t>((rounds - 1) * keyCount + i));
+        }
+        nvs_close(handle);
+        TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+        return writeOps;
+    };
+
+    size_t directWriteOps = updateAll(false);
+    size_t writeBackOps = updateAll(true);
+    CHECK(writeBackOps * 3 < directWriteOps);
+
+    s_perf << "Updating " << keyCount << " values " << rounds << " times: "
+           << directWriteOps << "W without write-back, "
+           << writeBackOps << "W with write-back" << std::endl;
+}
+
+TEST_CASE("power-off during nvs_commit leaves each key with either old or new value", "[nvs]")
+{
+    const int oldPageKeys = 20;
+    const int activePageKeys = 20;
+    const int newKeys = 10;
+    char key[16];
+    uint32_t val;
+
+    for (uint32_t errDelay = 0; ; ++errDelay) {
+        INFO(errDelay);
+        SpiFlashEmulator emu(5);
+        TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+        nvs_handle_t handle;
+        TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+
+        // some of the values are on an older page, some on the active one
+        for (int i = 0; i < oldPageKeys + activePageKeys; ++i) {
+            if (i == oldPageKeys) {
+                char filler[3000];
+                std::fill_n(filler, sizeof(filler), 'x');
+                TEST_ESP_OK(nvs_set_blob(handle, "filler", filler, sizeof(filler)));
+            }
+            snprintf(key, sizeof(key), "key_%d", i);
+            TEST_ESP_OK(nvs_set_u32(handle, key, 1));
+        }
+        size_t usedBefore;
+        TEST_ESP_OK(nvs_get_used_entry_count(handle, &usedBefore));
+
+        TEST_ESP_OK(nvs_set_write_back(handle, true));
+        for (int i = 0; i < oldPageKeys + activePageKeys + newKeys; ++i) {
+            snprintf(key, sizeof(key), "key_%d", i);
+            TEST_ESP_OK(nvs_set_u32(handle, key, 2));
+        }
+        emu.failAfter(errDelay);
+        esp_err_t err = nvs_commit(handle);
+        emu.failAfter(UINT32_MAX);
+        nvs_close(handle);
+        TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+
+        TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+        TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+        size_t newFound = 0;
+        for (int i = 0; i < oldPageKeys + activePageKeys + newKeys; ++i) {
+            snprintf(key, sizeof(key), "key_%d", i);
+            esp_err_t readErr = nvs_get_u32(handle, key, &val);
+            if (i < oldPageKeys + activePageKeys) {
+                TEST_ESP_OK(readErr);
+                CHECK((val == 1 || val == 2));
+            } else if (readErr == ESP_OK) {
+                CHECK(val == 2);
+            } else {
+                CHECK(readErr == ESP_ERR_NVS_NOT_FOUND);
+                continue;
+            }
+            CHECK((err != ESP_OK || val == 2));
+            if (i >= oldPageKeys + activePageKeys) {
+                ++newFound;
+            }
+        }
+        // there must be no leftover copies of the old values
+        size_t usedEntries;
+        TEST_ESP_OK(nvs_get_used_entry_count(handle, &usedEntries));
+        CHECK(usedEntries == usedBefore + newFound);
+        nvs_close(handle);
+        TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+
+        if (err == ESP_OK) {
+            break;
+        }
+    }
+}
+
+static void fill_partition_for_gc(nvs_handle_t handle, int count)
+{
+    // every tenth value is written once, the others overwrite a few counters
+    for (int i = 0; i < count; ++i) {
+        char key[16];
+        if (i % 10 == 0) {
+            snprintf(key, sizeof(key), "static_%d", (i / 10) % 1000);
+        } else {
+            snprintf(key, sizeof(key), "counter_%d", i % 10);
+        }
+        TEST_ESP_OK(nvs_set_u32(handle, key, i));
+    }
+}
+
+static void check_values_after_gc(nvs_handle_t handle, int count)
+{
+    size_t usedEntries;
+    TEST_ESP_OK(nvs_get_used_entry_count(handle, &usedEntries));
+    CHECK(usedEntries == static_cast<size_t>((count + 9) / 10 + 9));
+    for (int i = 0; i < count; ++i) {
+        char key[16];
+        if (i % 10 == 0) {
+            snprintf(key, sizeof(key), "static_%d", (i / 10) % 1000);
+        } else if (i >= count - 10) {
+            snprintf(key, sizeof(key), "counter_%d", i % 10);
+        } else {
+            continue;
+        }
+        uint32_t val;
+        TEST_ESP_OK(nvs_get_u32(handle, key, &val));
+        CHECK(val == static_cast<uint32_t>(i));
+    }
+}
+
+TEST_CASE("nvs_flash_gc_step frees pages in bounded steps", "[nvs]")
+{
+    const int count = 400; // fills three of five pages, leaving one free
+    const size_t budget = 4;
+    SpiFlashEmulator emu(5);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+    nvs_handle_t handle;
+    TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+    fill_partition_for_gc(handle, count);
+
+    bool done = false;
+    size_t steps = 0;
+    size_t totalErases = 0;
+    while (!done) {
+        emu.clearStats();
+        TEST_ESP_OK(nvs_flash_gc_step(NVS_DEFAULT_PART_NAME, budget, &done));
+        // moving an entry takes two writes to flash and erasing the original takes one
+        CHECK(emu.getWriteOps() <= 3 * budget);
+        CHECK(emu.getEraseOps() <= 1);
+        totalErases += emu.getEraseOps();
+        ++steps;
+        REQUIRE(steps < 100);
+    }
+    CHECK(steps > 1);
+    CHECK(totalErases == 1);
+    check_values_after_gc(handle, count);
+
+    // nothing to do until another free page is taken into use
+    emu.clearStats();
+    TEST_ESP_OK(nvs_flash_gc_step(NVS_DEFAULT_PART_NAME, budget, &done));
+    CHECK(done);
+    CHECK(emu.getWriteOps() == 0);
+
+    // filling the current page doesn't require erasing a page
+    emu.clearStats();
+    for (size_t i = 0; i < Page::ENTRY_COUNT; ++i) {
+        TEST_ESP_OK(nvs_set_u32(handle, "counter_1", i));
+    }
+    CHECK(emu.getEraseOps() == 0);
+
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+    TEST_ESP_ERR(nvs_flash_gc_step(NVS_DEFAULT_PART_NAME, budget, &done), ESP_ERR_NVS_NOT_INITIALIZED);
+}
+
+TEST_CASE("power-off during nvs_flash_gc_step doesn't lose values", "[nvs]")
+{
+    const int count = 400;
+
+    for (uint32_t errDelay = 0; ; ++errDelay) {
+        INFO(errDelay);
+        SpiFlashEmulator emu(5);
+        TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+        nvs_handle_t handle;
+        TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+        fill_partition_for_gc(handle, count);
+        nvs_close(handle);
+
+        emu.failAfter(errDelay);
+        esp_err_t err;
+        bool done = false;
+        do {
+            err = nvs_flash_gc_step(NVS_DEFAULT_PART_NAME, 4, &done);
+        } while (err == ESP_OK && !done);
+        emu.failAfter(UINT32_MAX);
+        TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+
+        TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+        TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+        check_values_after_gc(handle, count);
+        nvs_close(handle);
+        TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+
+        if (err == ESP_OK) {
+            break;
+        }
+    }
+}
+
+TEST_CASE("values set in a transaction are written together on commit", "[nvs]")
+{
+    const int keyCount = 30;
+    SpiFlashEmulator emu(10);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 10));
+    nvs_handle_t handle, other;
+    TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &other));
+    char key[16];
+    uint32_t val;
+
+    for (int i = 0; i < keyCount; ++i) {
+        snprintf(key, sizeof(key), "key_%d", i);
+        TEST_ESP_OK(nvs_set_u32(handle, key, 1));
+    }
+    // push the current values to older pages
+    char filler[3000];
+    std::fill_n(filler, sizeof(filler), 'x');
+    TEST_ESP_OK(nvs_set_blob(handle, "filler", filler, sizeof(filler)));
+    nvs_stats_t statsBefore;
+    TEST_ESP_OK(nvs_get_stats(NULL, &statsBefore));
+
+    emu.clearStats();
+    for (int i = 0; i < keyCount; ++i) {
+        snprintf(key, sizeof(key), "key_%d", i);
+        TEST_ESP_OK(nvs_set_u32(handle, key, 2));
+    }
+    size_t directWriteOps = emu.getWriteOps();
+
+    TEST_ESP_OK(nvs_transaction_begin(handle));
+    TEST_ESP_ERR(nvs_transaction_begin(handle), ESP_ERR_INVALID_STATE);
+    for (int i = 0; i < keyCount; ++i) {
+        snprintf(key, sizeof(key), "key_%d", i);
+        TEST_ESP_OK(nvs_set_u32(handle, key, 3));
+    }
+    TEST_ESP_OK(nvs_set_u32(handle, "new_key", 3));
+    TEST_ESP_ERR(nvs_set_str(handle, "str", "value"), ESP_ERR_INVALID_STATE);
+    TEST_ESP_ERR(nvs_erase_key(handle, "key_0"), ESP_ERR_INVALID_STATE);
+    TEST_ESP_ERR(nvs_erase_all(handle), ESP_ERR_INVALID_STATE);
+    TEST_ESP_ERR(nvs_set_write_back(handle, true), ESP_ERR_INVALID_STATE);
+
+    // nothing reaches flash before the transaction is committed
+    TEST_ESP_OK(nvs_commit(handle));
+    CHECK(emu.getWriteOps() == directWriteOps);
+    TEST_ESP_OK(nvs_get_u32(handle, "key_0", &val));
+    CHECK(val == 3);
+    TEST_ESP_OK(nvs_get_u32(other, "key_0", &val));
+    CHECK(val == 2);
+    TEST_ESP_ERR(nvs_get_u32(other, "new_key", &val), ESP_ERR_NVS_NOT_FOUND);
+
+    emu.clearStats();
+    TEST_ESP_OK(nvs_transaction_commit(handle));
+    size_t transactionWriteOps = emu.getWriteOps();
+    CHECK(transactionWriteOps * 2 < directWriteOps);
+    for (int i = 0; i < keyCount; ++i) {
+        snprintf(key, sizeof(key), "key_%d", i);
+        TEST_ESP_OK(nvs_get_u32(other, key, &val));
+        CHECK(val == 3);
+    }
+    TEST_ESP_OK(nvs_get_u32(other, "new_key", &val));
+    CHECK(val == 3);
+    // the marker is gone and previous versions have been erased
+    nvs_stats_t stats;
+    TEST_ESP_OK(nvs_get_stats(NULL, &stats));
+    CHECK(stats.used_entries == statsBefore.used_entries + 1);
+    TEST_ESP_ERR(nvs_transaction_commit(handle), ESP_ERR_INVALID_STATE);
+
+    // aborted and unchanged values are not written
+    TEST_ESP_OK(nvs_transaction_begin(handle));
+    TEST_ESP_OK(nvs_set_u32(handle, "key_0", 4));
+    TEST_ESP_OK(nvs_transaction_abort(handle));
+    TEST_ESP_OK(nvs_get_u32(handle, "key_0", &val));
+    CHECK(val == 3);
+    TEST_ESP_OK(nvs_transaction_begin(handle));
+    TEST_ESP_OK(nvs_set_u32(handle, "key_0", 3));
+    emu.clearStats();
+    TEST_ESP_OK(nvs_transaction_commit(handle));
+    CHECK(emu.getWriteOps() == 0);
+
+    // a transaction has to fit in one page
+    TEST_ESP_OK(nvs_transaction_begin(handle));
+    for (size_t i = 0; i < Page::ENTRY_COUNT; ++i) {
+        snprintf(key, sizeof(key), "many_%d", static_cast<int>(i));
+        TEST_ESP_OK(nvs_set_u8(handle, key, 1));
+    }
+    TEST_ESP_ERR(nvs_transaction_commit(handle), ESP_ERR_NVS_NOT_ENOUGH_SPACE);
+    TEST_ESP_OK(nvs_transaction_abort(handle));
+    TEST_ESP_OK(nvs_set_str(handle, "str", "value"));
+
+    s_perf << "Updating " << keyCount << " values: "
+           << directWriteOps << "W one by one, "
+           << transactionWriteOps << "W in a transaction" << std::endl;
+
+    nvs_close(other);
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
+TEST_CASE("power-off during nvs_transaction_commit updates either all values or none", "[nvs]")
+{
+    const int oldPageKeys = 20;
+    const int activePageKeys = 20;
+    const int newKeys = 10;
+    const int keyCount = oldPageKeys + activePageKeys + newKeys;
+    char key[16];
+    uint32_t val;
+
+    for (uint32_t errDelay = 0; ; ++errDelay) {
+        INFO(errDelay);
+        SpiFlashEmulator emu(5);
+        TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+        nvs_handle_t handle;
+        TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+
+        // some of the values are on an older page, some on the active one
+        for (int i = 0; i < oldPageKeys + activePageKeys; ++i) {
+            if (i == oldPageKeys) {
+                char filler[3000];
+                std::fill_n(filler, sizeof(filler), 'x');
+                TEST_ESP_OK(nvs_set_blob(handle, "filler", filler, sizeof(filler)));
+            }
+            snprintf(key, sizeof(key), "key_%d", i);
+            TEST_ESP_OK(nvs_set_u32(handle, key, 1));
+        }
+        nvs_stats_t statsBefore;
+        TEST_ESP_OK(nvs_get_stats(NULL, &statsBefore));
+
+        TEST_ESP_OK(nvs_transaction_begin(handle));
+        for (int i = 0; i < keyCount; ++i) {
+            snprintf(key, sizeof(key), "key_%d", i);
+            TEST_ESP_OK(nvs_set_u32(handle, key, 2));
+        }
+        emu.failAfter(errDelay);
+        esp_err_t err = nvs_transaction_commit(handle);
+        emu.failAfter(UINT32_MAX);
+        nvs_close(handle);
+        TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+
+        TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+        TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+        TEST_ESP_OK(nvs_get_u32(handle, "key_0", &val));
+        const uint32_t expected = val;
+        CHECK((err != ESP_OK || expected == 2));
+        for (int i = 0; i < keyCount; ++i) {
+            snprintf(key, sizeof(key), "key_%d", i);
+            esp_err_t readErr = nvs_get_u32(handle, key, &val);
+            if (i >= oldPageKeys + activePageKeys && expected == 1) {
+                CHECK(readErr == ESP_ERR_NVS_NOT_FOUND);
+            } else {
+                TEST_ESP_OK(readErr);
+                CHECK(val == expected);
+            }
+        }
+        // there must be no leftover copies of the old values, nor the marker
+        nvs_stats_t stats;
+        TEST_ESP_OK(nvs_get_stats(NULL, &stats));
+        CHECK(stats.used_entries == statsBefore.used_entries + ((expected == 2) ? newKeys : 0));
+        nvs_close(handle);
+        TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+
+        if (err == ESP_OK) {
+            break;
+        }
+    }
+}
+
+static void fill_blob_pattern(uint8_t* data, size_t size, uint32_t seed)
+{
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<uint8_t>((i * 7 + seed) ^ (i >> 8));
+    }
+}
+
+static esp_err_t write_blob_in_parts(nvs_handle_t handle, const char* key, const uint8_t* data, size_t size, size_t partSize)
+{
+    nvs_blob_t blob;
+    esp_err_t err = nvs_blob_open_write(handle, key, size, &blob);
+    if (err != ESP_OK) {
+        return err;
+    }
+    for (size_t offset = 0; offset < size && err == ESP_OK; offset += partSize) {
+        err = nvs_blob_write(blob, data + offset, std::min(partSize, size - offset));
+    }
+    esp_err_t closeErr = nvs_blob_close(blob);
+    return (err != ESP_OK) ? err : closeErr;
+}
+
+TEST_CASE("blob written in parts can be read back in parts and as a whole", "[nvs]")
+{
+    const size_t size = 3 * Page::CHUNK_MAX_SIZE + 123;
+    SpiFlashEmulator emu(10);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 10));
+    nvs_handle_t handle;
+    TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_set_u32(handle, "before", 1));
+
+    uint8_t* data = new uint8_t[size];
+    uint8_t* readData = new uint8_t[size];
+    fill_blob_pattern(data, size, 1);
+    TEST_ESP_OK(write_blob_in_parts(handle, "stream", data, size, 97));
+
+    size_t readSize = size;
+    TEST_ESP_OK(nvs_get_blob(handle, "stream", readData, &readSize));
+    CHECK(readSize == size);
+    CHECK(memcmp(data, readData, size) == 0);
+
+    nvs_blob_t blob;
+    size_t length = 0;
+    TEST_ESP_OK(nvs_blob_open_read(handle, "stream", &blob, &length));
+    CHECK(length == size);
+    std::mt19937 gen(42);
+    for (int i = 0; i < 200; ++i) {
+        size_t offset = gen() % size;
+        size_t partSize = std::min(static_cast<size_t>(gen() % 300), size - offset);
+        memset(readData, 0, partSize);
+        TEST_ESP_OK(nvs_blob_read(blob, offset, readData, partSize));
+        REQUIRE(memcmp(data + offset, readData, partSize) == 0);
+    }
+    TEST_ESP_ERR(nvs_blob_read(blob, size - 10, readData, 11), ESP_ERR_NVS_INVALID_LENGTH);
+    TEST_ESP_ERR(nvs_blob_write(blob, data, 1), ESP_ERR_INVALID_ARG);
+    TEST_ESP_OK(nvs_blob_close(blob));
+
+    // a small read only touches the chunk which holds it
+    TEST_ESP_OK(nvs_blob_open_read(handle, "stream", &blob, nullptr));
+    emu.clearStats();
+    TEST_ESP_OK(nvs_blob_read(blob, size - 16, readData, 16));
+    CHECK(emu.getReadBytes() < 2 * Page::CHUNK_MAX_SIZE);
+    // data of a chunk which has been checked once is read only as far as needed
+    emu.clearStats();
+    TEST_ESP_OK(nvs_blob_read(blob, size - 16, readData, 16));
+    CHECK(emu.getReadBytes() < Page::CHUNK_MAX_SIZE / 2);
+    TEST_ESP_OK(nvs_blob_close(blob));
+
+    // rewriting replaces the old version, whichever way it was written
+    size_t usedEntries;
+    TEST_ESP_OK(nvs_get_used_entry_count(handle, &usedEntries));
+    fill_blob_pattern(data, size, 2);
+    TEST_ESP_OK(write_blob_in_parts(handle, "stream", data, size, Page::CHUNK_MAX_SIZE + 1));
+    size_t newUsedEntries;
+    TEST_ESP_OK(nvs_get_used_entry_count(handle, &newUsedEntries));
+    CHECK(newUsedEntries == usedEntries);
+    readSize = size;
+    TEST_ESP_OK(nvs_get_blob(handle, "stream", readData, &readSize));
+    CHECK(memcmp(data, readData, size) == 0);
+
+    TEST_ESP_OK(write_blob_in_parts(handle, "stream", data, 0, 1));
+    readSize = 0;
+    TEST_ESP_OK(nvs_get_blob(handle, "stream", nullptr, &readSize));
+    CHECK(readSize == 0);
+
+    TEST_ESP_ERR(nvs_blob_open_read(handle, "missing", &blob, nullptr), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_ERR(nvs_blob_open_write(handle, "stream", 10 * Page::CHUNK_MAX_SIZE, &blob), ESP_ERR_NVS_VALUE_TOO_LONG);
+    uint32_t before;
+    TEST_ESP_OK(nvs_get_u32(handle, "before", &before));
+    CHECK(before == 1);
+
+    delete [] data;
+    delete [] readData;
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
+TEST_CASE("incomplete blob written in parts is discarded and keeps the old value", "[nvs]")
+{
+    const size_t size = 2 * Page::CHUNK_MAX_SIZE;
+    SpiFlashEmulator emu(8);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 8));
+    nvs_handle_t handle;
+    TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+
+    uint8_t* data = new uint8_t[size];
+    uint8_t* readData = new uint8_t[size];
+    fill_blob_pattern(data, size, 3);
+    TEST_ESP_OK(nvs_set_blob(handle, "stream", data, 100));
+    size_t usedEntries;
+    TEST_ESP_OK(nvs_get_used_entry_count(handle, &usedEntries));
+
+    nvs_blob_t blob;
+    TEST_ESP_OK(nvs_blob_open_write(handle, "stream", size, &blob));
+    TEST_ESP_OK(nvs_blob_write(blob, data, size - 1000));
+
+    // the key can't be changed by other means while it is being written
+    nvs_blob_t other;
+    TEST_ESP_ERR(nvs_blob_open_write(handle, "stream", 10, &other), ESP_ERR_INVALID_STATE);
+    TEST_ESP_ERR(nvs_set_blob(handle, "stream", data, 10), ESP_ERR_INVALID_STATE);
+    TEST_ESP_ERR(nvs_erase_key(handle, "stream"), ESP_ERR_INVALID_STATE);
+    TEST_ESP_ERR(nvs_erase_all(handle), ESP_ERR_INVALID_STATE);
+    TEST_ESP_OK(nvs_set_blob(handle, "other", data, 10));
+    TEST_ESP_OK(nvs_erase_key(handle, "other"));
+
+    // until the writer is closed, readers see the old value
+    size_t readSize = size;
+    TEST_ESP_OK(nvs_get_blob(handle, "stream", readData, &readSize));
+    CHECK(readSize == 100);
+
+    TEST_ESP_ERR(nvs_blob_write(blob, data, 1001), ESP_ERR_NVS_INVALID_LENGTH);
+    TEST_ESP_ERR(nvs_blob_close(blob), ESP_ERR_NVS_INVALID_LENGTH);
+
+    readSize = size;
+    TEST_ESP_OK(nvs_get_blob(handle, "stream", readData, &readSize));
+    CHECK(readSize == 100);
+    CHECK(memcmp(data, readData, 100) == 0);
+    size_t newUsedEntries;
+    TEST_ESP_OK(nvs_get_used_entry_count(handle, &newUsedEntries));
+    CHECK(newUsedEntries == usedEntries);
+
+    // the key is free again
+    TEST_ESP_OK(write_blob_in_parts(handle, "stream", data, size, 1000));
+    readSize = size;
+    TEST_ESP_OK(nvs_get_blob(handle, "stream", readData, &readSize));
+    CHECK(memcmp(data, readData, size) == 0);
+
+    nvs_handle_t readOnly;
+    TEST_ESP_OK(nvs_open("test", NVS_READONLY, &readOnly));
+    TEST_ESP_ERR(nvs_blob_open_write(readOnly, "stream", 10, &blob), ESP_ERR_NVS_READ_ONLY);
+    nvs_close(readOnly);
+
+    delete [] data;
+    delete [] readData;
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
+TEST_CASE("power-off while writing a blob in parts leaves either old or new value", "[nvs]")
+{
+    const size_t size = Page::CHUNK_MAX_SIZE + 500;
+    uint8_t* oldData = new uint8_t[size];
+    uint8_t* newData = new uint8_t[size];
+    uint8_t* readData = new uint8_t[size];
+    fill_blob_pattern(oldData, size, 4);
+    fill_blob_pattern(newData, size, 5);
+
+    for (uint32_t errDelay = 0; ; errDelay += 7) {
+        INFO(errDelay);
+        SpiFlashEmulator emu(5);
+        TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+        nvs_handle_t handle;
+        TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+        TEST_ESP_OK(nvs_set_blob(handle, "stream", oldData, size));
+
+        emu.failAfter(errDelay);
+        esp_err_t err = write_blob_in_parts(handle, "stream", newData, size, 256);
+        emu.failAfter(UINT32_MAX);
+        nvs_close(handle);
+        TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+
+        TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+        TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+        size_t readSize = size;
+        TEST_ESP_OK(nvs_get_blob(handle, "stream", readData, &readSize));
+        REQUIRE(readSize == size);
+        if (err == ESP_OK) {
+            CHECK(memcmp(newData, readData, size) == 0);
+        } else {
+            CHECK((memcmp(oldData, readData, size) == 0 || memcmp(newData, readData, size) == 0));
+        }
+        nvs_close(handle);
+        TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+
+        if (err == ESP_OK) {
+            break;
+        }
+    }
+    delete [] oldData;
+    delete [] newData;
+    delete [] readData;
+}
+
 /* Add new tests above */
 /* This test has to be the final one */
 
@@ -84,20 +84,16 @@ TEST_CASE("after erase the sector is set to 0xff", "[spi_flash_emu]")
 
 TEST_CASE("read/write/erase operation times are calculated correctly", "[spi_flash_emu]")
 {
+    // default timing is FLASH_TIMING_ESP8266
     SpiFlashEmulator emu(1);
     uint8_t data[512];
     spi_flash_read(0, data, 4);
-    CHECK(emu.getTotalTime() == 7);
+    CHECK(emu.getTotalTime() == 4);
     CHECK(emu.getReadOps() == 1);
     CHECK(emu.getReadBytes() == 4);
     emu.clearStats();
-    spi_flash_read(0, data, 8);
-    CHECK(emu.getTotalTime() == 5);
-    CHECK(emu.getReadOps() == 1);
-    CHECK(emu.getReadBytes() == 8);
-    emu.clearStats();
     spi_flash_read(0, data, 16);
-    CHECK(emu.getTotalTime() == 6);
+    CHECK(emu.getTotalTime() == 5);
     CHECK(emu.getReadOps() == 1);
     CHECK(emu.getReadBytes() == 16);
     emu.clearStats();
@@ -109,33 +105,23 @@ TEST_CASE("read/write/erase operation times are calculated correctly", "[spi_fla
     spi_flash_read(0, data, 256);
     CHECK(emu.getTotalTime() == 32);
     emu.clearStats();
-    spi_flash_read(0, data, (128+256)/2);
-    CHECK(emu.getTotalTime() == (18+32)/2);
-    emu.clearStats();
 
     spi_flash_write(0, data, 4);
-    CHECK(emu.getTotalTime() == 19);
+    CHECK(emu.getTotalTime() == 14);
     CHECK(emu.getWriteOps() == 1);
     CHECK(emu.getWriteBytes() == 4);
     emu.clearStats();
     CHECK(emu.getWriteOps() == 0);
     CHECK(emu.getWriteBytes() == 0);
-    spi_flash_write(0, data, 8);
-    CHECK(emu.getTotalTime() == 23);
-    emu.clearStats();
-    spi_flash_write(0, data, 16);
-    CHECK(emu.getTotalTime() == 35);
-    CHECK(emu.getWriteOps() == 1);
-    CHECK(emu.getWriteBytes() == 16);
-    emu.clearStats();
     spi_flash_write(0, data, 128);
-    CHECK(emu.getTotalTime() == 205);
+    CHECK(emu.getTotalTime() == 206);
     emu.clearStats();
     spi_flash_write(0, data, 256);
-    CHECK(emu.getTotalTime() == 417);
+    CHECK(emu.getTotalTime() == 404);
     emu.clearStats();
-    spi_flash_write(0, data, (128+256)/2);
-    CHECK(emu.getTotalTime() == (205+417)/2);
+    // a write crossing a page boundary programs two pages
+    spi_flash_write(252, data, 8);
+    CHECK(emu.getTotalTime() == 28);
     emu.clearStats();
 
     spi_flash_erase_sector(0);
@@ -143,6 +129,44 @@ TEST_CASE("read/write/erase operation times are calculated correctly", "[spi_fla
     CHECK(emu.getTotalTime() == 37142);
 }
 
+TEST_CASE("operation times follow the selected timing model", "[spi_flash_emu]")
+{
+    SpiFlashEmulator emu(1);
+    uint8_t data[512];
+    emu.setTiming(FLASH_TIMING_NONE);
+    spi_flash_read(0, data, sizeof(data));
+    spi_flash_write(0, data, sizeof(data));
+    spi_flash_erase_sector(0);
+    CHECK(emu.getTotalTime() == 0);
+
+    emu.setTiming(FLASH_TIMING_W25Q32);
+    spi_flash_read(0, data, 512);
+    CHECK(emu.getTotalTime() == (500 + 512 * 25) / 1000);
+    emu.clearStats();
+    spi_flash_write(0, data, 256);
+    CHECK(emu.getTotalTime() == 30 + 256 * 1450 / 1000);
+    emu.clearStats();
+    spi_flash_erase_sector(0);
+    CHECK(emu.getTotalTime() == 45000);
+}
+
+TEST_CASE("erase operations are counted per sector", "[spi_flash_emu]")
+{
+    SpiFlashEmulator emu(4);
+
+    CHECK(spi_flash_erase_sector(1) == ESP_OK);
+    CHECK(spi_flash_erase_sector(3) == ESP_OK);
+    CHECK(spi_flash_erase_sector(3) == ESP_OK);
+
+    CHECK(emu.getEraseOps() == 3);
+    CHECK(emu.getSectorEraseCount(0) == 0);
+    CHECK(emu.getSectorEraseCount(1) == 1);
+    CHECK(emu.getSectorEraseCount(3) == 2);
+
+    emu.clearStats();
+    CHECK(emu.getSectorEraseCount(3) == 0);
+}
+
 TEST_CASE("data is randomized predictably", "[spi_flash_emu]")
 {
     SpiFlashEmulator emu1(3);
@@ -259,6 +259,59 @@ esp_err_t esp_partition_write(const esp_partition_t* partition,
 esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
                                     uint32_t start_addr, uint32_t size);
 
+/**
+ * @brief Statistics of the partition read cache
+ */
+typedef struct {
+    uint32_t hits;          /*!< Number of sector reads served from the cache */
+    uint32_t misses;        /*!< Number of sectors read from flash into the cache */
+    uint32_t invalidations; /*!< Number of cached sectors dropped because they were written or erased */
+} esp_partition_read_cache_stats_t;
+
+/**
+ * @brief Set the number of flash sectors kept in the partition read cache
+ *
+ * esp_partition_read keeps recently read flash sectors of unencrypted partitions
+ * in RAM, so that metadata which file systems read again and again (FAT tables,
+ * SPIFFS lookup pages) is read from flash once. Reads of more than one sector
+ * bypass the cache. esp_partition_write and esp_partition_erase_range drop the
+ * sectors they change from the cache.
+ *
+ * The initial size is set by CONFIG_SPI_FLASH_PARTITION_READ_CACHE_SECTORS.
+ * Changing the size drops all cached sectors.
+ *
+ * @param sector_count Number of sectors, each takes SPI_FLASH_SEC_SIZE bytes of heap.
+ *                     0 disables the cache.
+ *
+ * @return ESP_OK, or ESP_ERR_NO_MEM if the cache could not be allocated
+ *         (in that case the cache is disabled).
+ */
+esp_err_t esp_partition_read_cache_config(size_t sector_count);
+
+/**
+ * @brief Drop cached sectors in a range of flash
+ *
+ * Must be called after writing or erasing flash which belongs to a partition
+ * with spi_flash_* functions directly, rather than through esp_partition_write
+ * or esp_partition_erase_range.
+ *
+ * @param flash_address Absolute flash address of the range
+ * @param size Size of the range, in bytes
+ */
+void esp_partition_read_cache_invalidate(size_t flash_address, size_t size);
+
+/**
+ * @brief Get statistics of the partition read cache
+ *
+ * @param[out] stats Pointer to the structure to fill
+ */
+void esp_partition_read_cache_get_stats(esp_partition_read_cache_stats_t* stats);
+
+/**
+ * @brief Reset statistics of the partition read cache
+ */
+void esp_partition_read_cache_reset_stats(void);
+
 /**
  * @brief Configure MMU to map partition into data memory
  *
@@ -16,7 +16,9 @@
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <sys/lock.h>
+#include <sys/param.h>
 #include "esp_flash_partitions.h"
 #include "esp_attr.h"
 #include "esp_spi_flash.h"
@@ -40,6 +42,13 @@ typedef struct partition_list_item_ {
     SLIST_ENTRY(partition_list_item_) next;
 } partition_list_item_t;
 
+/* Entry of the read cache of flash sectors, see esp_partition_read_cache_config */
+typedef struct {
+    size_t address;     // flash address of the cached sector, SIZE_MAX if the entry is unused
+    uint32_t last_use;  // value of s_read_cache_use_counter when the entry was last used
+    uint8_t* data;      // SPI_FLASH_SEC_SIZE bytes
+} read_cache_entry_t;
+
 typedef struct esp_partition_iterator_opaque_ {
     esp_partition_type_t type;                  // requested type
     esp_partition_subtype_t subtype;               // requested subtype
@@ -57,6 +66,19 @@ static SLIST_HEAD(partition_list_head_, partition_list_item_) s_partition_list =
         SLIST_HEAD_INITIALIZER(s_partition_list);
 static _lock_t s_partition_list_lock;
 
+#ifndef CONFIG_SPI_FLASH_PARTITION_READ_CACHE_SECTORS
+#define CONFIG_SPI_FLASH_PARTITION_READ_CACHE_SECTORS 0
+#endif
+
+static const char *TAG = "partition";
+
+static read_cache_entry_t* s_read_cache;
+static size_t s_read_cache_size;
+static bool s_read_cache_allocated;  // false until the cache is set up, on the first read or by esp_partition_read_cache_config
+static uint32_t s_read_cache_use_counter;
+static esp_partition_read_cache_stats_t s_read_cache_stats;
+static _lock_t s_read_cache_lock;
+
 
 esp_partition_iterator_t esp_partition_find(esp_partition_type_t type,
         esp_partition_subtype_t subtype, const char* label)
@@ -230,6 +252,125 @@ const esp_partition_t *esp_partition_verify(const esp_partition_t *partition)
     return NULL;
 }
 
+/* Call with s_read_cache_lock held */
+static esp_err_t read_cache_alloc(size_t sector_count)
+{
+    for (size_t i = 0; s_read_cache != NULL && i < s_read_cache_size; ++i) {
+        free(s_read_cache[i].data);
+    }
+    free(s_read_cache);
+    s_read_cache = NULL;
+    s_read_cache_size = 0;
+    s_read_cache_allocated = true;
+    if (sector_count == 0) {
+        return ESP_OK;
+    }
+    s_read_cache = calloc(sector_count, sizeof(read_cache_entry_t));
+    if (s_read_cache == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_read_cache_size = sector_count;
+    for (size_t i = 0; i < sector_count; ++i) {
+        s_read_cache[i].address = SIZE_MAX;
+        s_read_cache[i].data = malloc(SPI_FLASH_SEC_SIZE);
+        if (s_read_cache[i].data == NULL) {
+            read_cache_alloc(0);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_read_cache_config(size_t sector_count)
+{
+    _lock_acquire(&s_read_cache_lock);
+    esp_err_t err = read_cache_alloc(sector_count);
+    _lock_release(&s_read_cache_lock);
+    return err;
+}
+
+void esp_partition_read_cache_invalidate(size_t flash_address, size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+    size_t first = flash_address & ~(SPI_FLASH_SEC_SIZE - 1);
+    _lock_acquire(&s_read_cache_lock);
+    for (size_t i = 0; i < s_read_cache_size; ++i) {
+        read_cache_entry_t* entry = &s_read_cache[i];
+        if (entry->address != SIZE_MAX && entry->address >= first && entry->address < flash_address + size) {
+            entry->address = SIZE_MAX;
+            s_read_cache_stats.invalidations++;
+        }
+    }
+    _lock_release(&s_read_cache_lock);
+}
+
+void esp_partition_read_cache_get_stats(esp_partition_read_cache_stats_t* stats)
+{
+    _lock_acquire(&s_read_cache_lock);
+    *stats = s_read_cache_stats;
+    _lock_release(&s_read_cache_lock);
+}
+
+void esp_partition_read_cache_reset_stats(void)
+{
+    _lock_acquire(&s_read_cache_lock);
+    memset(&s_read_cache_stats, 0, sizeof(s_read_cache_stats));
+    _lock_release(&s_read_cache_lock);
+}
+
+/* Reads of up to one sector go through the cache, larger ones are mostly bulk data
+ * which would only push the frequently read sectors out of it. */
+static esp_err_t read_cache_read(size_t address, void* dst, size_t size)
+{
+    _lock_acquire(&s_read_cache_lock);
+    if (!s_read_cache_allocated && read_cache_alloc(CONFIG_SPI_FLASH_PARTITION_READ_CACHE_SECTORS) != ESP_OK) {
+        ESP_LOGW(TAG, "not enough memory for partition read cache");
+    }
+    if (s_read_cache_size == 0 || size > SPI_FLASH_SEC_SIZE) {
+        _lock_release(&s_read_cache_lock);
+        return spi_flash_read(address, dst, size);
+    }
+    esp_err_t err = ESP_OK;
+    uint8_t* out = (uint8_t*) dst;
+    while (size > 0) {
+        size_t sector = address & ~(SPI_FLASH_SEC_SIZE - 1);
+        size_t offset = address - sector;
+        size_t len = MIN(size, SPI_FLASH_SEC_SIZE - offset);
+        read_cache_entry_t* entry = NULL;
+        read_cache_entry_t* lru = &s_read_cache[0];
+        for (size_t i = 0; i < s_read_cache_size; ++i) {
+            if (s_read_cache[i].address == sector) {
+                entry = &s_read_cache[i];
+                break;
+            }
+            if (s_read_cache[i].last_use < lru->last_use) {
+                lru = &s_read_cache[i];
+            }
+        }
+        if (entry != NULL) {
+            s_read_cache_stats.hits++;
+        } else {
+            s_read_cache_stats.misses++;
+            entry = lru;
+            entry->address = SIZE_MAX;
+            err = spi_flash_read(sector, entry->data, SPI_FLASH_SEC_SIZE);
+            if (err != ESP_OK) {
+                break;
+            }
+            entry->address = sector;
+        }
+        entry->last_use = ++s_read_cache_use_counter;
+        memcpy(out, entry->data + offset, len);
+        out += len;
+        address += len;
+        size -= len;
+    }
+    _lock_release(&s_read_cache_lock);
+    return err;
+}
+
 esp_err_t esp_partition_read(const esp_partition_t* partition,
         size_t src_offset, void* dst, size_t size)
 {
@@ -242,7 +383,7 @@ esp_err_t esp_partition_read(const esp_partition_t* partition,
     }
 
     if (!partition->encrypted) {
-        return spi_flash_read(partition->address + src_offset, dst, size);
+        return read_cache_read(partition->address + src_offset, dst, size);
     } else {
 #if CONFIG_SECURE_FLASH_ENC_ENABLED
         /* Encrypted partitions need to be read via a cache mapping */
@@ -275,15 +416,18 @@ esp_err_t esp_partition_write(const esp_partition_t* partition,
         return ESP_ERR_INVALID_SIZE;
     }
     dst_offset = partition->address + dst_offset;
+    esp_err_t err;
     if (!partition->encrypted) {
-        return spi_flash_write(dst_offset, src, size);
+        err = spi_flash_write(dst_offset, src, size);
     } else {
 #if CONFIG_SECURE_FLASH_ENC_ENABLED
-        return spi_flash_write_encrypted(dst_offset, src, size);
+        err = spi_flash_write_encrypted(dst_offset, src, size);
 #else
         return ESP_ERR_NOT_SUPPORTED;
 #endif // CONFIG_SECURE_FLASH_ENC_ENABLED
     }
+    esp_partition_read_cache_invalidate(dst_offset, size);
+    return err;
 }
 
 esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
@@ -302,8 +446,9 @@ esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
     if (start_addr % SPI_FLASH_SEC_SIZE != 0) {
         return ESP_ERR_INVALID_ARG;
     }
-    return spi_flash_erase_range(partition->address + start_addr, size);
-
+    esp_err_t err = spi_flash_erase_range(partition->address + start_addr, size);
+    esp_partition_read_cache_invalidate(partition->address + start_addr, size);
+    return err;
 }
 
 /*
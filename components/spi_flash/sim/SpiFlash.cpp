@@ -62,6 +62,15 @@ void SpiFlash::init(uint32_t chip_size, uint32_t block_size, uint32_t sector_siz
     this->erase_cycles_limit = 0;
 
     this->total_erase_cycles = 0;
+    this->read_ops = 0;
+    this->read_bytes = 0;
+    this->write_ops = 0;
+    this->write_bytes = 0;
+
+    this->timing = FLASH_TIMING_NONE;
+    this->total_time_ns = 0;
+    this->fail_ops = 0;
+    this->fail_countdown = 0;
 
     // Load partitions table bin
     this->memory = (uint8_t *) malloc(this->chip_size);
@@ -111,17 +120,36 @@ uint32_t SpiFlash::get_page_size()
 
 esp_rom_spiflash_result_t SpiFlash::erase_block(uint32_t block)
 {
+    if (this->fail_op(SPIFLASH_OP_ERASE)) {
+        return ESP_ROM_SPIFLASH_RESULT_ERR;
+    }
+
     uint32_t sectors_per_block = (this->block_size / this->sector_size);
     uint32_t start_sector = block * sectors_per_block;
 
     for (int i = start_sector; i < start_sector + sectors_per_block; i++) {
-        this->erase_sector(i);
+        this->erase_sector_internal(i);
     }
 
+    this->total_time_ns += flash_timing_block_erase_ns(&this->timing);
     return ESP_ROM_SPIFLASH_RESULT_OK;
 }
 
 esp_rom_spiflash_result_t SpiFlash::erase_sector(uint32_t sector)
+{
+    if (this->fail_op(SPIFLASH_OP_ERASE)) {
+        return ESP_ROM_SPIFLASH_RESULT_ERR;
+    }
+
+    esp_rom_spiflash_result_t result = this->erase_sector_internal(sector);
+    if (result == ESP_ROM_SPIFLASH_RESULT_OK) {
+        // the chip takes the same time to erase a sector which is already blank
+        this->total_time_ns += flash_timing_sector_erase_ns(&this->timing);
+    }
+    return result;
+}
+
+esp_rom_spiflash_result_t SpiFlash::erase_sector_internal(uint32_t sector)
 {
     if (this->total_erase_cycles_limit != 0 && 
         this->total_erase_cycles >= this->total_erase_cycles_limit) {
@@ -170,6 +198,10 @@ esp_rom_spiflash_result_t SpiFlash::write(uint32_t dest_addr, const void *src, u
         return ESP_ROM_SPIFLASH_RESULT_ERR;
     }
 
+    if (this->fail_op(SPIFLASH_OP_WRITE)) {
+        return ESP_ROM_SPIFLASH_RESULT_ERR;
+    }
+
     start = dest_addr / this->get_sector_size();
     end = size > 0 ? (dest_addr + size - 1) / this->get_sector_size() : start;
 
@@ -194,6 +226,9 @@ esp_rom_spiflash_result_t SpiFlash::write(uint32_t dest_addr, const void *src, u
         this->memory[dest_addr + ctr] = data;
     }
 
+    this->write_ops++;
+    this->write_bytes += size;
+    this->total_time_ns += flash_timing_program_ns(&this->timing, dest_addr, size);
     return ESP_ROM_SPIFLASH_RESULT_OK;
 }
 
@@ -208,6 +243,10 @@ esp_rom_spiflash_result_t SpiFlash::read(uint32_t src_addr, void *dest, uint32_t
         return ESP_ROM_SPIFLASH_RESULT_ERR;
     }
 
+    if (this->fail_op(SPIFLASH_OP_READ)) {
+        return ESP_ROM_SPIFLASH_RESULT_ERR;
+    }
+
     start = src_addr / this->get_sector_size();
     end = size > 0 ? (src_addr + size - 1) / this->get_sector_size() : start;
 
@@ -220,6 +259,9 @@ esp_rom_spiflash_result_t SpiFlash::read(uint32_t src_addr, void *dest, uint32_t
 
     // Do the read
     memcpy(dest, &this->memory[src_addr], size);
+    this->read_ops++;
+    this->read_bytes += size;
+    this->total_time_ns += flash_timing_read_ns(&this->timing, size);
     return ESP_ROM_SPIFLASH_RESULT_OK;
 }
 
@@ -250,10 +292,80 @@ void SpiFlash::set_total_erase_cycles_limit(uint32_t limit)
 
 void SpiFlash::reset_erase_cycles()
 {
-    memset(this->erase_cycles, 0, sizeof(this->sectors * sizeof(uint32_t)));
+    memset(this->erase_cycles, 0, this->sectors * sizeof(uint32_t));
 }
 
 void SpiFlash::reset_total_erase_cycles()
 {
     this->total_erase_cycles = 0;
+}
+
+uint32_t SpiFlash::get_read_ops()
+{
+    return this->read_ops;
+}
+
+uint32_t SpiFlash::get_read_bytes()
+{
+    return this->read_bytes;
+}
+
+void SpiFlash::reset_read_counters()
+{
+    this->read_ops = 0;
+    this->read_bytes = 0;
+}
+
+uint32_t SpiFlash::get_write_ops()
+{
+    return this->write_ops;
+}
+
+uint32_t SpiFlash::get_write_bytes()
+{
+    return this->write_bytes;
+}
+
+void SpiFlash::reset_write_counters()
+{
+    this->write_ops = 0;
+    this->write_bytes = 0;
+}
+
+void SpiFlash::set_timing(const flash_timing_t& timing)
+{
+    this->timing = timing;
+}
+
+uint64_t SpiFlash::get_total_time_us()
+{
+    return this->total_time_ns / 1000;
+}
+
+void SpiFlash::reset_total_time()
+{
+    this->total_time_ns = 0;
+}
+
+void SpiFlash::set_fail_after(uint32_t count, uint32_t ops)
+{
+    this->fail_ops = ops;
+    this->fail_countdown = count;
+}
+
+void SpiFlash::clear_fail()
+{
+    this->fail_ops = 0;
+}
+
+bool SpiFlash::fail_op(uint32_t op)
+{
+    if (!(this->fail_ops & op)) {
+        return false;
+    }
+    if (this->fail_countdown == 0) {
+        return true;
+    }
+    this->fail_countdown--;
+    return false;
 }
\ No newline at end of file
@@ -19,6 +19,17 @@
 
 #include "esp_err.h"
 #include "esp32/rom/spi_flash.h"
+#include "flash_timing.h"
+
+/**
+* @brief Flash operations which fault injection applies to
+*/
+typedef enum {
+    SPIFLASH_OP_READ = 1 << 0,
+    SPIFLASH_OP_WRITE = 1 << 1,
+    SPIFLASH_OP_ERASE = 1 << 2,
+    SPIFLASH_OP_ALL = SPIFLASH_OP_READ | SPIFLASH_OP_WRITE | SPIFLASH_OP_ERASE,
+} spiflash_op_t;
 
 /**
 * @brief This class is used to emulate flash devices.
@@ -54,6 +65,33 @@ public:
     void reset_erase_cycles();
     void reset_total_erase_cycles();
 
+    uint32_t get_read_ops();
+    uint32_t get_read_bytes();
+    void reset_read_counters();
+
+    uint32_t get_write_ops();
+    uint32_t get_write_bytes();
+    void reset_write_counters();
+
+    /**
+    * @brief Set the latency model used to account the time taken by flash operations.
+    *
+    * init() resets the model to FLASH_TIMING_NONE.
+    */
+    void set_timing(const flash_timing_t& timing);
+    uint64_t get_total_time_us();
+    void reset_total_time();
+
+    /**
+    * @brief Make flash operations fail after a number of successful ones.
+    *
+    * The operation following the first count operations of the types in ops
+    * fails, as does every such operation after it, until clear_fail() is
+    * called. A failing operation does not change the flash contents.
+    */
+    void set_fail_after(uint32_t count, uint32_t ops = SPIFLASH_OP_ALL);
+    void clear_fail();
+
     uint8_t* get_memory_ptr(uint32_t src_address);
 
 private:
@@ -75,6 +113,21 @@ private:
     uint32_t total_erase_cycles;
     uint32_t total_erase_cycles_limit;
 
+    uint32_t read_ops;
+    uint32_t read_bytes;
+
+    uint32_t write_ops;
+    uint32_t write_bytes;
+
+    flash_timing_t timing;
+    uint64_t total_time_ns;
+
+    uint32_t fail_ops;
+    uint32_t fail_countdown;
+
+    bool fail_op(uint32_t op);
+    esp_rom_spiflash_result_t erase_sector_internal(uint32_t sector);
+
     void deinit();
 };
 
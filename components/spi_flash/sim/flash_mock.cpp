@@ -105,7 +105,7 @@ esp_rom_spiflash_result_t esp_rom_spiflash_write_encrypted(uint32_t flash_addr,
     return spiflash.write(flash_addr, data, len);
 }
 
-void *heap_caps_malloc( size_t size, uint32_t caps )
+extern "C" void *heap_caps_malloc( size_t size, uint32_t caps )
 {
-    return NULL;
+    return malloc(size);
 }
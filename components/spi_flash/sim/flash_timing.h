@@ -0,0 +1,88 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _flash_timing_H_
+#define _flash_timing_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+* @brief Latency model of a flash chip, shared by the host flash emulators.
+*
+* Reads take a fixed setup time (command, address and dummy cycles) plus a
+* time per byte. Programming is done page by page, each page touched by a
+* write takes a fixed setup time plus a time per programmed byte. Erasing
+* takes a fixed time per sector or block.
+*/
+typedef struct {
+    uint32_t read_setup_ns;         ///< fixed cost of a read operation
+    uint32_t read_ns_per_byte;      ///< inverse of the read bandwidth
+    uint32_t page_size;             ///< program page size in bytes
+    uint32_t program_setup_us;      ///< fixed cost of programming one page
+    uint32_t program_ns_per_byte;   ///< additional cost per programmed byte
+    uint32_t sector_erase_us;       ///< erasing one sector
+    uint32_t block_erase_us;        ///< erasing one block
+} flash_timing_t;
+
+/// All operations take no time
+static const flash_timing_t FLASH_TIMING_NONE = { 0, 0, 256, 0, 0, 0, 0 };
+
+/// ESP8266 at 160 MHz CPU / 80 MHz flash clock, fitted to measurements of the SPI flash driver.
+/// Block erase was not measured, it is taken to be as slow as erasing the 16 sectors of a block.
+static const flash_timing_t FLASH_TIMING_ESP8266 = { 4000, 111, 256, 8, 1550, 37142, 37142 * 16 };
+
+/// Winbond W25Q32 in QIO mode at 80 MHz, typical datasheet values
+static const flash_timing_t FLASH_TIMING_W25Q32 = { 500, 25, 256, 30, 1450, 45000, 150000 };
+
+/// Winbond W25Q32 in QIO mode at 80 MHz, maximum datasheet values
+static const flash_timing_t FLASH_TIMING_W25Q32_MAX = { 500, 25, 256, 800, 8600, 400000, 2000000 };
+
+/**
+* @brief Time taken by a read of size bytes, in nanoseconds
+*/
+static inline uint64_t flash_timing_read_ns(const flash_timing_t* timing, size_t size)
+{
+    return timing->read_setup_ns + (uint64_t) timing->read_ns_per_byte * size;
+}
+
+/**
+* @brief Time taken by programming size bytes at address, in nanoseconds
+*/
+static inline uint64_t flash_timing_program_ns(const flash_timing_t* timing, size_t address, size_t size)
+{
+    if (size == 0) {
+        return 0;
+    }
+    size_t pages = (address + size - 1) / timing->page_size - address / timing->page_size + 1;
+    return (uint64_t) pages * timing->program_setup_us * 1000 + (uint64_t) timing->program_ns_per_byte * size;
+}
+
+/**
+* @brief Time taken by erasing one sector, in nanoseconds
+*/
+static inline uint64_t flash_timing_sector_erase_ns(const flash_timing_t* timing)
+{
+    return (uint64_t) timing->sector_erase_us * 1000;
+}
+
+/**
+* @brief Time taken by erasing one block, in nanoseconds
+*/
+static inline uint64_t flash_timing_block_erase_ns(const flash_timing_t* timing)
+{
+    return (uint64_t) timing->block_erase_us * 1000;
+}
+
+#endif // _flash_timing_H_
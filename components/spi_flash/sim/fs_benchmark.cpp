@@ -0,0 +1,286 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fs_benchmark.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+namespace
+{
+
+const size_t APPEND_RECORD_COUNT = 256;
+const size_t APPEND_RECORD_SIZE = 64;
+
+const size_t CHURN_ROUNDS = 8;
+const size_t CHURN_FILE_COUNT = 24;
+const size_t CHURN_FILE_SIZE = 128;
+
+const size_t OVERWRITE_FILE_SIZE = 4096;
+const size_t OVERWRITE_COUNT = 512;
+const size_t OVERWRITE_SIZE = 32;
+
+const size_t LISTING_FILE_COUNT = 32;
+const size_t LISTING_FILE_SIZE = 64;
+const size_t LISTING_COUNT = 64;
+
+class Measurement
+{
+public:
+    Measurement(FsBenchTarget& target) : mTarget(target)
+    {
+    }
+
+    void start()
+    {
+        mTarget.resetFlashStats();
+        mStart = chrono::steady_clock::now();
+    }
+
+    void stop(size_t ops, size_t userBytes)
+    {
+        auto end = chrono::steady_clock::now();
+        mWallUs = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(end - mStart).count()) / 1000;
+        mStats = mTarget.getFlashStats();
+        mOps = ops;
+        mUserBytes = userBytes;
+    }
+
+    void print(ostream& out, const char* workload) const
+    {
+        double opsPerSec = (mWallUs > 0) ? mOps * 1e6 / mWallUs : 0;
+        double flashUsPerOp = (mOps > 0) ? static_cast<double>(mStats.flashTimeUs) / mOps : 0;
+        // listing does not write any user data, write amplification is not defined for it
+        double writeAmplification = (mUserBytes > 0) ? static_cast<double>(mStats.writeBytes) / mUserBytes : 0;
+        size_t eraseMin = 0;
+        size_t eraseMax = 0;
+        double eraseMean = 0;
+        if (!mStats.sectorEraseCounts.empty()) {
+            auto minmax = minmax_element(mStats.sectorEraseCounts.begin(), mStats.sectorEraseCounts.end());
+            eraseMin = *minmax.first;
+            eraseMax = *minmax.second;
+            for (auto count : mStats.sectorEraseCounts) {
+                eraseMean += count;
+            }
+            eraseMean /= mStats.sectorEraseCounts.size();
+        }
+        out << mTarget.name() << "," << workload << "," << mOps << "," << static_cast<size_t>(opsPerSec) << ","
+            << flashUsPerOp << ","
+            << mUserBytes << "," << mStats.readBytes << "," << mStats.writeBytes << ","
+            << writeAmplification << "," << mStats.eraseOps << ","
+            << eraseMin << "," << eraseMax << "," << eraseMean << endl;
+    }
+
+protected:
+    FsBenchTarget& mTarget;
+    chrono::steady_clock::time_point mStart;
+    double mWallUs = 0;
+    size_t mOps = 0;
+    size_t mUserBytes = 0;
+    FsBenchFlashStats mStats;
+};
+
+/* Deterministic data, so that the contents can be checked without keeping a copy */
+void fillPattern(uint8_t* data, size_t size, size_t seed)
+{
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<uint8_t>(seed * 31 + i);
+    }
+}
+
+bool checkPattern(const uint8_t* data, size_t size, size_t seed)
+{
+    for (size_t i = 0; i < size; ++i) {
+        if (data[i] != static_cast<uint8_t>(seed * 31 + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool fail(FsBenchTarget& target, const char* workload, const char* what, const char* path)
+{
+    cerr << target.name() << ": " << workload << ": " << what << " failed for " << path << endl;
+    return false;
+}
+
+/* Records appended one by one to a single file, as done by a data logger */
+bool runAppendLog(FsBenchTarget& target, Measurement& m)
+{
+    const char* workload = "append_log";
+    const char* path = "log.txt";
+    vector<uint8_t> record(APPEND_RECORD_SIZE);
+
+    m.start();
+    for (size_t i = 0; i < APPEND_RECORD_COUNT; ++i) {
+        fillPattern(record.data(), record.size(), i);
+        if (!target.write(path, record.data(), record.size(), true)) {
+            return fail(target, workload, "append", path);
+        }
+    }
+    m.stop(APPEND_RECORD_COUNT, APPEND_RECORD_COUNT * APPEND_RECORD_SIZE);
+
+    vector<uint8_t> data(APPEND_RECORD_COUNT * APPEND_RECORD_SIZE);
+    if (!target.read(path, data.data(), data.size())) {
+        return fail(target, workload, "read", path);
+    }
+    for (size_t i = 0; i < APPEND_RECORD_COUNT; ++i) {
+        if (!checkPattern(&data[i * APPEND_RECORD_SIZE], APPEND_RECORD_SIZE, i)) {
+            return fail(target, workload, "verify", path);
+        }
+    }
+    return true;
+}
+
+/* Small files created, read back and deleted in rounds, as done for cached or temporary objects */
+bool runSmallFileChurn(FsBenchTarget& target, Measurement& m)
+{
+    const char* workload = "small_file_churn";
+    uint8_t data[CHURN_FILE_SIZE];
+    char path[16];
+
+    m.start();
+    for (size_t round = 0; round < CHURN_ROUNDS; ++round) {
+        for (size_t i = 0; i < CHURN_FILE_COUNT; ++i) {
+            snprintf(path, sizeof(path), "churn%u.bin", (unsigned) i);
+            fillPattern(data, sizeof(data), round * CHURN_FILE_COUNT + i);
+            if (!target.write(path, data, sizeof(data), false)) {
+                return fail(target, workload, "write", path);
+            }
+        }
+        for (size_t i = 0; i < CHURN_FILE_COUNT; ++i) {
+            snprintf(path, sizeof(path), "churn%u.bin", (unsigned) i);
+            if (!target.read(path, data, sizeof(data))) {
+                return fail(target, workload, "read", path);
+            }
+            if (!checkPattern(data, sizeof(data), round * CHURN_FILE_COUNT + i)) {
+                return fail(target, workload, "verify", path);
+            }
+            if (!target.remove(path)) {
+                return fail(target, workload, "remove", path);
+            }
+        }
+    }
+    m.stop(CHURN_ROUNDS * CHURN_FILE_COUNT * 3, CHURN_ROUNDS * CHURN_FILE_COUNT * CHURN_FILE_SIZE);
+
+    if (target.list() != 0) {
+        return fail(target, workload, "list", "/");
+    }
+    return true;
+}
+
+/* Short records updated in place at random offsets of a file, as done for a small database */
+bool runRandomOverwrite(FsBenchTarget& target, Measurement& m)
+{
+    const char* workload = "random_overwrite";
+    const char* path = "ovw.bin";
+    vector<uint8_t> expected(OVERWRITE_FILE_SIZE);
+    fillPattern(expected.data(), expected.size(), 0);
+    if (!target.write(path, expected.data(), expected.size(), false)) {
+        return fail(target, workload, "write", path);
+    }
+
+    uint32_t random = 1;
+    uint8_t record[OVERWRITE_SIZE];
+    m.start();
+    for (size_t i = 0; i < OVERWRITE_COUNT; ++i) {
+        random = random * 1103515245 + 12345;
+        size_t offset = (random >> 8) % (OVERWRITE_FILE_SIZE - OVERWRITE_SIZE + 1);
+        fillPattern(record, sizeof(record), i + 1);
+        if (!target.overwrite(path, offset, record, sizeof(record))) {
+            return fail(target, workload, "overwrite", path);
+        }
+        memcpy(&expected[offset], record, sizeof(record));
+    }
+    m.stop(OVERWRITE_COUNT, OVERWRITE_COUNT * OVERWRITE_SIZE);
+
+    vector<uint8_t> data(OVERWRITE_FILE_SIZE);
+    if (!target.read(path, data.data(), data.size())) {
+        return fail(target, workload, "read", path);
+    }
+    if (data != expected) {
+        return fail(target, workload, "verify", path);
+    }
+    return true;
+}
+
+/* Repeated listing of a directory holding a moderate number of files */
+bool runDirListing(FsBenchTarget& target, Measurement& m)
+{
+    const char* workload = "dir_listing";
+    uint8_t data[LISTING_FILE_SIZE];
+    char path[16];
+    for (size_t i = 0; i < LISTING_FILE_COUNT; ++i) {
+        snprintf(path, sizeof(path), "dir%u.txt", (unsigned) i);
+        fillPattern(data, sizeof(data), i);
+        if (!target.write(path, data, sizeof(data), false)) {
+            return fail(target, workload, "write", path);
+        }
+    }
+
+    m.start();
+    for (size_t i = 0; i < LISTING_COUNT; ++i) {
+        if (target.list() != (int) LISTING_FILE_COUNT) {
+            return fail(target, workload, "list", "/");
+        }
+    }
+    m.stop(LISTING_COUNT, 0);
+    return true;
+}
+
+struct Workload {
+    const char* name;
+    bool (*run)(FsBenchTarget& target, Measurement& m);
+};
+
+const Workload s_workloads[] = {
+    {"append_log", runAppendLog},
+    {"small_file_churn", runSmallFileChurn},
+    {"random_overwrite", runRandomOverwrite},
+    {"dir_listing", runDirListing},
+};
+
+} // namespace
+
+void fsBenchPrintHeader(ostream& out)
+{
+    out << "fs,workload,ops,ops_per_sec,flash_us_per_op,user_bytes,flash_read_bytes,flash_write_bytes,"
+        << "write_amplification,erases,erase_min,erase_max,erase_mean" << endl;
+}
+
+bool fsBenchRun(FsBenchTarget& target, ostream& out)
+{
+    bool result = true;
+    for (auto& workload : s_workloads) {
+        if (!target.mount()) {
+            cerr << target.name() << ": " << workload.name << ": mount failed" << endl;
+            result = false;
+            continue;
+        }
+        Measurement m(target);
+        bool ok = workload.run(target, m);
+        target.unmount();
+        if (ok) {
+            m.print(out, workload.name);
+        }
+        result = result && ok;
+    }
+    return result;
+}
@@ -0,0 +1,89 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _fs_benchmark_H_
+#define _fs_benchmark_H_
+
+#include <stddef.h>
+#include <ostream>
+#include <vector>
+
+/**
+* @brief Flash traffic counted by the flash emulator while a workload was running.
+*
+* Erase counts only cover the sectors of the partition under test.
+*/
+struct FsBenchFlashStats {
+    size_t readBytes;
+    size_t writeBytes;
+    size_t eraseOps;
+    size_t flashTimeUs;     ///< time spent in flash operations, according to the emulator timing model
+    std::vector<size_t> sectorEraseCounts;
+};
+
+/**
+* @brief Storage under test, as seen by the file system benchmark.
+*
+* The same workloads are run through this interface on every target, so each
+* host test (SPIFFS, FAT on wear levelling, NVS) only provides an adapter.
+* File names passed to the adapter are short relative names (at most 12
+* characters, 8.3 compatible), the adapter maps them to its own namespace.
+* All methods return false (or -1) on failure.
+*/
+class FsBenchTarget
+{
+public:
+    virtual ~FsBenchTarget() {}
+
+    /// Name of the target, printed in the first column of the report
+    virtual const char* name() const = 0;
+
+    /// Format the partition and mount an empty file system
+    virtual bool mount() = 0;
+    virtual void unmount() = 0;
+
+    /// Create or truncate a file and write data to it, or append data to the end of the file
+    virtual bool write(const char* path, const void* data, size_t size, bool append) = 0;
+    /// Replace part of an existing file, without changing its size
+    virtual bool overwrite(const char* path, size_t offset, const void* data, size_t size) = 0;
+    /// Read the first size bytes of a file
+    virtual bool read(const char* path, void* data, size_t size) = 0;
+    virtual bool remove(const char* path) = 0;
+    /// Walk the list of files and return their count
+    virtual int list() = 0;
+
+    virtual void resetFlashStats() = 0;
+    virtual FsBenchFlashStats getFlashStats() = 0;
+};
+
+/**
+* @brief Print the CSV header line of the benchmark report
+*/
+void fsBenchPrintHeader(std::ostream& out);
+
+/**
+* @brief Run all benchmark workloads on a target
+*
+* Every workload is run on a freshly mounted file system. For each one a CSV
+* row is printed with throughput, simulated flash time per operation, write
+* amplification (flash bytes written per user byte) and the erase count
+* distribution over the partition sectors.
+* Data is read back and verified after each workload, outside of the measured
+* section.
+*
+* @return true if all workloads completed and the data was verified
+*/
+bool fsBenchRun(FsBenchTarget& target, std::ostream& out);
+
+#endif // _fs_benchmark_H_
@@ -4,8 +4,15 @@
 extern "C" {
 #endif
 
-typedef int sdmmc_card_t;
+typedef struct {
+    int capacity;           /*!< total number of sectors */
+    int sector_size;        /*!< sector size in bytes */
+} sdmmc_csd_t;
+
+typedef struct {
+    sdmmc_csd_t csd;        /*!< decoded CSD register value */
+} sdmmc_card_t;
 
 #if defined(__cplusplus)
 }
-#endif
\ No newline at end of file
+#endif
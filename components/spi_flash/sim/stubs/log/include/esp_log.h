@@ -12,10 +12,6 @@ extern "C" {
 #define strlcpy(a, b, c)
 #define strlcat(a, b, c)
 
-#define heap_caps_malloc(a, b)  NULL
-#define MALLOC_CAP_INTERNAL     0
-#define MALLOC_CAP_8BIT         0
-
 #define LOG_LOCAL_LEVEL         CONFIG_LOG_DEFAULT_LEVEL
 
 typedef enum {
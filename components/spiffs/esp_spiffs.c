@@ -56,6 +56,7 @@ static ssize_t vfs_spiffs_read(void* ctx, int fd, void * dst, size_t size);
 static int vfs_spiffs_close(void* ctx, int fd);
 static off_t vfs_spiffs_lseek(void* ctx, int fd, off_t offset, int mode);
 static int vfs_spiffs_fstat(void* ctx, int fd, struct stat * st);
+static int vfs_spiffs_fsync(void* ctx, int fd);
 static int vfs_spiffs_stat(void* ctx, const char * path, struct stat * st);
 static int vfs_spiffs_unlink(void* ctx, const char *path);
 static int vfs_spiffs_link(void* ctx, const char* n1, const char* n2);
@@ -88,6 +89,7 @@ static void esp_spiffs_free(esp_spiffs_t ** efs)
         free(e->fs);
     }
     vSemaphoreDelete(e->lock);
+    spiffs_api_buf_deinit(e);
     free(e->fds);
     free(e->cache);
     free(e->work);
@@ -193,6 +195,14 @@ static esp_err_t esp_spiffs_init(const esp_vfs_spiffs_conf_t* conf)
     }
     memset(efs->fds, 0, efs->fds_sz);
 
+#ifdef CONFIG_SPIFFS_VFS_FD_BUFFER
+    if (spiffs_api_buf_init(efs, conf->max_files, efs->cfg.log_page_size) != ESP_OK) {
+        ESP_LOGE(TAG, "file buffers could not be malloced");
+        esp_spiffs_free(&efs);
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+
 #if SPIFFS_CACHE
     efs->cache_sz = sizeof(spiffs_cache) + conf->max_files * (sizeof(spiffs_cache_page)
                           + efs->cfg.log_page_size);
@@ -337,6 +347,7 @@ esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t * conf)
         .open_p = &vfs_spiffs_open,
         .close_p = &vfs_spiffs_close,
         .fstat_p = &vfs_spiffs_fstat,
+        .fsync_p = &vfs_spiffs_fsync,
         .stat_p = &vfs_spiffs_stat,
         .link_p = &vfs_spiffs_link,
         .unlink_p = &vfs_spiffs_unlink,
@@ -460,6 +471,7 @@ static int vfs_spiffs_open(void* ctx, const char * path, int flags, int mode)
         SPIFFS_clearerr(efs->fs);
         return -1;
     }
+    spiffs_api_buf_open(efs, fd, spiffs_flags);
     if (!(spiffs_flags & SPIFFS_RDONLY)) {
         vfs_spiffs_update_mtime(efs->fs, fd);
     }
@@ -469,7 +481,7 @@ static int vfs_spiffs_open(void* ctx, const char * path, int flags, int mode)
 static ssize_t vfs_spiffs_write(void* ctx, int fd, const void * data, size_t size)
 {
     esp_spiffs_t * efs = (esp_spiffs_t *)ctx;
-    ssize_t res = SPIFFS_write(efs->fs, fd, (void *)data, size);
+    ssize_t res = spiffs_api_buf_write(efs, fd, data, size);
     if (res < 0) {
         errno = spiffs_res_to_errno(SPIFFS_errno(efs->fs));
         SPIFFS_clearerr(efs->fs);
@@ -481,7 +493,7 @@ static ssize_t vfs_spiffs_write(void* ctx, int fd, const void * data, size_t siz
 static ssize_t vfs_spiffs_read(void* ctx, int fd, void * dst, size_t size)
 {
     esp_spiffs_t * efs = (esp_spiffs_t *)ctx;
-    ssize_t res = SPIFFS_read(efs->fs, fd, dst, size);
+    ssize_t res = spiffs_api_buf_read(efs, fd, dst, size);
     if (res < 0) {
         errno = spiffs_res_to_errno(SPIFFS_errno(efs->fs));
         SPIFFS_clearerr(efs->fs);
@@ -493,7 +505,12 @@ static ssize_t vfs_spiffs_read(void* ctx, int fd, void * dst, size_t size)
 static int vfs_spiffs_close(void* ctx, int fd)
 {
     esp_spiffs_t * efs = (esp_spiffs_t *)ctx;
-    int res = SPIFFS_close(efs->fs, fd);
+    int res = spiffs_api_buf_flush(efs, fd);
+    // the file is closed even if buffered data could not be written
+    int close_res = SPIFFS_close(efs->fs, fd);
+    if (res >= 0) {
+        res = close_res;
+    }
     if (res < 0) {
         errno = spiffs_res_to_errno(SPIFFS_errno(efs->fs));
         SPIFFS_clearerr(efs->fs);
@@ -505,7 +522,7 @@ static int vfs_spiffs_close(void* ctx, int fd)
 static off_t vfs_spiffs_lseek(void* ctx, int fd, off_t offset, int mode)
 {
     esp_spiffs_t * efs = (esp_spiffs_t *)ctx;
-    off_t res = SPIFFS_lseek(efs->fs, fd, offset, mode);
+    off_t res = spiffs_api_buf_lseek(efs, fd, offset, mode);
     if (res < 0) {
         errno = spiffs_res_to_errno(SPIFFS_errno(efs->fs));
         SPIFFS_clearerr(efs->fs);
@@ -519,7 +536,10 @@ static int vfs_spiffs_fstat(void* ctx, int fd, struct stat * st)
     assert(st);
     spiffs_stat s;
     esp_spiffs_t * efs = (esp_spiffs_t *)ctx;
-    off_t res = SPIFFS_fstat(efs->fs, fd, &s);
+    off_t res = spiffs_api_buf_flush(efs, fd);
+    if (res >= 0) {
+        res = SPIFFS_fstat(efs->fs, fd, &s);
+    }
     if (res < 0) {
         errno = spiffs_res_to_errno(SPIFFS_errno(efs->fs));
         SPIFFS_clearerr(efs->fs);
@@ -533,6 +553,21 @@ static int vfs_spiffs_fstat(void* ctx, int fd, struct stat * st)
     return res;
 }
 
+static int vfs_spiffs_fsync(void* ctx, int fd)
+{
+    esp_spiffs_t * efs = (esp_spiffs_t *)ctx;
+    int res = spiffs_api_buf_flush(efs, fd);
+    if (res >= 0) {
+        res = SPIFFS_fflush(efs->fs, fd);
+    }
+    if (res < 0) {
+        errno = spiffs_res_to_errno(SPIFFS_errno(efs->fs));
+        SPIFFS_clearerr(efs->fs);
+        return -1;
+    }
+    return 0;
+}
+
 static int vfs_spiffs_stat(void* ctx, const char * path, struct stat * st)
 {
     assert(path);
@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <stdlib.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "esp_log.h"
 #include "esp_partition.h"
@@ -91,3 +93,200 @@ void spiffs_api_check(spiffs *fs, spiffs_check_type type,
                               spiffs_check_report_str[report], arg1, arg2);
     }
 }
+
+esp_err_t spiffs_api_buf_init(esp_spiffs_t *efs, uint32_t max_files, uint32_t buf_size)
+{
+    efs->fd_bufs = calloc(max_files, sizeof(spiffs_fd_buf_t));
+    if (efs->fd_bufs == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    efs->fd_bufs_count = max_files;
+    efs->fd_buf_sz = buf_size;
+    return ESP_OK;
+}
+
+void spiffs_api_buf_deinit(esp_spiffs_t *efs)
+{
+    if (efs->fd_bufs == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < efs->fd_bufs_count; i++) {
+        free(efs->fd_bufs[i].data);
+    }
+    free(efs->fd_bufs);
+    efs->fd_bufs = NULL;
+    efs->fd_bufs_count = 0;
+}
+
+static spiffs_fd_buf_t *spiffs_api_buf_get(esp_spiffs_t *efs, spiffs_file fd)
+{
+    if (efs->fd_bufs == NULL) {
+        return NULL;
+    }
+    /* SPIFFS file handles start at 1, plus the handle offset if enabled */
+    int index = fd - 1;
+#if SPIFFS_FILEHDL_OFFSET
+    index -= efs->fs->cfg.fh_ix_offset;
+#endif
+    if (index < 0 || index >= (int) efs->fd_bufs_count) {
+        return NULL;
+    }
+    return &efs->fd_bufs[index];
+}
+
+static bool spiffs_api_buf_alloc(esp_spiffs_t *efs, spiffs_fd_buf_t *buf)
+{
+    if (buf->data == NULL) {
+        buf->data = malloc(efs->fd_buf_sz);
+    }
+    return buf->data != NULL;
+}
+
+static s32_t spiffs_api_buf_sync(esp_spiffs_t *efs, spiffs_file fd, spiffs_fd_buf_t *buf)
+{
+    s32_t res = SPIFFS_OK;
+    if (buf->dirty) {
+        res = SPIFFS_write(efs->fs, fd, buf->data, buf->len);
+    } else if (buf->off < buf->len) {
+        // SPIFFS is ahead of the file position by the unread part of the buffer
+        res = SPIFFS_lseek(efs->fs, fd, buf->pos + buf->off, SPIFFS_SEEK_SET);
+    }
+    // on error the buffered data is dropped, the error is reported once
+    buf->dirty = false;
+    buf->len = 0;
+    buf->off = 0;
+    return (res < 0) ? res : SPIFFS_OK;
+}
+
+void spiffs_api_buf_open(esp_spiffs_t *efs, spiffs_file fd, spiffs_flags flags)
+{
+    spiffs_fd_buf_t *buf = spiffs_api_buf_get(efs, fd);
+    if (buf == NULL) {
+        return;
+    }
+    buf->dirty = false;
+    buf->len = 0;
+    buf->off = 0;
+    buf->append = (flags & SPIFFS_O_APPEND) != 0;
+}
+
+s32_t spiffs_api_buf_flush(esp_spiffs_t *efs, spiffs_file fd)
+{
+    spiffs_fd_buf_t *buf = spiffs_api_buf_get(efs, fd);
+    if (buf == NULL) {
+        return SPIFFS_OK;
+    }
+    return spiffs_api_buf_sync(efs, fd, buf);
+}
+
+s32_t spiffs_api_buf_read(esp_spiffs_t *efs, spiffs_file fd, void *dst, u32_t size)
+{
+    spiffs_fd_buf_t *buf = spiffs_api_buf_get(efs, fd);
+    if (buf == NULL) {
+        return SPIFFS_read(efs->fs, fd, dst, size);
+    }
+    if (buf->dirty) {
+        s32_t res = spiffs_api_buf_sync(efs, fd, buf);
+        if (res < 0) {
+            return res;
+        }
+    }
+    uint8_t *out = (uint8_t *) dst;
+    s32_t done = 0;
+    while (size > 0) {
+        if (buf->off < buf->len) {
+            u32_t n = buf->len - buf->off;
+            if (n > size) {
+                n = size;
+            }
+            memcpy(out, buf->data + buf->off, n);
+            buf->off += n;
+            out += n;
+            size -= n;
+            done += n;
+            continue;
+        }
+        // buffer used up, SPIFFS is at the file position
+        buf->len = 0;
+        buf->off = 0;
+        if (size >= efs->fd_buf_sz || !spiffs_api_buf_alloc(efs, buf)) {
+            s32_t res = SPIFFS_read(efs->fs, fd, out, size);
+            if (res < 0) {
+                return (done > 0) ? done : res;
+            }
+            return done + res;
+        }
+        buf->pos = SPIFFS_tell(efs->fs, fd);
+        if (buf->pos < 0) {
+            return (done > 0) ? done : buf->pos;
+        }
+        s32_t res = SPIFFS_read(efs->fs, fd, buf->data, efs->fd_buf_sz);
+        if (res < 0) {
+            return (done > 0) ? done : res;
+        }
+        if (res == 0) {
+            break;
+        }
+        buf->len = res;
+    }
+    return done;
+}
+
+s32_t spiffs_api_buf_write(esp_spiffs_t *efs, spiffs_file fd, const void *src, u32_t size)
+{
+    spiffs_fd_buf_t *buf = spiffs_api_buf_get(efs, fd);
+    if (buf == NULL) {
+        return SPIFFS_write(efs->fs, fd, (void *) src, size);
+    }
+    s32_t res;
+    if ((!buf->dirty && buf->len > 0) || buf->len + size > efs->fd_buf_sz) {
+        res = spiffs_api_buf_sync(efs, fd, buf);
+        if (res < 0) {
+            return res;
+        }
+    }
+    if (size >= efs->fd_buf_sz || !spiffs_api_buf_alloc(efs, buf)) {
+        return SPIFFS_write(efs->fs, fd, (void *) src, size);
+    }
+    if (buf->len == 0) {
+        // appended data goes to the end of file, wherever the file position is
+        buf->pos = buf->append ? SPIFFS_lseek(efs->fs, fd, 0, SPIFFS_SEEK_END) : SPIFFS_tell(efs->fs, fd);
+        if (buf->pos < 0) {
+            return buf->pos;
+        }
+    }
+    memcpy(buf->data + buf->len, src, size);
+    buf->len += size;
+    buf->dirty = true;
+    if (buf->len == efs->fd_buf_sz) {
+        res = spiffs_api_buf_sync(efs, fd, buf);
+        if (res < 0) {
+            return res;
+        }
+    }
+    return size;
+}
+
+s32_t spiffs_api_buf_lseek(esp_spiffs_t *efs, spiffs_file fd, s32_t offs, int whence)
+{
+    spiffs_fd_buf_t *buf = spiffs_api_buf_get(efs, fd);
+    if (buf != NULL && buf->len > 0) {
+        if (buf->dirty) {
+            // the position after buffered writes, as asked by ftell, or by newlib before writing to an append stream
+            if (offs == 0 && (whence == SPIFFS_SEEK_CUR || (whence == SPIFFS_SEEK_END && buf->append))) {
+                return buf->pos + buf->len;
+            }
+        } else if (whence != SPIFFS_SEEK_END) {
+            s32_t target = (whence == SPIFFS_SEEK_CUR) ? buf->pos + (s32_t) buf->off + offs : offs;
+            if (target >= buf->pos && target <= buf->pos + (s32_t) buf->len) {
+                buf->off = target - buf->pos;
+                return target;
+            }
+        }
+        s32_t res = spiffs_api_buf_sync(efs, fd, buf);
+        if (res < 0) {
+            return res;
+        }
+    }
+    return SPIFFS_lseek(efs->fs, fd, offs, whence);
+}
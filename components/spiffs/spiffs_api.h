@@ -26,6 +26,22 @@
 extern "C" {
 #endif
 
+/**
+ * @brief Read-ahead and write-behind buffer of a file opened through the VFS
+ *
+ * The buffer either holds data read ahead of the file position (the SPIFFS
+ * file offset is then at pos + len), or data written but not yet passed to
+ * SPIFFS (dirty, the SPIFFS file offset is then at pos).
+ */
+typedef struct {
+    uint8_t *data;                          /*!< Buffer, allocated on first use */
+    s32_t pos;                              /*!< File offset of the first byte in the buffer */
+    u32_t len;                              /*!< Number of valid bytes in the buffer */
+    u32_t off;                              /*!< Read position within the buffer */
+    bool dirty;                             /*!< Buffer holds written data */
+    bool append;                            /*!< File was opened with SPIFFS_O_APPEND */
+} spiffs_fd_buf_t;
+
 /**
  * @brief SPIFFS definition structure
  */
@@ -41,6 +57,9 @@ typedef struct {
     uint32_t fds_sz;                        /*!< File Descriptor Buffer Length */
     uint8_t *cache;                         /*!< Cache Buffer */
     uint32_t cache_sz;                      /*!< Cache Buffer Length */
+    spiffs_fd_buf_t *fd_bufs;               /*!< Buffers of open files, indexed by file handle, NULL if not used */
+    uint32_t fd_bufs_count;                 /*!< Number of file buffers */
+    uint32_t fd_buf_sz;                     /*!< Size of each file buffer */
 } esp_spiffs_t;
 
 s32_t spiffs_api_read(spiffs *fs, uint32_t addr, uint32_t size, uint8_t *dst);
@@ -52,6 +71,48 @@ s32_t spiffs_api_erase(spiffs *fs, uint32_t addr, uint32_t size);
 void spiffs_api_check(spiffs *fs, spiffs_check_type type,
                             spiffs_check_report report, uint32_t arg1, uint32_t arg2);
 
+/**
+ * @brief Allocate the file buffers of a mounted file system
+ *
+ * Buffers are allocated for max_files open files, the data of each buffer
+ * (buf_size bytes) is only allocated when the file handle is first used.
+ * Without file buffers, the spiffs_api_buf_ functions call SPIFFS directly.
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM
+ */
+esp_err_t spiffs_api_buf_init(esp_spiffs_t *efs, uint32_t max_files, uint32_t buf_size);
+
+/**
+ * @brief Free the file buffers, without writing back buffered data
+ */
+void spiffs_api_buf_deinit(esp_spiffs_t *efs);
+
+/**
+ * @brief Reset the file buffer of a newly opened file
+ *
+ * @param flags SPIFFS flags the file was opened with
+ */
+void spiffs_api_buf_open(esp_spiffs_t *efs, spiffs_file fd, spiffs_flags flags);
+
+/**
+ * @brief Buffered versions of SPIFFS_read, SPIFFS_write and SPIFFS_lseek
+ *
+ * Reads smaller than the buffer read a full buffer ahead, writes smaller than
+ * the buffer are collected and passed to SPIFFS in one call. Seeking writes
+ * back buffered data, unless the new position is within read-ahead data.
+ */
+s32_t spiffs_api_buf_read(esp_spiffs_t *efs, spiffs_file fd, void *dst, u32_t size);
+s32_t spiffs_api_buf_write(esp_spiffs_t *efs, spiffs_file fd, const void *src, u32_t size);
+s32_t spiffs_api_buf_lseek(esp_spiffs_t *efs, spiffs_file fd, s32_t offs, int whence);
+
+/**
+ * @brief Write back buffered data and drop read-ahead data of a file
+ *
+ * Must be called before the file is closed, and before accessing the file
+ * other than through the spiffs_api_buf_ functions.
+ */
+s32_t spiffs_api_buf_flush(esp_spiffs_t *efs, spiffs_file fd);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "esp_partition.h"
+#include "spiffs.h"
+#include "spiffs_nucleus.h"
+#include "spiffs_api.h"
+#include "SpiFlash.h"
+#include "fs_benchmark.h"
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+extern "C" void init_spi_flash(const char* chip_size, size_t block_size, size_t sector_size, size_t page_size, const char* partition_bin);
+extern SpiFlash spiflash;
+
+void init_spiffs(spiffs *fs, uint32_t max_files);
+void deinit_spiffs(spiffs *fs);
+
+// SPIFFS partition, driven through the SPIFFS API
+class SpiffsBenchTarget : public FsBenchTarget
+{
+public:
+    const char* name() const override
+    {
+        return "spiffs";
+    }
+
+    bool mount() override
+    {
+        init_spi_flash(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+        spiflash.set_timing(FLASH_TIMING_W25Q32);
+        mPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, "storage");
+        if (mPartition == NULL) {
+            return false;
+        }
+        // the flash is blank after init, so this formats the partition
+        init_spiffs(&mFs, 5);
+        return true;
+    }
+
+    void unmount() override
+    {
+        deinit_spiffs(&mFs);
+    }
+
+    bool write(const char* path, const void* data, size_t size, bool append) override
+    {
+        spiffs_flags flags = SPIFFS_O_CREAT | SPIFFS_O_WRONLY | (append ? SPIFFS_O_APPEND : SPIFFS_O_TRUNC);
+        spiffs_file file = SPIFFS_open(&mFs, path, flags, 0);
+        if (file < SPIFFS_OK) {
+            return false;
+        }
+        s32_t res = SPIFFS_write(&mFs, file, (void*) data, size);
+        return SPIFFS_close(&mFs, file) >= SPIFFS_OK && res == (s32_t) size;
+    }
+
+    bool overwrite(const char* path, size_t offset, const void* data, size_t size) override
+    {
+        spiffs_file file = SPIFFS_open(&mFs, path, SPIFFS_O_WRONLY, 0);
+        if (file < SPIFFS_OK) {
+            return false;
+        }
+        s32_t res = SPIFFS_lseek(&mFs, file, offset, SPIFFS_SEEK_SET);
+        if (res >= SPIFFS_OK) {
+            res = SPIFFS_write(&mFs, file, (void*) data, size);
+        }
+        return SPIFFS_close(&mFs, file) >= SPIFFS_OK && res == (s32_t) size;
+    }
+
+    bool read(const char* path, void* data, size_t size) override
+    {
+        spiffs_file file = SPIFFS_open(&mFs, path, SPIFFS_O_RDONLY, 0);
+        if (file < SPIFFS_OK) {
+            return false;
+        }
+        s32_t res = SPIFFS_read(&mFs, file, data, size);
+        return SPIFFS_close(&mFs, file) >= SPIFFS_OK && res == (s32_t) size;
+    }
+
+    bool remove(const char* path) override
+    {
+        return SPIFFS_remove(&mFs, path) >= SPIFFS_OK;
+    }
+
+    int list() override
+    {
+        spiffs_DIR dir;
+        struct spiffs_dirent entry;
+        if (SPIFFS_opendir(&mFs, "/", &dir) == NULL) {
+            return -1;
+        }
+        int count = 0;
+        while (SPIFFS_readdir(&dir, &entry) != NULL) {
+            if (entry.type == SPIFFS_TYPE_FILE) {
+                ++count;
+            }
+        }
+        SPIFFS_closedir(&dir);
+        return count;
+    }
+
+    void resetFlashStats() override
+    {
+        spiflash.reset_read_counters();
+        spiflash.reset_write_counters();
+        spiflash.reset_erase_cycles();
+        spiflash.reset_total_erase_cycles();
+        spiflash.reset_total_time();
+    }
+
+    FsBenchFlashStats getFlashStats() override
+    {
+        FsBenchFlashStats stats;
+        stats.readBytes = spiflash.get_read_bytes();
+        stats.writeBytes = spiflash.get_write_bytes();
+        stats.eraseOps = spiflash.get_total_erase_cycles();
+        stats.flashTimeUs = spiflash.get_total_time_us();
+        uint32_t sector_size = spiflash.get_sector_size();
+        for (uint32_t i = 0; i < mPartition->size / sector_size; i++) {
+            stats.sectorEraseCounts.push_back(spiflash.get_erase_cycles(mPartition->address / sector_size + i));
+        }
+        return stats;
+    }
+
+protected:
+    const esp_partition_t* mPartition = NULL;
+    spiffs mFs;
+};
+
+TEST_CASE("benchmark spiffs with shared file system workloads", "[bench][.]")
+{
+    const char* fileName = getenv("FS_BENCH_OUTPUT");
+    std::ofstream file((fileName != NULL) ? fileName : "fs_bench_spiffs.csv");
+    CHECK(file.is_open());
+    fsBenchPrintHeader(file);
+    fsBenchPrintHeader(std::cout);
+
+    SpiffsBenchTarget target;
+    std::stringstream rows;
+    CHECK(fsBenchRun(target, rows));
+    file << rows.str();
+    std::cout << rows.str();
+}
+
+// Small records written to and read back from one file, through the VFS file buffers or directly
+static void run_small_records(bool buffered, size_t record_size, std::ostream& out)
+{
+    const size_t record_count = 512;
+    init_spi_flash(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    spiflash.set_timing(FLASH_TIMING_W25Q32);
+
+    spiffs fs;
+    init_spiffs(&fs, 5);
+    esp_spiffs_t *efs = (esp_spiffs_t*) fs.user_data;
+    if (buffered) {
+        REQUIRE(spiffs_api_buf_init(efs, 5, CONFIG_SPIFFS_PAGE_SIZE) == ESP_OK);
+    }
+
+    uint8_t record[64];
+    REQUIRE(record_size <= sizeof(record));
+    const char* mode = buffered ? "buffered" : "direct";
+    for (int pass = 0; pass < 2; pass++) {
+        bool writing = (pass == 0);
+        spiffs_flags flags = writing ? (SPIFFS_O_CREAT | SPIFFS_O_TRUNC | SPIFFS_O_WRONLY) : SPIFFS_O_RDONLY;
+        spiffs_file file = SPIFFS_open(&fs, "records.bin", flags, 0);
+        REQUIRE(file >= SPIFFS_OK);
+        spiffs_api_buf_open(efs, file, flags);
+
+        spiflash.reset_read_counters();
+        spiflash.reset_write_counters();
+        spiflash.reset_total_time();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < record_count; i++) {
+            if (writing) {
+                memset(record, (int) i, record_size);
+                REQUIRE(spiffs_api_buf_write(efs, file, record, record_size) == (s32_t) record_size);
+            } else {
+                REQUIRE(spiffs_api_buf_read(efs, file, record, record_size) == (s32_t) record_size);
+                REQUIRE(record[0] == (uint8_t) i);
+            }
+        }
+        REQUIRE(spiffs_api_buf_flush(efs, file) >= SPIFFS_OK);
+        REQUIRE(SPIFFS_close(&fs, file) >= SPIFFS_OK);
+        auto end = std::chrono::steady_clock::now();
+
+        double wall_us = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 1000.0;
+        out << "spiffs," << mode << "," << (writing ? "write" : "read") << "," << record_size << ","
+            << record_count << "," << static_cast<size_t>(record_count * 1e6 / wall_us) << ","
+            << static_cast<double>(spiflash.get_total_time_us()) / record_count << ","
+            << spiflash.get_read_ops() << "," << spiflash.get_write_ops() << ","
+            << spiflash.get_write_bytes() << std::endl;
+    }
+    deinit_spiffs(&fs);
+}
+
+TEST_CASE("benchmark small record reads and writes with and without file buffers", "[bench][.]")
+{
+    std::cout << "fs,mode,access,record_size,ops,ops_per_sec,flash_us_per_op,flash_reads,flash_writes,flash_write_bytes" << std::endl;
+    for (size_t record_size : {4, 16, 64}) {
+        run_small_records(false, record_size, std::cout);
+        run_small_records(true, record_size, std::cout);
+    }
+}
@@ -11,6 +11,7 @@
 #define CONFIG_SPIFFS_USE_MAGIC 1
 #define CONFIG_SPIFFS_PAGE_CHECK 1
 #define CONFIG_SPIFFS_USE_MTIME 1
+#define CONFIG_SPIFFS_VFS_FD_BUFFER 1
 
 #define CONFIG_WL_SECTOR_SIZE 4096
 #define CONFIG_LOG_DEFAULT_LEVEL 3
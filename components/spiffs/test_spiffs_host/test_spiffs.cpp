@@ -9,12 +9,17 @@
 #include "spiffs.h"
 #include "spiffs_nucleus.h"
 #include "spiffs_api.h"
+#include "SpiFlash.h"
 
 #include "catch.hpp"
 
+#include <algorithm>
+#include <vector>
+
 extern "C" void init_spi_flash(const char* chip_size, size_t block_size, size_t sector_size, size_t page_size, const char* partition_bin);
+extern SpiFlash spiflash;
 
-static void init_spiffs(spiffs *fs, uint32_t max_files)
+void init_spiffs(spiffs *fs, uint32_t max_files)
 {
     spiffs_config cfg;
     s32_t spiffs_res;
@@ -67,10 +72,11 @@ static void init_spiffs(spiffs *fs, uint32_t max_files)
     REQUIRE(spiffs_res >= SPIFFS_OK);
 }
 
-static void deinit_spiffs(spiffs *fs)
+void deinit_spiffs(spiffs *fs)
 {
     SPIFFS_unmount(fs);
 
+    spiffs_api_buf_deinit((esp_spiffs_t*) fs->user_data);
     free(fs->work);
     free(fs->user_data);
     free(fs->fd_space);
@@ -245,4 +251,109 @@ TEST_CASE("can read spiffs image", "[spiffs]")
     check_spiffs_files(&fs, "../spiffs", path_buf);
 
     deinit_spiffs(&fs);
-}
\ No newline at end of file
+}
+
+static uint32_t stat_files(size_t cache_sectors)
+{
+    init_spi_flash(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    REQUIRE(esp_partition_read_cache_config(cache_sectors) == ESP_OK);
+
+    spiffs fs;
+    init_spiffs(&fs, 5);
+
+    const int file_count = 16;
+    char name[16];
+    for (int i = 0; i < file_count; i++) {
+        snprintf(name, sizeof(name), "file%d", i);
+        spiffs_file file = SPIFFS_open(&fs, name, SPIFFS_O_CREAT | SPIFFS_O_RDWR, 0);
+        REQUIRE(file >= SPIFFS_OK);
+        REQUIRE(SPIFFS_write(&fs, file, name, strlen(name)) == (s32_t) strlen(name));
+        REQUIRE(SPIFFS_close(&fs, file) >= SPIFFS_OK);
+    }
+
+    // every lookup scans the object lookup pages
+    spiflash.reset_read_counters();
+    spiffs_stat stat;
+    for (int round = 0; round < 4; round++) {
+        for (int i = 0; i < file_count; i++) {
+            snprintf(name, sizeof(name), "file%d", i);
+            REQUIRE(SPIFFS_stat(&fs, name, &stat) >= SPIFFS_OK);
+            REQUIRE(stat.size == strlen(name));
+        }
+    }
+    uint32_t read_ops = spiflash.get_read_ops();
+
+    deinit_spiffs(&fs);
+    REQUIRE(esp_partition_read_cache_config(0) == ESP_OK);
+    return read_ops;
+}
+
+TEST_CASE("partition read cache saves flash reads of lookup pages", "[spiffs]")
+{
+    uint32_t reads_uncached = stat_files(0);
+    uint32_t reads_cached = stat_files(4);
+    printf("Looking up files: %u flash reads without partition read cache, %u with cache\n",
+           (unsigned) reads_uncached, (unsigned) reads_cached);
+    CHECK(reads_cached < reads_uncached);
+}
+
+TEST_CASE("buffered reads, writes and seeks give the same file contents as direct access", "[spiffs]")
+{
+    init_spi_flash(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+
+    spiffs fs;
+    init_spiffs(&fs, 5);
+    esp_spiffs_t *efs = (esp_spiffs_t*) fs.user_data;
+    REQUIRE(spiffs_api_buf_init(efs, 5, CONFIG_SPIFFS_PAGE_SIZE) == ESP_OK);
+
+    spiffs_file file = SPIFFS_open(&fs, "buffered.bin", SPIFFS_O_CREAT | SPIFFS_O_RDWR, 0);
+    REQUIRE(file >= SPIFFS_OK);
+    spiffs_api_buf_open(efs, file, SPIFFS_O_CREAT | SPIFFS_O_RDWR);
+
+    // reference contents and position, sizes cover accesses within, across and larger than a buffer
+    std::vector<uint8_t> expected;
+    size_t pos = 0;
+    uint8_t data[CONFIG_SPIFFS_PAGE_SIZE * 2];
+    uint32_t random = 1;
+    for (int i = 0; i < 2000; i++) {
+        random = random * 1103515245 + 12345;
+        uint32_t op = (random >> 8) % 8;
+        uint32_t size = (random >> 12) % ((op == 0) ? sizeof(data) : 48) + 1;
+        if (op < 3) {
+            for (uint32_t j = 0; j < size; j++) {
+                data[j] = (uint8_t) (i + j);
+            }
+            REQUIRE(spiffs_api_buf_write(efs, file, data, size) == (s32_t) size);
+            if (expected.size() < pos + size) {
+                expected.resize(pos + size);
+            }
+            memcpy(&expected[pos], data, size);
+            pos += size;
+        } else if (op < 6) {
+            size_t expected_size = std::min((size_t) size, expected.size() - pos);
+            REQUIRE(spiffs_api_buf_read(efs, file, data, size) == (s32_t) expected_size);
+            REQUIRE(memcmp(data, &expected[pos], expected_size) == 0);
+            pos += expected_size;
+        } else if (op == 6) {
+            pos = (random >> 4) % (expected.size() + 1);
+            REQUIRE(spiffs_api_buf_lseek(efs, file, pos, SPIFFS_SEEK_SET) == (s32_t) pos);
+        } else {
+            REQUIRE(spiffs_api_buf_lseek(efs, file, 0, SPIFFS_SEEK_CUR) == (s32_t) pos);
+        }
+    }
+    REQUIRE(spiffs_api_buf_flush(efs, file) >= SPIFFS_OK);
+    REQUIRE(SPIFFS_close(&fs, file) >= SPIFFS_OK);
+
+    // contents written back to SPIFFS, read without buffering
+    spiffs_stat stat;
+    REQUIRE(SPIFFS_stat(&fs, "buffered.bin", &stat) >= SPIFFS_OK);
+    REQUIRE(stat.size == expected.size());
+    std::vector<uint8_t> contents(expected.size());
+    file = SPIFFS_open(&fs, "buffered.bin", SPIFFS_O_RDONLY, 0);
+    REQUIRE(file >= SPIFFS_OK);
+    REQUIRE(SPIFFS_read(&fs, file, contents.data(), contents.size()) == (s32_t) contents.size());
+    REQUIRE(SPIFFS_close(&fs, file) >= SPIFFS_OK);
+    CHECK(contents == expected);
+
+    deinit_spiffs(&fs);
+}
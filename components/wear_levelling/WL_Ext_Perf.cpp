@@ -13,6 +13,8 @@
 
 #include "WL_Ext_Perf.h"
 #include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
 #include "esp_log.h"
 
 static const char *TAG = "wl_ext_perf";
@@ -23,14 +25,40 @@ static const char *TAG = "wl_ext_perf";
         return (result); \
     }
 
+#define WL_EXT_CACHE_EMPTY 0xffffffff
+
+struct WL_Ext_Perf_Cache_Entry {
+    uint32_t sector;    // flash sector held by the entry, WL_EXT_CACHE_EMPTY if the entry is not used
+    uint32_t load_time; // time in ms when the sector was loaded, the data differs from flash since then
+    uint32_t last_use;  // value of cache_use_count at the last access
+    uint32_t *data;
+};
+
+static uint32_t wl_ext_time_ms()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
 WL_Ext_Perf::WL_Ext_Perf(): WL_Flash()
 {
     this->sector_buffer = NULL;
+    this->cache = NULL;
+    this->cache_sectors = 0;
+    this->cache_timeout = 0;
+    this->cache_use_count = 0;
 }
 
 WL_Ext_Perf::~WL_Ext_Perf()
 {
     free(this->sector_buffer);
+    if (this->cache != NULL) {
+        for (int i = 0; i < this->cache_sectors; i++) {
+            free(this->cache[i].data);
+        }
+        free(this->cache);
+    }
 }
 
 esp_err_t WL_Ext_Perf::config(WL_Config_s *cfg, Flash_Access *flash_drv)
@@ -50,6 +78,22 @@ esp_err_t WL_Ext_Perf::config(WL_Config_s *cfg, Flash_Access *flash_drv)
         return ESP_ERR_INVALID_ARG;
     }
 
+    this->cache_sectors = config->cache_sectors;
+    this->cache_timeout = config->cache_timeout;
+    if (this->cache_sectors > 0) {
+        this->cache = (WL_Ext_Perf_Cache_Entry *)calloc(this->cache_sectors, sizeof(WL_Ext_Perf_Cache_Entry));
+        if (this->cache == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        for (int i = 0; i < this->cache_sectors; i++) {
+            this->cache[i].sector = WL_EXT_CACHE_EMPTY;
+            this->cache[i].data = (uint32_t *)malloc(cfg->sector_size);
+            if (this->cache[i].data == NULL) {
+                return ESP_ERR_NO_MEM;
+            }
+        }
+    }
+
     return WL_Flash::config(cfg, flash_drv);
 }
 
@@ -69,7 +113,24 @@ size_t WL_Ext_Perf::sector_size()
 
 esp_err_t WL_Ext_Perf::erase_sector(size_t sector)
 {
-    return this->erase_sector_fit(sector, 1);
+    esp_err_t result = this->cache_write_back_expired();
+    WL_EXT_RESULT_CHECK(result);
+    return this->erase_sub_sectors(sector, 1);
+}
+
+esp_err_t WL_Ext_Perf::erase_sub_sectors(uint32_t start_sector, uint32_t count)
+{
+    if (this->cache == NULL) {
+        return this->erase_sector_fit(start_sector, count);
+    }
+    // The flash sector is erased only when it is written back, so following
+    // erases of other parts of the sector do not need erase cycles of their own
+    WL_Ext_Perf_Cache_Entry *entry;
+    esp_err_t result = this->cache_load(start_sector / this->size_factor, &entry);
+    WL_EXT_RESULT_CHECK(result);
+    uint32_t offset = (start_sector % this->size_factor) * this->fat_sector_size;
+    memset((uint8_t *)entry->data + offset, 0xff, count * this->fat_sector_size);
+    return ESP_OK;
 }
 
 esp_err_t WL_Ext_Perf::erase_sector_fit(uint32_t start_sector, uint32_t count)
@@ -100,6 +161,186 @@ esp_err_t WL_Ext_Perf::erase_sector_fit(uint32_t start_sector, uint32_t count)
     return ESP_OK;
 }
 
+esp_err_t WL_Ext_Perf::write_back_sector(uint32_t sector, const uint32_t *data)
+{
+    esp_err_t result = WL_Flash::erase_sector(sector);
+    WL_EXT_RESULT_CHECK(result);
+    return this->write_sub_sectors(sector, data);
+}
+
+esp_err_t WL_Ext_Perf::write_sub_sectors(uint32_t sector, const uint32_t *data)
+{
+    // Parts of the sector which are erased do not have to be written
+    for (int i = 0; i < this->size_factor; i++) {
+        const uint32_t *sub_sector = &data[i * this->fat_sector_size / sizeof(uint32_t)];
+        bool erased = true;
+        for (int j = 0; j < this->fat_sector_size / sizeof(uint32_t); j++) {
+            if (sub_sector[j] != 0xffffffff) {
+                erased = false;
+                break;
+            }
+        }
+        if (!erased) {
+            esp_err_t result = WL_Flash::write(sector * this->flash_sector_size + i * this->fat_sector_size, sub_sector, this->fat_sector_size);
+            WL_EXT_RESULT_CHECK(result);
+        }
+    }
+    return ESP_OK;
+}
+
+WL_Ext_Perf_Cache_Entry *WL_Ext_Perf::cache_find(uint32_t sector)
+{
+    for (int i = 0; i < this->cache_sectors; i++) {
+        if (this->cache[i].sector == sector) {
+            this->cache[i].last_use = ++this->cache_use_count;
+            return &this->cache[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t WL_Ext_Perf::cache_load(uint32_t sector, WL_Ext_Perf_Cache_Entry **out_entry)
+{
+    WL_Ext_Perf_Cache_Entry *entry = this->cache_find(sector);
+    if (entry == NULL) {
+        // Take an unused entry, or the least recently used one
+        for (int i = 0; i < this->cache_sectors; i++) {
+            if (this->cache[i].sector == WL_EXT_CACHE_EMPTY) {
+                entry = &this->cache[i];
+                break;
+            }
+            if ((entry == NULL) || (this->cache[i].last_use < entry->last_use)) {
+                entry = &this->cache[i];
+            }
+        }
+        if (entry->sector != WL_EXT_CACHE_EMPTY) {
+            esp_err_t result = this->cache_write_back(entry);
+            WL_EXT_RESULT_CHECK(result);
+        }
+        esp_err_t result = WL_Flash::read(sector * this->flash_sector_size, entry->data, this->flash_sector_size);
+        WL_EXT_RESULT_CHECK(result);
+        entry->sector = sector;
+        entry->load_time = wl_ext_time_ms();
+        entry->last_use = ++this->cache_use_count;
+    }
+    *out_entry = entry;
+    return ESP_OK;
+}
+
+esp_err_t WL_Ext_Perf::cache_write_back(WL_Ext_Perf_Cache_Entry *entry)
+{
+    ESP_LOGV(TAG, "%s sector = 0x%08x", __func__, entry->sector);
+    esp_err_t result = this->write_back_sector(entry->sector, entry->data);
+    WL_EXT_RESULT_CHECK(result);
+    entry->sector = WL_EXT_CACHE_EMPTY;
+    return ESP_OK;
+}
+
+esp_err_t WL_Ext_Perf::cache_write_back_expired()
+{
+    if ((this->cache == NULL) || (this->cache_timeout == 0)) {
+        return ESP_OK;
+    }
+    uint32_t now = wl_ext_time_ms();
+    for (int i = 0; i < this->cache_sectors; i++) {
+        if ((this->cache[i].sector != WL_EXT_CACHE_EMPTY) && (now - this->cache[i].load_time >= this->cache_timeout)) {
+            esp_err_t result = this->cache_write_back(&this->cache[i]);
+            WL_EXT_RESULT_CHECK(result);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t WL_Ext_Perf::sync()
+{
+    for (int i = 0; i < this->cache_sectors; i++) {
+        if (this->cache[i].sector != WL_EXT_CACHE_EMPTY) {
+            esp_err_t result = this->cache_write_back(&this->cache[i]);
+            WL_EXT_RESULT_CHECK(result);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t WL_Ext_Perf::flush()
+{
+    esp_err_t result = this->sync();
+    WL_EXT_RESULT_CHECK(result);
+    return WL_Flash::flush();
+}
+
+esp_err_t WL_Ext_Perf::write(size_t dest_addr, const void *src, size_t size)
+{
+    if (this->cache == NULL) {
+        return WL_Flash::write(dest_addr, src, size);
+    }
+    esp_err_t result = this->cache_write_back_expired();
+    WL_EXT_RESULT_CHECK(result);
+    // Data of cached sectors is written to RAM, the rest directly to flash,
+    // as long ranges as possible
+    size_t offset = 0;
+    size_t direct_offset = 0;
+    while (offset < size) {
+        size_t addr = dest_addr + offset;
+        size_t chunk_size = this->flash_sector_size - addr % this->flash_sector_size;
+        if (chunk_size > size - offset) {
+            chunk_size = size - offset;
+        }
+        WL_Ext_Perf_Cache_Entry *entry = this->cache_find(addr / this->flash_sector_size);
+        if (entry != NULL) {
+            if (offset > direct_offset) {
+                result = WL_Flash::write(dest_addr + direct_offset, (const uint8_t *)src + direct_offset, offset - direct_offset);
+                WL_EXT_RESULT_CHECK(result);
+            }
+            // Same as programming the flash, bits can only be cleared
+            uint8_t *cached = (uint8_t *)entry->data + addr % this->flash_sector_size;
+            for (size_t i = 0; i < chunk_size; i++) {
+                cached[i] &= ((const uint8_t *)src)[offset + i];
+            }
+            direct_offset = offset + chunk_size;
+        }
+        offset += chunk_size;
+    }
+    if (size > direct_offset) {
+        result = WL_Flash::write(dest_addr + direct_offset, (const uint8_t *)src + direct_offset, size - direct_offset);
+        WL_EXT_RESULT_CHECK(result);
+    }
+    return ESP_OK;
+}
+
+esp_err_t WL_Ext_Perf::read(size_t src_addr, void *dest, size_t size)
+{
+    if (this->cache == NULL) {
+        return WL_Flash::read(src_addr, dest, size);
+    }
+    esp_err_t result = this->cache_write_back_expired();
+    WL_EXT_RESULT_CHECK(result);
+    size_t offset = 0;
+    size_t direct_offset = 0;
+    while (offset < size) {
+        size_t addr = src_addr + offset;
+        size_t chunk_size = this->flash_sector_size - addr % this->flash_sector_size;
+        if (chunk_size > size - offset) {
+            chunk_size = size - offset;
+        }
+        WL_Ext_Perf_Cache_Entry *entry = this->cache_find(addr / this->flash_sector_size);
+        if (entry != NULL) {
+            if (offset > direct_offset) {
+                result = WL_Flash::read(src_addr + direct_offset, (uint8_t *)dest + direct_offset, offset - direct_offset);
+                WL_EXT_RESULT_CHECK(result);
+            }
+            memcpy((uint8_t *)dest + offset, (uint8_t *)entry->data + addr % this->flash_sector_size, chunk_size);
+            direct_offset = offset + chunk_size;
+        }
+        offset += chunk_size;
+    }
+    if (size > direct_offset) {
+        result = WL_Flash::read(src_addr + direct_offset, (uint8_t *)dest + direct_offset, size - direct_offset);
+        WL_EXT_RESULT_CHECK(result);
+    }
+    return ESP_OK;
+}
+
 esp_err_t WL_Ext_Perf::erase_range(size_t start_address, size_t size)
 {
     esp_err_t result = ESP_OK;
@@ -110,6 +351,8 @@ esp_err_t WL_Ext_Perf::erase_range(size_t start_address, size_t size)
         result = ESP_ERR_INVALID_ARG;
     }
     WL_EXT_RESULT_CHECK(result);
+    result = this->cache_write_back_expired();
+    WL_EXT_RESULT_CHECK(result);
 
     // The range to erase could be allocated in any possible way
     // ---------------------------------------------------------
@@ -148,7 +391,7 @@ esp_err_t WL_Ext_Perf::erase_range(size_t start_address, size_t size)
 
     // Here we will clear pre_check_count amount of sectors
     if (pre_check_count != 0) {
-        result = this->erase_sector_fit(start_address / this->fat_sector_size, pre_check_count);
+        result = this->erase_sub_sectors(start_address / this->fat_sector_size, pre_check_count);
         WL_EXT_RESULT_CHECK(result);
     }
     ESP_LOGV(TAG, "%s rest_check_start = %i, pre_check_count=%i, rest_check_count=%i, post_check_count=%i\n", __func__, rest_check_start, pre_check_count, rest_check_count, post_check_count);
@@ -156,12 +399,17 @@ esp_err_t WL_Ext_Perf::erase_range(size_t start_address, size_t size)
         rest_check_count = rest_check_count / this->size_factor;
         size_t start_sector = rest_check_start / this->flash_sector_size;
         for (size_t i = 0; i < rest_check_count; i++) {
+            // The complete sector is erased, cached data of it is not needed anymore
+            WL_Ext_Perf_Cache_Entry *entry = (this->cache != NULL) ? this->cache_find(start_sector + i) : NULL;
+            if (entry != NULL) {
+                entry->sector = WL_EXT_CACHE_EMPTY;
+            }
             result = WL_Flash::erase_sector(start_sector + i);
             WL_EXT_RESULT_CHECK(result);
         }
     }
     if (post_check_count != 0) {
-        result = this->erase_sector_fit(post_check_start, post_check_count);
+        result = this->erase_sub_sectors(post_check_start, post_check_count);
         WL_EXT_RESULT_CHECK(result);
     }
     return ESP_OK;
@@ -159,3 +159,37 @@ esp_err_t WL_Ext_Safe::erase_sector_fit(uint32_t start_sector, uint32_t count)
 
     return ESP_OK;
 }
+
+esp_err_t WL_Ext_Safe::write_back_sector(uint32_t sector, const uint32_t *data)
+{
+    // Same transaction as in erase_sector_fit, but with the complete sector
+    // stored in the dump, so that recover() writes all of it back
+    esp_err_t result = ESP_OK;
+    ESP_LOGV(TAG, "%s sector=0x%08x", __func__, sector);
+
+    result = WL_Flash::erase_sector(this->dump_addr / this->flash_sector_size);
+    WL_EXT_RESULT_CHECK(result);
+    result = WL_Flash::write(this->dump_addr, data, this->flash_sector_size);
+    WL_EXT_RESULT_CHECK(result);
+
+    WL_Ext_Safe_State state;
+    state.erase_begin = WL_EXT_SAFE_OK;
+    state.local_addr_base = sector;
+    state.local_addr_shift = 0;
+    state.count = 0;
+
+    result = WL_Flash::erase_sector(this->state_addr / this->flash_sector_size);
+    WL_EXT_RESULT_CHECK(result);
+    result = WL_Flash::write(this->state_addr + 0, &state, sizeof(WL_Ext_Safe_State));
+    WL_EXT_RESULT_CHECK(result);
+
+    result = WL_Flash::erase_sector(sector);
+    WL_EXT_RESULT_CHECK(result);
+    result = this->write_sub_sectors(sector, data);
+    WL_EXT_RESULT_CHECK(result);
+
+    result = WL_Flash::erase_sector(this->state_addr / this->flash_sector_size);
+    WL_EXT_RESULT_CHECK(result);
+
+    return ESP_OK;
+}
@@ -435,35 +435,85 @@ esp_err_t WL_Flash::updateWL()
     // Here we have to move the block and increase the state
     this->state.access_count = 0;
     ESP_LOGV(TAG, "%s - access_count= 0x%08x, pos= 0x%08x", __func__, this->state.access_count, this->state.pos);
-    // copy data to dummy block
-    size_t data_addr = this->state.pos + 1; // next block, [pos+1] copy to [pos]
-    if (data_addr >= this->state.max_pos) {
-        data_addr = 0;
-    }
-    data_addr = this->cfg.start_addr + data_addr * this->cfg.page_size;
-    this->dummy_addr = this->cfg.start_addr + this->state.pos * this->cfg.page_size;
-    result = this->flash_drv->erase_range(this->dummy_addr, this->cfg.page_size);
-    if (result != ESP_OK) {
-        ESP_LOGE(TAG, "%s - erase wl dummy sector result= 0x%08x", __func__, result);
-        this->state.access_count = this->state.max_count - 1; // we will update next time
-        return result;
+    if (this->max_pending_moves == 0) {
+        return this->moveBlock();
+    }
+    // The move is left to processUpdate(), unless too many moves are due already
+    this->pending_moves++;
+    while (this->pending_moves > this->max_pending_moves) {
+        result = this->moveBlock();
+        WL_RESULT_CHECK(result);
     }
+    return result;
+}
 
-    size_t copy_count = this->cfg.page_size / this->cfg.temp_buff_size;
-    for (size_t i = 0; i < copy_count; i++) {
-        result = this->flash_drv->read(data_addr + i * this->cfg.temp_buff_size, this->temp_buff, this->cfg.temp_buff_size);
+esp_err_t WL_Flash::moveBlock()
+{
+    // Finishes the move which is in progress, or does a complete one
+    bool done = false;
+    while (!done) {
+        esp_err_t result = this->moveStep(&done);
         if (result != ESP_OK) {
-            ESP_LOGE(TAG, "%s - not possible to read buffer, will try next time, result= 0x%08x", __func__, result);
-            this->state.access_count = this->state.max_count - 1; // we will update next time
             return result;
         }
-        result = this->flash_drv->write(this->dummy_addr + i * this->cfg.temp_buff_size, this->temp_buff, this->cfg.temp_buff_size);
+    }
+    return ESP_OK;
+}
+
+void WL_Flash::moveFailed()
+{
+    this->move_in_progress = false;
+    if (this->max_pending_moves == 0) {
+        this->state.access_count = this->state.max_count - 1; // we will update next time
+    }
+}
+
+esp_err_t WL_Flash::moveStep(bool *out_done)
+{
+    // The block after the dummy block is moved to the dummy block in steps:
+    // erase of the dummy block, copy of one sector per step, update of the state.
+    // Until the state is updated, calcAddr() maps the data to the source block.
+    esp_err_t result = ESP_OK;
+    *out_done = false;
+    if (!this->move_in_progress) {
+        // copy data to dummy block
+        size_t data_addr = this->state.pos + 1; // next block, [pos+1] copy to [pos]
+        if (data_addr >= this->state.max_pos) {
+            data_addr = 0;
+        }
+        this->move_src_addr = this->cfg.start_addr + data_addr * this->cfg.page_size;
+        this->dummy_addr = this->cfg.start_addr + this->state.pos * this->cfg.page_size;
+        result = this->flash_drv->erase_range(this->dummy_addr, this->cfg.page_size);
         if (result != ESP_OK) {
-            ESP_LOGE(TAG, "%s - not possible to write buffer, will try next time, result= 0x%08x", __func__, result);
-            this->state.access_count = this->state.max_count - 1; // we will update next time
+            ESP_LOGE(TAG, "%s - erase wl dummy sector result= 0x%08x", __func__, result);
+            this->moveFailed();
             return result;
         }
+        this->move_in_progress = true;
+        this->move_offset = 0;
+        return result;
+    }
+
+    if (this->move_offset < this->cfg.page_size) {
+        size_t copy_count = this->cfg.sector_size / this->cfg.temp_buff_size;
+        for (size_t i = 0; (i < copy_count) && (this->move_offset < this->cfg.page_size); i++) {
+            result = this->flash_drv->read(this->move_src_addr + this->move_offset, this->temp_buff, this->cfg.temp_buff_size);
+            if (result != ESP_OK) {
+                ESP_LOGE(TAG, "%s - not possible to read buffer, will try next time, result= 0x%08x", __func__, result);
+                this->moveFailed();
+                return result;
+            }
+            result = this->flash_drv->write(this->dummy_addr + this->move_offset, this->temp_buff, this->cfg.temp_buff_size);
+            if (result != ESP_OK) {
+                ESP_LOGE(TAG, "%s - not possible to write buffer, will try next time, result= 0x%08x", __func__, result);
+                this->moveFailed();
+                return result;
+            }
+            this->move_offset += this->cfg.temp_buff_size;
+        }
+        return result;
     }
+
     // done... block moved.
     // Here we will update structures...
     // Update bits and save to flash:
@@ -473,17 +523,22 @@ esp_err_t WL_Flash::updateWL()
     result |= this->flash_drv->write(this->addr_state1 + sizeof(wl_state_t) + byte_pos, this->temp_buff, this->cfg.wr_size);
     if (result != ESP_OK) {
         ESP_LOGE(TAG, "%s - update position 1 result= 0x%08x", __func__, result);
-        this->state.access_count = this->state.max_count - 1; // we will update next time
+        this->moveFailed();
         return result;
     }
     this->fillOkBuff(this->state.pos);
     result |= this->flash_drv->write(this->addr_state2 + sizeof(wl_state_t) + byte_pos, this->temp_buff, this->cfg.wr_size);
     if (result != ESP_OK) {
         ESP_LOGE(TAG, "%s - update position 2 result= 0x%08x", __func__, result);
-        this->state.access_count = this->state.max_count - 1; // we will update next time
+        this->moveFailed();
         return result;
     }
 
+    this->move_in_progress = false;
+    if (this->pending_moves > 0) {
+        this->pending_moves--;
+    }
+    *out_done = true;
     this->state.pos++;
     if (this->state.pos >= this->state.max_pos) {
         this->state.pos = 0;
@@ -514,6 +569,17 @@ esp_err_t WL_Flash::updateWL()
     return result;
 }
 
+void WL_Flash::checkMoveSource(size_t flash_addr, size_t size)
+{
+    // If data which was already copied to the dummy block changes, the move has to start again
+    if (this->move_in_progress &&
+            (flash_addr < this->move_src_addr + this->move_offset) &&
+            (this->move_src_addr < flash_addr + size)) {
+        ESP_LOGD(TAG, "%s - restart move, flash_addr= 0x%08x", __func__, (uint32_t) flash_addr);
+        this->move_in_progress = false;
+    }
+}
+
 size_t WL_Flash::calcAddr(size_t addr)
 {
     size_t result = (this->flash_size - this->state.move_count * this->cfg.page_size + addr) % this->flash_size;
@@ -526,6 +592,15 @@ size_t WL_Flash::calcAddr(size_t addr)
     return result;
 }
 
+size_t WL_Flash::calcContiguousSize(size_t addr, size_t size)
+{
+    // Logical addresses map to flash linearly, except that the mapping wraps
+    // around at the end of the flash and skips the dummy block
+    size_t result = (this->flash_size - this->state.move_count * this->cfg.page_size + addr) % this->flash_size;
+    size_t dummy_addr = this->state.pos * this->cfg.page_size;
+    size_t limit = (result < dummy_addr) ? dummy_addr - result : this->flash_size - result;
+    return (size < limit) ? size : limit;
+}
 
 size_t WL_Flash::chip_size()
 {
@@ -553,6 +628,7 @@ esp_err_t WL_Flash::erase_sector(size_t sector)
     result = this->updateWL();
     WL_RESULT_CHECK(result);
     size_t virt_addr = this->calcAddr(sector * this->cfg.sector_size);
+    this->checkMoveSource(this->cfg.start_addr + virt_addr, this->cfg.sector_size);
     result = this->flash_drv->erase_sector((this->cfg.start_addr + virt_addr) / this->cfg.sector_size);
     WL_RESULT_CHECK(result);
     return result;
@@ -581,15 +657,16 @@ esp_err_t WL_Flash::write(size_t dest_addr, const void *src, size_t size)
         return ESP_ERR_INVALID_STATE;
     }
     ESP_LOGD(TAG, "%s - dest_addr= 0x%08x, size= 0x%08x", __func__, (uint32_t) dest_addr, (uint32_t) size);
-    uint32_t count = (size - 1) / this->cfg.page_size;
-    for (size_t i = 0; i < count; i++) {
-        size_t virt_addr = this->calcAddr(dest_addr + i * this->cfg.page_size);
-        result = this->flash_drv->write(this->cfg.start_addr + virt_addr, &((uint8_t *)src)[i * this->cfg.page_size], this->cfg.page_size);
+    size_t offset = 0;
+    while (offset < size) {
+        // every range which is contiguous in flash is written at once
+        size_t virt_addr = this->calcAddr(dest_addr + offset);
+        size_t chunk_size = this->calcContiguousSize(dest_addr + offset, size - offset);
+        this->checkMoveSource(this->cfg.start_addr + virt_addr, chunk_size);
+        result = this->flash_drv->write(this->cfg.start_addr + virt_addr, &((uint8_t *)src)[offset], chunk_size);
         WL_RESULT_CHECK(result);
+        offset += chunk_size;
     }
-    size_t virt_addr_last = this->calcAddr(dest_addr + count * this->cfg.page_size);
-    result = this->flash_drv->write(this->cfg.start_addr + virt_addr_last, &((uint8_t *)src)[count * this->cfg.page_size], size - count * this->cfg.page_size);
-    WL_RESULT_CHECK(result);
     return result;
 }
 
@@ -600,16 +677,15 @@ esp_err_t WL_Flash::read(size_t src_addr, void *dest, size_t size)
         return ESP_ERR_INVALID_STATE;
     }
     ESP_LOGD(TAG, "%s - src_addr= 0x%08x, size= 0x%08x", __func__, (uint32_t) src_addr, (uint32_t) size);
-    uint32_t count = (size - 1) / this->cfg.page_size;
-    for (size_t i = 0; i < count; i++) {
-        size_t virt_addr = this->calcAddr(src_addr + i * this->cfg.page_size);
-        ESP_LOGV(TAG, "%s - real_addr= 0x%08x, size= 0x%08x", __func__, (uint32_t) (this->cfg.start_addr + virt_addr), (uint32_t) size);
-        result = this->flash_drv->read(this->cfg.start_addr + virt_addr, &((uint8_t *)dest)[i * this->cfg.page_size], this->cfg.page_size);
+    size_t offset = 0;
+    while (offset < size) {
+        size_t virt_addr = this->calcAddr(src_addr + offset);
+        size_t chunk_size = this->calcContiguousSize(src_addr + offset, size - offset);
+        ESP_LOGV(TAG, "%s - real_addr= 0x%08x, size= 0x%08x", __func__, (uint32_t) (this->cfg.start_addr + virt_addr), (uint32_t) chunk_size);
+        result = this->flash_drv->read(this->cfg.start_addr + virt_addr, &((uint8_t *)dest)[offset], chunk_size);
         WL_RESULT_CHECK(result);
+        offset += chunk_size;
     }
-    size_t virt_addr_last = this->calcAddr(src_addr + count * this->cfg.page_size);
-    result = this->flash_drv->read(this->cfg.start_addr + virt_addr_last, &((uint8_t *)dest)[count * this->cfg.page_size], size - count * this->cfg.page_size);
-    WL_RESULT_CHECK(result);
     return result;
 }
 
@@ -625,8 +701,43 @@ wl_config_t *WL_Flash::get_cfg()
 esp_err_t WL_Flash::flush()
 {
     esp_err_t result = ESP_OK;
-    this->state.access_count = this->state.max_count - 1;
-    result = this->updateWL();
+    // Moves which are due are done first
+    while ((this->pending_moves > 0) || this->move_in_progress) {
+        result = this->moveBlock();
+        WL_RESULT_CHECK(result);
+    }
+    this->state.access_count = 0;
+    result = this->moveBlock();
     ESP_LOGD(TAG, "%s - result= 0x%08x, move_count= 0x%08x", __func__, result, this->state.move_count);
     return result;
 }
+
+esp_err_t WL_Flash::sync()
+{
+    // all data is written to flash immediately
+    return ESP_OK;
+}
+
+void WL_Flash::set_deferred_update(uint32_t max_pending)
+{
+    this->max_pending_moves = max_pending;
+}
+
+bool WL_Flash::update_pending()
+{
+    return (this->pending_moves > 0) || this->move_in_progress;
+}
+
+esp_err_t WL_Flash::process_update(bool *out_pending)
+{
+    esp_err_t result = ESP_OK;
+    if (!this->initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (this->update_pending()) {
+        bool done;
+        result = this->moveStep(&done);
+    }
+    *out_pending = this->update_pending();
+    return result;
+}
@@ -112,6 +112,21 @@ esp_err_t wl_write(wl_handle_t handle, size_t dest_addr, const void *src, size_t
 */
 esp_err_t wl_read(wl_handle_t handle, size_t src_addr, void *dest, size_t size);
 
+/**
+* @brief Write data buffered by the WL instance to flash
+*
+* With 512 byte sectors, erase and write operations may be held in RAM to merge
+* them with operations on other parts of the same flash sector.
+* This function writes all such data to flash.
+*
+* @param handle WL module instance that was initialized before
+*
+* @return
+*       - ESP_OK, if all data was written successfully;
+*       - or one of error codes from lower-level flash driver.
+*/
+esp_err_t wl_sync(wl_handle_t handle);
+
 /**
 * @brief Get size of the WL storage
 *
@@ -17,6 +17,8 @@
 
 typedef struct WL_Ext_Cfg_s : public WL_Config_s {
     uint32_t fat_sector_size;   /*!< virtual sector size*/
+    uint32_t cache_sectors;     /*!< amount of flash sectors kept in RAM to merge writes to their virtual sectors, 0 to disable*/
+    uint32_t cache_timeout;     /*!< time in ms after which a cached sector is written back to flash, 0 to wait for sync*/
 } wl_ext_cfg_t;
 
 #endif // _WL_Ext_Cfg_H_
\ No newline at end of file
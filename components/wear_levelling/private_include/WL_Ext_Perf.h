@@ -17,6 +17,8 @@
 #include "WL_Flash.h"
 #include "WL_Ext_Cfg.h"
 
+struct WL_Ext_Perf_Cache_Entry;
+
 class WL_Ext_Perf : public WL_Flash
 {
 public:
@@ -33,13 +35,34 @@ public:
     esp_err_t erase_sector(size_t sector) override;
     esp_err_t erase_range(size_t start_address, size_t size) override;
 
+    esp_err_t write(size_t dest_addr, const void *src, size_t size) override;
+    esp_err_t read(size_t src_addr, void *dest, size_t size) override;
+
+    esp_err_t flush() override;
+    esp_err_t sync() override;
+
 protected:
     uint32_t flash_sector_size;
     uint32_t fat_sector_size;
     uint32_t size_factor;
     uint32_t *sector_buffer;
 
+    // Write-back cache of flash sectors, erasing a part of a cached sector only modifies the RAM copy
+    WL_Ext_Perf_Cache_Entry *cache;
+    uint32_t cache_sectors;
+    uint32_t cache_timeout;
+    uint32_t cache_use_count;
+
     virtual esp_err_t erase_sector_fit(uint32_t start_sector, uint32_t count);
+    // Replace content of the flash sector with data
+    virtual esp_err_t write_back_sector(uint32_t sector, const uint32_t *data);
+
+    esp_err_t write_sub_sectors(uint32_t sector, const uint32_t *data);
+    esp_err_t erase_sub_sectors(uint32_t start_sector, uint32_t count);
+    WL_Ext_Perf_Cache_Entry *cache_find(uint32_t sector);
+    esp_err_t cache_load(uint32_t sector, WL_Ext_Perf_Cache_Entry **out_entry);
+    esp_err_t cache_write_back(WL_Ext_Perf_Cache_Entry *entry);
+    esp_err_t cache_write_back_expired();
 
 };
 
@@ -43,10 +43,19 @@ public :
     esp_err_t read(size_t src_addr, void *dest, size_t size) override;
 
     esp_err_t flush() override;
+    // Write data buffered in RAM to flash, without moving the dummy sector
+    virtual esp_err_t sync();
 
     Flash_Access *get_drv();
     wl_config_t *get_cfg();
 
+    // Let erase_sector() only count block moves which are due, up to max_pending of them,
+    // and leave the moves to process_update(). 0 moves blocks in erase_sector().
+    void set_deferred_update(uint32_t max_pending);
+    // Do one step of a block move which is due, out_pending tells if more steps are needed
+    esp_err_t process_update(bool *out_pending);
+    bool update_pending();
+
 protected:
     bool configured = false;
     bool initialized = false;
@@ -67,10 +76,21 @@ protected:
     size_t dummy_addr;
     uint32_t pos_data[4];
 
+    uint32_t max_pending_moves = 0;
+    uint32_t pending_moves = 0;
+    bool move_in_progress = false;
+    size_t move_src_addr = 0;
+    size_t move_offset = 0;
+
     esp_err_t initSections();
     esp_err_t updateWL();
+    esp_err_t moveBlock();
+    esp_err_t moveStep(bool *out_done);
+    void moveFailed();
+    void checkMoveSource(size_t flash_addr, size_t size);
     esp_err_t recoverPos();
     size_t calcAddr(size_t addr);
+    size_t calcContiguousSize(size_t addr, size_t size);
 
     esp_err_t updateVersion();
     esp_err_t updateV1_V2();
@@ -1,11 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <algorithm>
 
 #include "esp_spi_flash.h"
 #include "esp_partition.h"
 #include "wear_levelling.h"
 #include "WL_Flash.h"
+#include "WL_Ext_Perf.h"
+#include "WL_Ext_Safe.h"
+#include "Partition.h"
 #include "SpiFlash.h"
 
 #include "catch.hpp"
@@ -207,4 +212,499 @@ TEST_CASE("power down test", "[wear_levelling]")
     // Unmount
     result = wl_unmount(wl_handle);
     REQUIRE(result == ESP_OK);
-}
\ No newline at end of file
+}
+// Partition which counts the accesses of the wear levelling layer
+class CountingPartition : public Partition
+{
+public:
+    CountingPartition(const esp_partition_t *partition) : Partition(partition) {}
+
+    esp_err_t write(size_t dest_addr, const void *src, size_t size) override
+    {
+        write_count++;
+        write_bytes += size;
+        return Partition::write(dest_addr, src, size);
+    }
+
+    esp_err_t read(size_t src_addr, void *dest, size_t size) override
+    {
+        read_count++;
+        read_bytes += size;
+        return Partition::read(src_addr, dest, size);
+    }
+
+    // Partition::erase_sector() calls erase_range()
+    esp_err_t erase_range(size_t start_address, size_t size) override
+    {
+        erase_count += size / SPI_FLASH_SEC_SIZE;
+        return Partition::erase_range(start_address, size);
+    }
+
+    void reset_counters()
+    {
+        write_count = write_bytes = read_count = read_bytes = erase_count = 0;
+    }
+
+    size_t write_count = 0;
+    size_t write_bytes = 0;
+    size_t read_count = 0;
+    size_t read_bytes = 0;
+    size_t erase_count = 0;
+};
+
+TEST_CASE("contiguous ranges are accessed with one driver call", "[wear_levelling]")
+{
+    init_spi_flash(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+    CountingPartition part(partition);
+
+    // same configuration as used by wl_mount
+    wl_config_t cfg;
+    cfg.full_mem_size = partition->size;
+    cfg.start_addr = 0;
+    cfg.version = 2;
+    cfg.sector_size = SPI_FLASH_SEC_SIZE;
+    cfg.page_size = SPI_FLASH_SEC_SIZE;
+    cfg.updaterate = 16;
+    cfg.temp_buff_size = 32;
+    cfg.wr_size = 16;
+
+    WL_Flash wl_flash;
+    REQUIRE(wl_flash.config(&cfg, &part) == ESP_OK);
+    REQUIRE(wl_flash.init() == ESP_OK);
+
+    const size_t sector_size = wl_flash.sector_size();
+    const size_t sectors = wl_flash.chip_size() / sector_size;
+    const size_t cluster_size = 16 * sector_size;
+    uint32_t *data = new uint32_t[cluster_size / sizeof(uint32_t)];
+    uint32_t *read = new uint32_t[cluster_size / sizeof(uint32_t)];
+
+    // move the dummy sector to the middle of the partition
+    for (size_t i = 0; i < sectors / 2; i++) {
+        REQUIRE(wl_flash.flush() == ESP_OK);
+    }
+
+    size_t write_calls = 0;
+    size_t read_calls = 0;
+    size_t bytes = 0;
+    for (size_t addr = 0; addr + cluster_size <= sectors * sector_size; addr += cluster_size) {
+        for (size_t i = 0; i < cluster_size / sizeof(uint32_t); i++) {
+            data[i] = addr + i;
+        }
+        REQUIRE(wl_flash.erase_range(addr, cluster_size) == ESP_OK);
+        part.reset_counters();
+        REQUIRE(wl_flash.write(addr, data, cluster_size) == ESP_OK);
+        REQUIRE(wl_flash.read(addr, read, cluster_size) == ESP_OK);
+        // at most one break for the dummy sector and one for the wrap-around
+        CHECK(part.write_count <= 3);
+        CHECK(part.read_count <= 3);
+        CHECK(memcmp(data, read, cluster_size) == 0);
+        write_calls += part.write_count;
+        read_calls += part.read_count;
+        bytes += cluster_size;
+    }
+
+    // data read sector by sector is the same as read in one go
+    for (size_t addr = 0; addr + cluster_size <= sectors * sector_size; addr += cluster_size) {
+        for (size_t i = 0; i < cluster_size / sector_size; i++) {
+            REQUIRE(wl_flash.read(addr + i * sector_size, &read[i * sector_size / sizeof(uint32_t)], sector_size) == ESP_OK);
+        }
+        for (size_t i = 0; i < cluster_size / sizeof(uint32_t); i++) {
+            REQUIRE(read[i] == addr + i);
+        }
+    }
+
+    printf("%u KB clusters: %u write calls, %u read calls, %u bytes per call\n",
+           (unsigned) (cluster_size / 1024), (unsigned) write_calls, (unsigned) read_calls,
+           (unsigned) (2 * bytes / (write_calls + read_calls)));
+
+    delete[] data;
+    delete[] read;
+}
+
+// Same configuration as used by wl_mount with 512 byte sectors
+static void init_ext_cfg(wl_ext_cfg_t *cfg, const esp_partition_t *partition, uint32_t cache_sectors, uint32_t cache_timeout)
+{
+    cfg->full_mem_size = partition->size;
+    cfg->start_addr = 0;
+    cfg->version = 2;
+    cfg->sector_size = SPI_FLASH_SEC_SIZE;
+    cfg->page_size = SPI_FLASH_SEC_SIZE;
+    cfg->updaterate = 16;
+    cfg->temp_buff_size = 32;
+    cfg->wr_size = 16;
+    cfg->fat_sector_size = 512;
+    cfg->cache_sectors = cache_sectors;
+    cfg->cache_timeout = cache_timeout;
+}
+
+static WL_Ext_Perf *create_ext_flash(bool safe, const esp_partition_t *partition, Partition *part, uint32_t cache_sectors, uint32_t cache_timeout = 0)
+{
+    wl_ext_cfg_t cfg;
+    init_ext_cfg(&cfg, partition, cache_sectors, cache_timeout);
+    WL_Ext_Perf *wl_flash = safe ? new WL_Ext_Safe() : new WL_Ext_Perf();
+    REQUIRE(wl_flash->config(&cfg, part) == ESP_OK);
+    REQUIRE(wl_flash->init() == ESP_OK);
+    return wl_flash;
+}
+
+// Write virtual sectors one by one, as FatFs does, and return the number of flash erase cycles
+static uint32_t write_virtual_sectors(WL_Ext_Perf *wl_flash, size_t start, size_t count, uint32_t add_const)
+{
+    const size_t sector_size = wl_flash->sector_size();
+    uint32_t *data = new uint32_t[sector_size / sizeof(uint32_t)];
+    spiflash.reset_total_erase_cycles();
+    for (size_t i = start; i < start + count; i++) {
+        for (uint32_t m = 0; m < sector_size / sizeof(uint32_t); m++) {
+            data[m] = i * sector_size + add_const + m;
+        }
+        REQUIRE(wl_flash->erase_range(i * sector_size, sector_size) == ESP_OK);
+        REQUIRE(wl_flash->write(i * sector_size, data, sector_size) == ESP_OK);
+    }
+    REQUIRE(wl_flash->sync() == ESP_OK);
+    delete[] data;
+    return spiflash.get_total_erase_cycles();
+}
+
+static bool check_virtual_sectors(WL_Ext_Perf *wl_flash, size_t start, size_t count, uint32_t add_const)
+{
+    const size_t sector_size = wl_flash->sector_size();
+    uint32_t *data = new uint32_t[sector_size / sizeof(uint32_t)];
+    bool match = true;
+    for (size_t i = start; i < start + count; i++) {
+        REQUIRE(wl_flash->read(i * sector_size, data, sector_size) == ESP_OK);
+        for (uint32_t m = 0; m < sector_size / sizeof(uint32_t); m++) {
+            if (data[m] != i * sector_size + add_const + m) {
+                match = false;
+            }
+        }
+    }
+    delete[] data;
+    return match;
+}
+
+TEST_CASE("sector cache merges writes to virtual sectors of one flash sector", "[wear_levelling]")
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+    const size_t count = 16 * SPI_FLASH_SEC_SIZE / 512;
+
+    for (int safe = 0; safe < 2; safe++) {
+        uint32_t erases[2];
+        for (uint32_t cache_sectors = 0; cache_sectors < 2; cache_sectors++) {
+            init_spi_flash(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+            Partition part(partition);
+            WL_Ext_Perf *wl_flash = create_ext_flash(safe, partition, &part, cache_sectors);
+
+            write_virtual_sectors(wl_flash, 0, count, 0);
+            // sectors are not blank anymore, so every erase is counted
+            erases[cache_sectors] = write_virtual_sectors(wl_flash, 0, count, 0x1234);
+            CHECK(check_virtual_sectors(wl_flash, 0, count, 0x1234));
+            delete wl_flash;
+
+            // data is on flash after sync
+            wl_flash = create_ext_flash(safe, partition, &part, 0);
+            CHECK(check_virtual_sectors(wl_flash, 0, count, 0x1234));
+            delete wl_flash;
+        }
+        printf("%s mode, %u virtual sectors written: %u erases without cache, %u erases with cache\n",
+               safe ? "Safety" : "Performance", (unsigned) count, (unsigned) erases[0], (unsigned) erases[1]);
+        CHECK(erases[1] * 4 < erases[0]);
+    }
+}
+
+TEST_CASE("cached sector is written back after timeout", "[wear_levelling]")
+{
+    init_spi_flash(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+    Partition part(partition);
+
+    WL_Ext_Perf *wl_flash = create_ext_flash(false, partition, &part, 1, 10);
+    write_virtual_sectors(wl_flash, 0, 8, 0);
+
+    const size_t sector_size = wl_flash->sector_size();
+    uint32_t *data = new uint32_t[sector_size / sizeof(uint32_t)];
+    memset(data, 0x55, sector_size);
+    spiflash.reset_total_erase_cycles();
+    REQUIRE(wl_flash->erase_range(0, sector_size) == ESP_OK);
+    REQUIRE(wl_flash->write(0, data, sector_size) == ESP_OK);
+    CHECK(spiflash.get_total_erase_cycles() == 0);
+
+    usleep(20 * 1000);
+    REQUIRE(wl_flash->read(sector_size, data, sector_size) == ESP_OK);
+    CHECK(spiflash.get_total_erase_cycles() > 0);
+    delete wl_flash;
+
+    wl_flash = create_ext_flash(false, partition, &part, 0);
+    REQUIRE(wl_flash->read(0, data, sector_size) == ESP_OK);
+    for (uint32_t m = 0; m < sector_size / sizeof(uint32_t); m++) {
+        REQUIRE(data[m] == 0x55555555);
+    }
+    CHECK(check_virtual_sectors(wl_flash, 1, 7, 0));
+    delete wl_flash;
+    delete[] data;
+}
+
+TEST_CASE("power loss while writing back cached sector in safety mode", "[wear_levelling]")
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+    const size_t count = SPI_FLASH_SEC_SIZE / 512;
+
+    for (uint32_t erase_limit = 1; erase_limit <= 8; erase_limit++) {
+        init_spi_flash(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+        Partition part(partition);
+        WL_Ext_Perf *wl_flash = create_ext_flash(true, partition, &part, 1);
+        write_virtual_sectors(wl_flash, 0, count, 0);
+
+        // power is lost after erase_limit erase cycles
+        const size_t sector_size = wl_flash->sector_size();
+        uint32_t *data = new uint32_t[sector_size / sizeof(uint32_t)];
+        for (size_t i = 0; i < count; i++) {
+            for (uint32_t m = 0; m < sector_size / sizeof(uint32_t); m++) {
+                data[m] = i * sector_size + 0x1234 + m;
+            }
+            REQUIRE(wl_flash->erase_range(i * sector_size, sector_size) == ESP_OK);
+            REQUIRE(wl_flash->write(i * sector_size, data, sector_size) == ESP_OK);
+        }
+        delete[] data;
+        spiflash.reset_total_erase_cycles();
+        spiflash.set_total_erase_cycles_limit(erase_limit);
+        wl_flash->sync();
+        spiflash.set_total_erase_cycles_limit(0);
+        delete wl_flash;
+
+        // the flash sector holds either the old or the new data
+        wl_flash = create_ext_flash(true, partition, &part, 0);
+        bool old_data = check_virtual_sectors(wl_flash, 0, count, 0);
+        bool new_data = check_virtual_sectors(wl_flash, 0, count, 0x1234);
+        CHECK((old_data || new_data));
+        delete wl_flash;
+    }
+}
+
+// Rewrite every sector a few times and return the largest number of flash erases done by one sector write
+static size_t rewrite_sectors(WL_Flash *wl_flash, CountingPartition *part, int rounds, bool process_update)
+{
+    const size_t sector_size = wl_flash->sector_size();
+    const size_t sectors = wl_flash->chip_size() / sector_size;
+    uint32_t *data = new uint32_t[sector_size / sizeof(uint32_t)];
+    size_t max_erases = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < sectors; i++) {
+            for (uint32_t m = 0; m < sector_size / sizeof(uint32_t); m++) {
+                data[m] = i * sector_size + round + m;
+            }
+            part->reset_counters();
+            REQUIRE(wl_flash->erase_range(i * sector_size, sector_size) == ESP_OK);
+            REQUIRE(wl_flash->write(i * sector_size, data, sector_size) == ESP_OK);
+            max_erases = std::max(max_erases, part->erase_count);
+            // background steps at an uneven rate, so that writes hit blocks which are being moved
+            if (process_update && ((i + round) % 3 == 0)) {
+                bool pending;
+                REQUIRE(wl_flash->process_update(&pending) == ESP_OK);
+            }
+        }
+        for (size_t i = 0; i < sectors; i++) {
+            REQUIRE(wl_flash->read(i * sector_size, data, sector_size) == ESP_OK);
+            for (uint32_t m = 0; m < sector_size / sizeof(uint32_t); m++) {
+                REQUIRE(data[m] == i * sector_size + round + m);
+            }
+        }
+    }
+    delete[] data;
+    return max_erases;
+}
+
+TEST_CASE("deferred block moves keep data consistent", "[wear_levelling]")
+{
+    init_spi_flash(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+    CountingPartition part(partition);
+    wl_ext_cfg_t cfg;
+    init_ext_cfg(&cfg, partition, 0, 0);
+
+    WL_Flash *wl_flash = new WL_Flash();
+    REQUIRE(wl_flash->config(&cfg, &part) == ESP_OK);
+    REQUIRE(wl_flash->init() == ESP_OK);
+    size_t max_erases_inline = rewrite_sectors(wl_flash, &part, 2, false);
+
+    wl_flash->set_deferred_update(4);
+    size_t max_erases_deferred = rewrite_sectors(wl_flash, &part, 4, true);
+    printf("Largest number of erases per sector write: %u with moves in erase, %u with deferred moves\n",
+           (unsigned) max_erases_inline, (unsigned) max_erases_deferred);
+    CHECK(max_erases_inline > 1);
+    CHECK(max_erases_deferred == 1);
+
+    // without background steps the backlog is bounded, moves are done in erase then
+    size_t max_erases_backlog = rewrite_sectors(wl_flash, &part, 1, false);
+    CHECK(max_erases_backlog > 1);
+    CHECK(wl_flash->update_pending());
+
+    REQUIRE(wl_flash->flush() == ESP_OK);
+    CHECK_FALSE(wl_flash->update_pending());
+    delete wl_flash;
+
+    // data and state are consistent on flash
+    wl_flash = new WL_Flash();
+    REQUIRE(wl_flash->config(&cfg, &part) == ESP_OK);
+    REQUIRE(wl_flash->init() == ESP_OK);
+    const size_t sector_size = wl_flash->sector_size();
+    uint32_t *data = new uint32_t[sector_size / sizeof(uint32_t)];
+    for (size_t i = 0; i < wl_flash->chip_size() / sector_size; i++) {
+        REQUIRE(wl_flash->read(i * sector_size, data, sector_size) == ESP_OK);
+        for (uint32_t m = 0; m < sector_size / sizeof(uint32_t); m++) {
+            REQUIRE(data[m] == i * sector_size + m);
+        }
+    }
+    delete[] data;
+    delete wl_flash;
+}
+
+TEST_CASE("partition read cache serves repeated small reads", "[wear_levelling]")
+{
+    init_spi_flash(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+    const size_t sector_size = CONFIG_WL_SECTOR_SIZE;
+    const size_t chunk_size = 64;
+    const size_t sectors = 3;
+    uint32_t *data = new uint32_t[sector_size / sizeof(uint32_t)];
+    uint32_t chunk[chunk_size / sizeof(uint32_t)];
+    uint32_t read_ops[2];
+
+    for (int cached = 0; cached < 2; cached++) {
+        REQUIRE(esp_partition_read_cache_config(cached ? 4 : 0) == ESP_OK);
+        esp_partition_read_cache_reset_stats();
+        wl_handle_t handle;
+        REQUIRE(wl_mount(partition, &handle) == ESP_OK);
+        spiflash.reset_read_counters();
+        for (uint32_t round = 0; round < 8; round++) {
+            // rewritten sectors must not be read from the cache
+            for (size_t s = 0; s < sectors; s++) {
+                for (uint32_t m = 0; m < sector_size / sizeof(uint32_t); m++) {
+                    data[m] = (round << 24) + s * sector_size + m;
+                }
+                REQUIRE(wl_erase_range(handle, s * sector_size, sector_size) == ESP_OK);
+                REQUIRE(wl_write(handle, s * sector_size, data, sector_size) == ESP_OK);
+            }
+            for (size_t s = 0; s < sectors; s++) {
+                for (size_t offset = 0; offset < sector_size; offset += chunk_size) {
+                    REQUIRE(wl_read(handle, s * sector_size + offset, chunk, chunk_size) == ESP_OK);
+                    for (uint32_t m = 0; m < chunk_size / sizeof(uint32_t); m++) {
+                        REQUIRE(chunk[m] == (round << 24) + s * sector_size + offset / sizeof(uint32_t) + m);
+                    }
+                }
+            }
+        }
+        read_ops[cached] = spiflash.get_read_ops();
+        REQUIRE(wl_unmount(handle) == ESP_OK);
+    }
+    esp_partition_read_cache_stats_t stats;
+    esp_partition_read_cache_get_stats(&stats);
+    REQUIRE(esp_partition_read_cache_config(0) == ESP_OK);
+    delete[] data;
+
+    printf("Small reads: %u flash reads without cache, %u with cache (%u hits, %u misses, %u invalidations)\n",
+           (unsigned) read_ops[0], (unsigned) read_ops[1],
+           (unsigned) stats.hits, (unsigned) stats.misses, (unsigned) stats.invalidations);
+    CHECK(stats.invalidations > 0);
+    CHECK(read_ops[1] * 4 < read_ops[0]);
+}
+
+static void fill_sector_data(uint32_t *data, size_t sector_size, int32_t sector, uint32_t generation)
+{
+    for (uint32_t m = 0; m < sector_size / sizeof(uint32_t); m++) {
+        data[m] = (generation << 24) + sector * sector_size + m;
+    }
+}
+
+TEST_CASE("power loss at any flash write or erase keeps other sectors intact", "[wear_levelling]")
+{
+    init_spi_flash(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+    wl_handle_t handle;
+    REQUIRE(wl_mount(partition, &handle) == ESP_OK);
+
+    size_t sector_size = wl_sector_size(handle);
+    const int32_t sectors_count = 16;
+    uint32_t *data = new uint32_t[sector_size / sizeof(uint32_t)];
+    uint32_t generation[sectors_count] = {0};
+    for (int32_t i = 0; i < sectors_count; i++) {
+        fill_sector_data(data, sector_size, i, 0);
+        REQUIRE(wl_erase_range(handle, i * sector_size, sector_size) == ESP_OK);
+        REQUIRE(wl_write(handle, i * sector_size, data, sector_size) == ESP_OK);
+    }
+
+    // fail at every write or erase of the first rewritten sectors, including the wear levelling state updates
+    for (uint32_t fail_after = 0; fail_after < 48; fail_after++) {
+        spiflash.set_fail_after(fail_after, SPIFLASH_OP_WRITE | SPIFLASH_OP_ERASE);
+        int32_t err_sector = -1;
+        for (int32_t i = 0; i < sectors_count && err_sector < 0; i++) {
+            fill_sector_data(data, sector_size, i, generation[i] + 1);
+            if (wl_erase_range(handle, i * sector_size, sector_size) != ESP_OK ||
+                    wl_write(handle, i * sector_size, data, sector_size) != ESP_OK) {
+                err_sector = i;
+            } else {
+                generation[i]++;
+            }
+        }
+        spiflash.clear_fail();
+        REQUIRE(err_sector >= 0);
+
+        REQUIRE(wl_unmount(handle) == ESP_OK);
+        REQUIRE(wl_mount(partition, &handle) == ESP_OK);
+        for (int32_t i = 0; i < sectors_count; i++) {
+            if (i == err_sector) {
+                continue;
+            }
+            REQUIRE(wl_read(handle, i * sector_size, data, sector_size) == ESP_OK);
+            for (uint32_t m = 0; m < sector_size / sizeof(uint32_t); m++) {
+                REQUIRE(data[m] == (generation[i] << 24) + i * sector_size + m);
+            }
+        }
+
+        // the interrupted sector holds either version, write it again
+        fill_sector_data(data, sector_size, err_sector, generation[err_sector]);
+        REQUIRE(wl_erase_range(handle, err_sector * sector_size, sector_size) == ESP_OK);
+        REQUIRE(wl_write(handle, err_sector * sector_size, data, sector_size) == ESP_OK);
+    }
+
+    delete[] data;
+    REQUIRE(wl_unmount(handle) == ESP_OK);
+}
+
+TEST_CASE("flash timing model accounts the time of wear levelling operations", "[wear_levelling]")
+{
+    init_spi_flash(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+    wl_handle_t handle;
+    REQUIRE(wl_mount(partition, &handle) == ESP_OK);
+    size_t sector_size = wl_sector_size(handle);
+    uint32_t *data = new uint32_t[sector_size / sizeof(uint32_t)];
+    fill_sector_data(data, sector_size, 0, 1);
+
+    // without a timing model, operations take no time
+    REQUIRE(wl_erase_range(handle, 0, sector_size) == ESP_OK);
+    REQUIRE(wl_write(handle, 0, data, sector_size) == ESP_OK);
+    CHECK(spiflash.get_total_time_us() == 0);
+
+    spiflash.set_timing(FLASH_TIMING_W25Q32);
+    REQUIRE(wl_erase_range(handle, 0, sector_size) == ESP_OK);
+    uint64_t erase_us = spiflash.get_total_time_us();
+    spiflash.reset_total_time();
+    REQUIRE(wl_write(handle, 0, data, sector_size) == ESP_OK);
+    uint64_t write_us = spiflash.get_total_time_us();
+    spiflash.reset_total_time();
+    REQUIRE(wl_read(handle, 0, data, sector_size) == ESP_OK);
+    uint64_t read_us = spiflash.get_total_time_us();
+    printf("W25Q32 timing: erase %u us, write %u us, read %u us of one %u byte sector\n",
+           (unsigned) erase_us, (unsigned) write_us, (unsigned) read_us, (unsigned) sector_size);
+
+    const flash_timing_t &timing = FLASH_TIMING_W25Q32;
+    CHECK(erase_us >= timing.sector_erase_us);
+    CHECK(write_us >= flash_timing_program_ns(&timing, 0, sector_size) / 1000);
+    CHECK(read_us >= flash_timing_read_ns(&timing, sector_size) / 1000);
+    CHECK(read_us < write_us);
+
+    delete[] data;
+    REQUIRE(wl_unmount(handle) == ESP_OK);
+}
@@ -23,6 +23,10 @@
 #include "WL_Ext_Safe.h"
 #include "SPI_Flash.h"
 #include "Partition.h"
+#if CONFIG_WL_DEFERRED_UPDATE
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#endif // CONFIG_WL_DEFERRED_UPDATE
 
 #ifndef MAX_WL_HANDLES
 #define MAX_WL_HANDLES 8
@@ -44,6 +48,14 @@
 #define WL_DEFAULT_START_ADDR   0
 #endif //WL_DEFAULT_START_ADDR
 
+#ifndef CONFIG_WL_SECTOR_CACHE_SIZE
+#define CONFIG_WL_SECTOR_CACHE_SIZE 0
+#endif // CONFIG_WL_SECTOR_CACHE_SIZE
+
+#ifndef CONFIG_WL_SECTOR_CACHE_TIMEOUT
+#define CONFIG_WL_SECTOR_CACHE_TIMEOUT 0
+#endif // CONFIG_WL_SECTOR_CACHE_TIMEOUT
+
 #ifndef WL_CURRENT_VERSION
 #define WL_CURRENT_VERSION  2
 #endif //WL_CURRENT_VERSION
@@ -58,6 +70,48 @@ static _lock_t s_instances_lock;
 static const char *TAG = "wear_levelling";
 
 static esp_err_t check_handle(wl_handle_t handle, const char *func);
+static void notify_update_task(wl_handle_t handle);
+
+#if CONFIG_WL_DEFERRED_UPDATE
+#ifndef WL_UPDATE_TASK_STACK_SIZE
+#define WL_UPDATE_TASK_STACK_SIZE   2048
+#endif // WL_UPDATE_TASK_STACK_SIZE
+
+#ifndef WL_UPDATE_RETRY_MS
+#define WL_UPDATE_RETRY_MS  1000
+#endif // WL_UPDATE_RETRY_MS
+
+static TaskHandle_t s_update_task;
+
+// Moves wear levelling blocks of all instances in the background, one step at a time,
+// so that other accesses wait for at most one step
+static void wl_update_task(void *arg)
+{
+    while (true) {
+        bool pending = false;
+        bool failed = false;
+        for (size_t i = 0; i < MAX_WL_HANDLES; i++) {
+            _lock_acquire(&s_instances_lock);
+            if (s_instances[i].instance != NULL) {
+                bool instance_pending = false;
+                _lock_acquire(&s_instances[i].lock);
+                esp_err_t result = s_instances[i].instance->process_update(&instance_pending);
+                _lock_release(&s_instances[i].lock);
+                if (result != ESP_OK) {
+                    ESP_LOGW(TAG, "%s: instance[0x%08x] update failed, result=0x%x", __func__, i, result);
+                    failed = true;
+                } else {
+                    pending |= instance_pending;
+                }
+            }
+            _lock_release(&s_instances_lock);
+        }
+        if (!pending) {
+            ulTaskNotifyTake(pdTRUE, failed ? pdMS_TO_TICKS(WL_UPDATE_RETRY_MS) : portMAX_DELAY);
+        }
+    }
+}
+#endif // CONFIG_WL_DEFERRED_UPDATE
 
 esp_err_t wl_mount(const esp_partition_t *partition, wl_handle_t *out_handle)
 {
@@ -88,6 +142,8 @@ esp_err_t wl_mount(const esp_partition_t *partition, wl_handle_t *out_handle)
     cfg.wr_size = WL_DEFAULT_WRITE_SIZE;
     // FAT sector size by default will be 512
     cfg.fat_sector_size = CONFIG_WL_SECTOR_SIZE;
+    cfg.cache_sectors = CONFIG_WL_SECTOR_CACHE_SIZE;
+    cfg.cache_timeout = CONFIG_WL_SECTOR_CACHE_TIMEOUT;
 
     if (*out_handle == WL_INVALID_HANDLE) {
         ESP_LOGE(TAG, "MAX_WL_HANDLES=%d instances already allocated", MAX_WL_HANDLES);
@@ -149,6 +205,16 @@ esp_err_t wl_mount(const esp_partition_t *partition, wl_handle_t *out_handle)
         ESP_LOGE(TAG, "%s: init instance=0x%08x, result=0x%x", __func__, *out_handle, result);
         goto out;
     }
+#if CONFIG_WL_DEFERRED_UPDATE
+    if (s_update_task == NULL) {
+        if (xTaskCreate(wl_update_task, "wl_update", WL_UPDATE_TASK_STACK_SIZE, NULL, CONFIG_WL_DEFERRED_UPDATE_TASK_PRIORITY, &s_update_task) != pdPASS) {
+            result = ESP_ERR_NO_MEM;
+            ESP_LOGE(TAG, "%s: can't create update task", __func__);
+            goto out;
+        }
+    }
+    wl_flash->set_deferred_update(CONFIG_WL_DEFERRED_UPDATE_BACKLOG);
+#endif // CONFIG_WL_DEFERRED_UPDATE
     s_instances[*out_handle].instance = wl_flash;
     _lock_init(&s_instances[*out_handle].lock);
     _lock_release(&s_instances_lock);
@@ -197,6 +263,7 @@ esp_err_t wl_erase_range(wl_handle_t handle, size_t start_addr, size_t size)
     }
     _lock_acquire(&s_instances[handle].lock);
     result = s_instances[handle].instance->erase_range(start_addr, size);
+    notify_update_task(handle);
     _lock_release(&s_instances[handle].lock);
     return result;
 }
@@ -209,6 +276,7 @@ esp_err_t wl_write(wl_handle_t handle, size_t dest_addr, const void *src, size_t
     }
     _lock_acquire(&s_instances[handle].lock);
     result = s_instances[handle].instance->write(dest_addr, src, size);
+    notify_update_task(handle);
     _lock_release(&s_instances[handle].lock);
     return result;
 }
@@ -221,6 +289,20 @@ esp_err_t wl_read(wl_handle_t handle, size_t src_addr, void *dest, size_t size)
     }
     _lock_acquire(&s_instances[handle].lock);
     result = s_instances[handle].instance->read(src_addr, dest, size);
+    notify_update_task(handle);
+    _lock_release(&s_instances[handle].lock);
+    return result;
+}
+
+esp_err_t wl_sync(wl_handle_t handle)
+{
+    esp_err_t result = check_handle(handle, __func__);
+    if (result != ESP_OK) {
+        return result;
+    }
+    _lock_acquire(&s_instances[handle].lock);
+    result = s_instances[handle].instance->sync();
+    notify_update_task(handle);
     _lock_release(&s_instances[handle].lock);
     return result;
 }
@@ -249,6 +331,16 @@ size_t wl_sector_size(wl_handle_t handle)
     return result;
 }
 
+// Accesses may have made block moves due, which are left to the background task
+static void notify_update_task(wl_handle_t handle)
+{
+#if CONFIG_WL_DEFERRED_UPDATE
+    if (s_instances[handle].instance->update_pending()) {
+        xTaskNotifyGive(s_update_task);
+    }
+#endif // CONFIG_WL_DEFERRED_UPDATE
+}
+
 static esp_err_t check_handle(wl_handle_t handle, const char *func)
 {
     if (handle == WL_INVALID_HANDLE) {